@@ -0,0 +1,150 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#define TEST_HARNESS_IMPLEMENTATION
+#include "AudioTest.h"
+
+
+float TestRandFloat(void)
+{
+    return (float)((double)TestRand() / 2147483648.0 - 1.0);
+}
+
+double SignalToNoiseDB(const float *reference, const float *test, size_t count, size_t stride)
+{
+    double signal = 0.0, noise = 0.0;
+    size_t i;
+
+    for(i=0; i<count; i++)
+    {
+        double ref = reference[i*stride];
+        double diff = ref - (double)test[i*stride];
+        signal += ref*ref;
+        noise += diff*diff;
+    }
+
+    if(noise <= signal*1e-20)
+        return 200.0;
+
+    return 10.0*log10(signal/noise);
+}
+
+void MakeTestSignal(float *out, size_t frames, int channels, const double *freqs, int numFreqs, double amplitude, double noise)
+{
+    size_t i;
+    int ch, f;
+
+    for(i=0; i<frames; i++)
+    {
+        for(ch=0; ch<channels; ch++)
+        {
+            double val = 0.0;
+
+            //each channel gets its own phases so stereo paths can't hide channel mixups
+            for(f=0; f<numFreqs; f++)
+                val += sin(2.0*M_PI*freqs[f]*(double)i + (double)(ch*(f+1)));
+
+            val *= amplitude/(double)numFreqs;
+            if(noise > 0.0)
+                val += noise*TestRandFloat();
+
+            out[i*channels+ch] = (float)val;
+        }
+    }
+}
+
+static unsigned int ReadLE(const unsigned char *data, int size)
+{
+    unsigned int val = 0;
+    while(size--)
+        val = (val<<8) | data[size];
+    return val;
+}
+
+float* LoadWaveFile(const char *path, size_t *frames, int *channels, int *sampleRate)
+{
+    FILE *file;
+    unsigned char header[12], chunk[8], fmt[16];
+    float *samples = NULL;
+    int bits = 0;
+
+    *frames = 0;
+    *channels = *sampleRate = 0;
+
+    file = fopen(path, "rb");
+    if(!file)
+        return NULL;
+
+    if(fread(header, 1, 12, file) != 12 || memcmp(header, "RIFF", 4) != 0 || memcmp(header+8, "WAVE", 4) != 0)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    while(fread(chunk, 1, 8, file) == 8)
+    {
+        unsigned int size = ReadLE(chunk+4, 4);
+
+        if(memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+        {
+            if(fread(fmt, 1, 16, file) != 16)
+                break;
+
+            *channels = (int)ReadLE(fmt+2, 2);
+            *sampleRate = (int)ReadLE(fmt+4, 4);
+            bits = (int)ReadLE(fmt+14, 2);
+            fseek(file, (long)(size-16 + (size&1)), SEEK_CUR);
+        }
+        else if(memcmp(chunk, "data", 4) == 0 && bits == 16 && *channels > 0)
+        {
+            size_t count = size/2, i;
+            short *pcm = (short*)malloc(size);
+
+            count = fread(pcm, 2, count, file);
+            samples = (float*)malloc(count*sizeof(float));
+            for(i=0; i<count; i++)
+                samples[i] = (float)pcm[i] / 32768.0f;
+
+            free(pcm);
+            *frames = count / *channels;
+            break;
+        }
+        else
+            fseek(file, (long)(size + (size&1)), SEEK_CUR);
+    }
+
+    fclose(file);
+    return samples;
+}
+
+//-------------------------------------------------------------------
+
+static const TestSuite suites[] =
+{
+    {"resampler", RunResamplerTest},
+    {"faac",      RunFaacTest},
+    {"quantizer", RunQuantizerTest},
+};
+
+//usage: AudioTest [suite [suite options]]
+//with no suite every suite runs with its defaults.  exits with the number of failed checks
+int main(int argc, char **argv)
+{
+    return RunTestSuites(suites, sizeof(suites)/sizeof(suites[0]), argc, argv);
+}
@@ -0,0 +1,61 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//regression checks and benchmarks for the audio libraries (libsamplerate, libfaac).  each suite
+//prints what it measured and counts a failure for every check that falls outside its limits
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#include "TestHarness.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//TestRand scaled to [-1, 1)
+float TestRandFloat(void);
+
+//signal power ratio of reference to (reference-test), in dB.  identical signals give 200
+double SignalToNoiseDB(const float *reference, const float *test, size_t count, size_t stride);
+
+//a few sines plus low level noise, interleaved.  frequencies are given as fractions of the sample rate
+void MakeTestSignal(float *out, size_t frames, int channels, const double *freqs, int numFreqs, double amplitude, double noise);
+
+//reads 16 bit pcm wave files, returns interleaved floats in [-1, 1]
+float* LoadWaveFile(const char *path, size_t *frames, int *channels, int *sampleRate);
+
+//libsamplerate's mono and stereo sinc converter before the SSE kernels (ResamplerScalar.c), same arguments as src_new
+struct SRC_STATE_tag* ScalarSincNew(int converter_type, int channels, int *error);
+
+int RunResamplerTest(int argc, char **argv);
+int RunFaacTest(int argc, char **argv);
+int RunQuantizerTest(int argc, char **argv);
+
+#ifdef __cplusplus
+}
+#endif
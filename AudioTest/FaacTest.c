@@ -0,0 +1,523 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "AudioTest.h"
+
+//libfaac internals: the encoder handle, the requantized spectrum and the inverse filterbank.
+//this has to be built with the same FAAC_PRECISION_DOUBLE setting as the libfaac it links
+#include "frame.h"
+#include "filtbank.h"
+
+//quality regression and encode time benchmark for libfaac.
+//
+//there's no AAC decoder in the tree, but the encoder already keeps exactly what a decoder would
+//reconstruct: after faacEncEncode, coderInfo.requantFreq holds the dequantized (and M/S
+//reconstructed) spectrum of the frame it just wrote.  with long windows only and without TNS,
+//running that through the encoder's own inverse filterbank gives the decoded audio, which is then
+//compared against the input for SNR, PSNR and segmental SNR.
+//
+//the encode time pass uses the settings AACEncoder uses (short windows allowed).
+
+typedef struct
+{
+    char name[64];
+    float *samples;
+    size_t frames;
+    int channels, sampleRate;
+} TestClip;
+
+typedef struct
+{
+    double snr, psnr, segSNR;
+    double kbps;
+    int delay;
+} QualityStats;
+
+//measured with the FAAC_PRECISION_DOUBLE (pre float) encoder on the synthetic clips at the default
+//length, only checked when the clips are that long
+typedef struct
+{
+    const char *clip;
+    int sampleRate, bitRate;
+    double snr, segSNR;
+} QualityFloor;
+
+static const QualityFloor qualityFloors[] =
+{
+    {"tones",         44100, 128, 25.56, 25.81},
+    {"tones",         44100, 192, 25.59, 25.85},
+    {"tones",         48000, 128, 24.68, 24.96},
+    {"tones",         48000, 192, 25.58, 25.82},
+    {"tones+noise",   44100, 128, 16.17, 16.18},
+    {"tones+noise",   44100, 192, 17.81, 17.82},
+    {"tones+noise",   48000, 128, 15.52, 15.53},
+    {"tones+noise",   48000, 192, 17.11, 17.13},
+    {"bursts",        44100, 128, 23.97, 24.43},
+    {"bursts",        44100, 192, 23.97, 24.44},
+    {"bursts",        48000, 128, 23.95, 24.35},
+    {"bursts",        48000, 192, 23.95, 24.37},
+};
+
+#define DEFAULT_SECONDS     10.0
+
+//float rounding moves individual quantizer decisions, which is worth a few tenths of a dB either way
+#define MAX_SNR_LOSS        0.5
+
+//average bitrate mode only caps the rate, signals that need fewer bits come in under the target
+#define MAX_BITRATE_OVERSHOOT   0.05
+
+//segments quieter than this are left out of segmental SNR, and each segment is clamped to the usual range
+#define SEGMENT_SILENCE     1e-8
+#define SEGMENT_MIN_SNR     -10.0
+#define SEGMENT_MAX_SNR     35.0
+
+static faacEncHandle OpenEncoder(const TestClip *clip, int bitRate, int bQualityPass, unsigned long *inputSamples, unsigned long *maxOutputBytes)
+{
+    faacEncHandle faac = faacEncOpen(clip->sampleRate, clip->channels, inputSamples, maxOutputBytes);
+    faacEncConfigurationPtr config;
+
+    if(!faac)
+        return NULL;
+
+    //same as AACEncoder
+    config = faacEncGetCurrentConfiguration(faac);
+    config->bitRate = (bitRate*1000)/clip->channels;
+    config->quantqual = 100;
+    config->inputFormat = FAAC_INPUT_FLOAT_NORM;
+    config->mpegVersion = MPEG4;
+    config->aacObjectType = LOW;
+    config->useLfe = 0;
+    config->outputFormat = 0;
+
+    //the encoder doesn't keep a reconstruction of short blocks or of TNS filtered spectra
+    if(bQualityPass)
+    {
+        config->shortctl = SHORTCTL_NOSHORT;
+        config->useTns = 0;
+    }
+
+    if(!faacEncSetConfiguration(faac, config))
+    {
+        faacEncClose(faac);
+        return NULL;
+    }
+
+    return faac;
+}
+
+//what a decoder does with the frame: bands coded with the zero codebook and everything past
+//max_sfb come out as silence, the rest is the dequantized spectrum
+static void DecodeFrame(faacEncHandle faac, int channel, faac_real *spectrum, faac_real *overlap, faac_real *out)
+{
+    CoderInfo *coderInfo = &faac->coderInfo[channel];
+    int sb, i;
+
+    memcpy(spectrum, coderInfo->requantFreq, BLOCK_LEN_LONG*sizeof(faac_real));
+
+    for(sb=0; sb<coderInfo->max_sfb; sb++)
+    {
+        if(coderInfo->book_vector[sb] == 0)
+        {
+            for(i=coderInfo->sfb_offset[sb]; i<coderInfo->sfb_offset[sb+1]; i++)
+                spectrum[i] = 0;
+        }
+    }
+
+    for(i=coderInfo->sfb_offset[coderInfo->max_sfb]; i<BLOCK_LEN_LONG; i++)
+        spectrum[i] = 0;
+
+    IFilterBank(faac, coderInfo, spectrum, out, overlap, MOVERLAPPED);
+}
+
+static void MeasureQuality(const TestClip *clip, const float *decoded, size_t decodedFrames, QualityStats *stats)
+{
+    size_t start = clip->sampleRate/10;     //skip the encoder's startup
+    size_t segment = FRAME_LEN;
+    double bestSNR = -1000.0;
+    double signal = 0.0, noise = 0.0, segSum = 0.0;
+    int numSegments = 0;
+    int k, ch;
+    size_t i, end;
+
+    //the decoded audio lags by a whole number of frames (look-ahead plus the filterbank overlap)
+    stats->delay = 0;
+    for(k=0; k<=4; k++)
+    {
+        size_t delay = k*FRAME_LEN;
+        size_t count = clip->sampleRate;
+        double snr;
+
+        if(start+delay+count > decodedFrames || start+count > clip->frames)
+            break;
+
+        snr = SignalToNoiseDB(clip->samples+start*clip->channels, decoded+(start+delay)*clip->channels, count, clip->channels);
+        if(snr > bestSNR)
+        {
+            bestSNR = snr;
+            stats->delay = (int)delay;
+        }
+    }
+
+    end = clip->frames;
+    if(end+stats->delay > decodedFrames)
+        end = decodedFrames-stats->delay;
+
+    for(i=start; i+segment <= end; i += segment)
+    {
+        for(ch=0; ch<clip->channels; ch++)
+        {
+            double segSignal = 0.0, segNoise = 0.0;
+            size_t j;
+
+            for(j=i; j<i+segment; j++)
+            {
+                double ref = clip->samples[j*clip->channels+ch];
+                double diff = ref - decoded[(j+stats->delay)*clip->channels+ch];
+                segSignal += ref*ref;
+                segNoise += diff*diff;
+            }
+
+            signal += segSignal;
+            noise += segNoise;
+
+            if(segSignal > SEGMENT_SILENCE*segment)
+            {
+                double snr = (segNoise > 0.0) ? 10.0*log10(segSignal/segNoise) : SEGMENT_MAX_SNR;
+                if(snr < SEGMENT_MIN_SNR) snr = SEGMENT_MIN_SNR;
+                if(snr > SEGMENT_MAX_SNR) snr = SEGMENT_MAX_SNR;
+                segSum += snr;
+                numSegments++;
+            }
+        }
+    }
+
+    if(noise <= 0.0)
+        noise = 1e-30;
+
+    stats->snr = 10.0*log10(signal/noise);
+    stats->psnr = 10.0*log10((double)(end-start)*clip->channels/noise);
+    stats->segSNR = numSegments ? segSum/numSegments : 0.0;
+}
+
+//pads the clip with a few frames of silence so the encoder's look-ahead gets flushed
+static float* PadClip(const TestClip *clip, unsigned long inputSamples, size_t *numCalls)
+{
+    size_t frameSamples = inputSamples/clip->channels;
+    size_t calls = (clip->frames+frameSamples-1)/frameSamples + 4;
+    float *padded = (float*)calloc(calls*inputSamples, sizeof(float));
+
+    memcpy(padded, clip->samples, clip->frames*clip->channels*sizeof(float));
+    *numCalls = calls;
+    return padded;
+}
+
+static int EncodeForQuality(const TestClip *clip, int bitRate, QualityStats *stats)
+{
+    unsigned long inputSamples, maxOutputBytes;
+    faacEncHandle faac = OpenEncoder(clip, bitRate, 1, &inputSamples, &maxOutputBytes);
+    faac_real spectrum[BLOCK_LEN_LONG], out[BLOCK_LEN_LONG];
+    faac_real *overlap;
+    unsigned char *output;
+    float *padded, *decoded;
+    size_t numCalls, call, totalBytes = 0;
+    int ch;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if(!faac)
+        return 0;
+
+    padded = PadClip(clip, inputSamples, &numCalls);
+    decoded = (float*)calloc(numCalls*inputSamples, sizeof(float));
+    overlap = (faac_real*)calloc(clip->channels*BLOCK_LEN_LONG, sizeof(faac_real));
+    output = (unsigned char*)malloc(maxOutputBytes);
+
+    for(call=0; call<numCalls; call++)
+    {
+        int bytes = faacEncEncode(faac, (int32_t*)(padded+call*inputSamples), inputSamples, output, maxOutputBytes);
+        if(bytes < 0)
+            break;
+
+        totalBytes += bytes;
+
+        for(ch=0; ch<clip->channels; ch++)
+        {
+            float *dest = decoded + call*inputSamples + ch;
+            int i;
+
+            DecodeFrame(faac, ch, spectrum, overlap+ch*BLOCK_LEN_LONG, out);
+
+            //the filterbank works at 16 bit levels, and the encoder's MDCT/IMDCT pair isn't
+            //normalized: a round trip through it scales by 2/BLOCK_LEN_LONG
+            for(i=0; i<BLOCK_LEN_LONG; i++)
+                dest[i*clip->channels] = (float)(out[i]*(BLOCK_LEN_LONG/2)/32768.0);
+        }
+    }
+
+    faacEncClose(faac);
+
+    MeasureQuality(clip, decoded, numCalls*inputSamples/clip->channels, stats);
+    stats->kbps = (double)totalBytes*8.0 / ((double)clip->frames/clip->sampleRate) / 1000.0;
+
+    free(output);
+    free(overlap);
+    free(decoded);
+    free(padded);
+    return 1;
+}
+
+//milliseconds of encoding per second of audio
+static double EncodeForTime(const TestClip *clip, int bitRate)
+{
+    unsigned long inputSamples, maxOutputBytes;
+    faacEncHandle faac = OpenEncoder(clip, bitRate, 0, &inputSamples, &maxOutputBytes);
+    unsigned char *output;
+    float *padded;
+    size_t numCalls, call;
+    double startTime, seconds;
+
+    if(!faac)
+        return 0.0;
+
+    padded = PadClip(clip, inputSamples, &numCalls);
+    output = (unsigned char*)malloc(maxOutputBytes);
+
+    startTime = GetTestTime();
+    for(call=0; call<numCalls; call++)
+        faacEncEncode(faac, (int32_t*)(padded+call*inputSamples), inputSamples, output, maxOutputBytes);
+    seconds = GetTestTime()-startTime;
+
+    faacEncClose(faac);
+
+    free(output);
+    free(padded);
+
+    return seconds*1000.0 / ((double)numCalls*inputSamples/clip->channels/clip->sampleRate);
+}
+
+//-------------------------------------------------------------------
+
+static void MakeClip(TestClip *clip, const char *name, int sampleRate, double seconds)
+{
+    static const double toneHz[] = {440.0, 1000.0, 3100.0, 7000.0};
+    double freqs[4];
+    size_t i;
+    int f;
+
+    strcpy(clip->name, name);
+    clip->sampleRate = sampleRate;
+    clip->channels = 2;
+    clip->frames = (size_t)(seconds*sampleRate);
+    clip->samples = (float*)malloc(clip->frames*clip->channels*sizeof(float));
+
+    for(f=0; f<4; f++)
+        freqs[f] = toneHz[f]/sampleRate;
+
+    SeedTestRand(1234);
+
+    if(strcmp(name, "tones") == 0)
+        MakeTestSignal(clip->samples, clip->frames, clip->channels, freqs, 4, 0.5, 0.0);
+    else if(strcmp(name, "tones+noise") == 0)
+        MakeTestSignal(clip->samples, clip->frames, clip->channels, freqs, 4, 0.4, 0.05);
+    else if(strcmp(name, "bursts") == 0)
+    {
+        //quarter second tone bursts with a sharp attack and an exponential decay
+        size_t burst = sampleRate/4;
+
+        MakeTestSignal(clip->samples, clip->frames, clip->channels, freqs, 4, 0.7, 0.0);
+        for(i=0; i<clip->frames; i++)
+        {
+            double gain = ((i/burst) & 1) ? 0.0 : exp(-8.0*(double)(i%burst)/burst);
+            clip->samples[i*2]   *= (float)gain;
+            clip->samples[i*2+1] *= (float)gain;
+        }
+    }
+}
+
+static const QualityFloor* FindFloor(const TestClip *clip, int bitRate)
+{
+    int i;
+
+    for(i=0; i<sizeof(qualityFloors)/sizeof(qualityFloors[0]); i++)
+    {
+        const QualityFloor *floor = qualityFloors+i;
+        if(strcmp(floor->clip, clip->name) == 0 && floor->sampleRate == clip->sampleRate && floor->bitRate == bitRate)
+            return floor;
+    }
+
+    return NULL;
+}
+
+//baseline files hold one "name rate bitrate snr segsnr" line per result, so one build (say
+//FAAC_PRECISION_DOUBLE) can write them and another build can be compared against it
+static int FindBaseline(FILE *baseline, const TestClip *clip, int bitRate, double *snr, double *segSNR)
+{
+    char name[256];
+    int rate, kbps;
+    double a, b;
+
+    if(!baseline)
+        return 0;
+
+    rewind(baseline);
+    while(fscanf(baseline, "%255s %d %d %lf %lf", name, &rate, &kbps, &a, &b) == 5)
+    {
+        if(strcmp(name, clip->name) == 0 && rate == clip->sampleRate && kbps == bitRate)
+        {
+            *snr = a;
+            *segSNR = b;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void RunClip(const TestClip *clip, const int *bitRates, int numBitRates, int bUseFloors, FILE *baselineIn, FILE *baselineOut)
+{
+    int i;
+
+    for(i=0; i<numBitRates; i++)
+    {
+        const QualityFloor *floor = bUseFloors ? FindFloor(clip, bitRates[i]) : NULL;
+        QualityStats stats;
+        double msPerSecond, baseSNR, baseSegSNR;
+
+        if(!EncodeForQuality(clip, bitRates[i], &stats))
+        {
+            TestCheck(0, "%s %d %dk: could not open the encoder", clip->name, clip->sampleRate, bitRates[i]);
+            continue;
+        }
+
+        msPerSecond = EncodeForTime(clip, bitRates[i]);
+
+        printf("%-24s %5d %3dk  snr %5.2f psnr %5.2f segsnr %5.2f dB  %6.1f kbps  delay %4d  encode %6.2f ms/s (x%.0f realtime)\n",
+            clip->name, clip->sampleRate, bitRates[i], stats.snr, stats.psnr, stats.segSNR, stats.kbps, stats.delay,
+            msPerSecond, msPerSecond > 0.0 ? 1000.0/msPerSecond : 0.0);
+
+        TestCheck(stats.kbps <= bitRates[i]*(1.0+MAX_BITRATE_OVERSHOOT), "%s %d %dk: bitrate %.1f kbps is over the target",
+            clip->name, clip->sampleRate, bitRates[i], stats.kbps);
+
+        if(floor)
+        {
+            TestCheck(stats.snr >= floor->snr-MAX_SNR_LOSS, "%s %d %dk: snr %.2f dB is below the %.2f dB floor",
+                clip->name, clip->sampleRate, bitRates[i], stats.snr, floor->snr);
+            TestCheck(stats.segSNR >= floor->segSNR-MAX_SNR_LOSS, "%s %d %dk: segmental snr %.2f dB is below the %.2f dB floor",
+                clip->name, clip->sampleRate, bitRates[i], stats.segSNR, floor->segSNR);
+        }
+
+        if(FindBaseline(baselineIn, clip, bitRates[i], &baseSNR, &baseSegSNR))
+        {
+            printf("%-24s %5d %3dk  baseline snr %5.2f segsnr %5.2f dB (%+.2f / %+.2f)\n", "", clip->sampleRate, bitRates[i],
+                baseSNR, baseSegSNR, stats.snr-baseSNR, stats.segSNR-baseSegSNR);
+
+            TestCheck(stats.snr >= baseSNR-MAX_SNR_LOSS, "%s %d %dk: snr %.2f dB is below the baseline's %.2f dB",
+                clip->name, clip->sampleRate, bitRates[i], stats.snr, baseSNR);
+            TestCheck(stats.segSNR >= baseSegSNR-MAX_SNR_LOSS, "%s %d %dk: segmental snr %.2f dB is below the baseline's %.2f dB",
+                clip->name, clip->sampleRate, bitRates[i], stats.segSNR, baseSegSNR);
+        }
+
+        if(baselineOut)
+            fprintf(baselineOut, "%s %d %d %.3f %.3f\n", clip->name, clip->sampleRate, bitRates[i], stats.snr, stats.segSNR);
+    }
+}
+
+//options: -seconds <n>       length of the synthetic clips (default 10)
+//         -baseline <file>   compare against the file if it exists, write it otherwise
+//         anything else is a 16 bit wave file to encode as well
+int RunFaacTest(int argc, char **argv)
+{
+    static const char *clipNames[] = {"tones", "tones+noise", "bursts"};
+    static const int sampleRates[] = {44100, 48000};
+    static const int bitRates[] = {128, 192};
+    const int numBitRates = sizeof(bitRates)/sizeof(bitRates[0]);
+    const char *baselinePath = NULL;
+    FILE *baselineIn = NULL, *baselineOut = NULL;
+    double seconds = DEFAULT_SECONDS;
+    TestClip clip;
+    int i, j;
+
+    for(i=0; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-seconds") == 0 && i+1 < argc)
+            seconds = atof(argv[++i]);
+        else if(strcmp(argv[i], "-baseline") == 0 && i+1 < argc)
+            baselinePath = argv[++i];
+    }
+
+    if(seconds < 2.0)
+        seconds = 2.0;
+
+    if(baselinePath)
+    {
+        baselineIn = fopen(baselinePath, "r");
+        if(!baselineIn)
+        {
+            baselineOut = fopen(baselinePath, "w");
+            if(baselineOut)
+                printf("writing baseline to %s\n", baselinePath);
+        }
+    }
+
+    for(i=0; i<sizeof(sampleRates)/sizeof(sampleRates[0]); i++)
+    {
+        for(j=0; j<sizeof(clipNames)/sizeof(clipNames[0]); j++)
+        {
+            MakeClip(&clip, clipNames[j], sampleRates[i], seconds);
+            RunClip(&clip, bitRates, numBitRates, seconds == DEFAULT_SECONDS, baselineIn, baselineOut);
+            free(clip.samples);
+        }
+    }
+
+    for(i=0; i<argc; i++)
+    {
+        const char *name;
+
+        if(strcmp(argv[i], "-seconds") == 0 || strcmp(argv[i], "-baseline") == 0)
+        {
+            i++;
+            continue;
+        }
+
+        clip.samples = LoadWaveFile(argv[i], &clip.frames, &clip.channels, &clip.sampleRate);
+        if(!clip.samples || clip.channels < 1 || clip.channels > 2)
+        {
+            TestCheck(0, "%s: not a mono or stereo 16 bit wave file", argv[i]);
+            free(clip.samples);
+            continue;
+        }
+
+        name = strrchr(argv[i], '/');
+        if(!name) name = strrchr(argv[i], '\\');
+        name = name ? name+1 : argv[i];
+
+        //names go into the baseline file, which is whitespace separated
+        for(j=0; name[j] && j<(int)sizeof(clip.name)-1; j++)
+            clip.name[j] = (name[j] == ' ') ? '_' : name[j];
+        clip.name[j] = 0;
+
+        RunClip(&clip, bitRates, numBitRates, 0, baselineIn, baselineOut);
+        free(clip.samples);
+    }
+
+    if(baselineIn)  fclose(baselineIn);
+    if(baselineOut) fclose(baselineOut);
+
+    return 0;
+}
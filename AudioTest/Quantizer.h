@@ -0,0 +1,107 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+
+#pragma once
+
+//libfaac's quantizer built twice, once with its SSE paths and once without, so the two can be
+//compared call for call.  QuantizerScalar.c and QuantizerVector.c define QUANTIZER_NAME and include
+//this to compile aacquant.c with the externs renamed and its static helpers exposed; everything
+//else only sees the declarations.  like FaacTest.c, this has to match libfaac's FAAC_PRECISION_DOUBLE
+
+#include "frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DECLARE_QUANTIZER(prefix) \
+    extern const int prefix##HasSSE; \
+    void prefix##AACQuantizeInit(CoderInfo *coderInfo, unsigned int numChannels, AACQuantCfg *aacquantCfg); \
+    void prefix##AACQuantizeEnd(CoderInfo *coderInfo, unsigned int numChannels, AACQuantCfg *aacquantCfg); \
+    void prefix##CalcAvgEnrg(CoderInfo *coderInfo, const faac_real *xr); \
+    void prefix##QuantizeBandTest(const faac_real *xp, int *pi, double istep, int offset, int end, faac_real *adj43); \
+    int prefix##CalcXrPowTest(const faac_real *xr, faac_real *xr_pow); \
+    double prefix##BandMaxTest(const faac_real *x, int start, int end); \
+    void prefix##BandScaleTest(faac_real *x, int start, int end, double fac); \
+    double prefix##BandEnergyTest(const int *xi, int start, int end); \
+    void prefix##CalcAllowedDistTest(CoderInfo *coderInfo, faac_real *xr, faac_real *xmin, int quality); \
+    void prefix##FixNoiseTest(CoderInfo *coderInfo, const faac_real *xr, faac_real *xr_pow, int *xi, faac_real *xmin, faac_real *pow43, faac_real *adj43);
+
+DECLARE_QUANTIZER(Scalar)
+DECLARE_QUANTIZER(Vector)
+
+#ifdef __cplusplus
+}
+#endif
+
+//-------------------------------------------------------------------
+
+#ifdef QUANTIZER_NAME
+
+#define AACQuantizeInit QUANTIZER_NAME(AACQuantizeInit)
+#define AACQuantizeEnd  QUANTIZER_NAME(AACQuantizeEnd)
+#define AACQuantize     QUANTIZER_NAME(AACQuantize)
+#define SortForGrouping QUANTIZER_NAME(SortForGrouping)
+#define CalcAvgEnrg     QUANTIZER_NAME(CalcAvgEnrg)
+
+#include "aacquant.c"
+
+#ifdef AACQUANT_SSE
+const int QUANTIZER_NAME(HasSSE) = 1;
+#else
+const int QUANTIZER_NAME(HasSSE) = 0;
+#endif
+
+void QUANTIZER_NAME(QuantizeBandTest)(const faac_real *xp, int *pi, double istep, int offset, int end, faac_real *adj43)
+{
+    QuantizeBand(xp, pi, istep, offset, end, adj43);
+}
+
+int QUANTIZER_NAME(CalcXrPowTest)(const faac_real *xr, faac_real *xr_pow)
+{
+    return CalcXrPow(xr, xr_pow);
+}
+
+double QUANTIZER_NAME(BandMaxTest)(const faac_real *x, int start, int end)
+{
+    return BandMax(x, start, end);
+}
+
+void QUANTIZER_NAME(BandScaleTest)(faac_real *x, int start, int end, double fac)
+{
+    BandScale(x, start, end, fac);
+}
+
+double QUANTIZER_NAME(BandEnergyTest)(const int *xi, int start, int end)
+{
+    return BandEnergy(xi, start, end);
+}
+
+void QUANTIZER_NAME(CalcAllowedDistTest)(CoderInfo *coderInfo, faac_real *xr, faac_real *xmin, int quality)
+{
+    CalcAllowedDist(coderInfo, NULL, xr, xmin, quality);
+}
+
+void QUANTIZER_NAME(FixNoiseTest)(CoderInfo *coderInfo, const faac_real *xr, faac_real *xr_pow, int *xi, faac_real *xmin, faac_real *pow43, faac_real *adj43)
+{
+    FixNoise(coderInfo, xr, xr_pow, xi, xmin, pow43, adj43);
+}
+
+#endif
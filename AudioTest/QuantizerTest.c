@@ -0,0 +1,472 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+
+#include "AudioTest.h"
+#include "Quantizer.h"
+
+//compares libfaac's SSE quantizer helpers against the scalar code they replaced.  every helper is
+//run on the same input through both builds of aacquant.c, first on its own (random lines, and lines
+//sitting right on a rounding boundary of the quantizer) and then the whole noise fitting pass
+//(CalcXrPow, CalcAllowedDist, FixNoise) on synthetic long window spectra using the real 44.1k band
+//table.  the vector paths compute in float where the scalar ones used double, so QuantizeBand can
+//round a line the other way when it lands within an ulp of a decision point.  that's allowed, but
+//only by one step, only rarely, and not at the cost of more quantization noise
+
+//relative error of sqrt(x*sqrt(x)) in float: half of each inner rounding plus the outer one
+#define MAX_XRPOW_ERROR         (1.0/8388608.0 * 1.01)
+
+//BandScale multiplies by a float factor instead of a double one
+#define MAX_SCALE_ERROR         (2.0/8388608.0)
+
+//random lines almost never land within an ulp of a decision point, boundary lines often do
+#define MAX_RANDOM_MISMATCH     0.0001
+#define MAX_BOUNDARY_MISMATCH   0.25
+
+//the full noise fitting pass: a band whose step search branches the other way requantizes every
+//line in it, so this is looser than the per line rate, but the noise has to stay the same
+#define MAX_LINE_MISMATCH       0.02
+#define MAX_NOISE_DIFFERENCE_DB 0.05
+
+#define TEST_LINES              (FRAME_LEN*64)
+
+//benchmark results go here so the calls can't be optimized away
+static volatile double sink;
+
+typedef struct
+{
+    int numBands;
+    int offsets[MAX_SCFAC_BANDS+1];
+    faac_real *pow43, *adj43;
+} QuantTables;
+
+//the decision points of the quantizer: a line of (already scaled) x^3/4 quantizes to i and above
+//once it reaches the 3/4 power of the midpoint between (i-1)^4/3 and i^4/3
+static double DecisionPoint(int i)
+{
+    return pow(0.5*(pow((double)(i-1), 4.0/3.0) + pow((double)i, 4.0/3.0)), 0.75);
+}
+
+static double RandUnit(void)
+{
+    return (double)TestRand() / 4294967296.0;
+}
+
+static int LoadTables(QuantTables *tables, CoderInfo *initInfo, AACQuantCfg *cfg)
+{
+    unsigned long inputSamples, maxOutputBytes;
+    faacEncHandle faac = faacEncOpen(44100, 1, &inputSamples, &maxOutputBytes);
+    faacEncStruct *encoder = (faacEncStruct*)faac;
+    int i;
+
+    if(!faac)
+        return 0;
+
+    memset(tables, 0, sizeof(*tables));
+    tables->numBands = encoder->srInfo->num_cb_long;
+    for(i=0; i<tables->numBands; i++)
+        tables->offsets[i+1] = tables->offsets[i] + encoder->srInfo->cb_width_long[i];
+
+    faacEncClose(faac);
+
+    //both builds make the same tables, no channels so there's no requant buffer to allocate
+    memset(cfg, 0, sizeof(*cfg));
+    ScalarAACQuantizeInit(initInfo, 0, cfg);
+    tables->pow43 = cfg->pow43;
+    tables->adj43 = cfg->adj43;
+    return 1;
+}
+
+//-------------------------------------------------------------------
+
+static void CompareQuantizeBand(const QuantTables *tables, const faac_real *lines, double istep, const char *name, double maxMismatch)
+{
+    static int scalarOut[TEST_LINES], vectorOut[TEST_LINES];
+    int i, mismatches = 0, maxDiff = 0;
+
+    //odd offsets and lengths so the vector loop's scalar tail gets used too
+    for(i=0; i<TEST_LINES; i += 61)
+    {
+        int end = (i+61 < TEST_LINES) ? i+61 : TEST_LINES;
+        ScalarQuantizeBandTest(lines, scalarOut, istep, i, end, tables->adj43);
+        VectorQuantizeBandTest(lines, vectorOut, istep, i, end, tables->adj43);
+    }
+
+    for(i=0; i<TEST_LINES; i++)
+    {
+        int diff = abs(scalarOut[i]-vectorOut[i]);
+        if(diff)
+            mismatches++;
+        if(diff > maxDiff)
+            maxDiff = diff;
+    }
+
+    printf("QuantizeBand %-22s %6.3f%% of lines differ, by at most %d\n", name, 100.0*mismatches/TEST_LINES, maxDiff);
+
+    TestCheck(maxDiff <= 1, "QuantizeBand %s: lines differ by up to %d steps", name, maxDiff);
+    TestCheck((double)mismatches/TEST_LINES <= maxMismatch, "QuantizeBand %s: %.3f%% of lines differ (limit %.3f%%)",
+        name, 100.0*mismatches/TEST_LINES, 100.0*maxMismatch);
+}
+
+static void TestKernels(const QuantTables *tables)
+{
+    static faac_real lines[TEST_LINES], scalarPow[FRAME_LEN], vectorPow[FRAME_LEN];
+    static int ints[TEST_LINES];
+    double maxPowError = 0.0, maxScaleError = 0.0;
+    int i, frame, bCountsMatch = 1, bMaxMatches = 1, bEnergyMatches = 1;
+
+    //lines as FixNoise hands them over: scaled so the band maximum is somewhere below IXMAX_VAL
+    for(i=0; i<TEST_LINES; i++)
+        lines[i] = (faac_real)(pow(IXMAX_VAL, RandUnit()) * RandUnit());
+    CompareQuantizeBand(tables, lines, 1.0, "random", MAX_RANDOM_MISMATCH);
+    CompareQuantizeBand(tables, lines, IPOW20(3), "random, istep < 1", MAX_RANDOM_MISMATCH);
+
+    //lines within a few ulps either side of a decision point
+    for(i=0; i<TEST_LINES; i++)
+    {
+        int q = 1 + (int)(RandUnit()*(IXMAX_VAL-1));
+        int ulps = (int)(TestRand()%9) - 4;
+        lines[i] = (faac_real)DecisionPoint(q);
+        lines[i] *= (faac_real)(1.0 + ulps/8388608.0);
+    }
+    CompareQuantizeBand(tables, lines, 1.0, "on a decision point", MAX_BOUNDARY_MISMATCH);
+
+    //CalcXrPow against the exact power, over the whole range a 16 bit spectrum covers plus silence
+    for(frame=0; frame<64; frame++)
+    {
+        int scalarCount, vectorCount;
+
+        for(i=0; i<FRAME_LEN; i++)
+        {
+            unsigned int r = TestRand();
+            if(r%16 == 0)
+                lines[i] = 0.0f;
+            else if(r%16 == 1)
+                lines[i] = (faac_real)(TestRandFloat()*1e-21);
+            else
+                lines[i] = (faac_real)(TestRandFloat()*pow(10.0, 8.0*RandUnit()-1.0));
+        }
+
+        scalarCount = ScalarCalcXrPowTest(lines, scalarPow);
+        vectorCount = VectorCalcXrPowTest(lines, vectorPow);
+        if(scalarCount != vectorCount)
+            bCountsMatch = 0;
+
+        for(i=0; i<FRAME_LEN; i++)
+        {
+            double x = fabs(lines[i]);
+            double exact = pow(x, 0.75);
+
+            if(x > 1E-20)
+            {
+                double err = fabs(vectorPow[i]-exact)/exact;
+                if(err > maxPowError)
+                    maxPowError = err;
+            }
+        }
+
+        //BandMax and BandScale on the xr_pow that was just made, in odd sized bands
+        for(i=0; i+37<=FRAME_LEN; i+=37)
+        {
+            double fac;
+            int j;
+
+            if(ScalarBandMaxTest(scalarPow, i, i+37) != VectorBandMaxTest(scalarPow, i, i+37))
+                bMaxMatches = 0;
+
+            fac = 1.0/(ScalarBandMaxTest(scalarPow, i, i+37) + 1.0);
+            memcpy(vectorPow+i, scalarPow+i, 37*sizeof(faac_real));
+            ScalarBandScaleTest(scalarPow, i, i+37, fac);
+            VectorBandScaleTest(vectorPow, i, i+37, fac);
+
+            for(j=i; j<i+37; j++)
+            {
+                if(scalarPow[j] != 0.0f)
+                {
+                    double err = fabs((double)vectorPow[j]-(double)scalarPow[j])/scalarPow[j];
+                    if(err > maxScaleError)
+                        maxScaleError = err;
+                }
+            }
+        }
+    }
+
+    for(i=0; i<TEST_LINES; i++)
+        ints[i] = (int)(TestRand()%(IXMAX_VAL+1));
+    for(i=0; i+53<=TEST_LINES; i+=53)
+    {
+        if(ScalarBandEnergyTest(ints, i, i+53) != VectorBandEnergyTest(ints, i, i+53))
+            bEnergyMatches = 0;
+    }
+
+    printf("CalcXrPow    max relative error %.3g (limit %.3g), BandScale max relative difference %.3g\n",
+        maxPowError, MAX_XRPOW_ERROR, maxScaleError);
+
+    TestCheck(bCountsMatch, "CalcXrPow: the count of lines to quantize differs");
+    TestCheck(maxPowError <= MAX_XRPOW_ERROR, "CalcXrPow: relative error %.3g is over %.3g", maxPowError, MAX_XRPOW_ERROR);
+    TestCheck(bMaxMatches, "BandMax: results differ");
+    TestCheck(maxScaleError <= MAX_SCALE_ERROR, "BandScale: results differ by %.3g", maxScaleError);
+    TestCheck(bEnergyMatches, "BandEnergy: results differ");
+}
+
+//-------------------------------------------------------------------
+
+//a long window spectrum the way a 16 bit source comes out of the MDCT: a falling envelope,
+//a few tones on top, laplacian lines and nothing above the encoder's bandwidth
+static void MakeSpectrum(faac_real *xr, double level)
+{
+    int peaks[3], i, p;
+
+    for(p=0; p<3; p++)
+        peaks[p] = 8 + (int)(RandUnit()*500);
+
+    for(i=0; i<FRAME_LEN; i++)
+    {
+        double envelope = level * pow(10.0, -(double)i/400.0);
+        double u = RandUnit();
+        double val = -log(u > 1e-12 ? u : 1e-12);
+
+        for(p=0; p<3; p++)
+            if(abs(i-peaks[p]) <= 1)
+                envelope *= 30.0;
+
+        xr[i] = (i < 743) ? (faac_real)(envelope * val * ((TestRand()&1) ? 1.0 : -1.0)) : 0.0f;
+    }
+}
+
+static void FitNoise(int bVector, CoderInfo *coderInfo, const QuantTables *tables, const faac_real *xr, int *xi)
+{
+    faac_real xr_pow[FRAME_LEN];
+    faac_real xmin[MAX_SCFAC_BANDS];
+
+    coderInfo->block_type = ONLY_LONG_WINDOW;
+    coderInfo->nr_of_sfb = tables->numBands;
+    memcpy(coderInfo->sfb_offset, tables->offsets, (tables->numBands+1)*sizeof(int));
+    coderInfo->global_gain = 0;
+    memset(coderInfo->scale_factor, 0, sizeof(coderInfo->scale_factor));
+    memset(xi, 0, FRAME_LEN*sizeof(int));
+
+    //what AACQuantize does before bit allocation, at the quality AACEncoder uses
+    if(bVector)
+    {
+        VectorCalcAvgEnrg(coderInfo, xr);
+        if(VectorCalcXrPowTest(xr, xr_pow))
+        {
+            VectorCalcAllowedDistTest(coderInfo, (faac_real*)xr, xmin, 100);
+            VectorFixNoiseTest(coderInfo, xr, xr_pow, xi, xmin, tables->pow43, tables->adj43);
+        }
+    }
+    else
+    {
+        ScalarCalcAvgEnrg(coderInfo, xr);
+        if(ScalarCalcXrPowTest(xr, xr_pow))
+        {
+            ScalarCalcAllowedDistTest(coderInfo, (faac_real*)xr, xmin, 100);
+            ScalarFixNoiseTest(coderInfo, xr, xr_pow, xi, xmin, tables->pow43, tables->adj43);
+        }
+    }
+}
+
+//quantization noise with each band at its least squares gain, which is what BalanceEnergy
+//approximates with the scale factors afterwards
+static void AddNoise(const QuantTables *tables, const faac_real *xr, const int *xi, double *signal, double *noise)
+{
+    int sb, i;
+
+    for(sb=0; sb<tables->numBands; sb++)
+    {
+        double xq = 0.0, qq = 0.0, xx = 0.0, gain;
+
+        for(i=tables->offsets[sb]; i<tables->offsets[sb+1]; i++)
+        {
+            double q = tables->pow43[xi[i]];
+            xq += fabs(xr[i])*q;
+            qq += q*q;
+            xx += (double)xr[i]*xr[i];
+        }
+
+        gain = (qq > 0.0) ? xq/qq : 0.0;
+        *signal += xx;
+        *noise += xx - 2.0*gain*xq + gain*gain*qq;
+    }
+}
+
+static void TestNoiseFitting(const QuantTables *tables, int numFrames)
+{
+    static CoderInfo scalarInfo, vectorInfo;
+    faac_real xr[FRAME_LEN];
+    int scalarXi[FRAME_LEN], vectorXi[FRAME_LEN];
+    double scalarSignal = 0.0, scalarNoise = 0.0, vectorSignal = 0.0, vectorNoise = 0.0;
+    double scalarSeconds = 0.0, vectorSeconds = 0.0, startTime;
+    double scalarSNR, vectorSNR, lineRate, bandRate;
+    int lines = 0, lineMismatches = 0, bands = 0, bandMismatches = 0, maxDiff = 0;
+    int frame, i;
+
+    for(frame=0; frame<numFrames; frame++)
+    {
+        //every eighth frame is near silence, which takes the empty band paths
+        MakeSpectrum(xr, (frame%8 == 7) ? 20.0 : 2e5);
+
+        startTime = GetTestTime();
+        FitNoise(0, &scalarInfo, tables, xr, scalarXi);
+        scalarSeconds += GetTestTime()-startTime;
+
+        startTime = GetTestTime();
+        FitNoise(1, &vectorInfo, tables, xr, vectorXi);
+        vectorSeconds += GetTestTime()-startTime;
+
+        for(i=0; i<tables->offsets[tables->numBands]; i++)
+        {
+            int diff = abs(scalarXi[i]-vectorXi[i]);
+            if(diff)
+                lineMismatches++;
+            if(diff > maxDiff)
+                maxDiff = diff;
+        }
+        lines += tables->offsets[tables->numBands];
+
+        for(i=0; i<tables->numBands; i++)
+        {
+            if(scalarInfo.scale_factor[i] != vectorInfo.scale_factor[i])
+                bandMismatches++;
+        }
+        bands += tables->numBands;
+
+        AddNoise(tables, xr, scalarXi, &scalarSignal, &scalarNoise);
+        AddNoise(tables, xr, vectorXi, &vectorSignal, &vectorNoise);
+    }
+
+    scalarSNR = 10.0*log10(scalarSignal/scalarNoise);
+    vectorSNR = 10.0*log10(vectorSignal/vectorNoise);
+    lineRate = (double)lineMismatches/lines;
+    bandRate = (double)bandMismatches/bands;
+
+    printf("FixNoise     %d frames: %.3f%% of lines differ (by at most %d), %.3f%% of scale factors differ\n",
+        numFrames, 100.0*lineRate, maxDiff, 100.0*bandRate);
+    printf("             quantization snr scalar %.3f vector %.3f dB, %.1f vs %.1f us/frame (x%.2f)\n",
+        scalarSNR, vectorSNR, scalarSeconds*1000000.0/numFrames, vectorSeconds*1000000.0/numFrames, scalarSeconds/vectorSeconds);
+
+    TestCheck(lineRate <= MAX_LINE_MISMATCH, "FixNoise: %.3f%% of lines differ (limit %.3f%%)", 100.0*lineRate, 100.0*MAX_LINE_MISMATCH);
+    TestCheck(vectorSNR >= scalarSNR-MAX_NOISE_DIFFERENCE_DB, "FixNoise: the vector path adds noise (%.3f vs %.3f dB)", vectorSNR, scalarSNR);
+}
+
+//-------------------------------------------------------------------
+
+static void BenchmarkKernels(const QuantTables *tables, int numFrames)
+{
+    static faac_real xr[FRAME_LEN], xr_pow[FRAME_LEN];
+    static int xi[FRAME_LEN];
+    double times[2][4] = {{0}};
+    int impl, frame, sb;
+
+    MakeSpectrum(xr, 2e5);
+
+    for(impl=0; impl<2; impl++)
+    {
+        double startTime;
+
+        startTime = GetTestTime();
+        for(frame=0; frame<numFrames; frame++)
+            sink = impl ? VectorCalcXrPowTest(xr, xr_pow) : ScalarCalcXrPowTest(xr, xr_pow);
+        times[impl][0] = GetTestTime()-startTime;
+
+        startTime = GetTestTime();
+        for(frame=0; frame<numFrames; frame++)
+        {
+            for(sb=0; sb<tables->numBands; sb++)
+                sink = impl ? VectorBandMaxTest(xr_pow, tables->offsets[sb], tables->offsets[sb+1]) :
+                               ScalarBandMaxTest(xr_pow, tables->offsets[sb], tables->offsets[sb+1]);
+        }
+        times[impl][1] = GetTestTime()-startTime;
+
+        //scale by the band's own 1/max like FixNoise, so every band ends at or below 1.0 and
+        //repeating it doesn't drift towards denormals
+        for(sb=0; sb<tables->numBands; sb++)
+        {
+            double maxx = ScalarBandMaxTest(xr_pow, tables->offsets[sb], tables->offsets[sb+1]);
+            if(maxx > 0.0)
+                ScalarBandScaleTest(xr_pow, tables->offsets[sb], tables->offsets[sb+1], 1000.0/maxx);
+        }
+
+        startTime = GetTestTime();
+        for(frame=0; frame<numFrames; frame++)
+        {
+            for(sb=0; sb<tables->numBands; sb++)
+            {
+                if(impl)
+                    VectorQuantizeBandTest(xr_pow, xi, 1.0, tables->offsets[sb], tables->offsets[sb+1], tables->adj43);
+                else
+                    ScalarQuantizeBandTest(xr_pow, xi, 1.0, tables->offsets[sb], tables->offsets[sb+1], tables->adj43);
+            }
+        }
+        times[impl][2] = GetTestTime()-startTime;
+
+        startTime = GetTestTime();
+        for(frame=0; frame<numFrames; frame++)
+        {
+            for(sb=0; sb<tables->numBands; sb++)
+                sink = impl ? VectorBandEnergyTest(xi, tables->offsets[sb], tables->offsets[sb+1]) :
+                               ScalarBandEnergyTest(xi, tables->offsets[sb], tables->offsets[sb+1]);
+        }
+        times[impl][3] = GetTestTime()-startTime;
+    }
+
+    printf("us/frame      CalcXrPow %.2f vs %.2f (x%.2f)  BandMax %.2f vs %.2f (x%.2f)  QuantizeBand %.2f vs %.2f (x%.2f)  BandEnergy %.2f vs %.2f (x%.2f)\n",
+        times[0][0]*1000000.0/numFrames, times[1][0]*1000000.0/numFrames, times[0][0]/times[1][0],
+        times[0][1]*1000000.0/numFrames, times[1][1]*1000000.0/numFrames, times[0][1]/times[1][1],
+        times[0][2]*1000000.0/numFrames, times[1][2]*1000000.0/numFrames, times[0][2]/times[1][2],
+        times[0][3]*1000000.0/numFrames, times[1][3]*1000000.0/numFrames, times[0][3]/times[1][3]);
+}
+
+//options: -frames <n>   spectra for the noise fitting comparison and the benchmark (default 2000)
+int RunQuantizerTest(int argc, char **argv)
+{
+    static CoderInfo initInfo;
+    AACQuantCfg cfg;
+    QuantTables tables;
+    int numFrames = 2000;
+    int i;
+
+    for(i=0; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-frames") == 0 && i+1 < argc)
+            numFrames = atoi(argv[++i]);
+    }
+
+    if(numFrames < 1)
+        numFrames = 1;
+
+    if(!VectorHasSSE)
+        printf("this build has no SSE quantizer, both sides run the scalar code\n");
+
+    if(!LoadTables(&tables, &initInfo, &cfg))
+    {
+        TestCheck(0, "faacEncOpen failed");
+        return 0;
+    }
+
+    SeedTestRand(0x5eed);
+
+    TestKernels(&tables);
+    TestNoiseFitting(&tables, numFrames);
+    BenchmarkKernels(&tables, numFrames);
+
+    ScalarAACQuantizeEnd(&initInfo, 0, &cfg);
+    return 0;
+}
@@ -0,0 +1,291 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "AudioTest.h"
+#include "samplerate.h"
+
+//compares the polyphase sinc converters against the variable ratio sinc converters they replace.
+//both are fed the same sum of sines in 10ms chunks (the way the audio thread feeds them), and the
+//output is checked against the analytically resampled sines as well as against each other.  the
+//variable ratio converter's SSE kernels are also checked sample for sample against a copy of the
+//scalar converter they replaced
+
+typedef struct
+{
+    int inRate, outRate, channels;
+} RateCase;
+
+static const RateCase rateCases[] =
+{
+    {44100, 48000, 2},
+    {48000, 44100, 2},
+    {44100, 48000, 1},
+    {32000, 48000, 2},
+    {22050, 44100, 1},
+};
+
+static const int qualities[] = {SRC_SINC_BEST_QUALITY, SRC_SINC_MEDIUM_QUALITY, SRC_SINC_FASTEST};
+
+//poly and vari compute the same taps, only the coefficient interpolation is done once up front
+//in float instead of per sample, so they should agree far below 16 bit resolution
+#define MIN_POLY_VS_VARI_SNR    100.0
+
+//the polyphase path must not measurably lose quality against the signal itself
+#define MAX_ANALYTIC_SNR_LOSS   0.5
+
+//the variable ratio path accumulates its position in floating point, so when an output lands exactly
+//on an input frame it can come out a hair early and produce that frame one call sooner.  a ratio change
+//made between calls then starts one output apart, which is worth about 80 dB against a 1e-4 nudge.
+//a real glitch at the switch (a lost or repeated frame, a wrong phase) is 20 dB or worse
+#define MAX_LENGTH_DIFFERENCE   1
+#define MIN_RATIO_CHANGE_SNR    70.0
+
+//the SSE kernels interpolate the coefficients and accumulate in float instead of double, which comes to
+//a couple of float roundings of the output (2.4e-7 at most here).  a wrong tap or a shifted window is
+//off by far more than this
+#define MAX_SCALAR_DIFFERENCE   2e-6
+
+//skip the filter warmup at either end of the output when comparing
+#define EDGE_SECONDS            0.05
+
+typedef SRC_STATE* (*NewStateProc)(int converter_type, int channels, int *error);
+
+typedef struct
+{
+    float *output;
+    long outFrames;
+    double setupMS;     //src_new plus the first chunk (builds the polyphase table)
+    double seconds;     //everything including setup
+} ConvertResult;
+
+static int Convert(NewStateProc newState, int converter, const RateCase *rc, const float *input, long inFrames, long maxOutFrames, double ratioChange, ConvertResult *result)
+{
+    SRC_STATE *state;
+    SRC_DATA data;
+    long chunkFrames = rc->inRate/100;
+    long inPos = 0;
+    double ratio = (double)rc->outRate/(double)rc->inRate;
+    double startTime;
+    int err;
+
+    memset(result, 0, sizeof(*result));
+    result->output = (float*)malloc(maxOutFrames*rc->channels*sizeof(float));
+
+    startTime = GetTestTime();
+
+    state = newState(converter, rc->channels, &err);
+    if(!state)
+    {
+        printf("src_new(%s) failed: %s\n", src_get_name(converter), src_strerror(err));
+        return 0;
+    }
+
+    while(inPos < inFrames)
+    {
+        long frames = (inFrames-inPos < chunkFrames) ? inFrames-inPos : chunkFrames;
+
+        //optionally nudge the ratio halfway through, like a sync adjustment would
+        if(ratioChange != 0.0 && inPos >= inFrames/2 && inPos-chunkFrames < inFrames/2)
+            src_set_ratio(state, ratio *= ratioChange);
+
+        data.data_in = (float*)input + inPos*rc->channels;
+        data.input_frames = frames;
+        data.data_out = result->output + result->outFrames*rc->channels;
+        data.output_frames = maxOutFrames-result->outFrames;
+        data.end_of_input = 0;
+        data.src_ratio = ratio;
+
+        if((err = src_process(state, &data)) != 0)
+        {
+            printf("src_process(%s) failed: %s\n", src_get_name(converter), src_strerror(err));
+            src_delete(state);
+            return 0;
+        }
+
+        if(inPos == 0)
+            result->setupMS = (GetTestTime()-startTime)*1000.0;
+
+        inPos += data.input_frames_used;
+        result->outFrames += data.output_frames_gen;
+
+        if(data.input_frames_used == 0 && data.output_frames_gen == 0)
+            break;
+    }
+
+    result->seconds = GetTestTime()-startTime;
+
+    src_delete(state);
+    return 1;
+}
+
+static double CompareRange(const float *reference, const float *test, long outFrames, const RateCase *rc)
+{
+    long edge = (long)(EDGE_SECONDS*rc->outRate);
+    double worst = 200.0;
+    int ch;
+
+    if(outFrames <= edge*2)
+        return 0.0;
+
+    for(ch=0; ch<rc->channels; ch++)
+    {
+        double snr = SignalToNoiseDB(reference+edge*rc->channels+ch, test+edge*rc->channels+ch, outFrames-edge*2, rc->channels);
+        if(snr < worst)
+            worst = snr;
+    }
+
+    return worst;
+}
+
+//the whole output, warmup included, has to match
+static double MaxDifference(const float *reference, const float *test, long outFrames, const RateCase *rc)
+{
+    double worst = 0.0;
+    long i;
+
+    for(i=0; i<outFrames*rc->channels; i++)
+    {
+        double diff = fabs((double)reference[i] - (double)test[i]);
+        if(diff > worst)
+            worst = diff;
+    }
+
+    return worst;
+}
+
+static void CompareScalar(const ConvertResult *scalar, const ConvertResult *vari, const RateCase *rc, int quality, const char *lpWhen)
+{
+    double maxDiff;
+
+    TestCheck(scalar->outFrames == vari->outFrames, "%s %d->%d %dch: output length differs from the scalar converter%s (%ld vs %ld)",
+        src_get_name(quality), rc->inRate, rc->outRate, rc->channels, lpWhen, scalar->outFrames, vari->outFrames);
+
+    maxDiff = MaxDifference(scalar->output, vari->output, (scalar->outFrames < vari->outFrames) ? scalar->outFrames : vari->outFrames, rc);
+    TestCheck(maxDiff <= MAX_SCALAR_DIFFERENCE, "%s %d->%d %dch: SSE converter differs from the scalar one by %g%s",
+        src_get_name(quality), rc->inRate, rc->outRate, rc->channels, maxDiff, lpWhen);
+}
+
+static void RunCase(const RateCase *rc, int quality, double seconds)
+{
+    //a low, a mid and two high tones, the top one well inside even the fastest filter's passband
+    double toneHz[4] = {440.0, 2000.0, 6500.0, 0.0};
+    double inFreqs[4], outFreqs[4];
+    long inFrames = (long)(seconds*rc->inRate);
+    long maxOutFrames = (long)((double)inFrames*rc->outRate/rc->inRate) + 64;
+    int minRate = (rc->inRate < rc->outRate) ? rc->inRate : rc->outRate;
+    float *input, *reference;
+    ConvertResult vari = {0}, poly = {0}, scalar = {0};
+    double variSNR, polySNR, crossSNR;
+    double variMSPS, polyMSPS, scalarMSPS;
+    int i;
+
+    toneHz[3] = 0.35*minRate;
+    for(i=0; i<4; i++)
+    {
+        inFreqs[i] = toneHz[i]/rc->inRate;
+        outFreqs[i] = toneHz[i]/rc->outRate;
+    }
+
+    input = (float*)malloc(inFrames*rc->channels*sizeof(float));
+    reference = (float*)malloc(maxOutFrames*rc->channels*sizeof(float));
+
+    MakeTestSignal(input, inFrames, rc->channels, inFreqs, 4, 0.9, 0.0);
+    MakeTestSignal(reference, maxOutFrames, rc->channels, outFreqs, 4, 0.9, 0.0);
+
+    if(!Convert(src_new, quality, rc, input, inFrames, maxOutFrames, 0.0, &vari) ||
+       !Convert(src_new, quality+SRC_SINC_BEST_QUALITY_POLYPHASE, rc, input, inFrames, maxOutFrames, 0.0, &poly) ||
+       !Convert(ScalarSincNew, quality, rc, input, inFrames, maxOutFrames, 0.0, &scalar))
+    {
+        TestCheck(0, "%s %d->%d: converter failed", src_get_name(quality), rc->inRate, rc->outRate);
+    }
+    else
+    {
+        TestCheck(labs(vari.outFrames-poly.outFrames) <= MAX_LENGTH_DIFFERENCE, "%s %d->%d %dch: output length differs (%ld vs %ld)",
+            src_get_name(quality), rc->inRate, rc->outRate, rc->channels, vari.outFrames, poly.outFrames);
+
+        variSNR  = CompareRange(reference, vari.output, vari.outFrames, rc);
+        polySNR  = CompareRange(reference, poly.output, poly.outFrames, rc);
+        crossSNR = CompareRange(vari.output, poly.output, (vari.outFrames < poly.outFrames) ? vari.outFrames : poly.outFrames, rc);
+
+        variMSPS = (double)inFrames*rc->channels / vari.seconds / 1000000.0;
+        polyMSPS = (double)inFrames*rc->channels / poly.seconds / 1000000.0;
+        scalarMSPS = (double)inFrames*rc->channels / scalar.seconds / 1000000.0;
+
+        printf("%-26s %5d->%5d %dch  snr vari %6.1f poly %6.1f cross %6.1f dB  scalar %7.2f vari %7.2f poly %7.2f Msamples/s (x%.2f)  table setup %.2f ms\n",
+            src_get_name(quality), rc->inRate, rc->outRate, rc->channels,
+            variSNR, polySNR, crossSNR, scalarMSPS, variMSPS, polyMSPS, polyMSPS/scalarMSPS, poly.setupMS);
+
+        CompareScalar(&scalar, &vari, rc, quality, "");
+
+        TestCheck(crossSNR >= MIN_POLY_VS_VARI_SNR, "%s %d->%d %dch: polyphase differs from the sinc converter (%.1f dB)",
+            src_get_name(quality), rc->inRate, rc->outRate, rc->channels, crossSNR);
+        TestCheck(polySNR >= variSNR-MAX_ANALYTIC_SNR_LOSS, "%s %d->%d %dch: polyphase SNR %.1f dB is below the sinc converter's %.1f dB",
+            src_get_name(quality), rc->inRate, rc->outRate, rc->channels, polySNR, variSNR);
+    }
+
+    free(vari.output);
+    free(poly.output);
+    free(scalar.output);
+    vari.output = poly.output = scalar.output = NULL;
+
+    //a ratio change has to drop the polyphase converter back onto the variable ratio path
+    //without a glitch, so both must still line up afterwards
+    if(Convert(src_new, quality, rc, input, inFrames, maxOutFrames, 1.0001, &vari) &&
+       Convert(src_new, quality+SRC_SINC_BEST_QUALITY_POLYPHASE, rc, input, inFrames, maxOutFrames, 1.0001, &poly) &&
+       Convert(ScalarSincNew, quality, rc, input, inFrames, maxOutFrames, 1.0001, &scalar))
+    {
+        crossSNR = CompareRange(vari.output, poly.output, (vari.outFrames < poly.outFrames) ? vari.outFrames : poly.outFrames, rc);
+        TestCheck(crossSNR >= MIN_RATIO_CHANGE_SNR, "%s %d->%d %dch: polyphase differs after a ratio change (%.1f dB)",
+            src_get_name(quality), rc->inRate, rc->outRate, rc->channels, crossSNR);
+
+        CompareScalar(&scalar, &vari, rc, quality, " after a ratio change");
+    }
+    else
+        TestCheck(0, "%s %d->%d: converter failed with a ratio change", src_get_name(quality), rc->inRate, rc->outRate);
+
+    free(vari.output);
+    free(poly.output);
+    free(scalar.output);
+    free(input);
+    free(reference);
+}
+
+//options: -seconds <n>   length of the test signal (default 10)
+int RunResamplerTest(int argc, char **argv)
+{
+    double seconds = 10.0;
+    int i, q;
+
+    for(i=0; i<argc; i++)
+    {
+        if(strcmp(argv[i], "-seconds") == 0 && i+1 < argc)
+            seconds = atof(argv[++i]);
+    }
+
+    if(seconds < EDGE_SECONDS*4)
+        seconds = EDGE_SECONDS*4;
+
+    for(q=0; q<sizeof(qualities)/sizeof(qualities[0]); q++)
+    {
+        for(i=0; i<sizeof(rateCases)/sizeof(rateCases[0]); i++)
+            RunCase(rateCases+i, qualities[q], seconds);
+    }
+
+    return 0;
+}
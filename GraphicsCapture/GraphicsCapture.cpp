@@ -25,6 +25,8 @@ extern "C" __declspec(dllexport) void UnloadPlugin();
 extern "C" __declspec(dllexport) CTSTR GetPluginName();
 extern "C" __declspec(dllexport) CTSTR GetPluginDescription();
 
+OBS_DECLARE_PLUGIN_API_VERSION
+
 HINSTANCE hinstMain = NULL;
 HANDLE textureMutexes[2] = {NULL, NULL};
 
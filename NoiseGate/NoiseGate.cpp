@@ -583,6 +583,8 @@ void NoiseGate::StreamStopped()
 //============================================================================
 // Plugin entry points
 
+OBS_DECLARE_PLUGIN_API_VERSION
+
 bool LoadPlugin()
 {
     if(NoiseGate::instance != NULL)
@@ -151,6 +151,6 @@ void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak)       {API->Ge
 void OBSAddSettingsPane(SettingsPane *pane)     {API->AddSettingsPane(pane);}
 void OBSRemoveSettingsPane(SettingsPane *pane)  {API->RemoveSettingsPane(pane);}
 
-UINT OBSGetAPIVersion()                         {return 0x0101;}
+UINT OBSGetAPIVersion()                         {return OBS_API_VERSION;}
 
 UINT OBSGetSampleRateHz()                       {return API->GetSampleRateHz();}
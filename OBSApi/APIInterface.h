@@ -25,6 +25,15 @@ typedef bool (STDCALL* OBSCONFIGPROC)(XElement*, bool); //element, bInitializing
 
 typedef void (STDCALL* OBSHOTKEYPROC)(DWORD, UPARAM, bool);
 
+//the API version these headers describe, formatted 0xMMmm.  the major version changes when the layout of
+//shared classes such as List or String changes
+#define OBS_API_VERSION                 0x0200
+#define OBS_API_VERSION_MAJOR(version)  ((version) >> 8)
+
+//every plugin puts this in one of its source files so OBS can tell which headers it was built against.  plugins
+//that don't export it, or were built for a different major version, aren't loaded
+#define OBS_DECLARE_PLUGIN_API_VERSION  extern "C" __declspec(dllexport) UINT GetPluginAPIVersion() {return OBS_API_VERSION;}
+
 #define HOTKEY_SHIFT    0x1
 #define HOTKEY_CONTROL  0x2
 #define HOTKEY_ALT      0x4
@@ -311,7 +320,7 @@ BASE_EXPORT void OBSGetCurMicVolumeStats(float *rms, float *max, float *peak);
 BASE_EXPORT void OBSAddSettingsPane(SettingsPane *pane);
 BASE_EXPORT void OBSRemoveSettingsPane(SettingsPane *pane);
 
-/** gets API version.  version is formatted: 0xMMmm */
+/** gets API version of the running OBS (OBS_API_VERSION when it was built).  version is formatted: 0xMMmm */
 BASE_EXPORT UINT OBSGetAPIVersion();
 
 BASE_EXPORT UINT OBSGetSampleRateHz();
@@ -50,20 +50,235 @@ void MultiplyAudioBuffer(float *buffer, int totalFloats, float mulVal)
         buffer[i] *= mulVal;
 }
 
+inline float HorizontalSum(__m128 val)
+{
+    __m128 shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(1, 0, 3, 2));
+    val = _mm_add_ps(val, shuf);
+    shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_cvtss_f32(_mm_add_ss(val, shuf));
+}
+
+inline float HorizontalMax(__m128 val)
+{
+    __m128 shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(1, 0, 3, 2));
+    val = _mm_max_ps(val, shuf);
+    shuf = _mm_shuffle_ps(val, val, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_cvtss_f32(_mm_max_ss(val, shuf));
+}
+
+//  accumulates vertically in two sets of registers and only reduces them once at the end, so the
+//loop body is nothing but loads, multiplies, adds and maxes
+void CalculateAudioLevels(const float *buffer, UINT totalFloats, float mulVal, double &sumSquares, float &peakSquared)
+{
+    float sum = 0.0f;
+    float peak = 0.0f;
+
+    UINT alignedFloats = totalFloats & 0xFFFFFFF8;
+    if(alignedFloats)
+    {
+        __m128 sseMulVal = _mm_set_ps1(mulVal);
+        __m128 sseSum1 = _mm_setzero_ps(), sseSum2 = _mm_setzero_ps();
+        __m128 sseMax1 = _mm_setzero_ps(), sseMax2 = _mm_setzero_ps();
+
+        if((UPARAM(buffer) & 0xF) == 0)
+        {
+            for(UINT i=0; i<alignedFloats; i += 8)
+            {
+                __m128 val1 = _mm_mul_ps(_mm_load_ps(buffer+i),   sseMulVal);
+                __m128 val2 = _mm_mul_ps(_mm_load_ps(buffer+i+4), sseMulVal);
+                val1 = _mm_mul_ps(val1, val1);
+                val2 = _mm_mul_ps(val2, val2);
+
+                sseSum1 = _mm_add_ps(sseSum1, val1);
+                sseSum2 = _mm_add_ps(sseSum2, val2);
+                sseMax1 = _mm_max_ps(sseMax1, val1);
+                sseMax2 = _mm_max_ps(sseMax2, val2);
+            }
+        }
+        else
+        {
+            for(UINT i=0; i<alignedFloats; i += 8)
+            {
+                __m128 val1 = _mm_mul_ps(_mm_loadu_ps(buffer+i),   sseMulVal);
+                __m128 val2 = _mm_mul_ps(_mm_loadu_ps(buffer+i+4), sseMulVal);
+                val1 = _mm_mul_ps(val1, val1);
+                val2 = _mm_mul_ps(val2, val2);
+
+                sseSum1 = _mm_add_ps(sseSum1, val1);
+                sseSum2 = _mm_add_ps(sseSum2, val2);
+                sseMax1 = _mm_max_ps(sseMax1, val1);
+                sseMax2 = _mm_max_ps(sseMax2, val2);
+            }
+        }
+
+        sum  = HorizontalSum(_mm_add_ps(sseSum1, sseSum2));
+        peak = HorizontalMax(_mm_max_ps(sseMax1, sseMax2));
+    }
+
+    for(UINT i=alignedFloats; i<totalFloats; i++)
+    {
+        float val = buffer[i] * mulVal;
+        float pow2Val = val * val;
+        sum += pow2Val;
+        peak = max(peak, pow2Val);
+    }
+
+    sumSquares += sum;
+    if(peak > peakSquared)
+        peakSquared = peak;
+}
+
+inline float toDB(float RMS)
+{
+    float db = 20.0f * log10(RMS);
+    if(!_finite(db))
+        return VOL_MIN;
+    return db;
+}
+
+AudioLevelMeter::AudioLevelMeter()
+{
+    sequence = 0;
+    Reset();
+}
+
+void AudioLevelMeter::Reset()
+{
+    sumSquares = 0.0;
+    peakSquared = 0.0f;
+    numFloats = 0;
+
+    mag = max = peak = VOL_MIN;
+    framesSincePeakUpdate = 0;
+
+    Publish();
+}
+
+void AudioLevelMeter::Publish()
+{
+    //odd sequence means a write is in progress
+    InterlockedIncrement(&sequence);
+    publishedMag  = mag;
+    publishedMax  = max;
+    publishedPeak = peak;
+    InterlockedIncrement(&sequence);
+}
+
+void AudioLevelMeter::Update(UINT framesElapsed, UINT samplesPerSec)
+{
+    float curRMS = VOL_MIN, curMax = VOL_MIN;
+    if(numFloats)
+    {
+        curRMS = toDB(float(sqrt(sumSquares / double(numFloats))));
+        curMax = toDB(sqrt(peakSquared));
+    }
+
+    sumSquares = 0.0;
+    peakSquared = 0.0f;
+    numFloats = 0;
+
+    //----------------------------------------------------------------------------
+    // same low pass as running 0.15 every 10ms, scaled for however long it's been
+
+    float alpha = 1.0f - powf(0.85f, float(framesElapsed) / float(samplesPerSec/100));
+
+    if(curMax > max)
+        max = curMax;
+    else
+        max = alpha * curMax + (1.0f - alpha) * max;
+
+    mag = alpha * curRMS + (1.0f - alpha) * mag;
+
+    //----------------------------------------------------------------------------
+    // delayed peak meter, holds for 3 seconds
+
+    if(max > peak || framesSincePeakUpdate > samplesPerSec*3)
+    {
+        peak = max;
+        framesSincePeakUpdate = 0;
+    }
+    else
+        framesSincePeakUpdate += framesElapsed;
+
+    Publish();
+}
+
+void AudioLevelMeter::GetLevels(float *rms, float *max, float *peak) const
+{
+    LONG start;
+
+    do
+    {
+        start = sequence;
+        MemoryBarrier();
+
+        *rms  = publishedMag;
+        *max  = publishedMax;
+        *peak = publishedPeak;
+
+        MemoryBarrier();
+    } while((start & 1) || start != sequence);
+}
+
 /* astoundingly disgusting hack to get more variables into the class without breaking API */
 struct NotAResampler
 {
     SRC_STATE *resampler;
     QWORD     jumpRange;
+
+    AudioLevelMeter levelMeter;
+
+    UINT      storedFloats;
+
+    bool      bDriftEngaged;
+    double    driftError;       //low passed difference between device time and segment time, in ms
+    double    driftIntegral;
+    double    driftCorrection;  //multiplied with the resample ratio
+    double    driftLogTime;
 };
 
 #define MoreVariables static_cast<NotAResampler*>(resampler)
 
+//-----------------------------------------
+// clock drift compensation
+//
+//  rather than snapping the timestamps when a device's clock has drifted too far from the system clock,
+//a PI controller continuously nudges the resample ratio so the device's audio stays on time.  device
+//timestamps jitter by a few ms, so the error is low passed over about a second first.
+
+#define DRIFT_ERROR_ALPHA       0.01
+#define DRIFT_KP                0.02        //ratio change per second of error
+#define DRIFT_KI                0.0001      //ratio change per second of error, per second
+#define DRIFT_MAX_CORRECTION    0.002       //2000ppm, well below anything audible
+#define DRIFT_ENGAGE_MS         3.0
+#define DRIFT_LOG_INTERVAL      300.0       //seconds
+
+static void UpdateDriftCompensation(NotAResampler *vars, double error, double elapsedTime)
+{
+    vars->driftError += DRIFT_ERROR_ALPHA * (error - vars->driftError);
+
+    if (!vars->bDriftEngaged)
+        return;
+
+    double errorSec = vars->driftError * 0.001;
+
+    //clamp the integral so it can't wind up past what the correction can actually do
+    const double maxIntegral = DRIFT_MAX_CORRECTION / DRIFT_KI;
+    vars->driftIntegral += errorSec * elapsedTime;
+    vars->driftIntegral = MIN(MAX(vars->driftIntegral, -maxIntegral), maxIntegral);
+
+    double correction = DRIFT_KP * errorSec + DRIFT_KI * vars->driftIntegral;
+    correction = MIN(MAX(correction, -DRIFT_MAX_CORRECTION), DRIFT_MAX_CORRECTION);
+
+    vars->driftCorrection = 1.0 + correction;
+}
+
 AudioSource::AudioSource()
 {
     sourceVolume = 1.0f;
     resampler = (void*)new NotAResampler;
     MoreVariables->jumpRange = 70;
+    MoreVariables->driftCorrection = 1.0;
 }
 
 AudioSource::~AudioSource()
@@ -102,11 +317,23 @@ void AudioSource::InitAudioData(bool bFloat, UINT channels, UINT samplesPerSec,
 
     UINT sampleRateHz = OBSGetSampleRateHz();
 
+    if(bResample)
+    {
+        src_delete(MoreVariables->resampler);
+        MoreVariables->resampler = NULL;
+        bResample = false;
+    }
+
+    MoreVariables->storedFloats = 0;
+    MoreVariables->bDriftEngaged = false;
+    MoreVariables->driftError = MoreVariables->driftIntegral = 0.0;
+    MoreVariables->driftCorrection = 1.0;
+
     if(inputSamplesPerSec != sampleRateHz)
     {
         int errVal;
 
-        int converterType = SRC_SINC_FASTEST;
+        int converterType = SRC_SINC_FASTEST_POLYPHASE;
         MoreVariables->resampler = src_new(converterType, 2, &errVal);
         if(!MoreVariables->resampler)
             CrashError(TEXT("AudioSource::InitAudioData: Could not initiate resampler"));
@@ -206,7 +433,17 @@ void AudioSource::AddAudioSegment(AudioSegment *newSegment, float curVolume)
     }
 
     if (newSegment)
+    {
+        //segment is still hot in the cache here, so measure it for the level meters now
+        List<float> &data = newSegment->audioData;
+        double sumSquares = 0.0;
+        float peakSquared = 0.0f;
+
+        CalculateAudioLevels(data.Array(), data.Num(), 1.0f, sumSquares, peakSquared);
+        MoreVariables->levelMeter.Accumulate(sumSquares, peakSquared, data.Num());
+
         audioSegments << newSegment;
+    }
 }
 
 //  Used to sort sort audio in case from back->front in case of burst (this shouldn't be
@@ -601,23 +838,78 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
         ReleaseBuffer();
 
         //------------------------------------------------------------
-        // resample
+        // clock drift estimation
+
+        UINT sampleRateHz = OBSGetSampleRateHz();
+        UINT segmentFloats = sampleRateHz/100*2;
+        UINT storedFloats = MoreVariables->storedFloats;
+
+        if (lastUsedTimestamp)
+        {
+            //time the first sample of this buffer would get on our timeline, compared with what the device says
+            double expectedTime = double(lastUsedTimestamp+10) + double(storedFloats/2)*1000.0/double(sampleRateHz);
+            double driftDif = double(newTimestamp) - expectedTime;
+
+            if (fabs(driftDif) > double(MoreVariables->jumpRange))
+            {
+                //an actual discontinuity rather than drift, so just snap to the new time
+                lastUsedTimestamp = newTimestamp - 10 - QWORD(double(storedFloats/2)*1000.0/double(sampleRateHz));
+                MoreVariables->driftError = 0.0;
+            }
+            else
+                UpdateDriftCompensation(MoreVariables, driftDif, double(numAudioFrames)/double(inputSamplesPerSec));
+
+            //small errors are just jitter, so don't touch anything until the device has actually drifted.
+            //sources already at the output rate only get a resampler at that point
+            if (!MoreVariables->bDriftEngaged && fabs(MoreVariables->driftError) >= DRIFT_ENGAGE_MS)
+            {
+                if (!bResample)
+                {
+                    int errVal;
+                    MoreVariables->resampler = src_new(SRC_SINC_FASTEST, 2, &errVal);
+                    if (MoreVariables->resampler)
+                    {
+                        resampleRatio = double(sampleRateHz) / double(inputSamplesPerSec);
+                        bResample = true;
+                    }
+                }
+
+                if (bResample)
+                {
+                    Log(TEXT("Audio device '%s' has drifted by %.1f ms, starting clock drift compensation"), GetDeviceName(), MoreVariables->driftError);
+                    MoreVariables->bDriftEngaged = true;
+                }
+            }
+
+            MoreVariables->driftLogTime += double(numAudioFrames)/double(inputSamplesPerSec);
+            if (MoreVariables->bDriftEngaged && MoreVariables->driftLogTime >= DRIFT_LOG_INTERVAL)
+            {
+                Log(TEXT("Audio device '%s' clock drift: %+.1f ppm, timing error %.1f ms"), GetDeviceName(),
+                    (MoreVariables->driftCorrection-1.0)*1000000.0, MoreVariables->driftError);
+                MoreVariables->driftLogTime = 0.0;
+            }
+        }
+
+        //------------------------------------------------------------
+        // resample into the storage buffer
 
         if(bResample)
         {
-            UINT frameAdjust = UINT((double(numAudioFrames) * resampleRatio) + 1.0);
+            double ratio = resampleRatio*MoreVariables->driftCorrection;
+
+            UINT frameAdjust = UINT((double(numAudioFrames) * ratio) + 2.0);
             UINT newFrameSize = frameAdjust*2;
 
-            if(tempResampleBuffer.Num() < newFrameSize)
-                tempResampleBuffer.SetSize(newFrameSize);
+            if(storageBuffer.Num() < storedFloats+newFrameSize)
+                storageBuffer.SetSize(storedFloats+newFrameSize);
 
             SRC_DATA data;
-            data.src_ratio = resampleRatio;
+            data.src_ratio = ratio;
 
             data.data_in = tempBuffer.Array();
             data.input_frames = numAudioFrames;
 
-            data.data_out = tempResampleBuffer.Array();
+            data.data_out = storageBuffer.Array()+storedFloats;
             data.output_frames = frameAdjust;
 
             data.end_of_input = 0;
@@ -635,49 +927,50 @@ UINT AudioSource::QueryAudio2(float curVolume, bool bCanBurstHack)
                 return NoAudioAvailable;
             }
 
-            numAudioFrames = data.output_frames_gen;
+            storedFloats += data.output_frames_gen*2;
+        }
+        else
+        {
+            if(storageBuffer.Num() < storedFloats+numAudioFrames*2)
+                storageBuffer.SetSize(storedFloats+numAudioFrames*2);
+
+            mcpy(storageBuffer.Array()+storedFloats, tempBuffer.Array(), numAudioFrames*2*sizeof(float));
+            storedFloats += numAudioFrames*2;
         }
 
         //------------------------------------------------------
-        // timestamp smoothing (keep audio within 70ms of target time)
+        // cut the stored audio into exact 10ms segments.  the resampled size varies by a frame or
+        // so with drift compensation, so the remainder just carries over to the next buffer
 
-        if (!lastUsedTimestamp)
-            lastUsedTimestamp = newTimestamp;
-        else
-            lastUsedTimestamp += 10;
-
-        QWORD difVal = GetQWDif(newTimestamp, lastUsedTimestamp);
-
-        if (difVal > MoreVariables->jumpRange /*|| (bCanBurstHack && newTimestamp < lastUsedTimestamp)*/) {
-            /*QWORD curTimeMS = App->GetVideoTime()-App->GetSceneTimestamp();
-            UINT curTimeTotalSec = (UINT)(curTimeMS/1000);
-            UINT curTimeTotalMin = curTimeTotalSec/60;
-            UINT curTimeHr  = curTimeTotalMin/60;
-            UINT curTimeMin = curTimeTotalMin-(curTimeHr*60);
-            UINT curTimeSec = curTimeTotalSec-(curTimeTotalMin*60);
-
-            Log(TEXT("A timestamp adjustment was encountered for device %s, approximate stream time is: %u:%u:%u, prev value: %llu, new value: %llu"), GetDeviceName(), curTimeHr, curTimeMin, curTimeSec, lastUsedTimestamp, newTimestamp);*/
-            //if (difVal >= 70)
-            //    Log(TEXT("A timestamp adjustment was encountered for device %s, diffVal: %llu, jumpRange: %llu, newTimestamp: %llu, lastUsedTimestamp: %llu"),
-            //    GetDeviceName(), difVal, MoreVariables->jumpRange, newTimestamp, lastUsedTimestamp);
-            lastUsedTimestamp = newTimestamp;
-        }
+        UINT usedFloats = 0;
 
-        //if (sstri(GetDeviceName(), L"avermedia") != NULL)
-        //    Log(L"newTimestamp: %llu, lastUsedTimestamp: %llu", newTimestamp, lastUsedTimestamp);
+        while ((storedFloats-usedFloats) >= segmentFloats)
+        {
+            if (!lastUsedTimestamp)
+                lastUsedTimestamp = newTimestamp;
+            else
+                lastUsedTimestamp += 10;
 
-        //-----------------------------------------------------------------------------
+            bool overshotAudio = (lastUsedTimestamp < lastSentTimestamp+10);
+            if (bCanBurstHack || !overshotAudio)
+            {
+                AudioSegment *newSegment = new AudioSegment(storageBuffer.Array()+usedFloats, segmentFloats, lastUsedTimestamp);
+                AddAudioSegment(newSegment, curVolume*sourceVolume);
+                lastSentTimestamp = lastUsedTimestamp;
+            }
 
-        float *newBuffer = (bResample) ? tempResampleBuffer.Array() : tempBuffer.Array();
+            usedFloats += segmentFloats;
+        }
 
-        bool overshotAudio = (lastUsedTimestamp < lastSentTimestamp+10);
-        if (bCanBurstHack || !overshotAudio)
+        if (usedFloats)
         {
-            AudioSegment *newSegment = new AudioSegment(newBuffer, numAudioFrames*2, lastUsedTimestamp);
-            AddAudioSegment(newSegment, curVolume*sourceVolume);
-            lastSentTimestamp = lastUsedTimestamp;
+            storedFloats -= usedFloats;
+            if (storedFloats)
+                mcpy(storageBuffer.Array(), storageBuffer.Array()+usedFloats, storedFloats*sizeof(float));
         }
 
+        MoreVariables->storedFloats = storedFloats;
+
         //-----------------------------------------------------------------------------
 
         return AudioAvailable;
@@ -819,3 +1112,6 @@ void AudioSource::AddAudioFilter(AudioFilter *filter) {audioFilters << filter;}
 void AudioSource::InsertAudioFilter(UINT pos, AudioFilter *filter) {audioFilters.Insert(pos, filter);}
 void AudioSource::RemoveAudioFilter(AudioFilter *filter) {audioFilters.RemoveItem(filter);}
 void AudioSource::RemoveAudioFilter(UINT id) {if(audioFilters.Num() > id) audioFilters.Remove(id);}
+
+AudioLevelMeter& AudioSource::GetLevelMeter() {return MoreVariables->levelMeter;}
+void AudioSource::GetVolumeLevels(float *rms, float *max, float *peak) const {MoreVariables->levelMeter.GetLevels(rms, max, peak);}
@@ -26,6 +26,54 @@ enum
     AudioAvailable,
 };
 
+//-----------------------------------------
+// vertical SSE kernel, returns the sum of squares and the largest squared sample
+
+BASE_EXPORT void CalculateAudioLevels(const float *buffer, UINT totalFloats, float mulVal, double &sumSquares, float &peakSquared);
+
+//-----------------------------------------
+// volume level metering.  raw sums are accumulated by the audio thread between
+// meter updates, and Update() converts them to dB and publishes the result
+// through a sequence counter so any thread can read it without locking
+
+class BASE_EXPORT AudioLevelMeter
+{
+    double sumSquares;
+    float  peakSquared;
+    UINT   numFloats;
+
+    float  mag, max, peak;
+    UINT   framesSincePeakUpdate;
+
+    volatile LONG sequence;
+    float  publishedMag, publishedMax, publishedPeak;
+
+    void Publish();
+
+public:
+    AudioLevelMeter();
+
+    void Reset();
+
+    inline void Accumulate(double sum, float peakSq, UINT floats)
+    {
+        sumSquares += sum;
+        if (peakSq > peakSquared)
+            peakSquared = peakSq;
+        numFloats += floats;
+    }
+
+    inline void Accumulate(const AudioLevelMeter &meter)
+    {
+        Accumulate(meter.sumSquares, meter.peakSquared, meter.numFloats);
+    }
+
+    void Update(UINT framesElapsed, UINT samplesPerSec);
+    void GetLevels(float *rms, float *max, float *peak) const;
+};
+
+//-----------------------------------------
+
 struct AudioSegment
 {
     List<float> audioData;
@@ -143,5 +191,8 @@ public:
     UINT QueryAudio2(float curVolume, bool bCanBurst=false);
 
     CTSTR GetDeviceName2() const {return GetDeviceName();}
+
+    AudioLevelMeter& GetLevelMeter();
+    void GetVolumeLevels(float *rms, float *max, float *peak) const;
 };
 
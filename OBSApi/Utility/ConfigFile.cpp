@@ -32,6 +32,27 @@
     Config
 ===========================================================*/
 
+//case is folded the same way scmpi does it, so anything scmpi matches hashes the same
+static inline UINT HashConfigName(UINT hash, CTSTR lpName)
+{
+    TCHAR ch;
+    while(ch = *(lpName++))
+    {
+        if((ch >= 'A') && (ch <= 'Z'))
+            ch += 0x20;
+        hash = (hash ^ UINT(ch)) * 16777619;
+    }
+
+    return hash;
+}
+
+static inline UINT HashConfigKey(CTSTR lpSection, CTSTR lpKey)
+{
+    UINT hash = HashConfigName(2166136261, lpSection);
+    hash = (hash ^ UINT(']')) * 16777619;
+    return HashConfigName(hash, lpKey);
+}
+
 BOOL ConfigFile::Create(CTSTR lpConfigFile)
 {
     strFileName = lpConfigFile;
@@ -146,6 +167,73 @@ void ConfigFile::LoadData()
 
         *lpNextLine = '\r';
     }
+
+    BuildKeyIndex();
+}
+
+//keys can repeat across sections with the same name, the first one in the file is the one that's indexed
+void ConfigFile::BuildKeyIndex()
+{
+    UINT numKeys = 0;
+    for(UINT i=0; i<Sections.Num(); i++)
+        numKeys += Sections[i].Keys.Num();
+
+    UINT indexSize = 16;
+    while(indexSize < numKeys*2)
+        indexSize <<= 1;
+
+    KeyIndex.Clear();
+    KeyIndex.SetSize(indexSize);
+
+    for(UINT i=0; i<Sections.Num(); i++)
+    {
+        ConfigSection &section = Sections[i];
+
+        for(UINT j=0; j<section.Keys.Num(); j++)
+        {
+            ConfigKey &key = section.Keys[j];
+            UINT hash = HashConfigKey(section.name, key.name);
+            UINT pos = hash & (indexSize-1);
+
+            while(KeyIndex[pos].key)
+            {
+                ConfigKeyIndex &entry = KeyIndex[pos];
+                if(entry.hash == hash && scmpi(entry.section->name, section.name) == 0 && scmpi(entry.key->name, key.name) == 0)
+                    break;
+
+                pos = (pos+1) & (indexSize-1);
+            }
+
+            ConfigKeyIndex &entry = KeyIndex[pos];
+            if(!entry.key)
+            {
+                entry.hash = hash;
+                entry.section = &section;
+                entry.key = &key;
+            }
+        }
+    }
+}
+
+ConfigKey* ConfigFile::FindKey(CTSTR lpSection, CTSTR lpKey)
+{
+    assert(lpSection);
+    assert(lpKey);
+
+    if(!KeyIndex.Num())
+        return NULL;
+
+    UINT indexMask = KeyIndex.Num()-1;
+    UINT hash = HashConfigKey(lpSection, lpKey);
+
+    for(UINT pos = hash & indexMask; KeyIndex[pos].key; pos = (pos+1) & indexMask)
+    {
+        ConfigKeyIndex &entry = KeyIndex[pos];
+        if(entry.hash == hash && scmpi(lpSection, entry.section->name) == 0 && scmpi(lpKey, entry.key->name) == 0)
+            return entry.key;
+    }
+
+    return NULL;
 }
 
 void ConfigFile::Close()
@@ -170,6 +258,7 @@ void ConfigFile::Close()
         section.Keys.Clear();
     }
     Sections.Clear();
+    KeyIndex.Clear();
 
     if(lpFileData)
     {
@@ -199,24 +288,9 @@ void ConfigFile::SetFilePath(CTSTR lpPath)
 
 String ConfigFile::GetString(CTSTR lpSection, CTSTR lpKey, CTSTR def)
 {
-    assert(lpSection);
-    assert(lpKey);
-
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return String(key.ValueList[0]);
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return String(key->ValueList[0]);
 
     if(def)
         return String(def);
@@ -226,24 +300,9 @@ String ConfigFile::GetString(CTSTR lpSection, CTSTR lpKey, CTSTR def)
 
 CTSTR ConfigFile::GetStringPtr(CTSTR lpSection, CTSTR lpKey, CTSTR def)
 {
-    assert(lpSection);
-    assert(lpKey);
-
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return key.ValueList[0];
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return key->ValueList[0];
 
     if(def)
         return def;
@@ -251,34 +310,50 @@ CTSTR ConfigFile::GetStringPtr(CTSTR lpSection, CTSTR lpKey, CTSTR def)
         return NULL;
 }
 
+static BOOL GetCachedInt(ConfigKey *key)
+{
+    //a lost race here only means the value gets parsed again
+    if(!(key->cachedTypes & CONFIG_CACHED_INT))
+    {
+        CTSTR lpValue = key->ValueList[0];
+
+        key->bValidInt = TRUE;
+        if(scmpi(lpValue, TEXT("true")) == 0)
+            key->intValue = 1;
+        else if(scmpi(lpValue, TEXT("false")) == 0)
+            key->intValue = 0;
+        else if(ValidIntString(lpValue))
+            key->intValue = tstring_base_to_int(lpValue, NULL, 0);
+        else
+            key->bValidInt = FALSE;
+
+        key->cachedTypes |= CONFIG_CACHED_INT;
+    }
+
+    return key->bValidInt;
+}
+
 int ConfigFile::GetInt(CTSTR lpSection, CTSTR lpKey, int def)
 {
-    assert(lpSection);
-    assert(lpKey);
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return def;
 
-    DWORD i,j;
+    if(GetCachedInt(key))
+        return key->intValue;
 
-    for(i=0; i<Sections.Num(); i++)
+    //if the first key isn't a valid int, the same key in a later section of the same name is used instead
+    for(UINT i=0; i<Sections.Num(); i++)
     {
         ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
+        if(scmpi(lpSection, section.name) != 0)
+            continue;
+
+        for(UINT j=0; j<section.Keys.Num(); j++)
         {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    if(scmpi(key.ValueList[0], TEXT("true")) == 0)
-                        return 1;
-                    else if(scmpi(key.ValueList[0], TEXT("false")) == 0)
-                        return 0;
-                    else
-                    {
-                        if(ValidIntString(key.ValueList[0]))
-                            return tstring_base_to_int(key.ValueList[0], NULL, 0);
-                    }
-                }
-            }
+            ConfigKey &laterKey = section.Keys[j];
+            if(&laterKey != key && scmpi(lpKey, laterKey.name) == 0 && GetCachedInt(&laterKey))
+                return laterKey.intValue;
         }
     }
 
@@ -287,123 +362,105 @@ int ConfigFile::GetInt(CTSTR lpSection, CTSTR lpKey, int def)
 
 DWORD ConfigFile::GetHex(CTSTR lpSection, CTSTR lpKey, DWORD def)
 {
-    assert(lpSection);
-    assert(lpKey);
-
-    DWORD i,j;
-
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return tstring_base_to_int(key.ValueList[0], NULL, 0);
-            }
-        }
-    }
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(key)
+        return tstring_base_to_int(key->ValueList[0], NULL, 0);
 
     return def;
 }
 
 float ConfigFile::GetFloat(CTSTR lpSection, CTSTR lpKey, float def)
 {
-    assert(lpSection);
-    assert(lpKey);
-
-    DWORD i,j;
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return def;
 
-    for(i=0; i<Sections.Num(); i++)
+    if(!(key->cachedTypes & CONFIG_CACHED_FLOAT))
     {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
-        {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                    return (float)tstof(key.ValueList[0]);
-            }
-        }
+        key->floatValue = (float)tstof(key->ValueList[0]);
+        key->cachedTypes |= CONFIG_CACHED_FLOAT;
     }
 
-    return def;
+    return key->floatValue;
 }
 
-Color4 ConfigFile::GetColor(CTSTR lpSection, CTSTR lpKey)
+static BOOL ParseColor(CTSTR lpValue, Color4 &ret)
 {
-    assert(lpSection);
-    assert(lpKey);
+    CTSTR strValue = lpValue;
+    if(*strValue == '{')
+    {
+        ret.x = float(tstof(++strValue));
 
-    DWORD i,j;
+        if(!(strValue = schr(strValue, ',')))
+            return FALSE;
+        ret.y = float(tstof(++strValue));
 
-    for(i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(lpSection, section.name) == 0)
+        if(!(strValue = schr(strValue, ',')))
+            return FALSE;
+        ret.z = float(tstof(++strValue));
+
+        if(!(strValue = schr(strValue, ',')))
         {
-            for(j=0; j<section.Keys.Num(); j++)
-            {
-                ConfigKey &key = section.Keys[j];
-                if(scmpi(lpKey, key.name) == 0)
-                {
-                    TSTR strValue = key.ValueList[0];
-                    if(*strValue == '{')
-                    {
-                        Color4 ret;
+            ret.w = 1.0f;
+            return TRUE;
+        }
+        ret.w = float(tstof(++strValue));
 
-                        ret.x = float(tstof(++strValue));
+        return TRUE;
+    }
+    else if(*strValue == '[')
+    {
+        ret.x = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.y = float(tstof(++strValue));
+        if(!(strValue = schr(strValue, ',')))
+            return FALSE;
+        ret.y = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.z = float(tstof(++strValue));
+        if(!(strValue = schr(strValue, ',')))
+            return FALSE;
+        ret.z = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        if(!(strValue = schr(strValue, ',')))
-                        {
-                            ret.w = 1.0f;
-                            return ret;
-                        }
-                        ret.w = float(tstof(++strValue));
+        if(!(strValue = schr(strValue, ',')))
+        {
+            ret.w = 1.0f;
+            return TRUE;
+        }
+        ret.w = (float(tstoi(++strValue))/255.0f)+0.001f;
 
-                        return ret;
-                    }
-                    else if(*strValue == '[')
-                    {
-                        Color4 ret;
+        return TRUE;
+    }
+    else if( (*LPWORD(strValue) == 'x0') ||
+        (*LPWORD(strValue) == 'X0') )
+    {
+        ret = RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
+        return TRUE;
+    }
 
-                        ret.x = (float(tstoi(++strValue))/255.0f)+0.001f;
+    return FALSE;
+}
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.y = (float(tstoi(++strValue))/255.0f)+0.001f;
+Color4 ConfigFile::GetColor(CTSTR lpSection, CTSTR lpKey)
+{
+    ConfigKey *key = FindKey(lpSection, lpKey);
+    if(!key)
+        return Color4(0.0f, 0.0f, 0.0f, 0.0f);
 
-                        if(!(strValue = schr(strValue, ',')))
-                            break;
-                        ret.z = (float(tstoi(++strValue))/255.0f)+0.001f;
+    Color4 ret;
+    if(ParseColor(key->ValueList[0], ret))
+        return ret;
 
-                        if(!(strValue = schr(strValue, ',')))
-                        {
-                            ret.w = 1.0f;
-                            return ret;
-                        }
-                        ret.w = (float(tstoi(++strValue))/255.0f)+0.001f;
+    //like GetInt, a key that isn't a color falls through to the same key in a later section of the same name
+    for(UINT i=0; i<Sections.Num(); i++)
+    {
+        ConfigSection &section = Sections[i];
+        if(scmpi(lpSection, section.name) != 0)
+            continue;
 
-                        return ret;
-                    }
-                    else if( (*LPWORD(strValue) == 'x0') ||
-                        (*LPWORD(strValue) == 'X0') )
-                    {
-                        return RGBA_to_Vect4(tstring_base_to_int(strValue+2, NULL, 16));
-                    }
-                }
-            }
+        for(UINT j=0; j<section.Keys.Num(); j++)
+        {
+            ConfigKey &laterKey = section.Keys[j];
+            if(&laterKey != key && scmpi(lpKey, laterKey.name) == 0 && ParseColor(laterKey.ValueList[0], ret))
+                return ret;
         }
     }
 
@@ -728,20 +785,7 @@ void ConfigFile::SetColorList(CTSTR lpSection, CTSTR lpKey, List<Color4> &ColorL
 
 BOOL  ConfigFile::HasKey(CTSTR lpSection, CTSTR lpKey)
 {
-    for(unsigned int i=0; i<Sections.Num(); i++)
-    {
-        ConfigSection &section = Sections[i];
-        if(scmpi(section.name, lpSection) == 0)
-        {
-            for(unsigned int j=0; j<section.Keys.Num(); j++)
-            {
-                if(scmpi(section.Keys[j].name, lpKey) == 0)
-                    return TRUE;
-            }
-        }
-    }
-
-    return FALSE;
+    return FindKey(lpSection, lpKey) != NULL;
 }
 
 
@@ -23,10 +23,19 @@
     Config
 ===========================================================*/
 
+#define CONFIG_CACHED_INT     1
+#define CONFIG_CACHED_FLOAT   2
+
 struct ConfigKey
 {
     TSTR name;
     List<TSTR> ValueList;
+
+    //parsed values of the first value, filled in by the getters.  keys are rebuilt whenever the file changes
+    volatile UINT cachedTypes;
+    BOOL bValidInt;
+    int intValue;
+    float floatValue;
 };
 
 struct ConfigSection
@@ -35,6 +44,13 @@ struct ConfigSection
     List<ConfigKey> Keys;
 };
 
+struct ConfigKeyIndex
+{
+    UINT hash;
+    ConfigSection *section;
+    ConfigKey *key;
+};
+
 
 class BASE_EXPORT ConfigFile
 {
@@ -99,7 +115,11 @@ private:
     void  SetKey(CTSTR lpSection, CTSTR lpKey, CTSTR newvalue);
     void  AddKey(CTSTR lpSection, CTSTR lpKey, CTSTR newvalue);
 
+    void  BuildKeyIndex();
+    ConfigKey* FindKey(CTSTR lpSection, CTSTR lpKey);
+
     List<ConfigSection> Sections;
+    List<ConfigKeyIndex> KeyIndex;
 
     BOOL  bOpen;
     String strFileName;
@@ -50,6 +50,26 @@ struct MemInfo
     size_t minBlockSize;
     size_t maxBlockSize;
     DWORD maxBlocks;
+    DWORD maxCached;        //most blocks of this size a thread holds on to before giving half back
+};
+
+//blocks sitting in a thread cache are still counted as used by their pool, they're
+//only handed back to the pools in batches so the mutex is taken once per batch
+struct CachedBlock
+{
+    CachedBlock *next;
+};
+
+struct FastAllocThreadCache
+{
+    FastAlloc   *allocator;
+    CachedBlock *freeBlocks[12];
+    DWORD       numFree[12];
+
+    //allocation profiling
+    FastAllocThreadCache *prev, *next;
+    QWORD       numAllocs[12], numFrees[12];
+    DWORD       sampleCountdown;
 };
 
 MemInfo MemInfoList[12],*SizeToMemInfo[0x8001];
@@ -62,6 +82,200 @@ Pool *PoolList[256];
 
 void STDCALL OpenLogFile();
 
+//-----------------------------------------
+//allocation profiling
+//  allocations are always counted per size class in the thread caches.  when profiling is enabled, one in
+//  every ALLOC_SAMPLE_RATE allocations on a thread is also recorded with its call site and allocation tag,
+//  and kept track of until it's freed so there's an estimate of the bytes each of them has in use
+
+#define ALLOC_SAMPLE_RATE       64
+#define MAX_ALLOC_SITES         0x400   //must be a power of two
+#define MAX_ALLOC_TAGS          64
+#define MAX_ALLOC_SAMPLES       0x4000  //must be a power of two
+#define ALLOC_SAMPLE_FILTER     0x40000
+
+struct AllocSite
+{
+    LPVOID address;
+    QWORD numAllocs, bytesAllocated, liveBytes;
+    QWORD lastNumAllocs, lastBytesAllocated;
+};
+
+struct AllocTagInfo
+{
+    CTSTR lpName;
+    QWORD bytesAllocated, liveBytes;
+};
+
+struct AllocSample
+{
+    LPVOID lpMemory;
+    size_t size;
+    UINT site, tag;
+};
+
+static BOOL                     bAllocProfiling = FALSE;
+static HANDLE                   hAllocProfileMutex = NULL;
+
+static FastAllocThreadCache     *firstThreadCache = NULL;
+static QWORD                    retiredAllocs[12], retiredFrees[12];
+static QWORD                    numLargeAllocs, numLargeFrees, largeBytesInUse;
+
+static AllocSite                allocSites[MAX_ALLOC_SITES];
+static UINT                     numAllocSites;
+static AllocTagInfo             allocTags[MAX_ALLOC_TAGS];
+static UINT                     numAllocTags;
+static AllocSample              allocSamples[MAX_ALLOC_SAMPLES];
+static UINT                     numAllocSamples;
+static QWORD                    lastTopAllocatorsTime;
+
+//how many live samples fall on each slot, so frees can skip the lock for anything that was never sampled
+static BYTE                     allocSampleFilter[ALLOC_SAMPLE_FILTER];
+
+static __declspec(thread) CTSTR curAllocationTag = NULL;
+
+inline UINT HashAllocPointer(LPVOID lpPointer)
+{
+    UPARAM val = UPARAM(lpPointer)>>4;
+    return UINT(val ^ (val>>15));
+}
+
+static UINT GetAllocSite(LPVOID address)
+{
+    UINT i = HashAllocPointer(address) & (MAX_ALLOC_SITES-1);
+    while(allocSites[i].address && allocSites[i].address != address)
+        i = (i+1) & (MAX_ALLOC_SITES-1);
+
+    if(!allocSites[i].address)
+    {
+        //keep the last slot free so lookups always end
+        if(numAllocSites == MAX_ALLOC_SITES-1)
+            return INVALID;
+
+        allocSites[i].address = address;
+        ++numAllocSites;
+    }
+
+    return i;
+}
+
+static UINT GetAllocTag(CTSTR lpName)
+{
+    for(UINT i=0; i<numAllocTags; i++)
+    {
+        if(allocTags[i].lpName == lpName)
+            return i;
+    }
+
+    if(numAllocTags == MAX_ALLOC_TAGS)
+        return INVALID;
+
+    allocTags[numAllocTags].lpName = lpName;
+    return numAllocTags++;
+}
+
+static void RecordAllocSample(LPVOID lpMemory, size_t size, LPVOID lpCaller)
+{
+    OSEnterMutex(hAllocProfileMutex);
+
+    if(bAllocProfiling)
+    {
+        UINT site = GetAllocSite(lpCaller);
+        UINT tag = GetAllocTag(curAllocationTag);
+
+        if(site != INVALID)
+        {
+            ++allocSites[site].numAllocs;
+            allocSites[site].bytesAllocated += size;
+        }
+        if(tag != INVALID)
+            allocTags[tag].bytesAllocated += size;
+
+        if(numAllocSamples < MAX_ALLOC_SAMPLES*3/4)
+        {
+            UINT i = HashAllocPointer(lpMemory) & (MAX_ALLOC_SAMPLES-1);
+            while(allocSamples[i].lpMemory)
+                i = (i+1) & (MAX_ALLOC_SAMPLES-1);
+
+            allocSamples[i].lpMemory = lpMemory;
+            allocSamples[i].size = size;
+            allocSamples[i].site = site;
+            allocSamples[i].tag = tag;
+            ++numAllocSamples;
+
+            if(site != INVALID)
+                allocSites[site].liveBytes += size;
+            if(tag != INVALID)
+                allocTags[tag].liveBytes += size;
+
+            BYTE &filter = allocSampleFilter[HashAllocPointer(lpMemory) & (ALLOC_SAMPLE_FILTER-1)];
+            if(filter != 0xFF)
+                ++filter;
+        }
+    }
+
+    OSLeaveMutex(hAllocProfileMutex);
+}
+
+static void RemoveAllocSample(LPVOID lpMemory)
+{
+    OSEnterMutex(hAllocProfileMutex);
+
+    UINT i = HashAllocPointer(lpMemory) & (MAX_ALLOC_SAMPLES-1);
+    while(allocSamples[i].lpMemory && allocSamples[i].lpMemory != lpMemory)
+        i = (i+1) & (MAX_ALLOC_SAMPLES-1);
+
+    if(allocSamples[i].lpMemory)
+    {
+        AllocSample &sample = allocSamples[i];
+        if(sample.site != INVALID)
+            allocSites[sample.site].liveBytes -= sample.size;
+        if(sample.tag != INVALID)
+            allocTags[sample.tag].liveBytes -= sample.size;
+
+        BYTE &filter = allocSampleFilter[HashAllocPointer(lpMemory) & (ALLOC_SAMPLE_FILTER-1)];
+        if(filter != 0xFF)
+            --filter;
+
+        //shift back anything after it that probed past this slot
+        UINT j = i;
+        for(;;)
+        {
+            j = (j+1) & (MAX_ALLOC_SAMPLES-1);
+            if(!allocSamples[j].lpMemory)
+                break;
+
+            UINT home = HashAllocPointer(allocSamples[j].lpMemory) & (MAX_ALLOC_SAMPLES-1);
+            bool bMove = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+            if(bMove)
+            {
+                allocSamples[i] = allocSamples[j];
+                i = j;
+            }
+        }
+
+        allocSamples[i].lpMemory = NULL;
+        --numAllocSamples;
+    }
+
+    OSLeaveMutex(hAllocProfileMutex);
+}
+
+inline void CheckAllocSample(LPVOID lpMemory, size_t size, LPVOID lpCaller, FastAllocThreadCache *cache)
+{
+    if(bAllocProfiling && cache && !cache->sampleCountdown--)
+    {
+        cache->sampleCountdown = ALLOC_SAMPLE_RATE-1;
+        RecordAllocSample(lpMemory, size, lpCaller);
+    }
+}
+
+inline void CheckFreeSample(LPVOID lpMemory)
+{
+    if(bAllocProfiling && allocSampleFilter[HashAllocPointer(lpMemory) & (ALLOC_SAMPLE_FILTER-1)])
+        RemoveAllocSample(lpMemory);
+}
+
 
 FastAlloc::FastAlloc()
 {
@@ -76,6 +290,7 @@ FastAlloc::FastAlloc()
         MemInfoList[i].maxBlockSize = to-1;
         MemInfoList[i].minBlockSize = from;
         MemInfoList[i].maxBlocks = 0x10000/(DWORD)MemInfoList[i].maxBlockSize;
+        MemInfoList[i].maxCached = MAX(1, MIN(MemInfoList[i].maxBlocks/2, 64));
         MemInfoList[i].nextFree = NULL;
 
         for(DWORD j=from; j<to; j++)
@@ -85,12 +300,21 @@ FastAlloc::FastAlloc()
     }
 
     hAllocationMutex = OSCreateMutex();
+    if(!hAllocProfileMutex)
+        hAllocProfileMutex = OSCreateMutex();
+    threadCacheStorage = OSCreateThreadStorage((XTHREADSTORAGEFREE)FreeThreadCache);
 }
 
 FastAlloc::~FastAlloc()
 {
+    //gives every thread's cached blocks back to the pools, so they don't show up as leaks below
+    OSCloseThreadStorage(threadCacheStorage);
     OSCloseMutex(hAllocationMutex);
 
+    bAllocProfiling = FALSE;
+    OSCloseMutex(hAllocProfileMutex);
+    hAllocProfileMutex = NULL;
+
     Pool *pool;
     BOOL bHasLeaks = 0;
 
@@ -137,99 +361,302 @@ void   FastAlloc::ErrorTermination()
     }
 }
 
-void * __restrict FastAlloc::_Allocate(size_t dwSize)
-{
-    OSEnterMutex(hAllocationMutex);
-
-    //assert(dwSize);
-    if(!dwSize) dwSize = 1;
+//-----------------------------------------
+//pool functions, the allocation mutex must be held for these
 
+static LPVOID AllocatePoolBlock(MemInfo *meminfo)
+{
     LPVOID lpMemory;
     Pool *pool;
 
-    if(dwSize < 0x8001)
+    if(!meminfo->nextFree) //no pools have been created for this section
     {
-        MemInfo *meminfo = GetMemInfo(dwSize);
+        lpMemory = OSVirtualAlloc(0x10000);
+        if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), meminfo->maxBlockSize, ReturnAddress());
+
+        Pool *&poollist = PoolList[PtrTo32(lpMemory)>>24];
+        if(!poollist)
+        {
+            poollist = (Pool*)OSVirtualAlloc(sizeof(Pool)*256);
+            if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), meminfo->maxBlockSize, ReturnAddress());
+            zero(poollist, sizeof(Pool)*256);
+        }
+        pool = &poollist[(PtrTo32(lpMemory)>>16)&0xFF];
+
+        pool->lpMem = lpMemory;
+        pool->bytesTotal = 0x10000;
+        pool->meminfo = meminfo;
+        pool->firstFreeMem = (FreeMemInfo*)lpMemory;
+        pool->lastFreeMem = (FreeMemInfo*)lpMemory;
+
+        meminfo->nextFree = (FreeMemInfo*)lpMemory;
+        meminfo->nextFree->num = meminfo->maxBlocks;
+        meminfo->nextFree->lpPool = pool;
+        meminfo->nextFree->lpPrev = meminfo->nextFree->lpNext = NULL;
+    }
+    else
+        pool = meminfo->nextFree->lpPool;
+
+    assert(pool);
+
+    assert(pool->bytesTotal);
+
+    lpMemory = meminfo->nextFree;
+
+    assert(meminfo->nextFree->num);
+
+    ++pool->blocksUsed;
+
+    if(pool->blocksUsed == meminfo->maxBlocks)
+    {
+        pool->firstFreeMem = NULL;
+        pool->lastFreeMem = NULL;
+    }
+    else if(meminfo->nextFree->num == 1)
+        pool->firstFreeMem = meminfo->nextFree->lpNext;
+
+
+    if(meminfo->nextFree->num > 1)
+    {
+        FreeMemInfo *next = (FreeMemInfo*)(((LPBYTE)meminfo->nextFree)+meminfo->maxBlockSize);
+        if(pool->firstFreeMem == meminfo->nextFree)
+            pool->firstFreeMem = next;
+        if(pool->lastFreeMem == meminfo->nextFree)
+            pool->lastFreeMem = next;
+
+        mcpy(next, meminfo->nextFree, sizeof(FreeMemInfo));
+
+        if(next->lpPrev)
+            next->lpPrev->lpNext = next;
+        if(next->lpNext)
+            next->lpNext->lpPrev = next;
 
-        if(!meminfo->nextFree) //no pools have been created for this section
+        --next->num;
+        meminfo->nextFree = next;
+    }
+    else
+    {
+        FreeMemInfo *freemem = meminfo->nextFree;
+        if(freemem->lpNext)
+            freemem->lpNext->lpPrev = freemem->lpPrev;
+        if(freemem->lpPrev)
+            freemem->lpPrev->lpNext = freemem->lpNext;
+        meminfo->nextFree = freemem->lpNext;
+    }
+
+    return lpMemory;
+}
+
+static void FreePoolBlock(LPVOID lpMemory)
+{
+    Pool *pool = &PoolList[PtrTo32(lpMemory)>>24][(PtrTo32(lpMemory)>>16)&0xFF];
+    MemInfo *meminfo = pool->meminfo;
+
+    if(meminfo && pool->blocksUsed == 1)
+    {
+        FreeMemInfo *prevPoolFreeMem = pool->firstFreeMem->lpPrev;
+        FreeMemInfo *nextPoolFreeMem = pool->lastFreeMem->lpNext;
+
+        if(prevPoolFreeMem)
+            prevPoolFreeMem->lpNext = nextPoolFreeMem;
+        if(nextPoolFreeMem)
+            nextPoolFreeMem->lpPrev = prevPoolFreeMem;
+
+        if(meminfo->nextFree && (meminfo->nextFree->lpPool == pool))
+            meminfo->nextFree = nextPoolFreeMem;
+    }
+
+    assert(pool->blocksUsed);
+
+    FreeMemInfo *freemem = (FreeMemInfo*)lpMemory;
+
+    if(--pool->blocksUsed)
+    {
+        freemem->lpPool = pool;
+        freemem->num = 1;
+
+        if(pool->blocksUsed == (meminfo->maxBlocks-1))
         {
-            lpMemory = OSVirtualAlloc(0x10000);
-            if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
+            pool->firstFreeMem = pool->lastFreeMem = (FreeMemInfo*)lpMemory;
+            if(meminfo->nextFree)
+            {
+                freemem->lpNext = meminfo->nextFree;
+                freemem->lpPrev = meminfo->nextFree->lpPrev;
+
+                if(freemem->lpPrev)
+                    freemem->lpPrev->lpNext = freemem;
 
-            Pool *&poollist = PoolList[PtrTo32(lpMemory)>>24];
-            if(!poollist)
+                meminfo->nextFree->lpPrev = freemem;
+                meminfo->nextFree = freemem;
+            }
+            else
             {
-                poollist = (Pool*)OSVirtualAlloc(sizeof(Pool)*256);
-                if(!poollist) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
-                zero(poollist, sizeof(Pool)*256);
+                freemem->lpPrev = freemem->lpNext = NULL;
+                meminfo->nextFree = freemem;
             }
-            pool = &poollist[(PtrTo32(lpMemory)>>16)&0xFF];
-
-            pool->lpMem = lpMemory;
-            pool->bytesTotal = 0x10000;
-            pool->meminfo = meminfo;
-            pool->firstFreeMem = (FreeMemInfo*)lpMemory;
-            pool->lastFreeMem = (FreeMemInfo*)lpMemory;
-
-            meminfo->nextFree = (FreeMemInfo*)lpMemory;
-            meminfo->nextFree->num = meminfo->maxBlocks;
-            meminfo->nextFree->lpPool = pool;
-            meminfo->nextFree->lpPrev = meminfo->nextFree->lpNext = NULL;
         }
         else
-            pool = meminfo->nextFree->lpPool;
+        {
+            freemem->lpNext = pool->firstFreeMem;
+            freemem->lpPrev = pool->firstFreeMem->lpPrev;
+
+            pool->firstFreeMem->lpPrev = freemem;
+            pool->firstFreeMem = freemem;
 
-        assert(pool);
+            if(freemem->lpPrev)
+                freemem->lpPrev->lpNext = freemem;
 
+            if(!meminfo->nextFree || (pool <= meminfo->nextFree->lpPool))
+                meminfo->nextFree = freemem;
+        }
+    }
+    else
+    {
         assert(pool->bytesTotal);
-    
-        lpMemory = meminfo->nextFree;
+        assert(pool->lpMem);
+        OSVirtualFree(pool->lpMem);
+        zero(pool, sizeof(Pool));
+    }
+}
 
-        assert(meminfo->nextFree->num);
+//-----------------------------------------
+//thread caches
+
+FastAllocThreadCache* FastAlloc::GetThreadCache()
+{
+    FastAllocThreadCache *cache = (FastAllocThreadCache*)OSGetThreadStorage(threadCacheStorage);
+    if(!cache)
+    {
+        cache = (FastAllocThreadCache*)malloc(sizeof(FastAllocThreadCache));
+        if(!cache)
+            return NULL;
 
-        ++pool->blocksUsed;
+        zero(cache, sizeof(FastAllocThreadCache));
+        cache->allocator = this;
+        cache->sampleCountdown = ALLOC_SAMPLE_RATE-1;
 
-        if(pool->blocksUsed == meminfo->maxBlocks)
+        if(!OSSetThreadStorage(threadCacheStorage, cache))
         {
-            pool->firstFreeMem = NULL;
-            pool->lastFreeMem = NULL;
+            free(cache);
+            return NULL;
         }
-        else if(meminfo->nextFree->num == 1)
-            pool->firstFreeMem = meminfo->nextFree->lpNext;
 
+        OSEnterMutex(hAllocProfileMutex);
+        cache->next = firstThreadCache;
+        if(firstThreadCache)
+            firstThreadCache->prev = cache;
+        firstThreadCache = cache;
+        OSLeaveMutex(hAllocProfileMutex);
+    }
 
-        if(meminfo->nextFree->num > 1)
-        {
-            FreeMemInfo *next = (FreeMemInfo*)(((LPBYTE)meminfo->nextFree)+meminfo->maxBlockSize);
-            if(pool->firstFreeMem == meminfo->nextFree)
-                pool->firstFreeMem = next;
-            if(pool->lastFreeMem == meminfo->nextFree)
-                pool->lastFreeMem = next;
+    return cache;
+}
+
+void FastAlloc::FlushThreadCache(FastAllocThreadCache *cache, UINT sizeClass, DWORD count)
+{
+    OSEnterMutex(hAllocationMutex);
+
+    while(count-- && cache->freeBlocks[sizeClass])
+    {
+        CachedBlock *block = cache->freeBlocks[sizeClass];
+        cache->freeBlocks[sizeClass] = block->next;
+        --cache->numFree[sizeClass];
+
+        FreePoolBlock(block);
+    }
+
+    OSLeaveMutex(hAllocationMutex);
+}
+
+void STDCALL FastAlloc::FreeThreadCache(LPVOID param)
+{
+    FastAllocThreadCache *cache = (FastAllocThreadCache*)param;
+
+    for(UINT i=1; i<12; i++)
+    {
+        if(cache->numFree[i])
+            cache->allocator->FlushThreadCache(cache, i, cache->numFree[i]);
+    }
+
+    OSEnterMutex(hAllocProfileMutex);
+
+    for(UINT i=1; i<12; i++)
+    {
+        retiredAllocs[i] += cache->numAllocs[i];
+        retiredFrees[i] += cache->numFrees[i];
+    }
+
+    if(cache->prev)
+        cache->prev->next = cache->next;
+    else
+        firstThreadCache = cache->next;
+    if(cache->next)
+        cache->next->prev = cache->prev;
+
+    OSLeaveMutex(hAllocProfileMutex);
+
+    free(cache);
+}
+
+//-----------------------------------------
+
+void * __restrict FastAlloc::_Allocate(size_t dwSize)
+{
+    return AllocateBlock(dwSize, ReturnAddress());
+}
+
+LPVOID FastAlloc::AllocateBlock(size_t dwSize, LPVOID lpCaller)
+{
+    //assert(dwSize);
+    if(!dwSize) dwSize = 1;
 
-            mcpy(next, meminfo->nextFree, sizeof(FreeMemInfo));
+    LPVOID lpMemory;
+    Pool *pool;
+
+    FastAllocThreadCache *cache = GetThreadCache();
 
-            if(next->lpPrev)
-                next->lpPrev->lpNext = next;
-            if(next->lpNext)
-                next->lpNext->lpPrev = next;
+    if(dwSize < 0x8001)
+    {
+        MemInfo *meminfo = GetMemInfo(dwSize);
 
-            --next->num;
-            meminfo->nextFree = next;
+        if(!cache)
+        {
+            OSEnterMutex(hAllocationMutex);
+            lpMemory = AllocatePoolBlock(meminfo);
+            OSLeaveMutex(hAllocationMutex);
+            return lpMemory;
         }
-        else
+
+        UINT sizeClass = UINT(meminfo-MemInfoList);
+        if(!cache->freeBlocks[sizeClass])
         {
-            FreeMemInfo *freemem = meminfo->nextFree;
-            if(freemem->lpNext)
-                freemem->lpNext->lpPrev = freemem->lpPrev;
-            if(freemem->lpPrev)
-                freemem->lpPrev->lpNext = freemem->lpNext;
-            meminfo->nextFree = freemem->lpNext;
+            DWORD count = MAX(1, meminfo->maxCached/2);
+
+            OSEnterMutex(hAllocationMutex);
+            for(DWORD i=0; i<count; i++)
+            {
+                CachedBlock *block = (CachedBlock*)AllocatePoolBlock(meminfo);
+                block->next = cache->freeBlocks[sizeClass];
+                cache->freeBlocks[sizeClass] = block;
+            }
+            OSLeaveMutex(hAllocationMutex);
+
+            cache->numFree[sizeClass] += count;
         }
 
-        //zero(lpMemory, dwSize);
+        CachedBlock *block = cache->freeBlocks[sizeClass];
+        cache->freeBlocks[sizeClass] = block->next;
+        --cache->numFree[sizeClass];
+
+        ++cache->numAllocs[sizeClass];
+        CheckAllocSample(block, dwSize, lpCaller, cache);
+
+        return block;
     }
     else
     {
+        OSEnterMutex(hAllocationMutex);
+
         dwSize = align(dwSize);
         lpMemory = OSVirtualAlloc(dwSize);
         if(!lpMemory) CrashError(TEXT("Out of memory while trying to allocate %d bytes at %p"), dwSize, ReturnAddress());
@@ -250,9 +677,14 @@ void * __restrict FastAlloc::_Allocate(size_t dwSize)
         pool->lpMem = lpMemory;
         pool->meminfo = NULL;
         pool->firstFreeMem = pool->lastFreeMem = NULL;
-    }
 
-    OSLeaveMutex(hAllocationMutex);
+        ++numLargeAllocs;
+        largeBytesInUse += dwSize;
+
+        OSLeaveMutex(hAllocationMutex);
+
+        CheckAllocSample(lpMemory, dwSize, lpCaller, cache);
+    }
 
     return lpMemory;
 }
@@ -281,7 +713,7 @@ void * FastAlloc::_ReAllocate(LPVOID lpMemory, size_t dwSize)
     else if(align(dwSize) == pool->bytesTotal)
         return lpMemory;
 
-    LPVOID lpNew = _Allocate(dwSize);
+    LPVOID lpNew = AllocateBlock(dwSize, ReturnAddress());
     if(!lpNew) CrashError(TEXT("Out of memory while trying to reallocate %d bytes at %p"), dwSize, ReturnAddress());
 
     if(pool->meminfo)
@@ -296,79 +728,226 @@ void * FastAlloc::_ReAllocate(LPVOID lpMemory, size_t dwSize)
 
 void FastAlloc::_Free(LPVOID lpMemory)
 {
+    if(!lpMemory)
+        return;
+
+    CheckFreeSample(lpMemory);
+
+    Pool *pool = &PoolList[PtrTo32(lpMemory)>>24][(PtrTo32(lpMemory)>>16)&0xFF];
+    MemInfo *meminfo = pool->meminfo;
+
+    FastAllocThreadCache *cache = meminfo ? GetThreadCache() : NULL;
+    if(cache)
+    {
+        UINT sizeClass = UINT(meminfo-MemInfoList);
+        ++cache->numFrees[sizeClass];
+
+        CachedBlock *block = (CachedBlock*)lpMemory;
+        block->next = cache->freeBlocks[sizeClass];
+        cache->freeBlocks[sizeClass] = block;
+
+        if(++cache->numFree[sizeClass] > meminfo->maxCached)
+            FlushThreadCache(cache, sizeClass, MAX(1, meminfo->maxCached/2));
+        return;
+    }
+
     OSEnterMutex(hAllocationMutex);
+    if(!meminfo)
+    {
+        ++numLargeFrees;
+        largeBytesInUse -= pool->bytesTotal;
+    }
+    FreePoolBlock(lpMemory);
+    OSLeaveMutex(hAllocationMutex);
+}
+
+//-----------------------------------------
+//allocation profiling functions
+
+AllocationTag::AllocationTag(CTSTR lpTag)
+{
+    lpPrevTag = curAllocationTag;
+    curAllocationTag = lpTag;
+}
+
+AllocationTag::~AllocationTag()
+{
+    curAllocationTag = lpPrevTag;
+}
+
+void STDCALL EnableAllocationProfiling(BOOL bEnable)
+{
+    if(!hAllocProfileMutex)
+        return;
 
-    if(lpMemory)
+    OSEnterMutex(hAllocProfileMutex);
+
+    if(bEnable && !bAllocProfiling)
     {
-        Pool *pool = &PoolList[PtrTo32(lpMemory)>>24][(PtrTo32(lpMemory)>>16)&0xFF];
-        MemInfo *meminfo = pool->meminfo;
+        zero(allocSites, sizeof(allocSites));
+        zero(allocTags, sizeof(allocTags));
+        zero(allocSamples, sizeof(allocSamples));
+        zero(allocSampleFilter, sizeof(allocSampleFilter));
+        numAllocSites = numAllocTags = numAllocSamples = 0;
+        lastTopAllocatorsTime = OSGetTimeMicroseconds();
+    }
 
-        if(meminfo && pool->blocksUsed == 1)
-        {
-            FreeMemInfo *prevPoolFreeMem = pool->firstFreeMem->lpPrev;
-            FreeMemInfo *nextPoolFreeMem = pool->lastFreeMem->lpNext;
+    bAllocProfiling = bEnable;
 
-            if(prevPoolFreeMem)
-                prevPoolFreeMem->lpNext = nextPoolFreeMem;
-            if(nextPoolFreeMem)
-                nextPoolFreeMem->lpPrev = prevPoolFreeMem;
+    OSLeaveMutex(hAllocProfileMutex);
+}
 
-            if(meminfo->nextFree && (meminfo->nextFree->lpPool == pool))
-                meminfo->nextFree = nextPoolFreeMem;
-        }
+struct TopAllocSite
+{
+    LPVOID address;
+    QWORD numAllocs, bytesAllocated, liveBytes;
+};
 
-        assert(pool->blocksUsed);
+//keeps the sites with the most allocations in order, most first
+static void AddTopAllocSite(TopAllocSite *topSites, UINT &numTopSites, UINT maxTopSites, const TopAllocSite &site)
+{
+    UINT pos = numTopSites;
+    while(pos && topSites[pos-1].numAllocs < site.numAllocs)
+        --pos;
 
-        FreeMemInfo *freemem = (FreeMemInfo*)lpMemory;
+    if(pos == maxTopSites)
+        return;
 
-        if(--pool->blocksUsed)
-        {
-            freemem->lpPool = pool;
-            freemem->num = 1;
+    UINT moveCount = MIN(numTopSites, maxTopSites-1)-pos;
+    if(moveCount)
+        mcpyrev(topSites+pos+1, topSites+pos, moveCount*sizeof(TopAllocSite));
 
-            if(pool->blocksUsed == (meminfo->maxBlocks-1))
-            {
-                pool->firstFreeMem = pool->lastFreeMem = (FreeMemInfo*)lpMemory;
-                if(meminfo->nextFree)
-                {
-                    freemem->lpNext = meminfo->nextFree;
-                    freemem->lpPrev = meminfo->nextFree->lpPrev;
+    topSites[pos] = site;
+    if(numTopSites < maxTopSites)
+        ++numTopSites;
+}
 
-                    if(freemem->lpPrev)
-                        freemem->lpPrev->lpNext = freemem;
+#define NUM_DUMPED_ALLOC_SITES 20
 
-                    meminfo->nextFree->lpPrev = freemem;
-                    meminfo->nextFree = freemem;
-                }
-                else
-                {
-                    freemem->lpPrev = freemem->lpNext = NULL;
-                    meminfo->nextFree = freemem;
-                }
-            }
-            else
-            {
-                freemem->lpNext = pool->firstFreeMem;
-                freemem->lpPrev = pool->firstFreeMem->lpPrev;
+void STDCALL DumpAllocationProfileData()
+{
+    if(!hAllocProfileMutex)
+        return;
 
-                pool->firstFreeMem->lpPrev = freemem;
-                pool->firstFreeMem = freemem;
+    QWORD numAllocs[12], numFrees[12];
+    TopAllocSite topSites[NUM_DUMPED_ALLOC_SITES];
+    AllocTagInfo tags[MAX_ALLOC_TAGS];
+    UINT numTopSites = 0, numTags = 0;
+    bool bSampled;
 
-                if(freemem->lpPrev)
-                    freemem->lpPrev->lpNext = freemem;
+    //everything is copied out first, logging allocates too
+    OSEnterMutex(hAllocProfileMutex);
+
+    for(UINT i=1; i<12; i++)
+    {
+        numAllocs[i] = retiredAllocs[i];
+        numFrees[i] = retiredFrees[i];
+
+        for(FastAllocThreadCache *cache = firstThreadCache; cache; cache = cache->next)
+        {
+            numAllocs[i] += cache->numAllocs[i];
+            numFrees[i] += cache->numFrees[i];
+        }
+    }
 
-                if(!meminfo->nextFree || (pool <= meminfo->nextFree->lpPool))
-                    meminfo->nextFree = freemem;
+    bSampled = bAllocProfiling != 0;
+    if(bSampled)
+    {
+        for(UINT i=0; i<MAX_ALLOC_SITES; i++)
+        {
+            AllocSite &site = allocSites[i];
+            if(site.address)
+            {
+                TopAllocSite topSite = {site.address, site.numAllocs, site.bytesAllocated, site.liveBytes};
+                AddTopAllocSite(topSites, numTopSites, NUM_DUMPED_ALLOC_SITES, topSite);
             }
         }
-        else
+
+        numTags = numAllocTags;
+        mcpy(tags, allocTags, sizeof(AllocTagInfo)*numTags);
+    }
+
+    OSLeaveMutex(hAllocProfileMutex);
+
+    if(!bSampled)
+        return;
+
+    Log(TEXT("\r\nAllocation profile:\r\n"));
+    Log(TEXT("=============================================================="));
+
+    for(UINT i=1; i<12; i++)
+    {
+        if(!numAllocs[i])
+            continue;
+
+        QWORD inUse = numAllocs[i]-numFrees[i];
+        Log(TEXT("up to %u bytes - [allocations: %llu] [in use: %llu blocks, %g MB]"), (UINT)MemInfoList[i].maxBlockSize,
+            numAllocs[i], inUse, double(inUse*MemInfoList[i].maxBlockSize)/(1024.0*1024.0));
+    }
+
+    Log(TEXT("large - [allocations: %llu] [in use: %llu, %g MB]"), numLargeAllocs, numLargeAllocs-numLargeFrees,
+        double(largeBytesInUse)/(1024.0*1024.0));
+
+    Log(TEXT("\r\nAllocation sites (estimated from one in %u allocations):"), ALLOC_SAMPLE_RATE);
+    for(UINT i=0; i<numTopSites; i++)
+    {
+        TopAllocSite &site = topSites[i];
+        Log(TEXT("%p - [allocations: %llu] [allocated: %g MB] [in use: %g MB]"), site.address, site.numAllocs*ALLOC_SAMPLE_RATE,
+            double(site.bytesAllocated*ALLOC_SAMPLE_RATE)/(1024.0*1024.0), double(site.liveBytes*ALLOC_SAMPLE_RATE)/(1024.0*1024.0));
+    }
+
+    Log(TEXT("\r\nAllocation tags:"));
+    for(UINT i=0; i<numTags; i++)
+    {
+        Log(TEXT("%s - [allocated: %g MB] [in use: %g MB]"), tags[i].lpName ? tags[i].lpName : TEXT("(untagged)"),
+            double(tags[i].bytesAllocated*ALLOC_SAMPLE_RATE)/(1024.0*1024.0), double(tags[i].liveBytes*ALLOC_SAMPLE_RATE)/(1024.0*1024.0));
+    }
+
+    Log(TEXT("==============================================================\r\n"));
+}
+
+void STDCALL LogTopAllocators(UINT numAllocators)
+{
+    if(!hAllocProfileMutex || !bAllocProfiling)
+        return;
+
+    TopAllocSite topSites[NUM_DUMPED_ALLOC_SITES];
+    UINT numTopSites = 0;
+
+    if(numAllocators > NUM_DUMPED_ALLOC_SITES)
+        numAllocators = NUM_DUMPED_ALLOC_SITES;
+
+    OSEnterMutex(hAllocProfileMutex);
+
+    QWORD curTime = OSGetTimeMicroseconds();
+    double seconds = double(curTime-lastTopAllocatorsTime)/1000000.0;
+    lastTopAllocatorsTime = curTime;
+
+    for(UINT i=0; i<MAX_ALLOC_SITES; i++)
+    {
+        AllocSite &site = allocSites[i];
+        if(site.address && site.numAllocs != site.lastNumAllocs)
         {
-            assert(pool->bytesTotal);
-            assert(pool->lpMem);
-            OSVirtualFree(pool->lpMem);
-            zero(pool, sizeof(Pool));
+            TopAllocSite topSite = {site.address, site.numAllocs-site.lastNumAllocs, site.bytesAllocated-site.lastBytesAllocated, site.liveBytes};
+            AddTopAllocSite(topSites, numTopSites, numAllocators, topSite);
+
+            site.lastNumAllocs = site.numAllocs;
+            site.lastBytesAllocated = site.bytesAllocated;
         }
     }
 
-    OSLeaveMutex(hAllocationMutex);
+    OSLeaveMutex(hAllocProfileMutex);
+
+    if(!numTopSites || seconds <= 0.0)
+        return;
+
+    String strTop;
+    for(UINT i=0; i<numTopSites; i++)
+    {
+        TopAllocSite &site = topSites[i];
+        strTop << FormattedString(TEXT("%s%p: %g/s %g KB/s"), i ? TEXT(", ") : TEXT(""), site.address,
+            double(site.numAllocs*ALLOC_SAMPLE_RATE)/seconds, double(site.bytesAllocated*ALLOC_SAMPLE_RATE)/(1024.0*seconds));
+    }
+
+    Log(TEXT("Top allocators: %s"), strTop.Array());
 }
@@ -19,6 +19,10 @@
 
 #pragma once
 
+struct FastAllocThreadCache;
+
+//each thread keeps a few free blocks of every size so most allocations don't touch the mutex.
+//blocks go between the thread caches and the shared pools in batches
 class BASE_EXPORT FastAlloc : public Alloc
 {
 public:
@@ -35,4 +39,11 @@ public:
 
 private:
     HANDLE hAllocationMutex;
+    DWORD threadCacheStorage;
+
+    LPVOID AllocateBlock(size_t dwSize, LPVOID lpCaller);
+
+    FastAllocThreadCache* GetThreadCache();
+    void FlushThreadCache(FastAllocThreadCache *cache, UINT sizeClass, DWORD count);
+    static void STDCALL FreeThreadCache(LPVOID param);
 };
@@ -21,7 +21,10 @@
 
 
 // This is loosely based on the hierarchical profiling method from Game Programming Gems 3 by Greg Hjelstrom & Byon Garrabrant.
-
+//
+// every thread keeps its own tree of nodes, so nothing is locked while profiling.  nodes never move or go away
+// while their thread is running, so the dump functions can walk other threads' trees at the same time.  a thread
+// resets its own tree when asked to, and its data is only freed once it has exited
 
 
 
@@ -31,12 +34,299 @@ inline double MicroToMS(DWORD microseconds)
 }
 
 float minPercentage, minTime;
-HANDLE hProfilerMutex = NULL;
+HANDLE hProfilerMutex = NULL; //only guards the list of threads
+static DWORD profileThreadStorage = 0;
+
+
+//-----------------------------------------
+//histograms
+//  log-scale buckets, eight per power of two, so a time is never more than 12.5% off from its bucket
+
+#define PROFILE_HISTOGRAM_BUCKETS 240
+
+inline UINT GetHistogramBucket(DWORD microseconds)
+{
+    if(microseconds < 8)
+        return microseconds;
+
+    UINT shift = 0;
+    while(microseconds >= 16)
+    {
+        microseconds >>= 1;
+        ++shift;
+    }
+
+    return 8 + shift*8 + (microseconds-8);
+}
+
+inline DWORD GetHistogramBucketTime(UINT bucket)
+{
+    if(bucket < 8)
+        return bucket;
+
+    UINT shift = (bucket-8)/8;
+    DWORD lowest = (8 + (bucket-8)%8) << shift;
+    return lowest + ((1<<shift)/2);
+}
+
+inline DWORD GetHistogramPercentile(const DWORD *histogram, DWORD numCalls, DWORD maxTime, double percentile)
+{
+    DWORD target = (DWORD)ceil(double(numCalls)*percentile);
+    DWORD count = 0;
+
+    for(UINT i=0; i<PROFILE_HISTOGRAM_BUCKETS; i++)
+    {
+        count += histogram[i];
+        if(count >= target && count)
+            return MIN(GetHistogramBucketTime(i), maxTime);
+    }
+
+    return maxTime;
+}
+
+
+//-----------------------------------------
+//per-thread data
+
+struct ProfileNodeInfo
+{
+    CTSTR lpName;
+    bool bSingular;
+
+    DWORD numCalls;
+    DWORD numParallelCalls;
+    DWORD lastCall;
+    DWORD maxTimeElapsed;
+
+    QWORD totalTimeElapsed,
+          lastTimeElapsed,
+          cpuTimeElapsed,
+          lastCpuTimeElapsed;
+
+    DWORD histogram[PROFILE_HISTOGRAM_BUCKETS];
+
+    ProfileNodeInfo *parent;
+    ProfileNodeInfo *volatile firstChild;
+    ProfileNodeInfo *volatile nextSibling;
+    ProfileNodeInfo *lastChild;
+
+    void ResetData()
+    {
+        numCalls = numParallelCalls = lastCall = maxTimeElapsed = 0;
+        totalTimeElapsed = lastTimeElapsed = cpuTimeElapsed = lastCpuTimeElapsed = 0;
+        zero(histogram, sizeof(histogram));
+
+        for(ProfileNodeInfo *child = firstChild; child; child = child->nextSibling)
+            child->ResetData();
+    }
+};
+
+struct ProfileChildEntry
+{
+    ProfileNodeInfo *parent;
+    CTSTR lpName;
+    ProfileNodeInfo *node;
+};
+
+#define PROFILE_NODE_BLOCK_SIZE 64
+
+//timeline events, kept in a ring per thread while the timeline is enabled.  must be a power of two
+#define PROFILE_TIMELINE_EVENTS 0x4000
+
+struct ProfileEvent
+{
+    CTSTR lpName;
+    QWORD startTime;
+    DWORD duration;
+};
+
+struct ProfileThreadData
+{
+    ProfileThreadData *next;
+    UINT threadIndex;
+
+    ProfileEvent *events;
+    volatile UINT numEvents; //total ever written, the ring position is this masked
+
+    ProfileNodeInfo *volatile firstRoot;
+    ProfileNodeInfo *lastRoot;
+
+    volatile bool bResetPending; //set by FreeProfileData, the thread resets its nodes before its next root node
+    volatile bool bExited;       //set when the thread exits, its data is freed by the next FreeProfileData
+
+    List<ProfileNodeInfo*> nodeBlocks;
+    UINT numBlockNodes;
+
+    //nodes are looked up by parent and name here rather than by searching the parent's children
+    ProfileChildEntry *childTable;
+    UINT childTableSize, numChildEntries;
+
+    ~ProfileThreadData()
+    {
+        for(UINT i=0; i<nodeBlocks.Num(); i++)
+            Free(nodeBlocks[i]);
+        Free(childTable);
+        Free(events);
+    }
+
+    void ResetNodes()
+    {
+        for(ProfileNodeInfo *root = firstRoot; root; root = root->nextSibling)
+            root->ResetData();
+        bResetPending = false;
+    }
 
+    inline void AddEvent(CTSTR lpName, QWORD startTime, DWORD duration)
+    {
+        if(!events)
+            events = (ProfileEvent*)Allocate(sizeof(ProfileEvent)*PROFILE_TIMELINE_EVENTS);
+
+        ProfileEvent &event = events[numEvents & (PROFILE_TIMELINE_EVENTS-1)];
+        event.lpName = lpName;
+        event.startTime = startTime;
+        event.duration = duration;
+
+        ++numEvents;
+    }
+
+    static inline UINT HashChild(ProfileNodeInfo *parent, CTSTR lpName)
+    {
+        UPARAM val = (UPARAM(parent)>>4) ^ (UPARAM(lpName)*31);
+        return UINT(val ^ (val>>16));
+    }
+
+    void InsertChildEntry(ProfileNodeInfo *node)
+    {
+        UINT i = HashChild(node->parent, node->lpName) & (childTableSize-1);
+        while(childTable[i].node)
+            i = (i+1) & (childTableSize-1);
+
+        childTable[i].parent = node->parent;
+        childTable[i].lpName = node->lpName;
+        childTable[i].node = node;
+        ++numChildEntries;
+    }
+
+    void GrowChildTable()
+    {
+        ProfileChildEntry *oldTable = childTable;
+        UINT oldSize = childTableSize;
+
+        childTableSize = oldSize ? oldSize*2 : 64;
+        childTable = (ProfileChildEntry*)Allocate(sizeof(ProfileChildEntry)*childTableSize);
+        zero(childTable, sizeof(ProfileChildEntry)*childTableSize);
+        numChildEntries = 0;
+
+        for(UINT i=0; i<oldSize; i++)
+        {
+            if(oldTable[i].node)
+                InsertChildEntry(oldTable[i].node);
+        }
+
+        Free(oldTable);
+    }
 
-struct BASE_EXPORT ProfileNodeInfo
+    ProfileNodeInfo* NewNode()
+    {
+        if(!nodeBlocks.Num() || numBlockNodes == PROFILE_NODE_BLOCK_SIZE)
+        {
+            ProfileNodeInfo *block = (ProfileNodeInfo*)Allocate(sizeof(ProfileNodeInfo)*PROFILE_NODE_BLOCK_SIZE);
+            zero(block, sizeof(ProfileNodeInfo)*PROFILE_NODE_BLOCK_SIZE);
+            nodeBlocks << block;
+            numBlockNodes = 0;
+        }
+
+        return nodeBlocks.Last()+(numBlockNodes++);
+    }
+
+    ProfileNodeInfo* GetNode(ProfileNodeInfo *parent, CTSTR lpName, bool bSingular)
+    {
+        if(childTableSize)
+        {
+            UINT i = HashChild(parent, lpName) & (childTableSize-1);
+            while(childTable[i].node)
+            {
+                if(childTable[i].parent == parent && childTable[i].lpName == lpName)
+                    return childTable[i].node;
+                i = (i+1) & (childTableSize-1);
+            }
+        }
+
+        if(numChildEntries*2 >= childTableSize)
+            GrowChildTable();
+
+        ProfileNodeInfo *node = NewNode();
+        node->lpName = lpName;
+        node->bSingular = bSingular;
+        node->parent = parent;
+
+        InsertChildEntry(node);
+
+        //linked in last, once the node is filled in, for anyone walking the tree from another thread
+        if(parent)
+        {
+            if(parent->lastChild)
+                parent->lastChild->nextSibling = node;
+            else
+                parent->firstChild = node;
+            parent->lastChild = node;
+        }
+        else
+        {
+            if(lastRoot)
+                lastRoot->nextSibling = node;
+            else
+                firstRoot = node;
+            lastRoot = node;
+        }
+
+        return node;
+    }
+};
+
+static ProfileThreadData *firstProfileThread = NULL;
+static UINT numProfileThreads = 0;
+static BOOL bTimelineEnabled = FALSE;
+
+static __declspec(thread) ProfilerNode *__curProfilerNode = NULL;
+static __declspec(thread) ProfileThreadData *curProfileThread = NULL;
+BOOL bProfilingEnabled = FALSE;
+
+static ProfileThreadData* GetProfileThread()
+{
+    if(!curProfileThread)
+    {
+        curProfileThread = new ProfileThreadData;
+
+        OSEnterMutex(hProfilerMutex);
+        curProfileThread->threadIndex = ++numProfileThreads;
+        curProfileThread->next = firstProfileThread;
+        firstProfileThread = curProfileThread;
+        OSLeaveMutex(hProfilerMutex);
+
+        //only used to find out when the thread exits
+        OSSetThreadStorage(profileThreadStorage, curProfileThread);
+    }
+
+    return curProfileThread;
+}
+
+//the data is kept until the next FreeProfileData so threads stopped before a dump still show up in it
+static void STDCALL EndProfileThread(LPVOID param)
 {
-    ~ProfileNodeInfo()
+    OSEnterMutex(hProfilerMutex);
+    ((ProfileThreadData*)param)->bExited = true;
+    OSLeaveMutex(hProfilerMutex);
+}
+
+
+//-----------------------------------------
+//dumping
+//  the threads' trees are merged by name into these first
+
+struct ProfileSummary
+{
+    ~ProfileSummary()
     {
         FreeData();
     }
@@ -54,6 +344,7 @@ struct BASE_EXPORT ProfileNodeInfo
     DWORD numParallelCalls;
     DWORD avgTimeElapsed;
     DWORD avgCpuTime;
+    DWORD maxTimeElapsed;
     double avgPercentage;
     double childPercentage;
     double unaccountedPercentage;
@@ -61,14 +352,12 @@ struct BASE_EXPORT ProfileNodeInfo
     bool bSingular;
 
     QWORD totalTimeElapsed,
-          lastTimeElapsed,
-          cpuTimeElapsed,
-          lastCpuTimeElapsed;
+          cpuTimeElapsed;
 
-    DWORD lastCall;
+    DWORD histogram[PROFILE_HISTOGRAM_BUCKETS];
 
-    ProfileNodeInfo *parent;
-    List<ProfileNodeInfo> Children;
+    ProfileSummary *parent;
+    List<ProfileSummary> Children;
 
     void calculateProfileData(int rootCallCount)
     {
@@ -110,18 +399,21 @@ struct BASE_EXPORT ProfileNodeInfo
 
         CTSTR lpIndent = indent == 0 ? TEXT("") : indentStr.Array();
 
-        int perFrameCalls = (int)floor(numCalls/(double)rootCallCount+0.5);
-
         float fTimeTaken = (float)MicroToMS(avgTimeElapsed);
-        float cpuTime = (float)MicroToMS(avgCpuTime);
-        float totalCpuTime = (float)cpuTimeElapsed*0.001f;
 
         if(avgPercentage >= minPercentage && fTimeTaken >= minTime)
         {
+            float p50 = (float)MicroToMS(GetHistogramPercentile(histogram, numCalls, maxTimeElapsed, 0.50));
+            float p95 = (float)MicroToMS(GetHistogramPercentile(histogram, numCalls, maxTimeElapsed, 0.95));
+            float p99 = (float)MicroToMS(GetHistogramPercentile(histogram, numCalls, maxTimeElapsed, 0.99));
+            float fMaxTime = (float)MicroToMS(maxTimeElapsed);
+
             if(Children.Num())
-                Log(TEXT("%s%s - [%.3g%%] [avg time: %g ms] [children: %.3g%%] [unaccounted: %.3g%%]"), lpIndent, lpName, avgPercentage, fTimeTaken, childPercentage, unaccountedPercentage);
+                Log(TEXT("%s%s - [%.3g%%] [avg time: %g ms] [p50: %g ms, p95: %g ms, p99: %g ms, max: %g ms] [children: %.3g%%] [unaccounted: %.3g%%]"),
+                    lpIndent, lpName, avgPercentage, fTimeTaken, p50, p95, p99, fMaxTime, childPercentage, unaccountedPercentage);
             else
-                Log(TEXT("%s%s - [%.3g%%] [avg time: %g ms]"), lpIndent, lpName, avgPercentage, fTimeTaken);
+                Log(TEXT("%s%s - [%.3g%%] [avg time: %g ms] [p50: %g ms, p95: %g ms, p99: %g ms, max: %g ms]"),
+                    lpIndent, lpName, avgPercentage, fTimeTaken, p50, p95, p99, fMaxTime);
         }
 
         for(unsigned int i=0; i<Children.Num(); i++)
@@ -149,100 +441,90 @@ struct BASE_EXPORT ProfileNodeInfo
         float totalCpuTime = (float)cpuTimeElapsed*0.001f;
 
         if(avgPercentage >= minPercentage && fTimeTaken >= minTime)
-        {
-            if(Children.Num())
-                Log(TEXT("%s%s - [cpu time: avg %g ms, total %g ms] [avg calls per frame: %d]"), lpIndent, lpName, cpuTime, totalCpuTime, perFrameCalls);
-            else
-                Log(TEXT("%s%s - [cpu time: avg %g ms, total %g ms] [avg calls per frame: %d]"), lpIndent, lpName, cpuTime, totalCpuTime, perFrameCalls);
-        }
+            Log(TEXT("%s%s - [cpu time: avg %g ms, total %g ms] [avg calls per frame: %d]"), lpIndent, lpName, cpuTime, totalCpuTime, perFrameCalls);
 
         for(unsigned int i=0; i<Children.Num(); i++)
             Children[i].dumpCPUData(rootCallCount, indent+1);
     }
 
-    void dumpLastData(int callNum, int indent=0)
+    //a node that's been entered but hasn't finished a call yet has nothing to show
+    static inline bool HasData(ProfileNodeInfo *node)
     {
-        if(lastCall != callNum)
-            return;
-
-        String indentStr;
-        for(int i=0; i<indent; i++)
-            indentStr << TEXT("| ");
-
-        CTSTR lpIndent = indent == 0 ? TEXT("") : indentStr.Array();
-
-        Log(TEXT("%s%s - [time: %g ms (cpu time: %g ms)]"), lpIndent, lpName, MicroToMS((DWORD)lastTimeElapsed), MicroToMS((DWORD)lastCpuTimeElapsed));
-
-        for(unsigned int i=0; i<Children.Num(); i++)
-            Children[i].dumpLastData(callNum, indent+1);
+        return node->numCalls && node->numParallelCalls;
     }
 
-    ProfileNodeInfo* FindSubProfile(CTSTR lpName)
+    void MergeNode(ProfileNodeInfo *node)
     {
-        for(unsigned int i=0; i<Children.Num(); i++)
+        bSingular = node->bSingular;
+        numCalls += node->numCalls;
+        totalTimeElapsed += node->totalTimeElapsed;
+        cpuTimeElapsed += node->cpuTimeElapsed;
+        numParallelCalls = node->numParallelCalls;
+        if(node->maxTimeElapsed > maxTimeElapsed)
+            maxTimeElapsed = node->maxTimeElapsed;
+
+        for(UINT i=0; i<PROFILE_HISTOGRAM_BUCKETS; i++)
+            histogram[i] += node->histogram[i];
+
+        for(ProfileNodeInfo *child = node->firstChild; child; child = child->nextSibling)
         {
-            if(Children[i].lpName == lpName)
-                return &Children[i];
+            if(HasData(child))
+                FindSummary(Children, child->lpName)->MergeNode(child);
         }
-
-        return NULL;
     }
 
-    static ProfileNodeInfo* FindProfile(CTSTR lpName)
+    static ProfileSummary* FindSummary(List<ProfileSummary> &summaries, CTSTR lpName)
     {
-        for(unsigned int i=0; i<profilerData.Num(); i++)
+        for(UINT i=0; i<summaries.Num(); i++)
         {
-            if(profilerData[i].lpName == lpName)
-                return profilerData+i;
+            if(summaries[i].lpName == lpName)
+                return summaries+i;
         }
 
-        return NULL;
+        ProfileSummary *summary = summaries.CreateNew();
+        summary->lpName = lpName;
+        return summary;
     }
+};
 
-    static void MergeProfileInfo(ProfileNodeInfo &info)
-    {
-        OSEnterMutex(hProfilerMutex);
-        ProfileNodeInfo *sum = FindProfile(info.lpName);
-        if(!sum)
-        {
-            sum = profilerData.CreateNew();
-            sum->lpName = info.lpName;
-        }
-        sum->MergeProfileInfo(&info, info.lastCall, sum->lastCall + info.lastCall);
-        OSLeaveMutex(hProfilerMutex);
-    }
+static void GetProfileSummaries(List<ProfileSummary> &summaries)
+{
+    OSEnterMutex(hProfilerMutex);
 
-    void MergeProfileInfo(ProfileNodeInfo *info, DWORD rootLastCall, DWORD updatedLastCall)
+    for(ProfileThreadData *thread = firstProfileThread; thread; thread = thread->next)
     {
-        bSingular = info->bSingular;
-        numCalls += info->numCalls;
-        if(lastCall == rootLastCall) lastCall = updatedLastCall;
-        totalTimeElapsed += info->totalTimeElapsed;
-        lastTimeElapsed = info->lastTimeElapsed;
-        cpuTimeElapsed += info->cpuTimeElapsed;
-        lastCpuTimeElapsed = info->lastCpuTimeElapsed;
-        numParallelCalls = info->numParallelCalls;
-        for(UINT i = 0; i < info->Children.Num(); i++)
+        if(thread->bResetPending)
+            continue;
+
+        for(ProfileNodeInfo *root = thread->firstRoot; root; root = root->nextSibling)
         {
-            ProfileNodeInfo &child = info->Children[i];
-            ProfileNodeInfo *sumChild = FindSubProfile(child.lpName);
-            if(!sumChild)
-            {
-                sumChild = Children.CreateNew();
-                sumChild->lpName = child.lpName;
-            }
-            sumChild->MergeProfileInfo(&child, rootLastCall, updatedLastCall);
+            if(ProfileSummary::HasData(root))
+                ProfileSummary::FindSummary(summaries, root->lpName)->MergeNode(root);
         }
     }
 
-    static List<ProfileNodeInfo> profilerData;
-};
+    OSLeaveMutex(hProfilerMutex);
+}
 
+static void DumpLastNodeData(ProfileNodeInfo *node, DWORD callNum, int indent=0)
+{
+    if(node->lastCall != callNum)
+        return;
 
-static __declspec(thread) ProfilerNode *__curProfilerNode = NULL;
-BOOL bProfilingEnabled = FALSE;
-List<ProfileNodeInfo> ProfileNodeInfo::profilerData;
+    String indentStr;
+    for(int i=0; i<indent; i++)
+        indentStr << TEXT("| ");
+
+    CTSTR lpIndent = indent == 0 ? TEXT("") : indentStr.Array();
 
+    Log(TEXT("%s%s - [time: %g ms (cpu time: %g ms)]"), lpIndent, node->lpName, MicroToMS((DWORD)node->lastTimeElapsed), MicroToMS((DWORD)node->lastCpuTimeElapsed));
+
+    for(ProfileNodeInfo *child = node->firstChild; child; child = child->nextSibling)
+        DumpLastNodeData(child, node->numCalls, indent+1);
+}
+
+
+//-----------------------------------------
 
 void STDCALL EnableProfiling(BOOL bEnable, float pminPercentage, float pminTime)
 {
@@ -255,38 +537,245 @@ void STDCALL EnableProfiling(BOOL bEnable, float pminPercentage, float pminTime)
 
 void STDCALL DumpProfileData()
 {
-    if(ProfileNodeInfo::profilerData.Num())
+    List<ProfileSummary> summaries;
+    GetProfileSummaries(summaries);
+
+    if(summaries.Num())
     {
         Log(TEXT("\r\nProfiler time results:\r\n"));
         Log(TEXT("=============================================================="));
-        for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
-            ProfileNodeInfo::profilerData[i].dumpData(ProfileNodeInfo::profilerData[i].numCalls);
+        for(unsigned int i=0; i<summaries.Num(); i++)
+            summaries[i].dumpData(summaries[i].numCalls);
         Log(TEXT("==============================================================\r\n"));
         Log(TEXT("\r\nProfiler CPU results:\r\n"));
         Log(TEXT("=============================================================="));
-        for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
-            ProfileNodeInfo::profilerData[i].dumpCPUData(ProfileNodeInfo::profilerData[i].numCalls);
+        for(unsigned int i=0; i<summaries.Num(); i++)
+            summaries[i].dumpCPUData(summaries[i].numCalls);
         Log(TEXT("==============================================================\r\n"));
     }
+
+    for(unsigned int i=0; i<summaries.Num(); i++)
+        summaries[i].FreeData();
 }
 
 void STDCALL DumpLastProfileData()
 {
-    if(ProfileNodeInfo::profilerData.Num())
+    if(firstProfileThread)
     {
         Log(TEXT("\r\nProfiler result for the last frame:"));
         Log(TEXT("=============================================================="));
-        for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
-            ProfileNodeInfo::profilerData[i].dumpLastData(ProfileNodeInfo::profilerData[i].lastCall);
+
+        OSEnterMutex(hProfilerMutex);
+        for(ProfileThreadData *thread = firstProfileThread; thread; thread = thread->next)
+        {
+            if(thread->bResetPending)
+                continue;
+
+            for(ProfileNodeInfo *root = thread->firstRoot; root; root = root->nextSibling)
+            {
+                if(root->numParallelCalls)
+                    DumpLastNodeData(root, root->lastCall);
+            }
+        }
+        OSLeaveMutex(hProfilerMutex);
+
         Log(TEXT("==============================================================\r\n"));
     }
 }
 
+//-----------------------------------------
+//timeline
+
+struct TimelineThread
+{
+    UINT threadIndex;
+    CTSTR lpName;
+    List<ProfileEvent> events;
+    bool bWrapped; //the ring was overwritten before the start of the requested window
+};
+
+struct TimelineSaveJob
+{
+    String strFile;
+    List<TimelineThread> threads;
+    QWORD saveTime;
+    DWORD seconds;
+};
+
+static String GetTimelineName(CTSTR lpName)
+{
+    String strName = lpName;
+    strName.FindReplace(TEXT("\\"), TEXT("\\\\"));
+    strName.FindReplace(TEXT("\""), TEXT("\\\""));
+    return strName;
+}
+
+//writes the chrome trace event format, which chrome://tracing and most trace viewers can open
+static DWORD STDCALL SaveTimelineThread(LPVOID param)
+{
+    TimelineSaveJob *job = (TimelineSaveJob*)param;
+
+    XFile file;
+    if(file.Open(job->strFile, XFILE_WRITE, XFILE_CREATEALWAYS))
+    {
+        UINT numEvents = 0;
+
+        file.WriteAsUTF8(TEXT("{\"traceEvents\":[\r\n"));
+
+        for(UINT i=0; i<job->threads.Num(); i++)
+        {
+            TimelineThread &thread = job->threads[i];
+
+            if(thread.bWrapped && thread.events.Num())
+            {
+                double coveredSeconds = double(job->saveTime-thread.events[0].startTime)/1000000.0;
+                Log(TEXT("Profiler: Timeline for '%s' only covers the last %g of %u seconds, it does more than %u profiled scopes in that time"),
+                    thread.lpName, coveredSeconds, job->seconds, PROFILE_TIMELINE_EVENTS);
+            }
+
+            String strLine = FormattedString(TEXT("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}"),
+                i ? TEXT(",\r\n") : TEXT(""), thread.threadIndex, GetTimelineName(thread.lpName).Array());
+            file.WriteAsUTF8(strLine, strLine.Length());
+
+            for(UINT j=0; j<thread.events.Num(); j++)
+            {
+                ProfileEvent &event = thread.events[j];
+
+                strLine = FormattedString(TEXT(",\r\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%llu,\"dur\":%u}"),
+                    GetTimelineName(event.lpName).Array(), thread.threadIndex, event.startTime, event.duration);
+                file.WriteAsUTF8(strLine, strLine.Length());
+            }
+
+            numEvents += thread.events.Num();
+        }
+
+        file.WriteAsUTF8(TEXT("\r\n]}\r\n"));
+        file.Close();
+
+        Log(TEXT("Profiler: Saved %u timeline events from %u threads to '%s'"), numEvents, job->threads.Num(), job->strFile.Array());
+    }
+    else
+        Log(TEXT("Profiler: Unable to create timeline file '%s'"), job->strFile.Array());
+
+    for(UINT i=0; i<job->threads.Num(); i++)
+        job->threads[i].events.Clear();
+    job->threads.Clear();
+
+    delete job;
+    return 0;
+}
+
+void STDCALL EnableProfileTimeline(BOOL bEnable)
+{
+    bTimelineEnabled = bEnable;
+}
+
+BOOL STDCALL SaveProfileTimeline(CTSTR lpFile, DWORD seconds)
+{
+    if(!bTimelineEnabled)
+        return FALSE;
+
+    TimelineSaveJob *job = new TimelineSaveJob;
+    job->strFile = lpFile;
+    job->saveTime = OSGetTimeMicroseconds();
+    job->seconds = seconds;
+
+    QWORD minStartTime = job->saveTime;
+    minStartTime = (minStartTime > QWORD(seconds)*1000000) ? minStartTime-QWORD(seconds)*1000000 : 0;
+
+    //only the events are copied here, the file is written on its own thread so a long frame doesn't cause more of them
+    OSEnterMutex(hProfilerMutex);
+
+    for(ProfileThreadData *thread = firstProfileThread; thread; thread = thread->next)
+    {
+        if(!thread->events || !thread->firstRoot)
+            continue;
+
+        //the slot after the newest event may be mid-write, so one less than the whole ring is taken
+        UINT end = thread->numEvents;
+        UINT count = MIN(end, PROFILE_TIMELINE_EVENTS-1);
+
+        TimelineThread *timelineThread = job->threads.CreateNew();
+        timelineThread->threadIndex = thread->threadIndex;
+        timelineThread->lpName = thread->firstRoot->lpName;
+        timelineThread->events.SetSize(count);
+
+        for(UINT i=0; i<count; i++)
+            timelineThread->events[i] = thread->events[(end-count+i) & (PROFILE_TIMELINE_EVENTS-1)];
+
+        //the thread kept going while it was being copied, anything it wrote over since then is dropped
+        UINT overwritten = thread->numEvents-end;
+        if(overwritten >= count)
+            timelineThread->events.Clear();
+        else if(overwritten)
+            timelineThread->events.RemoveRange(0, overwritten);
+
+        //the ring is sized for typical threads, a busy one can wrap before the whole window is covered
+        timelineThread->bWrapped = (end > count || overwritten) && timelineThread->events.Num() && timelineThread->events[0].startTime > minStartTime;
+
+        UINT numOld = 0;
+        while(numOld < timelineThread->events.Num() && timelineThread->events[numOld].startTime < minStartTime)
+            ++numOld;
+        if(numOld)
+            timelineThread->events.RemoveRange(0, numOld);
+    }
+
+    OSLeaveMutex(hProfilerMutex);
+
+    OSCloseThread(OSCreateThread((XTHREAD)SaveTimelineThread, job));
+    return TRUE;
+}
+
+//-----------------------------------------
+
+void STDCALL InitProfiler()
+{
+    profileThreadStorage = OSCreateThreadStorage(EndProfileThread);
+}
+
+//threads that have exited are freed here.  the ones still running can be in the middle of updating their nodes,
+//so they're only asked to reset them, and are left out of the dumps until they have
 void STDCALL FreeProfileData()
 {
-    for(unsigned int i=0; i<ProfileNodeInfo::profilerData.Num(); i++)
-        ProfileNodeInfo::profilerData[i].FreeData();
-    ProfileNodeInfo::profilerData.Clear();
+    OSEnterMutex(hProfilerMutex);
+
+    ProfileThreadData **prevNext = &firstProfileThread;
+    while(ProfileThreadData *thread = *prevNext)
+    {
+        if(thread->bExited)
+        {
+            *prevNext = thread->next;
+            delete thread;
+        }
+        else
+        {
+            thread->bResetPending = true;
+            prevNext = &thread->next;
+        }
+    }
+
+    OSLeaveMutex(hProfilerMutex);
+}
+
+//only called from TerminateXT, once nothing else is running
+void STDCALL TerminateProfiler()
+{
+    OSCloseThreadStorage(profileThreadStorage);
+
+    OSEnterMutex(hProfilerMutex);
+
+    ProfileThreadData *thread = firstProfileThread;
+    while(thread)
+    {
+        ProfileThreadData *next = thread->next;
+        delete thread;
+        thread = next;
+    }
+
+    firstProfileThread = NULL;
+    curProfileThread = NULL;
+
+    OSLeaveMutex(hProfilerMutex);
 }
 
 ProfilerNode::ProfilerNode(CTSTR lpName, bool bSingularize) : lpName(nullptr), parent(nullptr), info(nullptr)
@@ -307,34 +796,25 @@ ProfilerNode::ProfilerNode(CTSTR lpName, bool bSingularize) : lpName(nullptr), p
     if(parent)
     {
         if(!parent->lpName) return; //profiling was disabled when parent was created, so exit to avoid inconsistent results
-        ProfileNodeInfo *parentInfo = parent->info;
-        if(parentInfo)
-        {
-            info = parentInfo->FindSubProfile(lpName);
-            if(!info)
-            {
-                info = parentInfo->Children.CreateNew();
-                info->lpName = lpName;
-                info->bSingular = bSingularNode;
-            }
-        }
+        info = curProfileThread->GetNode(parent->info, lpName, bSingularNode);
     }
     else if(bProfilingEnabled)
     {
-        info = new ProfileNodeInfo;
-        info->lpName = lpName;
+        //no other node of this thread is open here, so this is where a requested reset is safe
+        ProfileThreadData *profileThread = GetProfileThread();
+        if(profileThread->bResetPending)
+            profileThread->ResetNodes();
+
+        info = profileThread->GetNode(NULL, lpName, false);
     }
     else
         return;
 
-    if (info)
-    {
-        ++info->numCalls;
-        if(!parent)
-            info->lastCall = info->numCalls;
-        else
-            info->lastCall = parent->info->numCalls;
-    }
+    ++info->numCalls;
+    if(!parent)
+        info->lastCall = info->numCalls;
+    else
+        info->lastCall = parent->info->numCalls;
 
     this->lpName = lpName;
 
@@ -355,6 +835,11 @@ ProfilerNode::~ProfilerNode()
         DWORD curTime = (DWORD)(newTime-startTime);
         info->totalTimeElapsed += curTime;
         info->lastTimeElapsed = curTime;
+        if(curTime > info->maxTimeElapsed)
+            info->maxTimeElapsed = curTime;
+        ++info->histogram[GetHistogramBucket(curTime)];
+        if(bTimelineEnabled)
+            curProfileThread->AddEvent(lpName, startTime, curTime);
         if(thread)
         {
             DWORD cpuTime = DWORD(OSGetThreadTime(thread) - cpuStartTime);
@@ -366,12 +851,6 @@ ProfilerNode::~ProfilerNode()
 
     if(!bSingularNode)
         __curProfilerNode = parent;
-
-    if(!parent && info)
-    {
-        ProfileNodeInfo::MergeProfileInfo(*info);
-        delete info;
-    }
 }
 
 void ProfilerNode::MonitorThread(HANDLE thread_)
@@ -66,3 +66,25 @@ BASE_EXPORT void STDCALL EnableProfiling(BOOL bEnable, float minPercentage=0.0f,
 BASE_EXPORT void STDCALL DumpProfileData();
 BASE_EXPORT void STDCALL DumpLastProfileData();
 BASE_EXPORT void STDCALL FreeProfileData();
+
+//timeline of every profiled scope per thread, saved as a chrome trace (chrome://tracing)
+BASE_EXPORT void STDCALL EnableProfileTimeline(BOOL bEnable);
+//saves the last few seconds of the timeline.  returns FALSE if the timeline isn't enabled
+BASE_EXPORT BOOL STDCALL SaveProfileTimeline(CTSTR lpFile, DWORD seconds);
+
+
+//allocation profiling (FastAlloc only).  allocations made while an allocation tag is in scope are counted under its name
+class BASE_EXPORT AllocationTag
+{
+    CTSTR lpPrevTag;
+
+public:
+    AllocationTag(CTSTR lpTag);
+    ~AllocationTag();
+};
+
+#define allocationTag(name)                             AllocationTag _curAllocTag(TEXT(name));
+
+BASE_EXPORT void STDCALL EnableAllocationProfiling(BOOL bEnable);
+BASE_EXPORT void STDCALL DumpAllocationProfileData();
+BASE_EXPORT void STDCALL LogTopAllocators(UINT numAllocators);
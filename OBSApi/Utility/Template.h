@@ -19,33 +19,105 @@
 
 #pragma once
 
+//NOTE: capacity was added after array/num, which changed the size of List.  OBS_API_VERSION was bumped to 0x0200
+//with it, plugins built against older headers must be rebuilt (OBS won't load them)
 template<typename T> class List
 {
 private:
     List(List const&) = delete;
-    List(List&&) = delete;
     List &operator=(List const&) = delete;
-    List &operator=(List&&) = delete;
 protected:
     T *array;
     unsigned int num;
+    unsigned int capacity;
+
+    //grows by half again each time so that repeated appends are amortized constant time
+    inline void Grow(unsigned int n)
+    {
+        if(n <= capacity)
+            return;
+
+        unsigned int newCapacity = capacity+(capacity/2);
+        if(newCapacity < 4)
+            newCapacity = 4;
+        if(newCapacity < n)
+            newCapacity = n;
+
+        Reserve(newCapacity);
+    }
+
+    inline UINT ItemIndex(const T& val) const
+    {
+        if(&val >= array && &val < array+num)
+            return UINT(&val-array);
+
+        return INVALID;
+    }
 
 public:
 
-    inline List() : array(NULL), num(0) {}
+    inline List() : array(NULL), num(0), capacity(0) {}
+    inline List(List &&list) : array(list.array), num(list.num), capacity(list.capacity)
+    {
+        zero(&list, sizeof(List<T>));
+    }
+
     inline ~List()
     {
         Clear();
     }
 
-    inline T* Array() const             {return array;}
-    inline unsigned int Num() const     {return num;}
+    inline List &operator=(List &&list)
+    {
+        if(this != &list)
+            TransferFrom(list);
+        return *this;
+    }
+
+    inline T* Array() const                 {return array;}
+    inline unsigned int Num() const         {return num;}
+    inline unsigned int Capacity() const    {return capacity;}
+
+    inline void Reserve(unsigned int n)
+    {
+        if(n <= capacity)
+            return;
+
+        array = (T*)ReAllocate(array, sizeof(T)*n);
+        capacity = n;
+    }
+
+    inline void ShrinkToFit()
+    {
+        if(capacity == num)
+            return;
+        else if(!num)
+        {
+            Clear();
+            return;
+        }
+
+        array = (T*)ReAllocate(array, sizeof(T)*num);
+        capacity = num;
+    }
 
     inline unsigned int Add(const T& val)
     {
-        array = (T*)ReAllocate(array, sizeof(T)*++num);
-        mcpy(&array[(num-1)], (void*)&val, sizeof(T));
-        return num-1;
+        if(num == capacity)
+        {
+            //val can be an item of this list, which growing would move
+            UINT valIndex = ItemIndex(val);
+            Grow(num+1);
+
+            if(valIndex != INVALID)
+            {
+                mcpy(&array[num], &array[valIndex], sizeof(T));
+                return num++;
+            }
+        }
+
+        mcpy(&array[num], (void*)&val, sizeof(T));
+        return num++;
     }
 
     inline unsigned int SafeAdd(const T& val)
@@ -65,35 +137,34 @@ public:
         assert(index <= num);
         if(index > num) return;
 
-        if(!num && !index)
+        if(index == num)
         {
             Add(val);
             return;
         }
 
         //this makes it safe to insert an item already in the list
-        T *temp = (T*)Allocate(sizeof(T));
-        mcpy(temp, &val, sizeof(T));
+        UINT valIndex = ItemIndex(val);
+        Grow(num+1);
 
-        UINT moveCount = num-index;
-        array = (T*)ReAllocate(array, sizeof(T)*++num);
-        if(moveCount)
-            mcpyrev(array+(index+1), array+index, moveCount*sizeof(T));
-        mcpy(&array[index], temp, sizeof(T));
+        mcpyrev(array+(index+1), array+index, (num-index)*sizeof(T));
+        ++num;
 
-        Free(temp);
+        if(valIndex == INVALID)
+            mcpy(&array[index], (void*)&val, sizeof(T));
+        else
+            mcpy(&array[index], &array[(valIndex >= index) ? valIndex+1 : valIndex], sizeof(T));
     }
 
+    //does not give back memory, use ShrinkToFit or Clear for that
     inline void Remove(unsigned int index)
     {
         assert(index < num);
         if(index >= num) return;
 
-        if(!--num) {Free(array); array=NULL; return;}
-
-        mcpy(&array[index], &array[index+1], sizeof(T)*(num-index));
-
-        array = (T*)ReAllocate(array, sizeof(T)*num);
+        --num;
+        if(index < num)
+            mcpy(&array[index], &array[index+1], sizeof(T)*(num-index));
     }
 
     inline void RemoveItem(const T& obj)
@@ -122,18 +193,12 @@ public:
             Remove(start);
             return;
         }
-        else if(count == num)
-        {
-            Clear();
-            return;
-        }
 
         num -= count;
 
         UINT cutoffCount = num-start;
         if(cutoffCount)
             mcpy(array+start, array+end, cutoffCount*sizeof(T));
-        array = (T*)ReAllocate(array, num*sizeof(T));
     }
 
     inline void CopyArray(const T *new_array, unsigned int n)
@@ -146,7 +211,7 @@ public:
 
         SetSize(n);
 
-        if(!num) {array=NULL; return;}
+        if(!num) return;
 
         mcpy(array, (void*)new_array, sizeof(T)*num);
     }
@@ -214,8 +279,9 @@ public:
         BOOL bClear=(n>num);
         UINT oldNum=num;
 
+        //shrinking keeps the memory around for the next time the list grows
+        Grow(n);
         num = n;
-        array = (T*)ReAllocate(array, sizeof(T)*num);
 
         if(bClear)
             zero(&array[oldNum], sizeof(T)*(num-oldNum));
@@ -306,16 +372,18 @@ public:
     inline void TransferFrom(List<T>& list)
     {
         if(array) Clear();
-        array = list.Array();
-        num   = list.Num();
+        array    = list.array;
+        num      = list.num;
+        capacity = list.capacity;
         zero(&list, sizeof(List<T>));
     }
 
     inline void TransferFrom(T *arrayIn, UINT numIn)
     {
         if(array) Clear();
-        array = arrayIn;
-        num   = numIn;
+        array    = arrayIn;
+        num      = numIn;
+        capacity = numIn;
     }
 
     inline void TransferTo(List<T>& list)
@@ -338,7 +406,7 @@ public:
                 CrashError(TEXT("what the.."));*/
             Free(array);
             array = NULL;
-            num = 0;
+            num = capacity = 0;
         }
     }
 
@@ -681,9 +749,7 @@ public:
             while(CheckAndCleanAvail());
 
             if(!num)
-                {Free(array); array = NULL;}
-            else
-                array = (T*)ReAllocate(array, sizeof(T)*num);
+                List<T>::Clear();
         }
         else
         {
@@ -706,8 +772,9 @@ public:
 
     inline void operator=(const SafeList<T>& list)
     {
-        array = list.Array();
-        num   = list.Num();
+        array    = list.Array();
+        num      = list.Num();
+        capacity = list.Capacity();
         AvailableItems = list.AvailableItems;
     }
 
@@ -26,6 +26,13 @@
   XElement
 =========================================================*/
 
+//item names are all interned, so a name that was never interned can't match anything
+static inline bool FindItemName(CTSTR lpName, InternedString &name)
+{
+    name = InternedString::FindI(lpName);
+    return name.IsValid() || !lpName || !*lpName;
+}
+
 XElement::~XElement()
 {
     DWORD i;
@@ -88,12 +95,16 @@ void  XElement::GetStringList(CTSTR lpName, StringList &stringList) const
 
     stringList.Clear();
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsData()) continue;
 
         XDataItem *item = static_cast<XDataItem*>(SubItems[i]);
-        if(item->strName.CompareI(lpName))
+        if(item->strName.CompareI(name))
             stringList << item->strData;
     }
 }
@@ -104,12 +115,16 @@ void  XElement::GetIntList(CTSTR lpName, List<int> &IntList) const
 
     IntList.Clear();
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsData()) continue;
 
         XDataItem *item = static_cast<XDataItem*>(SubItems[i]);
-        if(item->strName.CompareI(lpName))
+        if(item->strName.CompareI(name))
         {
             CTSTR lpValue = item->strData;
 
@@ -315,11 +330,15 @@ void  XElement::RemoveItem(CTSTR lpName)
 
     if(lpName)
     {
+        InternedString name;
+        if(!FindItemName(lpName, name))
+            return;
+
         for(DWORD i=0; i<SubItems.Num(); i++)
         {
             if(!SubItems[i]->IsData()) continue;
 
-            if(static_cast<XDataItem*>(SubItems[i])->strName.CompareI(lpName))
+            if(static_cast<XDataItem*>(SubItems[i])->strName.CompareI(name))
             {
                 delete SubItems[i];
                 SubItems.Remove(i--);
@@ -345,12 +364,16 @@ XElement* XElement::GetElement(CTSTR lpName) const
     if (!lpName)
         return NULL;
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return NULL;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsElement()) continue;
 
         XElement *element = static_cast<XElement*>(SubItems[i]);
-        if(element->strName.CompareI(lpName))
+        if(element->strName.CompareI(name))
             return element;
     }
 
@@ -378,6 +401,10 @@ XElement* XElement::GetElementByItem(CTSTR lpName, CTSTR lpItemName, CTSTR lpIte
     assert(lpItemName);
     assert(lpItemValue);
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return NULL;
+
     if(lpName)
     {
         for(DWORD i=0; i<SubItems.Num(); i++)
@@ -385,7 +412,7 @@ XElement* XElement::GetElementByItem(CTSTR lpName, CTSTR lpItemName, CTSTR lpIte
             if(!SubItems[i]->IsElement()) continue;
 
             XElement *element = static_cast<XElement*>(SubItems[i]);
-            if(element->strName.CompareI(lpName))
+            if(element->strName.CompareI(name))
             {
                 if(scmpi(element->GetString(lpItemName), lpItemValue) == 0)
                     return element;
@@ -474,12 +501,16 @@ void  XElement::GetElementList(CTSTR lpName, List<XElement*> &Elements) const
 {
     Elements.Clear();
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsElement()) continue;
 
         XElement *element = static_cast<XElement*>(SubItems[i]);
-        if(!lpName || element->strName.CompareI(lpName))
+        if(!lpName || element->strName.CompareI(name))
             Elements << element;
     }
 }
@@ -503,12 +534,16 @@ void  XElement::RemoveElement(CTSTR lpName)
 {
     assert(lpName);
 
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsElement()) continue;
 
         XElement *element = static_cast<XElement*>(SubItems[i]);
-        if(element->strName.CompareI(lpName))
+        if(element->strName.CompareI(name))
         {
             delete element;
             SubItems.Remove(i--);
@@ -519,12 +554,16 @@ void  XElement::RemoveElement(CTSTR lpName)
 
 XDataItem* XElement::GetDataItem(CTSTR lpName) const
 {
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return NULL;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         if(!SubItems[i]->IsData()) continue;
 
         XDataItem *data = static_cast<XDataItem*>(SubItems[i]);
-        if(data->strName.CompareI(lpName))
+        if(data->strName.CompareI(name))
             return data;
     }
 
@@ -550,9 +589,13 @@ XDataItem* XElement::GetDataItemByID(DWORD itemID) const
 
 XBaseItem* XElement::GetBaseItem(CTSTR lpName) const
 {
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return NULL;
+
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
-        if(SubItems[i]->strName.CompareI(lpName))
+        if(SubItems[i]->strName.CompareI(name))
             return SubItems[i];
     }
 
@@ -570,6 +613,10 @@ XBaseItem* XElement::GetBaseItemByID(DWORD itemID) const
 
 DWORD XElement::NumElements(CTSTR lpName)
 {
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return 0;
+
     int num=0;
 
     for(DWORD i=0; i<SubItems.Num(); i++)
@@ -577,7 +624,7 @@ DWORD XElement::NumElements(CTSTR lpName)
         if(!SubItems[i]->IsElement()) continue;
 
         XElement *element = static_cast<XElement*>(SubItems[i]);
-        if(!lpName || element->strName.CompareI(lpName))
+        if(!lpName || element->strName.CompareI(name))
             ++num;
     }
 
@@ -586,6 +633,10 @@ DWORD XElement::NumElements(CTSTR lpName)
 
 DWORD XElement::NumDataItems(CTSTR lpName)
 {
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return 0;
+
     int num=0;
 
     for(DWORD i=0; i<SubItems.Num(); i++)
@@ -593,7 +644,7 @@ DWORD XElement::NumDataItems(CTSTR lpName)
         if(!SubItems[i]->IsData()) continue;
 
         XDataItem *data = static_cast<XDataItem*>(SubItems[i]);
-        if(!lpName || data->strName.CompareI(lpName))
+        if(!lpName || data->strName.CompareI(name))
             ++num;
     }
 
@@ -602,12 +653,16 @@ DWORD XElement::NumDataItems(CTSTR lpName)
 
 DWORD XElement::NumBaseItems(CTSTR lpName)
 {
+    InternedString name;
+    if(!FindItemName(lpName, name))
+        return 0;
+
     int num=0;
 
     for(DWORD i=0; i<SubItems.Num(); i++)
     {
         XDataItem *data = static_cast<XDataItem*>(SubItems[i]);
-        if(!lpName || data->strName.CompareI(lpName))
+        if(!lpName || data->strName.CompareI(name))
             ++num;
     }
 
@@ -702,9 +757,272 @@ bool XElement::Export(CTSTR lpFile)
   XConfig
 =========================================================*/
 
-String XConfig::ConvertToTextString(String &string)
+//binary snapshot layout:  header, string offsets, string data (null terminated TCHARs), then the items in
+//the same order as the text file.  names and values are stored once each no matter how often they're used
+#define XCONFIG_CACHE_MAGIC     0x42464358 //'XCFB'
+#define XCONFIG_CACHE_VERSION   2
+#define XCONFIG_CACHE_MAX_SIZE  (256*1024*1024)
+
+struct XConfigCacheHeader
+{
+    DWORD magic, version;
+    DWORD charSize;
+
+    //the text file this was made from
+    QWORD textSize, textModifiedTime;
+
+    UINT numStrings, stringDataLength;
+    UINT numItems, numRootItems;
+
+    UINT checksum;      //of everything after the header, so damage to the strings is caught too
+};
+
+//FNV-1a a word at a time.  any single damaged word changes the result
+static UINT ChecksumCacheData(UINT checksum, LPCVOID lpData, size_t size)
+{
+    const BYTE *lpBytes = (const BYTE*)lpData;
+
+    for(; size >= sizeof(UINT); size -= sizeof(UINT), lpBytes += sizeof(UINT))
+        checksum = (checksum ^ *(const UINT*)lpBytes) * 16777619;
+    for(; size; size--)
+        checksum = (checksum ^ *(lpBytes++)) * 16777619;
+
+    return checksum;
+}
+
+struct XConfigCacheItem
+{
+    UINT type;
+    UINT name;
+    UINT value;     //string index for data items, number of sub items for elements
+};
+
+struct XConfigCacheWriter
+{
+    List<UINT> stringOffsets;
+    List<TCHAR> stringData;
+    List<XConfigCacheItem> items;
+
+    List<UINT> stringTable;     //string index+1, 0 if empty
+
+    static inline UINT HashString(CTSTR lpString)
+    {
+        UINT hash = 2166136261;
+        while(*lpString)
+            hash = (hash ^ UINT(*(lpString++))) * 16777619;
+        return hash;
+    }
+
+    void GrowStringTable()
+    {
+        UINT tableSize = stringTable.Num() ? stringTable.Num()*2 : 1024;
+        stringTable.Clear();
+        stringTable.SetSize(tableSize);
+
+        for(UINT i=0; i<stringOffsets.Num(); i++)
+        {
+            UINT pos = HashString(&stringData[stringOffsets[i]]) & (tableSize-1);
+            while(stringTable[pos])
+                pos = (pos+1) & (tableSize-1);
+            stringTable[pos] = i+1;
+        }
+    }
+
+    UINT AddString(CTSTR lpString)
+    {
+        if((stringOffsets.Num()+1)*2 > stringTable.Num())
+            GrowStringTable();
+
+        if(!lpString) lpString = TEXT("");
+        UINT tableMask = stringTable.Num()-1;
+
+        UINT pos;
+        for(pos = HashString(lpString) & tableMask; stringTable[pos]; pos = (pos+1) & tableMask)
+        {
+            UINT index = stringTable[pos]-1;
+            if(scmp(&stringData[stringOffsets[index]], lpString) == 0)
+                return index;
+        }
+
+        UINT index = stringOffsets.Num();
+        stringTable[pos] = index+1;
+
+        stringOffsets << stringData.Num();
+        stringData.AppendArray(lpString, slen(lpString)+1);
+
+        return index;
+    }
+};
+
+void XConfig::WriteCacheItems(XConfigCacheWriter &writer, XElement *curElement)
 {
-    String stringOut = string;
+    for(UINT i=0; i<curElement->SubItems.Num(); i++)
+    {
+        XBaseItem *baseItem = curElement->SubItems[i];
+
+        XConfigCacheItem &item = *writer.items.CreateNew();
+        item.type = baseItem->type;
+        item.name = writer.AddString(baseItem->strName);
+
+        if(baseItem->IsData())
+            item.value = writer.AddString(static_cast<XDataItem*>(baseItem)->strData);
+        else
+        {
+            XElement *element = static_cast<XElement*>(baseItem);
+            item.value = element->SubItems.Num();
+            WriteCacheItems(writer, element);
+        }
+    }
+}
+
+//called after the text file is written, a crash in between just leaves the snapshot out of date
+void XConfig::WriteCache()
+{
+    QWORD textModifiedTime = OSGetFileModificationTime(strFileName);
+    if(textModifiedTime == QWORD(-1))
+        return;
+
+    XConfigCacheWriter writer;
+    WriteCacheItems(writer, RootElement);
+
+    XConfigCacheHeader header;
+    zero(&header, sizeof(header));
+    header.magic = XCONFIG_CACHE_MAGIC;
+    header.version = XCONFIG_CACHE_VERSION;
+    header.charSize = sizeof(TCHAR);
+    header.textModifiedTime = textModifiedTime;
+    header.numStrings = writer.stringOffsets.Num();
+    header.stringDataLength = writer.stringData.Num();
+    header.numItems = writer.items.Num();
+    header.numRootItems = RootElement->SubItems.Num();
+
+    header.checksum = ChecksumCacheData(2166136261, writer.stringOffsets.Array(), writer.stringOffsets.Num()*sizeof(UINT));
+    header.checksum = ChecksumCacheData(header.checksum, writer.stringData.Array(), writer.stringData.Num()*sizeof(TCHAR));
+    header.checksum = ChecksumCacheData(header.checksum, writer.items.Array(), writer.items.Num()*sizeof(XConfigCacheItem));
+
+    XFile textFile;
+    if(!textFile.Open(strFileName, XFILE_READ, XFILE_OPENEXISTING))
+        return;
+    header.textSize = textFile.GetFileSize();
+    textFile.Close();
+
+    XFile cacheFile;
+    if(!cacheFile.Open(GetCachePath(), XFILE_WRITE, XFILE_CREATEALWAYS))
+        return;
+
+    cacheFile.Write(&header, sizeof(header));
+    cacheFile.Write(writer.stringOffsets.Array(), writer.stringOffsets.Num()*sizeof(UINT));
+    cacheFile.Write(writer.stringData.Array(), writer.stringData.Num()*sizeof(TCHAR));
+    cacheFile.Write(writer.items.Array(), writer.items.Num()*sizeof(XConfigCacheItem));
+    cacheFile.Close();
+}
+
+bool XConfig::ReadCacheItems(XElement *curElement, UINT numItems, const XConfigCacheItem *&curItem, const XConfigCacheItem *itemsEnd, const UINT *stringOffsets, CTSTR lpStringData, UINT numStrings)
+{
+    for(UINT i=0; i<numItems; i++)
+    {
+        if(curItem == itemsEnd)
+            return false;
+
+        const XConfigCacheItem &item = *(curItem++);
+        if(item.name >= numStrings)
+            return false;
+
+        CTSTR lpName = lpStringData+stringOffsets[item.name];
+
+        if(item.type == XConfig_Data)
+        {
+            if(item.value >= numStrings)
+                return false;
+
+            curElement->SubItems << new XDataItem(lpName, lpStringData+stringOffsets[item.value]);
+        }
+        else if(item.type == XConfig_Element)
+        {
+            XElement *newElement = curElement->CreateElement(lpName);
+            if(!ReadCacheItems(newElement, item.value, curItem, itemsEnd, stringOffsets, lpStringData, numStrings))
+                return false;
+        }
+        else
+            return false;
+    }
+
+    return true;
+}
+
+//the whole snapshot is read in one go and checked against the text file before anything is built from it
+bool XConfig::ReadCache(QWORD textSize)
+{
+    QWORD textModifiedTime = OSGetFileModificationTime(strFileName);
+    if(textModifiedTime == QWORD(-1))
+        return false;
+
+    XFile cacheFile;
+    if(!cacheFile.Open(GetCachePath(), XFILE_READ, XFILE_OPENEXISTING))
+        return false;
+
+    QWORD cacheSize = cacheFile.GetFileSize();
+    if(cacheSize < sizeof(XConfigCacheHeader) || cacheSize > XCONFIG_CACHE_MAX_SIZE)
+        return false;
+
+    LPBYTE lpCacheData = (LPBYTE)Allocate(DWORD(cacheSize));
+    bool bSuccess = false;
+
+    if(cacheFile.Read(lpCacheData, DWORD(cacheSize)) == DWORD(cacheSize))
+    {
+        XConfigCacheHeader &header = *(XConfigCacheHeader*)lpCacheData;
+
+        QWORD expectedSize = sizeof(XConfigCacheHeader) +
+                             QWORD(header.numStrings)*sizeof(UINT) +
+                             QWORD(header.stringDataLength)*sizeof(TCHAR) +
+                             QWORD(header.numItems)*sizeof(XConfigCacheItem);
+
+        if( header.magic == XCONFIG_CACHE_MAGIC             &&
+            header.version == XCONFIG_CACHE_VERSION         &&
+            header.charSize == sizeof(TCHAR)                &&
+            header.textSize == textSize                     &&
+            header.textModifiedTime == textModifiedTime     &&
+            expectedSize == cacheSize                       )
+        {
+            const UINT *stringOffsets = (const UINT*)(lpCacheData+sizeof(XConfigCacheHeader));
+            CTSTR lpStringData = (CTSTR)(stringOffsets+header.numStrings);
+            const XConfigCacheItem *items = (const XConfigCacheItem*)(lpStringData+header.stringDataLength);
+
+            UINT checksum = ChecksumCacheData(2166136261, stringOffsets, header.numStrings*sizeof(UINT));
+            checksum = ChecksumCacheData(checksum, lpStringData, header.stringDataLength*sizeof(TCHAR));
+            checksum = ChecksumCacheData(checksum, items, header.numItems*sizeof(XConfigCacheItem));
+
+            //every string has to start inside the data, and the data has to end with a null
+            bSuccess = checksum == header.checksum;
+            bSuccess = bSuccess && (!header.numStrings || (header.stringDataLength && !lpStringData[header.stringDataLength-1]));
+            for(UINT i=0; bSuccess && i<header.numStrings; i++)
+                bSuccess = stringOffsets[i] < header.stringDataLength;
+
+            if(bSuccess)
+            {
+                const XConfigCacheItem *curItem = items;
+                bSuccess = ReadCacheItems(RootElement, header.numRootItems, curItem, items+header.numItems, stringOffsets, lpStringData, header.numStrings) &&
+                           curItem == items+header.numItems;
+            }
+
+            if(!bSuccess)
+            {
+                for(UINT i=0; i<RootElement->SubItems.Num(); i++)
+                    delete RootElement->SubItems[i];
+                RootElement->SubItems.Clear();
+            }
+        }
+    }
+
+    Free(lpCacheData);
+    return bSuccess;
+}
+
+//---------------------------
+
+String XConfig::ConvertToTextString(CTSTR lpString)
+{
+    String stringOut = lpString;
     stringOut.FindReplace(TEXT("\\"), TEXT("\\\\"));
     stringOut.FindReplace(TEXT("\r"), TEXT("\\r"));
     stringOut.FindReplace(TEXT("\n"), TEXT("\\n"));
@@ -1001,7 +1319,7 @@ void  XConfig::WriteFileData(XFile &file, int indent, XElement *curElement)
 }
 
 
-bool  XConfig::Open(CTSTR lpFile)
+bool  XConfig::Open(CTSTR lpFile, bool bBinaryCache)
 {
     if(RootElement)
     {
@@ -1020,9 +1338,16 @@ bool  XConfig::Open(CTSTR lpFile)
 
     RootElement = new XElement(this, NULL, TEXT("Root"));
     strFileName = lpFile;
+    this->bBinaryCache = bBinaryCache;
 
     DWORD dwFileSize = (DWORD)file.GetFileSize();
 
+    if(bBinaryCache && ReadCache(dwFileSize))
+    {
+        file.Close();
+        return true;
+    }
+
     LPSTR lpFileDataUTF8 = (LPSTR)Allocate(dwFileSize+1);
     zero(lpFileDataUTF8, dwFileSize+1);
     file.Read(lpFileDataUTF8, dwFileSize);
@@ -1075,6 +1400,9 @@ bool  XConfig::Open(CTSTR lpFile)
 
     file.Close();
 
+    if(bBinaryCache)
+        WriteCache();
+
     return true;
 }
 
@@ -1099,5 +1427,8 @@ void  XConfig::Save()
         WriteFileData(file, 0, RootElement);
 
         file.Close();
+
+        if(bBinaryCache)
+            WriteCache();
     }
 }
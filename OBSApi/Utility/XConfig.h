@@ -39,7 +39,8 @@ protected:
 
     virtual ~XBaseItem() {}
 
-    String strName;
+    //names repeat a lot across scenes and sources, so they're stored once each
+    InternedString strName;
     int type;
 
 public:
@@ -99,8 +100,12 @@ public:
 
     inline bool HasItem(CTSTR lpName) const
     {
+        InternedString name = InternedString::FindI(lpName);
+        if (name.IsEmpty() && lpName && *lpName)
+            return false;
+
         for (UINT i=0; i<SubItems.Num(); i++) {
-            if (SubItems[i]->strName.CompareI(lpName))
+            if (SubItems[i]->strName.CompareI(name))
                 return true;
         }
 
@@ -205,29 +210,41 @@ public:
 };
 
 
+struct XConfigCacheItem;
+struct XConfigCacheWriter;
+
 class BASE_EXPORT XConfig
 {
     friend class XElement;
 
     XElement *RootElement;
     String strFileName;
+    bool bBinaryCache;
 
     bool ReadFileData(XElement *curElement, int level, TSTR &lpFileData);
     void WriteFileData(XFile &file, int indent, XElement *curElement);
     void WriteFileItem(XFile &file, int indent, XBaseItem *curItem);
 
-    static String ConvertToTextString(String &string);
+    static String ConvertToTextString(CTSTR lpString);
     static String ProcessString(TSTR &lpTemp);
 
     bool ReadFileData2(XElement *curElement, int level, TSTR &lpFileData, bool isJSON);
 
+    //binary snapshot of the parsed file, kept next to it and used instead of the text while it's up to date
+    inline String GetCachePath() const {return String() << strFileName << TEXT(".cache");}
+    bool ReadCache(QWORD textSize);
+    bool ReadCacheItems(XElement *curElement, UINT numItems, const XConfigCacheItem *&curItem, const XConfigCacheItem *itemsEnd, const UINT *stringOffsets, CTSTR lpStringData, UINT numStrings);
+    void WriteCache();
+    void WriteCacheItems(XConfigCacheWriter &writer, XElement *curElement);
+
 public:
-    inline XConfig() : RootElement(NULL) {}
-    inline XConfig(TSTR lpFile) : RootElement(NULL) {Open(lpFile);}
+    inline XConfig() : RootElement(NULL), bBinaryCache(false) {}
+    inline XConfig(TSTR lpFile) : RootElement(NULL), bBinaryCache(false) {Open(lpFile);}
 
     inline ~XConfig() {Close();}
 
-    bool    Open(CTSTR lpFile);
+    //bBinaryCache is for large files that are opened often (scene collections), parsing them is what's slow
+    bool    Open(CTSTR lpFile, bool bBinaryCache=false);
     void    Close(bool bSave=false);
     void    Save();
 
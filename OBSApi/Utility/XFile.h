@@ -255,7 +255,6 @@ public:
 
     inline QWORD GetTotalWritten() {return totalWritten;}
 
-private:
     void Flush()
     {
         if(bufferPos)
@@ -265,6 +264,8 @@ private:
         }
     }
 
+private:
+
     XFile file;
 
     DWORD bufferPos;
@@ -273,3 +274,109 @@ private:
     QWORD totalWritten;
     LPBYTE Buffer;
 };
+
+
+//-----------------------------------------
+// async output serializer
+
+#define XFILE_ASYNC_UNBUFFERED  0x1     //bypass the system file cache
+#define XFILE_ASYNC_MAPPED      0x2     //copy into a sliding mapped view instead, the system writes the pages back on its own
+
+struct XFileWriteStats
+{
+    QWORD totalWritten;
+
+    UINT numWrites;
+    QWORD totalWriteTime, maxWriteTime;     //microseconds spent in WriteFile on the I/O thread
+
+    UINT numStalls;
+    QWORD totalStallTime, maxStallTime;     //microseconds the serializing thread waited for a free buffer
+
+    //for outputs that write several files in a row
+    inline void Add(const XFileWriteStats &stats)
+    {
+        totalWritten += stats.totalWritten;
+
+        numWrites += stats.numWrites;
+        totalWriteTime += stats.totalWriteTime;
+        if(stats.maxWriteTime > maxWriteTime)
+            maxWriteTime = stats.maxWriteTime;
+
+        numStalls += stats.numStalls;
+        totalStallTime += stats.totalStallTime;
+        if(stats.maxStallTime > maxStallTime)
+            maxStallTime = stats.maxStallTime;
+    }
+};
+
+//same as XFileOutputSerializer, but full buffers are handed to a separate thread to be written, so
+//a slow disk doesn't stall the thread that's serializing until every buffer is queued up
+class BASE_EXPORT XFileAsyncOutputSerializer : public Serializer
+{
+public:
+    XFileAsyncOutputSerializer();
+    ~XFileAsyncOutputSerializer();
+
+    BOOL IsLoading() {return FALSE;}
+
+    //bufferSize is rounded up to whole sectors.  preallocSize reserves disk space ahead of the
+    //write position in steps of that many bytes (0 to disable).  mapped files use bufferSize*numBuffers
+    //as the view size and always grow the file in whole steps, cutting it back to size on close
+    BOOL Open(CTSTR lpFile, DWORD dwCreationDisposition, DWORD bufferSize=(1024*1024), UINT numBuffers=4, DWORD flags=0, QWORD preallocSize=0);
+    void Close();
+
+    void Serialize(LPCVOID lpData, DWORD length);
+
+    //seeking waits for all queued writes.  unbuffered files switch to buffered I/O from then on
+    UINT64 Seek(INT64 offset, DWORD seekType=SERIALIZE_SEEK_START);
+    UINT64 GetPos() const {return filePos+bufferPos;}
+
+    inline QWORD GetTotalWritten() {return totalWritten;}
+    inline BOOL HasWriteError() const {return bWriteError;}
+
+    //queues the current buffer (unbuffered files keep back anything past the last whole sector)
+    void Flush();
+
+    //waits until everything queued so far is in the file
+    void Sync();
+
+    void GetStats(XFileWriteStats &stats) const;
+    void LogStats(CTSTR lpName) const;
+    static void LogStats(CTSTR lpName, const XFileWriteStats &stats);
+
+private:
+    static DWORD STDCALL WriteThread(LPVOID param);
+    void WriteLoop();
+
+    void QueueBuffer(DWORD size);
+    void EndUnbuffered(bool bReopen);
+
+    bool MapView(UINT64 pos);
+    void UnmapView();
+
+    HANDLE hFile;
+    String strFile;
+
+    HANDLE hWriteThread;
+    HANDLE hFreeBuffers, hQueuedBuffers;
+
+    LPBYTE *buffers;
+    DWORD *bufferDataSizes;
+    UINT numBuffers, curBuffer;
+
+    DWORD bufferSize, bufferPos;
+    UINT64 filePos;
+    QWORD totalWritten;
+
+    bool bUnbuffered;
+    volatile bool bWriteError;
+
+    bool bMapped;
+    HANDLE hMapping;
+    LPBYTE lpView;
+    UINT64 viewStart, mappedSize, fileEnd;
+
+    QWORD preallocSize, allocatedSize;
+
+    XFileWriteStats stats;
+};
@@ -21,7 +21,7 @@
 #ifdef WIN32
 
 #define _WIN32_WINDOWS 0x0410
-#define _WIN32_WINNT   0x0403
+#define _WIN32_WINNT   0x0600
 #include <windows.h>
 #include "XT.h"
 
@@ -225,6 +225,526 @@ void XFile::Close()
     }
 }
 
+//-----------------------------------------
+
+//unbuffered writes have to be whole sectors, 4k covers both 512 byte and advanced format drives
+#define XFILE_SECTOR_SIZE 4096
+
+//mapped files grow by this much at a time if no preallocation size is given
+#define XFILE_MAPPED_EXTENT (64*1024*1024)
+
+XFileAsyncOutputSerializer::XFileAsyncOutputSerializer()
+{
+    hFile = INVALID_HANDLE_VALUE;
+    hWriteThread = hFreeBuffers = hQueuedBuffers = NULL;
+    buffers = NULL;
+    bufferDataSizes = NULL;
+    numBuffers = curBuffer = 0;
+    bufferSize = bufferPos = 0;
+    filePos = totalWritten = 0;
+    bUnbuffered = false;
+    bWriteError = false;
+    preallocSize = allocatedSize = 0;
+    bMapped = false;
+    hMapping = NULL;
+    lpView = NULL;
+    viewStart = mappedSize = fileEnd = 0;
+    zero(&stats, sizeof(stats));
+}
+
+XFileAsyncOutputSerializer::~XFileAsyncOutputSerializer()
+{
+    Close();
+}
+
+BOOL XFileAsyncOutputSerializer::Open(CTSTR lpFile, DWORD dwCreationDisposition, DWORD bufferSize, UINT numBuffers, DWORD flags, QWORD preallocSize)
+{
+    assert(lpFile);
+
+    if(!bufferSize) bufferSize = 1024*1024;
+    if(numBuffers < 2) numBuffers = 2;
+
+    bMapped = (flags & XFILE_ASYNC_MAPPED) != 0;
+    bUnbuffered = !bMapped && (flags & XFILE_ASYNC_UNBUFFERED) != 0;
+
+    if(bMapped)
+    {
+        //mapping a file for writing needs read access too
+        hFile = CreateFile(lpFile, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, NULL, dwCreationDisposition, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(hFile == INVALID_HANDLE_VALUE)
+            return FALSE;
+
+        strFile = lpFile;
+
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+
+        //views have to start on allocation granularity boundaries
+        DWORD viewSize = bufferSize*numBuffers;
+        this->bufferSize = (viewSize+si.dwAllocationGranularity-1) / si.dwAllocationGranularity * si.dwAllocationGranularity;
+        this->numBuffers = 0;
+        this->preallocSize = preallocSize ? preallocSize : XFILE_MAPPED_EXTENT;
+
+        curBuffer = bufferPos = 0;
+        filePos = totalWritten = allocatedSize = 0;
+        viewStart = mappedSize = fileEnd = 0;
+        bWriteError = false;
+        zero(&stats, sizeof(stats));
+        return TRUE;
+    }
+
+    DWORD dwFlags = FILE_ATTRIBUTE_NORMAL|FILE_FLAG_SEQUENTIAL_SCAN;
+    if(bUnbuffered)
+        dwFlags |= FILE_FLAG_NO_BUFFERING;
+
+    hFile = CreateFile(lpFile, GENERIC_WRITE, FILE_SHARE_READ, NULL, dwCreationDisposition, dwFlags, NULL);
+    if(hFile == INVALID_HANDLE_VALUE)
+        return FALSE;
+
+    strFile = lpFile;
+
+    this->bufferSize = (bufferSize+XFILE_SECTOR_SIZE-1) & ~(XFILE_SECTOR_SIZE-1);
+    this->numBuffers = numBuffers;
+    this->preallocSize = preallocSize;
+
+    //VirtualAlloc gives page aligned memory, which unbuffered I/O needs
+    buffers = (LPBYTE*)Allocate(sizeof(LPBYTE)*numBuffers);
+    bufferDataSizes = (DWORD*)Allocate(sizeof(DWORD)*numBuffers);
+    for(UINT i=0; i<numBuffers; i++)
+    {
+        buffers[i] = (LPBYTE)VirtualAlloc(NULL, this->bufferSize, MEM_COMMIT|MEM_RESERVE, PAGE_READWRITE);
+        bufferDataSizes[i] = 0;
+
+        if(!buffers[i])
+        {
+            Log(TEXT("XFileAsyncOutputSerializer: Could not allocate write buffers for '%s': %s"), lpFile, OSGetErrorString(GetLastError()));
+
+            while(i--)
+                VirtualFree(buffers[i], 0, MEM_RELEASE);
+
+            Free(buffers);
+            Free(bufferDataSizes);
+            buffers = NULL;
+            bufferDataSizes = NULL;
+
+            CloseHandle(hFile);
+            hFile = INVALID_HANDLE_VALUE;
+            return FALSE;
+        }
+    }
+
+    curBuffer = bufferPos = 0;
+    filePos = totalWritten = allocatedSize = 0;
+    bWriteError = false;
+    zero(&stats, sizeof(stats));
+
+    //the serializing thread always owns one buffer, the rest start out free
+    hFreeBuffers = CreateSemaphore(NULL, numBuffers-1, numBuffers-1, NULL);
+    hQueuedBuffers = CreateSemaphore(NULL, 0, numBuffers, NULL);
+
+    hWriteThread = OSCreateThread((XTHREAD)WriteThread, this);
+    return TRUE;
+}
+
+void XFileAsyncOutputSerializer::Close()
+{
+    if(hFile == INVALID_HANDLE_VALUE)
+        return;
+
+    if(bMapped)
+    {
+        UnmapView();
+
+        if(hMapping)
+        {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+
+        //drop whatever's left of the last extent
+        LARGE_INTEGER move;
+        move.QuadPart = fileEnd;
+        SetFilePointerEx(hFile, move, NULL, FILE_BEGIN);
+        SetEndOfFile(hFile);
+
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+        bMapped = false;
+        return;
+    }
+
+    if(bUnbuffered)
+        EndUnbuffered(false);
+    else
+        Sync();
+
+    //a zero sized buffer tells the I/O thread to exit
+    bufferDataSizes[curBuffer] = 0;
+    ReleaseSemaphore(hQueuedBuffers, 1, NULL);
+
+    OSWaitForThread(hWriteThread, NULL);
+    OSCloseThread(hWriteThread);
+    hWriteThread = NULL;
+
+    CloseHandle(hFreeBuffers);
+    CloseHandle(hQueuedBuffers);
+    hFreeBuffers = hQueuedBuffers = NULL;
+
+    //any space preallocated past the end of the file is released when the handle closes
+    CloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+
+    for(UINT i=0; i<numBuffers; i++)
+        VirtualFree(buffers[i], 0, MEM_RELEASE);
+
+    Free(buffers);
+    Free(bufferDataSizes);
+    buffers = NULL;
+    bufferDataSizes = NULL;
+}
+
+void XFileAsyncOutputSerializer::Serialize(LPCVOID lpData, DWORD length)
+{
+    assert(lpData);
+
+    LPBYTE lpTemp = (LPBYTE)lpData;
+
+    totalWritten += length;
+
+    if(bMapped)
+    {
+        while(length)
+        {
+            if(!lpView || filePos < viewStart || filePos >= viewStart+bufferSize)
+            {
+                if(!MapView(filePos))
+                {
+                    bWriteError = true;
+                    return;
+                }
+            }
+
+            DWORD viewOffset = DWORD(filePos-viewStart);
+            DWORD dwWriteSize = MIN(length, (bufferSize-viewOffset));
+
+            mcpy(lpView+viewOffset, lpTemp, dwWriteSize);
+
+            lpTemp += dwWriteSize;
+            filePos += dwWriteSize;
+
+            length -= dwWriteSize;
+        }
+
+        if(filePos > fileEnd)
+            fileEnd = filePos;
+        return;
+    }
+
+    while(length)
+    {
+        if(bufferPos == bufferSize)
+            Flush();
+
+        DWORD dwWriteSize = MIN(length, (bufferSize-bufferPos));
+
+        mcpy(buffers[curBuffer]+bufferPos, lpTemp, dwWriteSize);
+
+        lpTemp += dwWriteSize;
+        bufferPos += dwWriteSize;
+
+        length -= dwWriteSize;
+    }
+}
+
+UINT64 XFileAsyncOutputSerializer::Seek(INT64 offset, DWORD seekType)
+{
+    //the view just moves on the next write
+    if(bMapped)
+    {
+        if(seekType == SERIALIZE_SEEK_CURRENT)
+            filePos += offset;
+        else if(seekType == SERIALIZE_SEEK_END)
+            filePos = fileEnd+offset;
+        else
+            filePos = offset;
+
+        return filePos;
+    }
+
+    //sector aligned writes only work for straight appends
+    if(bUnbuffered)
+        EndUnbuffered(true);
+    else
+        Sync();
+
+    DWORD moveMethod = FILE_BEGIN;
+    if(seekType == SERIALIZE_SEEK_CURRENT)
+        moveMethod = FILE_CURRENT;
+    else if(seekType == SERIALIZE_SEEK_END)
+        moveMethod = FILE_END;
+
+    LARGE_INTEGER move, newPos;
+    move.QuadPart = offset;
+    newPos.QuadPart = 0;
+    SetFilePointerEx(hFile, move, &newPos, moveMethod);
+
+    filePos = newPos.QuadPart;
+    return filePos;
+}
+
+void XFileAsyncOutputSerializer::Flush()
+{
+    //mapped pages are already in the system cache, which writes them back by itself
+    if(bMapped)
+        return;
+
+    DWORD queueSize = bufferPos;
+    if(bUnbuffered)
+        queueSize &= ~(XFILE_SECTOR_SIZE-1);
+
+    if(!queueSize)
+        return;
+
+    UINT lastBuffer = curBuffer;
+    DWORD tailSize = bufferPos-queueSize;
+
+    QueueBuffer(queueSize);
+
+    //the I/O thread only reads the part that was queued, so the tail can be copied over while it works
+    if(tailSize)
+        mcpy(buffers[curBuffer], buffers[lastBuffer]+queueSize, tailSize);
+
+    filePos += queueSize;
+    bufferPos = tailSize;
+}
+
+void XFileAsyncOutputSerializer::Sync()
+{
+    if(bMapped)
+        return;
+
+    Flush();
+
+    for(UINT i=1; i<numBuffers; i++)
+        WaitForSingleObject(hFreeBuffers, INFINITE);
+    ReleaseSemaphore(hFreeBuffers, numBuffers-1, NULL);
+}
+
+void XFileAsyncOutputSerializer::QueueBuffer(DWORD size)
+{
+    bufferDataSizes[curBuffer] = size;
+    ReleaseSemaphore(hQueuedBuffers, 1, NULL);
+
+    curBuffer = (curBuffer+1) % numBuffers;
+
+    //backpressure: if the disk can't keep up, the serializing thread has to wait here
+    if(WaitForSingleObject(hFreeBuffers, 0) == WAIT_TIMEOUT)
+    {
+        QWORD startTime = OSGetTimeMicroseconds();
+        WaitForSingleObject(hFreeBuffers, INFINITE);
+        QWORD stallTime = OSGetTimeMicroseconds()-startTime;
+
+        stats.numStalls++;
+        stats.totalStallTime += stallTime;
+        if(stallTime > stats.maxStallTime)
+            stats.maxStallTime = stallTime;
+    }
+}
+
+void XFileAsyncOutputSerializer::EndUnbuffered(bool bReopen)
+{
+    Sync();
+
+    //write out what's left padded to a whole sector, then cut the file back down to size
+    UINT64 endPos = filePos+bufferPos;
+    if(bufferPos)
+    {
+        DWORD paddedSize = (bufferPos+XFILE_SECTOR_SIZE-1) & ~(XFILE_SECTOR_SIZE-1);
+        zero(buffers[curBuffer]+bufferPos, paddedSize-bufferPos);
+
+        DWORD dwWritten;
+        if(!WriteFile(hFile, buffers[curBuffer], paddedSize, &dwWritten, NULL) || dwWritten != paddedSize)
+            bWriteError = true;
+
+        LARGE_INTEGER move;
+        move.QuadPart = endPos;
+        SetFilePointerEx(hFile, move, NULL, FILE_BEGIN);
+        SetEndOfFile(hFile);
+    }
+
+    filePos = endPos;
+    bufferPos = 0;
+    bUnbuffered = false;
+
+    if(bReopen)
+    {
+        CloseHandle(hFile);
+        hFile = CreateFile(strFile, GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(hFile == INVALID_HANDLE_VALUE)
+            CrashError(TEXT("XFileAsyncOutputSerializer: Could not reopen '%s' for buffered writing"), strFile.Array());
+
+        LARGE_INTEGER move;
+        move.QuadPart = endPos;
+        SetFilePointerEx(hFile, move, NULL, FILE_BEGIN);
+    }
+}
+
+bool XFileAsyncOutputSerializer::MapView(UINT64 pos)
+{
+    QWORD startTime = OSGetTimeMicroseconds();
+
+    UnmapView();
+
+    UINT64 newViewStart = pos - (pos % bufferSize);
+    UINT64 viewEnd = newViewStart+bufferSize;
+
+    //a mapping can't grow, so the file is extended a whole step at a time and mapped again.  extending
+    //up front also means running out of disk space shows up here rather than as a page fault later
+    if(viewEnd > mappedSize)
+    {
+        if(hMapping)
+        {
+            CloseHandle(hMapping);
+            hMapping = NULL;
+        }
+
+        LARGE_INTEGER newSize;
+        newSize.QuadPart = (viewEnd+preallocSize-1) / preallocSize * preallocSize;
+        if(!SetFilePointerEx(hFile, newSize, NULL, FILE_BEGIN) || !SetEndOfFile(hFile))
+        {
+            if(!bWriteError)
+                Log(TEXT("XFileAsyncOutputSerializer: Could not extend '%s': %s"), strFile.Array(), OSGetErrorString(GetLastError()));
+            return false;
+        }
+
+        mappedSize = newSize.QuadPart;
+    }
+
+    if(!hMapping)
+    {
+        hMapping = CreateFileMapping(hFile, NULL, PAGE_READWRITE, 0, 0, NULL);
+        if(!hMapping)
+        {
+            if(!bWriteError)
+                Log(TEXT("XFileAsyncOutputSerializer: Could not map '%s': %s"), strFile.Array(), OSGetErrorString(GetLastError()));
+            return false;
+        }
+    }
+
+    lpView = (LPBYTE)MapViewOfFile(hMapping, FILE_MAP_WRITE, DWORD(newViewStart>>32), DWORD(newViewStart), bufferSize);
+    if(!lpView)
+    {
+        if(!bWriteError)
+            Log(TEXT("XFileAsyncOutputSerializer: Could not map a view of '%s': %s"), strFile.Array(), OSGetErrorString(GetLastError()));
+        return false;
+    }
+
+    viewStart = newViewStart;
+
+    QWORD mapTime = OSGetTimeMicroseconds()-startTime;
+
+    stats.numWrites++;
+    stats.totalWriteTime += mapTime;
+    if(mapTime > stats.maxWriteTime)
+        stats.maxWriteTime = mapTime;
+
+    return true;
+}
+
+//unmapping doesn't wait for the dirty pages, they're written back lazily
+void XFileAsyncOutputSerializer::UnmapView()
+{
+    if(lpView)
+    {
+        UnmapViewOfFile(lpView);
+        lpView = NULL;
+    }
+}
+
+DWORD STDCALL XFileAsyncOutputSerializer::WriteThread(LPVOID param)
+{
+    ((XFileAsyncOutputSerializer*)param)->WriteLoop();
+    return 0;
+}
+
+void XFileAsyncOutputSerializer::WriteLoop()
+{
+    UINT index = 0;
+
+    while(true)
+    {
+        WaitForSingleObject(hQueuedBuffers, INFINITE);
+
+        DWORD size = bufferDataSizes[index];
+        if(!size)
+            break;
+
+        if(preallocSize)
+        {
+            LARGE_INTEGER zeroMove, curPos;
+            zeroMove.QuadPart = 0;
+            SetFilePointerEx(hFile, zeroMove, &curPos, FILE_CURRENT);
+
+            //reserving extents ahead of time keeps the file from fragmenting, and unlike
+            //SetEndOfFile it doesn't change the file size if we crash
+            if(QWORD(curPos.QuadPart)+size > allocatedSize)
+            {
+                FILE_ALLOCATION_INFO allocInfo;
+                allocInfo.AllocationSize.QuadPart = (curPos.QuadPart+size+preallocSize-1) / preallocSize * preallocSize;
+                if(SetFileInformationByHandle(hFile, FileAllocationInfo, &allocInfo, sizeof(allocInfo)))
+                    allocatedSize = allocInfo.AllocationSize.QuadPart;
+                else
+                    preallocSize = 0;
+            }
+        }
+
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        DWORD dwWritten;
+        if(!WriteFile(hFile, buffers[index], size, &dwWritten, NULL) || dwWritten != size)
+        {
+            if(!bWriteError)
+                Log(TEXT("XFileAsyncOutputSerializer: Write to '%s' failed: %s"), strFile.Array(), OSGetErrorString(GetLastError()));
+            bWriteError = true;
+        }
+
+        QWORD writeTime = OSGetTimeMicroseconds()-startTime;
+
+        stats.numWrites++;
+        stats.totalWriteTime += writeTime;
+        if(writeTime > stats.maxWriteTime)
+            stats.maxWriteTime = writeTime;
+
+        index = (index+1) % numBuffers;
+        ReleaseSemaphore(hFreeBuffers, 1, NULL);
+    }
+}
+
+void XFileAsyncOutputSerializer::GetStats(XFileWriteStats &stats) const
+{
+    stats = this->stats;
+    stats.totalWritten = totalWritten;
+}
+
+void XFileAsyncOutputSerializer::LogStats(CTSTR lpName) const
+{
+    XFileWriteStats curStats;
+    GetStats(curStats);
+
+    LogStats(lpName, curStats);
+}
+
+void XFileAsyncOutputSerializer::LogStats(CTSTR lpName, const XFileWriteStats &curStats)
+{
+    double avgWriteTime = curStats.numWrites ? double(curStats.totalWriteTime)/double(curStats.numWrites)/1000.0 : 0.0;
+
+    Log(TEXT("%s: %llu bytes written in %u writes, average write time %g ms, max %g ms"), lpName,
+        curStats.totalWritten, curStats.numWrites, avgWriteTime, double(curStats.maxWriteTime)/1000.0);
+    if(curStats.numStalls)
+        Log(TEXT("%s: disk fell behind %u times, stalled for %g ms total, max %g ms"), lpName,
+            curStats.numStalls, double(curStats.totalStallTime)/1000.0, double(curStats.maxStallTime)/1000.0);
+}
+
 String GetPathFileName(CTSTR lpPath, BOOL bExtension)
 {
     assert(lpPath);
@@ -48,7 +48,7 @@
 
 String::String()
 {
-    curLength = 0;
+    curLength = capacity = 0;
     lpString = NULL;
 }
 
@@ -57,13 +57,14 @@ String::String(LPCSTR str)
 #ifdef UNICODE
     if(!str)
     {
-        curLength = 0;
+        curLength = capacity = 0;
         lpString = NULL;
         return;
     }
 
     size_t utf8Len = strlen(str);
     curLength = (UINT)utf8_to_wchar_len(str, utf8Len, 0);
+    capacity = curLength ? curLength+1 : 0;
 
     if(curLength)
     {
@@ -75,12 +76,13 @@ String::String(LPCSTR str)
 #else
     if(!str)
     {
-        curLength = 0;
+        curLength = capacity = 0;
         lpString = NULL;
         return;
     }
 
     curLength = slen(str);
+    capacity = curLength ? curLength+1 : 0;
 
     if(curLength)
     {
@@ -97,12 +99,13 @@ String::String(CWSTR str)
 #ifdef UNICODE
     if(!str)
     {
-        curLength = 0;
+        curLength = capacity = 0;
         lpString = NULL;
         return;
     }
 
     curLength = slen(str);
+    capacity = curLength ? curLength+1 : 0;
 
     if(curLength)
     {
@@ -114,13 +117,14 @@ String::String(CWSTR str)
 #else
     if(!str)
     {
-        curLength = 0;
+        curLength = capacity = 0;
         lpString = NULL;
         return;
     }
 
     size_t wideLen = wcslen(str);
     curLength = (UINT)wchar_to_utf8_len(str, wideLen, 0);
+    capacity = curLength ? curLength+1 : 0;
 
     if(curLength)
     {
@@ -135,6 +139,8 @@ String::String(CWSTR str)
 String::String(const String &str)
 {
     curLength = str.curLength;
+    capacity = curLength ? curLength+1 : 0;
+
     if(curLength)
     {
         lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
@@ -151,6 +157,25 @@ String::~String()
         Free(lpString);
 }
 
+//makes room for length characters plus the null.  appends grow the buffer by half again so building a
+//string up a piece at a time doesn't reallocate for every piece.  the buffer is kept when the string shrinks
+void String::ReserveLength(UINT length, bool bAppend)
+{
+    UINT newCapacity = length+1;
+    if(newCapacity <= capacity)
+        return;
+
+    if(bAppend)
+    {
+        UINT grownCapacity = MAX(capacity+(capacity/2), 16);
+        if(grownCapacity > newCapacity)
+            newCapacity = grownCapacity;
+    }
+
+    lpString = (TSTR)ReAllocate(lpString, newCapacity*sizeof(TCHAR));
+    capacity = newCapacity;
+}
+
 
 String& String::operator=(CTSTR str)
 {
@@ -161,15 +186,11 @@ String& String::operator=(CTSTR str)
 
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        ReserveLength(curLength, false);
         scpy(lpString, str);
     }
     else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+        Clear();
 
     return *this;
 }
@@ -186,28 +207,10 @@ String& String::operator+=(CTSTR str)
     if(!strLength)
         return *this;
 
+    ReserveLength(curLength+strLength, true);
+    scpy(lpString+curLength, str);
     curLength += strLength;
 
-    if(curLength)
-    {
-        if(lpString)
-        {
-            lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
-            scat(lpString, str);
-        }
-        else
-        {
-            lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
-            scpy(lpString, str);
-        }
-    }
-    else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
-
     return *this;
 }
 
@@ -220,7 +223,7 @@ String  String::operator+(CTSTR str) const
 String& String::operator=(TCHAR ch)
 {
     curLength = 1;
-    lpString = (TSTR)ReAllocate(lpString, 2);
+    ReserveLength(1, false);
     *lpString = ch;
     lpString[1] = 0;
 
@@ -229,8 +232,8 @@ String& String::operator=(TCHAR ch)
 
 String& String::operator+=(TCHAR ch)
 {
+    ReserveLength(curLength+1, true);
     ++curLength;
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
     lpString[curLength-1] = ch;
     lpString[curLength]   = 0;
 
@@ -294,19 +297,18 @@ String  String::operator+(unsigned int unumber) const
 
 String& String::operator=(const String &str)
 {
+    if(&str == this)
+        return *this;
+
     curLength = str.curLength;
 
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        ReserveLength(curLength, false);
         scpy(lpString, str.lpString);
     }
     else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+        Clear();
 
     return *this;
 }
@@ -316,27 +318,13 @@ String& String::operator+=(const String &str)
     if(!str.curLength)
         return *this;
 
-    curLength += str.curLength;
+    //str can be this string, so take its length before growing
+    UINT strLength = str.curLength;
 
-    if(curLength)
-    {
-        if(lpString)
-        {
-            lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
-            scat(lpString, str.lpString);
-        }
-        else
-        {
-            lpString = (TSTR)Allocate((curLength+1)*sizeof(TCHAR));
-            scpy(lpString, str.lpString);
-        }
-    }
-    else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+    ReserveLength(curLength+strLength, true);
+    mcpy(lpString+curLength, str.lpString, strLength*sizeof(TCHAR));
+    curLength += strLength;
+    lpString[curLength] = 0;
 
     return *this;
 }
@@ -476,7 +464,8 @@ String& String::FindReplace(CTSTR strFind, CTSTR strReplace)
         {
             curLength += (replaceLen-findLen)*nOccurences;
 
-            lpTemp = lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+            ReserveLength(curLength, false);
+            lpTemp = lpString;
 
             while(lpTemp = sstr(lpTemp, strFind))
             {
@@ -516,7 +505,7 @@ void String::InsertString(UINT dwPos, CTSTR str)
 
     if(strLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+strLength+1)*sizeof(TCHAR));
+        ReserveLength(curLength+strLength, true);
 
         TSTR lpPos = lpString+dwPos;
         mcpyrev(lpPos+strLength, lpPos, ((curLength+1)-dwPos)*sizeof(TCHAR));
@@ -540,22 +529,10 @@ String& String::AppendString(CTSTR str, UINT count)
     if(!strLength)
         return *this;
 
-    UINT oldLen = curLength;
-
+    ReserveLength(curLength+strLength, true);
+    scpy_n(lpString+curLength, str, strLength);
     curLength += strLength;
 
-    if(curLength)
-    {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
-        scpy_n(lpString+oldLen, str, strLength);
-    }
-    else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
-
     return *this;
 }
 
@@ -587,7 +564,7 @@ String& String::Clear()
     if(lpString)
         Free(lpString);
     lpString = NULL;
-    curLength = 0;
+    curLength = capacity = 0;
 
     return *this;
 }
@@ -737,7 +714,7 @@ String& String::SetLength(UINT length)
     curLength = length;
     if(curLength)
     {
-        lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
+        ReserveLength(curLength, false);
 
         if(oldLength < curLength)
             zero(&lpString[oldLength], ((curLength+1)-oldLength)*sizeof(TCHAR));
@@ -745,11 +722,7 @@ String& String::SetLength(UINT length)
             lpString[length] = 0;
     }
     else
-    {
-        if(lpString)
-            Free(lpString);
-        lpString = NULL;
-    }
+        Clear();
 
     return *this;
 }
@@ -771,7 +744,6 @@ void String::RemoveRange(unsigned int from, unsigned int to)
     unsigned int remainderLength = (curLength+1)-to;
     curLength -= delLength;
     mcpy(lpString+from, lpString+to, remainderLength*sizeof(TCHAR));
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
 }
 
 
@@ -788,10 +760,12 @@ String& String::InsertChar(UINT pos, TCHAR chr)
         return *this;
     }
     
+    ReserveLength(curLength+1, true);
     ++curLength;
-    lpString = (TSTR)ReAllocate(lpString, (curLength+1)*sizeof(TCHAR));
     if(curLength > 1)
         mcpyrev(lpString+pos+1, lpString+pos, (curLength-pos)*sizeof(TCHAR));
+    else
+        lpString[1] = 0;
 
     lpString[pos] = chr;
 
@@ -813,7 +787,6 @@ String& String::RemoveChar(UINT pos)
     {
         if(pos < curLength)
             mcpy(lpString+pos, lpString+pos+1, (curLength-pos)*sizeof(TCHAR));
-        lpString = (TSTR)ReAllocate(lpString, (curLength)*sizeof(TCHAR));
         --curLength;
     }
 
@@ -1921,3 +1894,220 @@ UINT64 tstoui64(TCHAR *lpInt)
 {
     return (UINT64)tstring_base_to_uint64(lpInt, NULL, 10);
 }
+
+//---------------------------------------------------------
+
+static HANDLE hInternMutex = NULL;
+static InternedStringEntry **internBuckets = NULL;
+static UINT numInternBuckets = 0, numInternedStrings = 0;
+
+//ascii only, the same as scmpi
+static inline TCHAR FoldInternChar(TCHAR ch)
+{
+    return (ch >= 'A' && ch <= 'Z') ? TCHAR(ch+('a'-'A')) : ch;
+}
+
+static UINT HashInternString(CTSTR lpStr, UINT length, bool bFold)
+{
+    UINT hash = 2166136261;
+    for(UINT i=0; i<length; i++)
+    {
+        TCHAR ch = bFold ? FoldInternChar(lpStr[i]) : lpStr[i];
+        hash = (hash ^ UINT(ch & TCHARMASK)) * 16777619;
+    }
+
+    return hash;
+}
+
+//with bFold, only looks at folded entries and compares against the folded spelling of lpStr
+static InternedStringEntry* FindInternEntry(CTSTR lpStr, UINT length, UINT hash, bool bFold)
+{
+    if(!numInternBuckets)
+        return NULL;
+
+    for(InternedStringEntry *entry = internBuckets[hash & (numInternBuckets-1)]; entry; entry = entry->next)
+    {
+        if(entry->hash != hash || entry->length != length)
+            continue;
+
+        if(bFold)
+        {
+            if(entry->folded != entry)
+                continue;
+
+            UINT i;
+            for(i=0; i<length; i++)
+            {
+                if(FoldInternChar(lpStr[i]) != entry->str[i])
+                    break;
+            }
+
+            if(i == length)
+                return entry;
+        }
+        else if(mcmp(entry->str, lpStr, length*sizeof(TCHAR)))
+            return entry;
+    }
+
+    return NULL;
+}
+
+static void GrowInternTable()
+{
+    UINT newNumBuckets = numInternBuckets ? numInternBuckets*2 : 256;
+
+    InternedStringEntry **newBuckets = (InternedStringEntry**)Allocate(newNumBuckets*sizeof(InternedStringEntry*));
+    zero(newBuckets, newNumBuckets*sizeof(InternedStringEntry*));
+
+    for(UINT i=0; i<numInternBuckets; i++)
+    {
+        InternedStringEntry *entry = internBuckets[i];
+        while(entry)
+        {
+            InternedStringEntry *next = entry->next;
+            InternedStringEntry *&bucket = newBuckets[entry->hash & (newNumBuckets-1)];
+
+            entry->next = bucket;
+            bucket = entry;
+
+            entry = next;
+        }
+    }
+
+    if(internBuckets)
+        Free(internBuckets);
+
+    internBuckets = newBuckets;
+    numInternBuckets = newNumBuckets;
+}
+
+static InternedStringEntry* AddInternEntry(CTSTR lpStr, UINT length, UINT hash, bool bFold)
+{
+    if(numInternedStrings >= numInternBuckets)
+        GrowInternTable();
+
+    InternedStringEntry *entry = (InternedStringEntry*)Allocate(sizeof(InternedStringEntry)+length*sizeof(TCHAR));
+    for(UINT i=0; i<length; i++)
+        entry->str[i] = bFold ? FoldInternChar(lpStr[i]) : lpStr[i];
+    entry->str[length] = 0;
+
+    entry->length = length;
+    entry->hash = hash;
+    entry->folded = entry;
+
+    InternedStringEntry *&bucket = internBuckets[hash & (numInternBuckets-1)];
+    entry->next = bucket;
+    bucket = entry;
+
+    ++numInternedStrings;
+    return entry;
+}
+
+static InternedStringEntry* InternString(CTSTR lpStr)
+{
+    if(!lpStr || !*lpStr)
+        return NULL;
+
+    UINT length = slen(lpStr);
+    UINT hash = HashInternString(lpStr, length, false);
+
+    OSEnterMutex(hInternMutex);
+
+    InternedStringEntry *entry = FindInternEntry(lpStr, length, hash, false);
+    if(!entry)
+    {
+        entry = AddInternEntry(lpStr, length, hash, false);
+
+        //an all lower case spelling is its own folded entry
+        UINT i;
+        for(i=0; i<length; i++)
+        {
+            if(FoldInternChar(lpStr[i]) != lpStr[i])
+                break;
+        }
+
+        if(i < length)
+        {
+            UINT foldedHash = HashInternString(lpStr, length, true);
+
+            InternedStringEntry *folded = FindInternEntry(lpStr, length, foldedHash, true);
+            if(!folded)
+                folded = AddInternEntry(lpStr, length, foldedHash, true);
+
+            entry->folded = folded;
+        }
+    }
+
+    OSLeaveMutex(hInternMutex);
+
+    return entry;
+}
+
+InternedString::InternedString(CTSTR lpStr)
+{
+    entry = InternString(lpStr);
+}
+
+InternedString& InternedString::operator=(CTSTR lpStr)
+{
+    entry = InternString(lpStr);
+    return *this;
+}
+
+InternedString InternedString::FindI(CTSTR lpStr)
+{
+    InternedString str;
+    if(!lpStr || !*lpStr)
+        return str;
+
+    UINT length = slen(lpStr);
+    UINT hash = HashInternString(lpStr, length, true);
+
+    OSEnterMutex(hInternMutex);
+    str.entry = FindInternEntry(lpStr, length, hash, true);
+    OSLeaveMutex(hInternMutex);
+
+    return str;
+}
+
+BOOL InternedString::CompareI(CTSTR lpStr) const
+{
+    if(!entry)
+        return !lpStr || (lpStr[0] == 0);
+
+    return lpStr && scmpi(entry->str, lpStr) == 0;
+}
+
+void STDCALL InitInternedStrings()
+{
+    hInternMutex = OSCreateMutex();
+}
+
+//entries belong to the allocator, so this has to happen before it's replaced
+void STDCALL FreeInternedStrings()
+{
+    for(UINT i=0; i<numInternBuckets; i++)
+    {
+        InternedStringEntry *entry = internBuckets[i];
+        while(entry)
+        {
+            InternedStringEntry *next = entry->next;
+            Free(entry);
+            entry = next;
+        }
+    }
+
+    if(internBuckets)
+        Free(internBuckets);
+
+    internBuckets = NULL;
+    numInternBuckets = numInternedStrings = 0;
+}
+
+void STDCALL TerminateInternedStrings()
+{
+    FreeInternedStrings();
+
+    OSCloseMutex(hInternMutex);
+    hInternMutex = NULL;
+}
@@ -78,6 +78,9 @@ class BASE_EXPORT String
 {
     TSTR lpString;
     unsigned int curLength;
+    unsigned int capacity;
+
+    void ReserveLength(UINT length, bool bAppend);
 
 public:
     String();
@@ -197,6 +200,50 @@ BASE_EXPORT String FormattedString(CTSTR lpFormat, ...);
 WORD StringCRC16(CTSTR lpData);
 WORD StringCRC16I(CTSTR lpData);
 
+//---------------------------------------------------------
+// interned strings are stored once for the life of the program, so two of them are equal if they point to
+// the same entry.  spellings that only differ in case share a folded entry, which is what CompareI checks
+
+struct InternedStringEntry
+{
+    InternedStringEntry *next;
+    InternedStringEntry *folded;
+    UINT hash, length;
+    TCHAR str[1];
+};
+
+class BASE_EXPORT InternedString
+{
+    InternedStringEntry *entry;
+
+public:
+    inline InternedString() : entry(NULL) {}
+    InternedString(CTSTR lpStr);
+
+    InternedString& operator=(CTSTR lpStr);
+
+    //finds the folded entry for lpStr without adding anything.  empty if no spelling of it has been interned,
+    //in which case nothing interned can match it with CompareI
+    static InternedString FindI(CTSTR lpStr);
+
+    inline CTSTR Array() const                  {return entry ? entry->str : NULL;}
+    inline operator CTSTR() const               {return Array();}
+
+    inline UINT Length() const                  {return entry ? entry->length : 0;}
+    inline BOOL IsEmpty() const                 {return entry == NULL;}
+    inline BOOL IsValid() const                 {return entry != NULL;}
+
+    inline BOOL operator==(const InternedString &str) const {return entry == str.entry;}
+    inline BOOL operator!=(const InternedString &str) const {return entry != str.entry;}
+
+    inline BOOL CompareI(const InternedString &str) const
+    {
+        return (entry ? entry->folded : NULL) == (str.entry ? str.entry->folded : NULL);
+    }
+
+    BOOL CompareI(CTSTR lpStr) const;
+};
+
 class BASE_EXPORT StringList : public List<String>
 {
 public:
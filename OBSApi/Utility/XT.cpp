@@ -66,8 +66,17 @@ void STDCALL CriticalExit();
 void STDCALL OpenLogFile();
 void STDCALL CloseLogFile();
 
+static void StartLogThread();
+static BOOL StopLogThread();
+static void FreeLogQueue();
+
 void STDCALL OSInit();
 void STDCALL OSExit();
+void STDCALL InitProfiler();
+void STDCALL TerminateProfiler();
+void STDCALL InitInternedStrings();
+void STDCALL FreeInternedStrings();
+void STDCALL TerminateInternedStrings();
 
 BOOL STDCALL InitXT(CTSTR logFile, CTSTR allocatorName)
 {
@@ -77,9 +86,13 @@ BOOL STDCALL InitXT(CTSTR logFile, CTSTR allocatorName)
             scpy(lpLogFileName, logFile);
 
         OSInit();
+        InitProfiler();
+        InitInternedStrings();
 
         ResetXTAllocator(allocatorName);
         bBaseLoaded = 1;
+
+        StartLogThread();
     }
 
     return TRUE;
@@ -94,9 +107,14 @@ void STDCALL InitXTLog(CTSTR logFile)
 
 void STDCALL ResetXTAllocator(CTSTR lpAllocator)
 {
+    //queued log records belong to the old allocator
+    BOOL bRestartLogThread = StopLogThread();
+
     StringLog.Stop();
     StringLog.Clear();
 
+    FreeInternedStrings();
+
     delete locale;
     delete MainAllocator;
 
@@ -112,15 +130,24 @@ void STDCALL ResetXTAllocator(CTSTR lpAllocator)
     locale = new LocaleStringLookup;
 
     StringLog.Reset();
+
+    if(bRestartLogThread)
+        StartLogThread();
 }
 
 void STDCALL TerminateXT()
 {
     if(bBaseLoaded)
     {
+        //the queue has to be emptied while its records' allocator and the log file are still around
+        StopLogThread();
+        FreeLogQueue();
+
         StringLog.Stop();
 
         FreeProfileData();
+        TerminateProfiler();
+        TerminateInternedStrings();
 
         delete locale;
         locale = NULL;
@@ -151,6 +178,7 @@ void STDCALL CriticalExit()
 {
     if(bBaseLoaded)
     {
+        FlushLog();
         bBaseLoaded = 0;
 
         if(LogFile.IsOpen())
@@ -186,6 +214,7 @@ void STDCALL TraceCrashEnd()
 
     String strOut = FormattedString(TEXT("%s\r\n"), strStackTrace.Array());
 
+    FlushLog();
     OpenLogFile();
     LogFile.WriteAsUTF8(strOut, strOut.Length());
     LogFile.WriteAsUTF8(TEXT("\r\n"));
@@ -223,6 +252,254 @@ void STDCALL CloseLogFile()
 
 
 
+//-----------------------------------------
+//log queue
+//  log lines are formatted on the calling thread and queued for the log thread, which does the UTF-8
+//  conversion and file writes, so a slow disk can't stall the audio or encode threads.  the queue is a
+//  bounded multi-producer ring: when it's full (or holding too much text) lines are dropped and counted
+//  rather than blocking the caller
+
+#define LOG_QUEUE_SIZE      0x1000              //records, must be a power of two
+#define LOG_QUEUE_MAX_BYTES (4*1024*1024)
+
+struct LogRecord
+{
+    UINT len;
+    bool bWriteFile;
+    TCHAR text[1];
+};
+
+struct LogQueueSlot
+{
+    volatile LONG sequence;
+    LogRecord *record;
+};
+
+static LogQueueSlot     logQueue[LOG_QUEUE_SIZE];
+static volatile LONG    logQueueWritePos = 0;
+static LONG             logQueueReadPos = 0;    //only used with hLogWriteMutex held
+static volatile LONG    logQueueBytes = 0;
+static volatile LONG    numDroppedLogLines = 0;
+static volatile LONG    numLogQueueWriters = 0; //threads between checking bLogThreadRunning and publishing their record
+
+static HANDLE           hLogWriteMutex = NULL;
+static HANDLE           hLogEvent = NULL;
+static HANDLE           hLogThread = NULL;
+static volatile BOOL    bLogThreadRunning = FALSE;
+
+static void WriteLogLine(CTSTR text, UINT len, bool bWriteFile)
+{
+    if(bWriteFile)
+    {
+        OpenLogFile();
+        LogFile.WriteAsUTF8(text, len);
+        LogFile.WriteAsUTF8(TEXT("\r\n"));
+        CloseLogFile();
+    }
+
+    StringLog.Append(text, len);
+}
+
+//hLogWriteMutex must be held
+static void WriteQueuedLogLines()
+{
+    while(true)
+    {
+        LogQueueSlot &slot = logQueue[logQueueReadPos & (LOG_QUEUE_SIZE-1)];
+        if(slot.sequence != logQueueReadPos+1)
+            break;
+
+        LogRecord *record = slot.record;
+        InterlockedExchange(&slot.sequence, logQueueReadPos+LOG_QUEUE_SIZE);
+        ++logQueueReadPos;
+
+        WriteLogLine(record->text, record->len, record->bWriteFile);
+
+        InterlockedExchangeAdd(&logQueueBytes, -LONG(record->len*sizeof(TCHAR)));
+        Free(record);
+    }
+
+    LONG numDropped = InterlockedExchange(&numDroppedLogLines, 0);
+    if(numDropped)
+    {
+        String strOut = FormattedString(TEXT("%s: Log queue full, dropped %d lines"), CurrentTimeString().Array(), numDropped);
+        WriteLogLine(strOut, strOut.Length(), true);
+    }
+}
+
+static void PushLogRecord(CTSTR text, UINT len, bool bWriteFile)
+{
+    LONG size = LONG(len*sizeof(TCHAR));
+    if(logQueueBytes+size > LOG_QUEUE_MAX_BYTES)
+    {
+        InterlockedIncrement(&numDroppedLogLines);
+        return;
+    }
+
+    LogRecord *record = (LogRecord*)Allocate(sizeof(LogRecord)+size);
+    record->len = len;
+    record->bWriteFile = bWriteFile;
+    mcpy(record->text, text, size);
+    record->text[len] = 0;
+
+    InterlockedExchangeAdd(&logQueueBytes, size);
+
+    LONG pos = logQueueWritePos;
+    LogQueueSlot *slot;
+
+    while(true)
+    {
+        slot = &logQueue[pos & (LOG_QUEUE_SIZE-1)];
+
+        LONG diff = slot->sequence-pos;
+        if(diff == 0)
+        {
+            LONG prevPos = InterlockedCompareExchange(&logQueueWritePos, pos+1, pos);
+            if(prevPos == pos)
+                break;
+
+            pos = prevPos;
+        }
+        else if(diff < 0)
+        {
+            InterlockedExchangeAdd(&logQueueBytes, -size);
+            InterlockedIncrement(&numDroppedLogLines);
+            Free(record);
+            return;
+        }
+        else
+            pos = logQueueWritePos;
+    }
+
+    slot->record = record;
+    InterlockedExchange(&slot->sequence, pos+1);
+
+    OSSignalEvent(hLogEvent);
+}
+
+//returns false if there's no log thread, in which case the caller writes the line itself
+static bool QueueLogLine(CTSTR text, UINT len, bool bWriteFile)
+{
+    //counted so StopLogThread can wait out lines that were already on their way into the queue
+    InterlockedIncrement(&numLogQueueWriters);
+
+    bool bQueued = bLogThreadRunning != FALSE;
+    if(bQueued)
+        PushLogRecord(text, len, bWriteFile);
+
+    InterlockedDecrement(&numLogQueueWriters);
+    return bQueued;
+}
+
+static void LogLine(CTSTR text, UINT len, bool bWriteFile=true)
+{
+    if(QueueLogLine(text, len, bWriteFile))
+        return;
+
+    if(hLogWriteMutex)
+    {
+        OSEnterMutex(hLogWriteMutex);
+        WriteLogLine(text, len, bWriteFile);
+        OSLeaveMutex(hLogWriteMutex);
+    }
+    else
+        WriteLogLine(text, len, bWriteFile);
+}
+
+static DWORD STDCALL LogThread(LPVOID param)
+{
+    while(bLogThreadRunning)
+    {
+        OSWaitForEvent(hLogEvent);
+
+        OSEnterMutex(hLogWriteMutex);
+        WriteQueuedLogLines();
+        OSLeaveMutex(hLogWriteMutex);
+    }
+
+    return 0;
+}
+
+static void StartLogThread()
+{
+    if(!hLogWriteMutex)
+    {
+        hLogWriteMutex = OSCreateMutex();
+        hLogEvent = OSCreateEvent();
+
+        for(LONG i=0; i<LOG_QUEUE_SIZE; i++)
+            logQueue[i].sequence = i;
+    }
+
+    bLogThreadRunning = TRUE;
+    hLogThread = OSCreateThread((XTHREAD)LogThread, NULL);
+}
+
+//anything logged after this is written by the calling thread again
+static BOOL StopLogThread()
+{
+    if(!hLogThread)
+        return FALSE;
+
+    bLogThreadRunning = FALSE;
+    MemoryBarrier();
+
+    //once this hits zero nothing else can be added to the queue, so the drain below gets everything
+    while(numLogQueueWriters)
+        OSSleep(0);
+
+    OSSignalEvent(hLogEvent);
+
+    OSWaitForThread(hLogThread, NULL);
+    OSCloseThread(hLogThread);
+    hLogThread = NULL;
+
+    OSEnterMutex(hLogWriteMutex);
+    WriteQueuedLogLines();
+    OSLeaveMutex(hLogWriteMutex);
+
+    return TRUE;
+}
+
+static void FreeLogQueue()
+{
+    if(!hLogWriteMutex)
+        return;
+
+    //write out and free anything that's still queued rather than losing it
+    OSEnterMutex(hLogWriteMutex);
+    WriteQueuedLogLines();
+    OSLeaveMutex(hLogWriteMutex);
+
+    OSCloseMutex(hLogWriteMutex);
+    OSCloseEvent(hLogEvent);
+    hLogWriteMutex = hLogEvent = NULL;
+}
+
+void STDCALL FlushLog()
+{
+    if(!hLogWriteMutex)
+        return;
+
+    //when crashing, the log thread could be stuck mid-write (or be the thread that crashed, in which case
+    //the mutex is ours already), so don't wait on it forever
+    for(int i=0; i<100; i++)
+    {
+        if(OSTryEnterMutex(hLogWriteMutex))
+        {
+            WriteQueuedLogLines();
+            if(LogFile.IsOpen())
+                LogFile.FlushFileBuffers();
+            OSLeaveMutex(hLogWriteMutex);
+            return;
+        }
+
+        OSSleep(10);
+    }
+}
+
+//-----------------------------------------
+
 void __cdecl LogRaw(const TCHAR *text, UINT len)
 {
     if(!text) return;
@@ -230,12 +507,7 @@ void __cdecl LogRaw(const TCHAR *text, UINT len)
     if (!len)
         len = slen(text);
 
-    OpenLogFile();
-    LogFile.WriteAsUTF8(text, len);
-    LogFile.WriteAsUTF8(TEXT("\r\n"));
-    CloseLogFile();
-
-    StringLog.Append(text, len);
+    LogLine(text, len);
 }
 
 void __cdecl Logva(const TCHAR *format, va_list argptr)
@@ -249,12 +521,7 @@ void __cdecl Logva(const TCHAR *format, va_list argptr)
 
     strOut.FindReplace(TEXT("\n"), String() << TEXT("\n") << strCurTime);
 
-    OpenLogFile();
-    LogFile.WriteAsUTF8(strOut, strOut.Length());
-    LogFile.WriteAsUTF8(TEXT("\r\n"));
-    CloseLogFile();
-
-    StringLog.Append(strOut);
+    LogLine(strOut, strOut.Length());
 }
 
 void __cdecl Log(const TCHAR *format, ...)
@@ -280,13 +547,7 @@ void __cdecl AppWarning(const TCHAR *format, ...)
     String strOut(L"Warning -- ");
     strOut << FormattedStringva(format, arglist);
 
-    if(bLogStarted)
-    {
-        OpenLogFile();
-        LogFile.WriteAsUTF8(strOut, strOut.Length());
-        LogFile.WriteAsUTF8(TEXT("\r\n"));
-        CloseLogFile();
-    }
+    LogLine(strOut, strOut.Length(), bLogStarted != 0);
 
     OSDebugOut(TEXT("Warning -- "));
     OSDebugOutva(format, arglist);
@@ -305,8 +566,6 @@ void __cdecl AppWarning(const TCHAR *format, ...)
         ProgramBreak();
     }
 #endif
-
-    StringLog.Append(strOut);
 }
 
 
@@ -320,6 +579,7 @@ __declspec(noreturn) void __cdecl CrashError(const TCHAR *format, ...)
     String strOut(L"\r\nError: ");
     strOut << FormattedStringva(format, arglist);
 
+    FlushLog();
     OpenLogFile();
     LogFile.WriteAsUTF8(strOut);
     LogFile.WriteStr(TEXT("\r\n"));
@@ -362,6 +622,7 @@ String CurrentLogFilename()
 
 void ReadLog(String &data)
 {
+    FlushLog();
     StringLog.Read(data);
 }
 
@@ -152,12 +152,22 @@ BASE_EXPORT BOOL   STDCALL OSWaitForThread(HANDLE hThread, LPDWORD ret);
 BASE_EXPORT BOOL   STDCALL OSCloseThread(HANDLE hThread);
 BASE_EXPORT BOOL   STDCALL OSTerminateThread(HANDLE hThread, DWORD waitMS=100);
 
+//per-thread values.  the free callback is called with a thread's value when that thread exits, and with every
+//value still set when the storage is closed
+BASE_EXPORT DWORD  STDCALL OSCreateThreadStorage(XTHREADSTORAGEFREE freeCallback);
+BASE_EXPORT LPVOID STDCALL OSGetThreadStorage(DWORD storageID);
+BASE_EXPORT BOOL   STDCALL OSSetThreadStorage(DWORD storageID, LPVOID value);
+BASE_EXPORT void   STDCALL OSCloseThreadStorage(DWORD storageID);
+
 BASE_EXPORT HANDLE STDCALL OSCreateMutex();
 BASE_EXPORT void   STDCALL OSEnterMutex(HANDLE hMutex);
 BASE_EXPORT BOOL   STDCALL OSTryEnterMutex(HANDLE hMutex);
 BASE_EXPORT void   STDCALL OSLeaveMutex(HANDLE hMutex);
 BASE_EXPORT void   STDCALL OSCloseMutex(HANDLE hMutex);
 
+BASE_EXPORT HANDLE STDCALL OSCreateEvent();
+BASE_EXPORT void   STDCALL OSSignalEvent(HANDLE event);
+BASE_EXPORT BOOL   STDCALL OSWaitForEvent(HANDLE event, DWORD waitMS=WAIT_INFINITE);
 BASE_EXPORT void           OSCloseEvent(HANDLE event);
 
 BASE_EXPORT void   STDCALL OSSetMainAppWindow(HANDLE window);
@@ -183,6 +193,7 @@ BASE_EXPORT void   STDCALL OSCheckForBuggyDLLs ();
 BASE_EXPORT void __cdecl   LogRaw(const TCHAR *text, UINT len=0);
 BASE_EXPORT void __cdecl   Logva(const TCHAR *format, va_list argptr);
 BASE_EXPORT void __cdecl   Log(const TCHAR *format, ...);
+BASE_EXPORT void STDCALL   FlushLog(); //writes out anything still queued.  safe to call from a crash handler
 
 BASE_EXPORT __declspec(noreturn) void __cdecl   CrashError(const TCHAR *format, ...);
 BASE_EXPORT void __cdecl   AppWarning(const TCHAR *format, ...);
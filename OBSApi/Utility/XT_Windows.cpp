@@ -500,6 +500,32 @@ void   STDCALL OSCloseMutex(HANDLE hMutex)
 }
 
 
+DWORD  STDCALL OSCreateThreadStorage(XTHREADSTORAGEFREE freeCallback)
+{
+    return FlsAlloc((PFLS_CALLBACK_FUNCTION)freeCallback);
+}
+
+LPVOID STDCALL OSGetThreadStorage(DWORD storageID)
+{
+    if(storageID == FLS_OUT_OF_INDEXES)
+        return NULL;
+    return FlsGetValue(storageID);
+}
+
+BOOL   STDCALL OSSetThreadStorage(DWORD storageID, LPVOID value)
+{
+    if(storageID == FLS_OUT_OF_INDEXES)
+        return FALSE;
+    return FlsSetValue(storageID, value);
+}
+
+void   STDCALL OSCloseThreadStorage(DWORD storageID)
+{
+    if(storageID != FLS_OUT_OF_INDEXES)
+        FlsFree(storageID);
+}
+
+
 void   STDCALL OSSleepSubMillisecond(double fMSeconds)
 {
     int intPart;
@@ -748,6 +774,22 @@ BOOL   STDCALL OSTerminateThread(HANDLE hThread, DWORD waitMS)
     return 1;
 }
 
+//auto-reset
+HANDLE STDCALL OSCreateEvent()
+{
+    return CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+void STDCALL OSSignalEvent(HANDLE event)
+{
+    SetEvent(event);
+}
+
+BOOL STDCALL OSWaitForEvent(HANDLE event, DWORD waitMS)
+{
+    return WaitForSingleObject(event, waitMS) == WAIT_OBJECT_0;
+}
+
 void OSCloseEvent(HANDLE event)
 {
     CloseHandle(event);
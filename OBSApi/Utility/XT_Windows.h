@@ -81,6 +81,7 @@
 //-----------------------------------------
 typedef void (STDCALL* DEFPROC)();
 typedef DWORD (STDCALL* XTHREAD)(LPVOID);
+typedef void (STDCALL* XTHREADSTORAGEFREE)(LPVOID);
 
 
 //-----------------------------------------
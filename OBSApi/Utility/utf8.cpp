@@ -17,6 +17,11 @@
 #include <wchar.h>
 #include "XT.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
+
 #define _NXT    0x80
 #define _SEQ2    0xc0
 #define _SEQ3    0xe0
@@ -31,6 +36,8 @@
 
 static int __wchar_forbitten(wchar_t sym);
 static int __utf8_forbitten(unsigned char octet);
+static size_t __utf8_ascii_run(const unsigned char *in, size_t insize, wchar_t *out);
+static size_t __wchar_ascii_run(const wchar_t *in, size_t insize, unsigned char *out);
 
 static int
 __wchar_forbitten(wchar_t sym)
@@ -58,6 +65,69 @@ __utf8_forbitten(unsigned char octet)
     return (0);
 }
 
+//
+// Ascii converts one to one and can't be forbitten or a BOM, so runs of it
+// are copied 16 at a time and only the rest goes through the state machines.
+// Both return how many characters were ascii, copying them if out isn't NULL.
+//
+static size_t
+__utf8_ascii_run(const unsigned char *in, size_t insize, wchar_t *out)
+{
+    size_t i = 0;
+
+#ifdef UTF8_SSE2
+    __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= insize; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(in + i));
+        if (_mm_movemask_epi8(chunk) != 0)
+            break;
+
+        if (out != NULL) {
+            _mm_storeu_si128((__m128i *)(out + i), _mm_unpacklo_epi8(chunk, zero));
+            _mm_storeu_si128((__m128i *)(out + i + 8), _mm_unpackhi_epi8(chunk, zero));
+        }
+    }
+#endif
+
+    for (; i < insize && in[i] < 0x80; i++) {
+        if (out != NULL)
+            out[i] = (wchar_t)in[i];
+    }
+
+    return (i);
+}
+
+static size_t
+__wchar_ascii_run(const wchar_t *in, size_t insize, unsigned char *out)
+{
+    size_t i = 0;
+
+#ifdef UTF8_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i nonascii = _mm_set1_epi16((short)0xff80);
+
+    for (; i + 16 <= insize; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(in + i + 8));
+
+        __m128i high_bits = _mm_and_si128(_mm_or_si128(lo, hi), nonascii);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(high_bits, zero)) != 0xffff)
+            break;
+
+        if (out != NULL)
+            _mm_storeu_si128((__m128i *)(out + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < insize && (unsigned int)in[i] < 0x80; i++) {
+        if (out != NULL)
+            out[i] = (unsigned char)in[i];
+    }
+
+    return (i);
+}
+
 size_t
 utf8_to_wchar(const char *in, size_t insize, wchar_t *out, size_t outsize,
     int flags)
@@ -75,6 +145,20 @@ utf8_to_wchar(const char *in, size_t insize, wchar_t *out, size_t outsize,
     wlim = out + outsize;
 
     for (; p < lim; p += n) {
+        if ((*p & 0x80) == 0) {
+            n = lim - p;
+            if (out != NULL && (size_t)(wlim - out) < n)
+                n = wlim - out;    // the state machine reports running out
+
+            n = __utf8_ascii_run(p, n, out);
+            if (n != 0) {
+                total += n;
+                if (out != NULL)
+                    out += n;
+                continue;
+            }
+        }
+
         if (__utf8_forbitten(*p) != 0 &&
             (flags & UTF8_IGNORE_ERROR) == 0)
             return (0);
@@ -183,6 +267,21 @@ wchar_to_utf8(const wchar_t *in, size_t insize, char *out, size_t outsize,
     lim = p + outsize;
     total = 0;
     for (; w < wlim; w++) {
+        if ((unsigned int)*w < 0x80) {
+            n = wlim - w;
+            if (out != NULL && (size_t)(lim - p) < n)
+                n = lim - p;    // the state machine reports running out
+
+            n = __wchar_ascii_run(w, n, out != NULL ? p : NULL);
+            if (n != 0) {
+                total += n;
+                if (out != NULL)
+                    p += n;
+                w += n - 1;    // the loop steps past the last one
+                continue;
+            }
+        }
+
         if (__wchar_forbitten(*w) != 0) {
             if ((flags & UTF8_IGNORE_ERROR) == 0)
                 return (0);
@@ -292,6 +391,12 @@ size_t utf8_to_wchar_len(const char *in, size_t insize, int flags)
     lim = p + insize;
 
     for (; p < lim; p += n) {
+        if ((*p & 0x80) == 0) {
+            n = __utf8_ascii_run(p, lim - p, NULL);
+            total += n;
+            continue;
+        }
+
         if (__utf8_forbitten(*p) != 0 &&
             (flags & UTF8_IGNORE_ERROR) == 0)
             return (0);
@@ -384,6 +489,13 @@ size_t wchar_to_utf8_len(const wchar_t *in, size_t insize, int flags)
     wlim = w + insize;
     total = 0;
     for (; w < wlim; w++) {
+        if ((unsigned int)*w < 0x80) {
+            n = __wchar_ascii_run(w, wlim - w, NULL);
+            total += n;
+            w += n - 1;    // the loop steps past the last one
+            continue;
+        }
+
         if (__wchar_forbitten(*w) != 0) {
             if ((flags & UTF8_IGNORE_ERROR) == 0)
                 return (0);
@@ -0,0 +1,327 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//runs the allocation pattern of a stream on several threads at once and times it on FastAlloc and on
+//the crt heap (DefaultAlloc).  per set of threads:
+//  render:   lots of small short lived allocations every frame, all freed at the end of the frame
+//  audio:    a float buffer and a few small objects per 10ms segment, freed a few segments later
+//  encoder:  packets from a couple of KB up to past the pool sizes, handed to the output thread
+//  output:   frees the encoder's packets, so every packet is freed on a different thread than it came from
+//every allocation is stamped at both ends and checked when it's freed, so blocks that get handed out
+//twice or overwritten by another thread show up as failures
+
+#define ALLOC_TEST_DEFAULT_FRAMES   2000
+#define ALLOC_TEST_RENDER_ALLOCS    200
+#define ALLOC_TEST_AUDIO_LIVE       10
+#define ALLOC_TEST_AUDIO_SEGMENT    (441*2*sizeof(float))
+#define ALLOC_TEST_QUEUE_SIZE       256
+
+struct AllocTestPacket
+{
+    LPVOID lpData;
+    size_t size;
+};
+
+struct AllocTestQueue
+{
+    HANDLE hMutex;
+    AllocTestPacket packets[ALLOC_TEST_QUEUE_SIZE];
+    UINT readPos, count;
+    bool bDone;
+};
+
+struct AllocTestThread
+{
+    Alloc *allocator;
+    AllocTestQueue *queue;
+    UINT numFrames;
+    UINT seed;
+
+    //results
+    QWORD numAllocs;
+    UINT numCorrupted;
+};
+
+//-------------------------------------------------------------------
+
+inline UINT AllocTestRand(UINT &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+inline LPVOID AllocTestAllocate(AllocTestThread *data, size_t size)
+{
+    BYTE *lpData = (BYTE*)data->allocator->_Allocate(size);
+    UINT stamp = UINT(size)*2654435761U;
+
+    *(UINT*)lpData = stamp;
+    *(UINT*)(lpData+size-sizeof(UINT)) = stamp;
+
+    data->numAllocs++;
+    return lpData;
+}
+
+inline void AllocTestFree(AllocTestThread *data, LPVOID lpData, size_t size)
+{
+    BYTE *lpBytes = (BYTE*)lpData;
+    UINT stamp = UINT(size)*2654435761U;
+
+    if(*(UINT*)lpBytes != stamp || *(UINT*)(lpBytes+size-sizeof(UINT)) != stamp)
+        data->numCorrupted++;
+
+    data->allocator->_Free(lpData);
+}
+
+//sizes are at least 8 so both stamps fit
+static DWORD STDCALL RenderTestThread(AllocTestThread *data)
+{
+    LPVOID allocs[ALLOC_TEST_RENDER_ALLOCS];
+    size_t sizes[ALLOC_TEST_RENDER_ALLOCS];
+    UINT state = data->seed;
+
+    for(UINT frame=0; frame<data->numFrames; frame++)
+    {
+        for(UINT i=0; i<ALLOC_TEST_RENDER_ALLOCS; i++)
+        {
+            //strings and vertex lists, with the odd texture upload buffer
+            UINT val = AllocTestRand(state);
+            sizes[i] = (val%64 == 0) ? 4096+(val>>8)%8192 : 8+(val>>8)%504;
+            allocs[i] = AllocTestAllocate(data, sizes[i]);
+        }
+
+        for(UINT i=0; i<ALLOC_TEST_RENDER_ALLOCS; i++)
+            AllocTestFree(data, allocs[i], sizes[i]);
+    }
+
+    return 0;
+}
+
+static DWORD STDCALL AudioTestThread(AllocTestThread *data)
+{
+    LPVOID segments[ALLOC_TEST_AUDIO_LIVE][4];
+    size_t sizes[4] = {ALLOC_TEST_AUDIO_SEGMENT, 64, 96, 24};
+    UINT numSegments = data->numFrames*2; //10ms segments at 50fps worth of frames
+
+    zero(segments, sizeof(segments));
+
+    for(UINT i=0; i<numSegments; i++)
+    {
+        LPVOID *segment = segments[i%ALLOC_TEST_AUDIO_LIVE];
+        if(segment[0])
+        {
+            for(UINT j=0; j<4; j++)
+                AllocTestFree(data, segment[j], sizes[j]);
+        }
+
+        for(UINT j=0; j<4; j++)
+            segment[j] = AllocTestAllocate(data, sizes[j]);
+    }
+
+    for(UINT i=0; i<ALLOC_TEST_AUDIO_LIVE; i++)
+    {
+        if(segments[i][0])
+        {
+            for(UINT j=0; j<4; j++)
+                AllocTestFree(data, segments[i][j], sizes[j]);
+        }
+    }
+
+    return 0;
+}
+
+static DWORD STDCALL EncoderTestThread(AllocTestThread *data)
+{
+    AllocTestQueue *queue = data->queue;
+    UINT state = data->seed;
+
+    for(UINT frame=0; frame<data->numFrames; frame++)
+    {
+        //a keyframe every 120 frames, audio packets in between
+        UINT val = AllocTestRand(state);
+        size_t size = (frame%120 == 0) ? 100000+val%50000 : ((frame&1) ? 300+val%200 : 2000+val%20000);
+
+        AllocTestPacket packet;
+        packet.size = size;
+        packet.lpData = AllocTestAllocate(data, size);
+
+        while(true)
+        {
+            OSEnterMutex(queue->hMutex);
+            if(queue->count < ALLOC_TEST_QUEUE_SIZE)
+            {
+                queue->packets[(queue->readPos+queue->count)%ALLOC_TEST_QUEUE_SIZE] = packet;
+                queue->count++;
+                OSLeaveMutex(queue->hMutex);
+                break;
+            }
+            OSLeaveMutex(queue->hMutex);
+            OSSleep(0);
+        }
+    }
+
+    OSEnterMutex(queue->hMutex);
+    queue->bDone = true;
+    OSLeaveMutex(queue->hMutex);
+
+    return 0;
+}
+
+static DWORD STDCALL OutputTestThread(AllocTestThread *data)
+{
+    AllocTestQueue *queue = data->queue;
+
+    while(true)
+    {
+        AllocTestPacket packet;
+        bool bHasPacket = false, bDone;
+
+        OSEnterMutex(queue->hMutex);
+        if(queue->count)
+        {
+            packet = queue->packets[queue->readPos];
+            queue->readPos = (queue->readPos+1)%ALLOC_TEST_QUEUE_SIZE;
+            queue->count--;
+            bHasPacket = true;
+        }
+        bDone = queue->bDone;
+        OSLeaveMutex(queue->hMutex);
+
+        if(bHasPacket)
+            AllocTestFree(data, packet.lpData, packet.size);
+        else if(bDone)
+            break;
+        else
+            OSSleep(0);
+    }
+
+    return 0;
+}
+
+static const XTHREAD allocTestRoles[] =
+{
+    (XTHREAD)RenderTestThread,
+    (XTHREAD)AudioTestThread,
+    (XTHREAD)EncoderTestThread,
+    (XTHREAD)OutputTestThread,
+};
+
+#define ALLOC_TEST_NUM_ROLES (sizeof(allocTestRoles)/sizeof(allocTestRoles[0]))
+
+//-------------------------------------------------------------------
+
+//runs numSets of render/audio/encoder/output threads at once.  returns the time it took in seconds
+static double TimeAllocMix(Alloc *allocator, UINT numSets, UINT numFrames, QWORD &numAllocs)
+{
+    List<AllocTestQueue*> queues;
+    List<AllocTestThread*> threadData;
+    List<HANDLE> threads;
+
+    UINT numCorrupted = 0;
+    numAllocs = 0;
+
+    for(UINT i=0; i<numSets; i++)
+    {
+        AllocTestQueue *queue = new AllocTestQueue;
+        queue->hMutex = OSCreateMutex();
+        queues << queue;
+
+        for(UINT j=0; j<ALLOC_TEST_NUM_ROLES; j++)
+        {
+            AllocTestThread *data = new AllocTestThread;
+            data->allocator = allocator;
+            data->queue = queue;
+            data->numFrames = numFrames;
+            data->seed = 1 + i*ALLOC_TEST_NUM_ROLES + j;
+            threadData << data;
+        }
+    }
+
+    double startTime = GetTestTime();
+
+    for(UINT i=0; i<threadData.Num(); i++)
+        threads << OSCreateThread(allocTestRoles[i%ALLOC_TEST_NUM_ROLES], threadData[i]);
+
+    for(UINT i=0; i<threads.Num(); i++)
+    {
+        OSWaitForThread(threads[i], NULL);
+        OSCloseThread(threads[i]);
+    }
+
+    double time = GetTestTime()-startTime;
+
+    for(UINT i=0; i<threadData.Num(); i++)
+    {
+        numAllocs += threadData[i]->numAllocs;
+        numCorrupted += threadData[i]->numCorrupted;
+        delete threadData[i];
+    }
+
+    for(UINT i=0; i<queues.Num(); i++)
+    {
+        OSCloseMutex(queues[i]->hMutex);
+        delete queues[i];
+    }
+
+    TestCheck(numCorrupted == 0, TEXT("%u allocation(s) were overwritten with %u thread set(s)"), numCorrupted, numSets);
+
+    return time;
+}
+
+//usage: alloc [frames [max thread sets]]
+int RunAllocTest(int argc, TCHAR **argv)
+{
+    UINT numFrames = (argc > 0) ? tstoi(argv[0]) : ALLOC_TEST_DEFAULT_FRAMES;
+    UINT maxSets = (argc > 1) ? tstoi(argv[1]) : MAX(OSGetLogicalCores()/ALLOC_TEST_NUM_ROLES, 2);
+    if(!numFrames)
+        numFrames = ALLOC_TEST_DEFAULT_FRAMES;
+    if(!maxSets)
+        maxSets = 1;
+
+    DefaultAlloc *crtAlloc = new DefaultAlloc;
+
+    wprintf(TEXT("%u frames per thread set, up to %u set(s) of %u threads\n"), numFrames, maxSets, UINT(ALLOC_TEST_NUM_ROLES));
+
+    //once to get the pools and the crt heap to their working size
+    QWORD numAllocs;
+    TimeAllocMix(MainAllocator, 1, numFrames/4, numAllocs);
+    TimeAllocMix(crtAlloc, 1, numFrames/4, numAllocs);
+
+    //1, 2, 4.. sets, ending on maxSets
+    for(UINT numSets=1; numSets<=maxSets; numSets = (numSets*2 > maxSets && numSets < maxSets) ? maxSets : numSets*2)
+    {
+        QWORD numFastAllocs, numCrtAllocs;
+        double fastTime = TimeAllocMix(MainAllocator, numSets, numFrames, numFastAllocs);
+        double crtTime = TimeAllocMix(crtAlloc, numSets, numFrames, numCrtAllocs);
+
+        wprintf(TEXT("%2u threads  FastAlloc %7.3f s (%6.2f M allocs/s)  crt heap %7.3f s (%6.2f M allocs/s)  %5.2fx\n"),
+            numSets*UINT(ALLOC_TEST_NUM_ROLES),
+            fastTime, double(numFastAllocs)/fastTime/1e6,
+            crtTime, double(numCrtAllocs)/crtTime/1e6,
+            crtTime/fastTime);
+    }
+
+    delete crtAlloc;
+
+    return 0;
+}
@@ -0,0 +1,504 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//loads the largest profile in %APPDATA%\OBS\profiles (or the one given, or a generated one if there are
+//none) and runs a lookup storm on it: the lookups OBS does when it starts a stream, then every key in the
+//file with random case and some that aren't there, through each of the getters.  every answer is checked
+//against a linear scan of the same file done the way ConfigFile used to, which is also what it's timed
+//against
+
+#define CONFIG_TEST_DEFAULT_PASSES  200
+#define CONFIG_TEST_GENERATED_FILE  TEXT("configtest.ini")
+
+enum ConfigTestType
+{
+    ConfigTest_String,
+    ConfigTest_Int,
+    ConfigTest_Float,
+};
+
+struct ConfigTestLookup
+{
+    CTSTR lpSection, lpKey;
+    ConfigTestType type;
+    CTSTR lpValue;          //written to the generated profile
+};
+
+//what OBS::Start and the encoders read from the profile
+static const ConfigTestLookup startLookups[] =
+{
+    {TEXT("Audio"),             TEXT("Device"),                 ConfigTest_String,  TEXT("Default")},
+    {TEXT("Audio"),             TEXT("PlaybackDevice"),         ConfigTest_String,  TEXT("Default")},
+    {TEXT("Audio"),             TEXT("DesktopVolume"),          ConfigTest_Float,   TEXT("1")},
+    {TEXT("Audio"),             TEXT("MicVolume"),              ConfigTest_Float,   TEXT("0.85")},
+    {TEXT("Audio"),             TEXT("MicBoostMultiple"),       ConfigTest_Int,     TEXT("1")},
+    {TEXT("Audio"),             TEXT("MicTimeOffset"),          ConfigTest_Int,     TEXT("0")},
+    {TEXT("Audio"),             TEXT("UsePushToTalk"),          ConfigTest_Int,     TEXT("0")},
+    {TEXT("Audio"),             TEXT("PushToTalkDelay"),        ConfigTest_Int,     TEXT("200")},
+    {TEXT("Audio"),             TEXT("ForceMicMono"),           ConfigTest_Int,     TEXT("false")},
+    {TEXT("Audio"),             TEXT("SyncToVideoTime"),        ConfigTest_Int,     TEXT("1")},
+    {TEXT("Audio Encoding"),    TEXT("Codec"),                  ConfigTest_String,  TEXT("AAC")},
+    {TEXT("Audio Encoding"),    TEXT("Bitrate"),                ConfigTest_Int,     TEXT("160")},
+    {TEXT("Audio Encoding"),    TEXT("RecordingBitrate"),       ConfigTest_Int,     TEXT("320")},
+    {TEXT("General"),           TEXT("Priority"),               ConfigTest_String,  TEXT("Normal")},
+    {TEXT("General"),           TEXT("UseMultithreadedOptimizations"), ConfigTest_Int, TEXT("true")},
+    {TEXT("Publish"),           TEXT("Mode"),                   ConfigTest_Int,     TEXT("0")},
+    {TEXT("Publish"),           TEXT("Service"),                ConfigTest_Int,     TEXT("2")},
+    {TEXT("Publish"),           TEXT("URL"),                    ConfigTest_String,  TEXT("rtmp://live.example.com/app")},
+    {TEXT("Publish"),           TEXT("PlayPath"),               ConfigTest_String,  TEXT("live_123456_abcdefghijklmnop")},
+    {TEXT("Publish"),           TEXT("SaveToFile"),             ConfigTest_Int,     TEXT("1")},
+    {TEXT("Publish"),           TEXT("SavePath"),               ConfigTest_String,  TEXT("C:\\Users\\Streamer\\Videos\\recording.flv")},
+    {TEXT("Publish"),           TEXT("Delay"),                  ConfigTest_Int,     TEXT("0")},
+    {TEXT("Publish"),           TEXT("AutoReconnect"),          ConfigTest_Int,     TEXT("1")},
+    {TEXT("Publish"),           TEXT("AutoReconnectTimeout"),   ConfigTest_Int,     TEXT("10")},
+    {TEXT("Publish"),           TEXT("LowLatencyMode"),         ConfigTest_Int,     TEXT("0")},
+    {TEXT("Publish"),           TEXT("LatencyFactor"),          ConfigTest_Int,     TEXT("20")},
+    {TEXT("Publish"),           TEXT("FrameDropThreshold"),     ConfigTest_Int,     TEXT("600")},
+    {TEXT("Publish"),           TEXT("BFrameDropThreshold"),    ConfigTest_Int,     TEXT("400")},
+    {TEXT("Publish"),           TEXT("BindToIP"),               ConfigTest_String,  TEXT("Default")},
+    {TEXT("Publish"),           TEXT("TCPBufferSize"),          ConfigTest_Int,     TEXT("65536")},
+    {TEXT("Publish"),           TEXT("ReplayBufferSeconds"),    ConfigTest_Int,     TEXT("30")},
+    {TEXT("Publish"),           TEXT("FilePreallocationMB"),    ConfigTest_Int,     TEXT("0")},
+    {TEXT("Publish"),           TEXT("KeepRecording"),          ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video"),             TEXT("BaseWidth"),              ConfigTest_Int,     TEXT("1920")},
+    {TEXT("Video"),             TEXT("BaseHeight"),             ConfigTest_Int,     TEXT("1080")},
+    {TEXT("Video"),             TEXT("Downscale"),              ConfigTest_Float,   TEXT("1.5")},
+    {TEXT("Video"),             TEXT("FPS"),                    ConfigTest_Int,     TEXT("60")},
+    {TEXT("Video"),             TEXT("Filter"),                 ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video"),             TEXT("Monitor"),                ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video"),             TEXT("UnlockFPS"),              ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video Encoding"),    TEXT("MaxBitrate"),             ConfigTest_Int,     TEXT("3500")},
+    {TEXT("Video Encoding"),    TEXT("BufferSize"),             ConfigTest_Int,     TEXT("3500")},
+    {TEXT("Video Encoding"),    TEXT("UseBufferSize"),          ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video Encoding"),    TEXT("Preset"),                 ConfigTest_String,  TEXT("veryfast")},
+    {TEXT("Video Encoding"),    TEXT("X264Profile"),            ConfigTest_String,  TEXT("high")},
+    {TEXT("Video Encoding"),    TEXT("KeyframeInterval"),       ConfigTest_Int,     TEXT("2")},
+    {TEXT("Video Encoding"),    TEXT("UseCBR"),                 ConfigTest_Int,     TEXT("1")},
+    {TEXT("Video Encoding"),    TEXT("PadCBR"),                 ConfigTest_Int,     TEXT("1")},
+    {TEXT("Video Encoding"),    TEXT("UseCFR"),                 ConfigTest_Int,     TEXT("1")},
+    {TEXT("Video Encoding"),    TEXT("UseCustomSettings"),      ConfigTest_Int,     TEXT("0")},
+    {TEXT("Video Encoding"),    TEXT("CustomSettings"),         ConfigTest_String,  TEXT("")},
+};
+
+#define CONFIG_TEST_NUM_START_LOOKUPS (sizeof(startLookups)/sizeof(startLookups[0]))
+
+//-------------------------------------------------------------------
+//the same file scanned the way ConfigFile did before it had an index
+
+struct RefConfigKey
+{
+    TSTR lpName;
+    TSTR lpValue;   //first value only, like the getters
+};
+
+struct RefConfigSection
+{
+    TSTR lpName;
+    List<RefConfigKey> Keys;
+};
+
+struct RefConfigFile
+{
+    TSTR lpFileData;
+    List<RefConfigSection> Sections;
+
+    RefConfigFile() : lpFileData(NULL) {}
+    ~RefConfigFile()
+    {
+        for(UINT i=0; i<Sections.Num(); i++)
+            Sections[i].Keys.Clear();
+        if(lpFileData)
+            Free(lpFileData);
+    }
+
+    //parses like ConfigFile::LoadData, leaving the names and values in place in the file data
+    bool Load(CTSTR lpFile)
+    {
+        XFile file;
+        if(!file.Open(lpFile, XFILE_READ, XFILE_OPENEXISTING))
+            return false;
+
+        DWORD dwLength = (DWORD)file.GetFileSize();
+        LPSTR lpTempFileData = (LPSTR)Allocate(dwLength+5);
+        file.Read(&lpTempFileData[2], dwLength);
+        lpTempFileData[0] = lpTempFileData[dwLength+2] = 13;
+        lpTempFileData[1] = lpTempFileData[dwLength+3] = 10;
+        lpTempFileData[dwLength+4] = 0;
+
+        lpFileData = utf8_createTstr(lpTempFileData);
+        Free(lpTempFileData);
+
+        RefConfigSection *lpCurSection = NULL;
+        TSTR lpCurLine, lpNextLine = schr(lpFileData, '\r');
+
+        while(*(lpCurLine = (lpNextLine+2)))
+        {
+            lpNextLine = schr(lpCurLine, '\r');
+            if(!lpNextLine)
+                return false;
+            *lpNextLine = 0;
+
+            if(*lpCurLine == '[' && lpNextLine[-1] == ']')
+            {
+                lpNextLine[-1] = 0;
+                lpCurSection = Sections.CreateNew();
+                lpCurSection->lpName = lpCurLine+1;
+            }
+            else if(lpCurSection && *lpCurLine && !(lpCurLine[0] == '/' && lpCurLine[1] == '/'))
+            {
+                TSTR lpValue = schr(lpCurLine, '=');
+                if(!lpValue)
+                    return false;
+
+                if(lpValue[1])
+                {
+                    *lpValue = 0;
+
+                    //repeated keys in a section add values to the first one
+                    UINT i;
+                    for(i=0; i<lpCurSection->Keys.Num(); i++)
+                    {
+                        if(scmpi(lpCurSection->Keys[i].lpName, lpCurLine) == 0)
+                            break;
+                    }
+
+                    if(i == lpCurSection->Keys.Num())
+                    {
+                        RefConfigKey *key = lpCurSection->Keys.CreateNew();
+                        key->lpName = lpCurLine;
+                        key->lpValue = lpValue+1;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    RefConfigKey* FindKey(CTSTR lpSection, CTSTR lpKey, RefConfigKey *after=NULL)
+    {
+        bool bFoundAfter = (after == NULL);
+
+        for(UINT i=0; i<Sections.Num(); i++)
+        {
+            RefConfigSection &section = Sections[i];
+            if(scmpi(lpSection, section.lpName) != 0)
+                continue;
+
+            for(UINT j=0; j<section.Keys.Num(); j++)
+            {
+                RefConfigKey &key = section.Keys[j];
+                if(!bFoundAfter)
+                    bFoundAfter = (&key == after);
+                else if(scmpi(lpKey, key.lpName) == 0)
+                    return &key;
+            }
+        }
+
+        return NULL;
+    }
+
+    CTSTR GetStringPtr(CTSTR lpSection, CTSTR lpKey)
+    {
+        RefConfigKey *key = FindKey(lpSection, lpKey);
+        return key ? key->lpValue : NULL;
+    }
+
+    //keeps going to later sections of the same name if the value isn't an int
+    int GetInt(CTSTR lpSection, CTSTR lpKey, int def)
+    {
+        for(RefConfigKey *key = FindKey(lpSection, lpKey); key; key = FindKey(lpSection, lpKey, key))
+        {
+            if(scmpi(key->lpValue, TEXT("true")) == 0)
+                return 1;
+            else if(scmpi(key->lpValue, TEXT("false")) == 0)
+                return 0;
+            else if(ValidIntString(key->lpValue))
+                return tstring_base_to_int(key->lpValue, NULL, 0);
+        }
+
+        return def;
+    }
+
+    float GetFloat(CTSTR lpSection, CTSTR lpKey, float def)
+    {
+        RefConfigKey *key = FindKey(lpSection, lpKey);
+        return key ? (float)tstof(key->lpValue) : def;
+    }
+};
+
+//-------------------------------------------------------------------
+
+static bool FindLargestProfile(String &strPath)
+{
+    CTSTR lpAppData = _wgetenv(TEXT("APPDATA"));
+    if(!lpAppData)
+        return false;
+
+    String strDir;
+    strDir << lpAppData << TEXT("\\OBS\\profiles\\");
+
+    OSFindData ofd;
+    HANDLE hFind = OSFindFirstFile(strDir + TEXT("*.ini"), ofd);
+    if(!hFind)
+        return false;
+
+    QWORD largestSize = 0;
+    do
+    {
+        if(ofd.bDirectory)
+            continue;
+
+        String strFile = strDir + ofd.fileName;
+        XFile file;
+        if(file.Open(strFile, XFILE_READ, XFILE_OPENEXISTING) && file.GetFileSize() > largestSize)
+        {
+            largestSize = file.GetFileSize();
+            strPath = strFile;
+        }
+    } while(OSFindNextFile(hFind, ofd));
+
+    OSFindClose(hFind);
+
+    return largestSize != 0;
+}
+
+//the keys OBS reads plus plugin sections.  the first video section is a stray one of the kind hand edited
+//profiles end up with, so GetInt has to go on to the real BaseWidth.  the color sections do the same for GetColor
+static bool GenerateProfile(CTSTR lpFile)
+{
+    XFile file;
+    if(!file.Open(lpFile, XFILE_WRITE, XFILE_CREATEALWAYS))
+        return false;
+
+    String strText;
+    CTSTR lpLastSection = NULL;
+
+    strText << TEXT("[Video]\r\nBaseWidth=notanumber\r\n");
+    strText << TEXT("[Colors]\r\nBackground=[12,34\r\nBorder=blue\r\n");
+    strText << TEXT("[Colors]\r\nBackground={0.25,0.5,0.75}\r\nBorder=[32,64,96,255]\r\n");
+
+    for(UINT i=0; i<CONFIG_TEST_NUM_START_LOOKUPS; i++)
+    {
+        const ConfigTestLookup &lookup = startLookups[i];
+        if(!lpLastSection || scmp(lpLastSection, lookup.lpSection) != 0)
+        {
+            strText << TEXT("[") << lookup.lpSection << TEXT("]\r\n");
+            lpLastSection = lookup.lpSection;
+        }
+
+        strText << lookup.lpKey << TEXT("=") << lookup.lpValue << TEXT("\r\n");
+    }
+
+    for(UINT i=0; i<24; i++)
+    {
+        strText << FormattedString(TEXT("[Plugin%u]\r\n"), i);
+        for(UINT j=0; j<32; j++)
+            strText << FormattedString(TEXT("Setting%u=%d\r\n"), j, int(i*1000+j));
+    }
+
+    file.Write("\xEF\xBB\xBF", 3);
+    file.WriteAsUTF8(strText);
+
+    return true;
+}
+
+//mixes the case of the ascii letters, the lookups are case insensitive
+static void ScrambleCase(String &str)
+{
+    TSTR lpStr = str.Array();
+    for(UINT i=0; i<str.Length(); i++)
+    {
+        TCHAR ch = lpStr[i];
+        if((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'))
+        {
+            if(TestRand() & 1)
+                lpStr[i] = ch ^ 0x20;
+        }
+    }
+}
+
+struct ConfigTestQuery
+{
+    String strSection, strKey;
+    ConfigTestType type;
+};
+
+//-------------------------------------------------------------------
+
+//usage: config [profile.ini [passes]]
+int RunConfigTest(int argc, TCHAR **argv)
+{
+    UINT numPasses = (argc > 1) ? tstoi(argv[1]) : CONFIG_TEST_DEFAULT_PASSES;
+    if(!numPasses)
+        numPasses = CONFIG_TEST_DEFAULT_PASSES;
+
+    String strPath;
+    bool bGenerated = false;
+
+    if(argc > 0)
+        strPath = argv[0];
+    else if(!FindLargestProfile(strPath))
+    {
+        strPath = CONFIG_TEST_GENERATED_FILE;
+        bGenerated = GenerateProfile(strPath);
+        TestCheck(bGenerated, TEXT("couldn't write '%s'"), strPath.Array());
+        if(!bGenerated)
+            return 0;
+    }
+
+    ConfigFile config;
+    RefConfigFile ref;
+
+    double startTime = GetTestTime();
+    bool bOpened = config.Open(strPath) != 0;
+    double loadTime = GetTestTime()-startTime;
+
+    TestCheck(bOpened && ref.Load(strPath), TEXT("couldn't load '%s'"), strPath.Array());
+    if(!bOpened)
+        return 0;
+
+    //every key in the file by its type, with the case scrambled, and a miss for every few of them
+    List<ConfigTestQuery> queries;
+    UINT numKeys = 0;
+
+    SeedTestRand(47);
+
+    for(UINT i=0; i<ref.Sections.Num(); i++)
+    {
+        RefConfigSection &section = ref.Sections[i];
+        for(UINT j=0; j<section.Keys.Num(); j++)
+        {
+            RefConfigKey &key = section.Keys[j];
+            ConfigTestQuery *query = queries.CreateNew();
+            query->strSection = section.lpName;
+            query->strKey = key.lpName;
+            query->type = ValidIntString(key.lpValue) ? ConfigTest_Int : (ValidFloatString(key.lpValue) ? ConfigTest_Float : ConfigTest_String);
+            ScrambleCase(query->strSection);
+            ScrambleCase(query->strKey);
+
+            if(numKeys++ % 4 == 0)
+            {
+                query = queries.CreateNew();
+                query->strSection = section.lpName;
+                query->strKey << key.lpName << TEXT("Missing");
+                query->type = ConfigTestType(TestRand()%3);
+            }
+        }
+    }
+
+    for(UINT i=0; i<CONFIG_TEST_NUM_START_LOOKUPS; i++)
+    {
+        ConfigTestQuery *query = queries.CreateNew();
+        query->strSection = startLookups[i].lpSection;
+        query->strKey = startLookups[i].lpKey;
+        query->type = startLookups[i].type;
+    }
+
+    wprintf(TEXT("%s'%s': %u sections, %u keys, loaded in %.2f ms\n"), bGenerated ? TEXT("generated ") : TEXT(""),
+        strPath.Array(), ref.Sections.Num(), numKeys, loadTime*1000.0);
+
+    //every getter has to give the same answer as the scan
+    UINT numMismatches = 0;
+    for(UINT i=0; i<queries.Num(); i++)
+    {
+        ConfigTestQuery &query = queries[i];
+        CTSTR lpRefValue = ref.GetStringPtr(query.strSection, query.strKey);
+        CTSTR lpValue = config.GetStringPtr(query.strSection, query.strKey);
+
+        bool bMatch = (!lpRefValue == !lpValue) && (!lpValue || scmp(lpValue, lpRefValue) == 0);
+        bMatch = bMatch && (config.HasKey(query.strSection, query.strKey) != 0) == (lpRefValue != NULL);
+        bMatch = bMatch && config.GetString(query.strSection, query.strKey, TEXT("def")) == (lpRefValue ? lpRefValue : TEXT("def"));
+
+        //twice, so the cached values get checked too
+        for(UINT j=0; j<2; j++)
+        {
+            bMatch = bMatch && config.GetInt(query.strSection, query.strKey, -12345) == ref.GetInt(query.strSection, query.strKey, -12345);
+            bMatch = bMatch && config.GetFloat(query.strSection, query.strKey, -1.0f) == ref.GetFloat(query.strSection, query.strKey, -1.0f);
+        }
+
+        if(!bMatch && numMismatches++ < 10)
+            TestCheck(false, TEXT("[%s] %s doesn't match the scan"), query.strSection.Array(), query.strKey.Array());
+    }
+
+    if(numMismatches > 10)
+        TestCheck(false, TEXT("%u lookups in total didn't match the scan"), numMismatches);
+
+    if(bGenerated)
+    {
+        TestCheck(config.GetColor(TEXT("Colors"), TEXT("Background")) == Color4(0.25f, 0.5f, 0.75f, 1.0f),
+            TEXT("GetColor didn't go on to the later Background"));
+        TestCheck(config.GetColor(TEXT("Colors"), TEXT("Border")).CloseTo(Color4(32.0f/255.0f, 64.0f/255.0f, 96.0f/255.0f, 1.0f), 0.01f),
+            TEXT("GetColor didn't go on to the later Border"));
+    }
+
+    //the storm.  the checksum keeps the lookups from being optimized out
+    double times[2];
+    INT64 checksums[2] = {0, 0};
+
+    for(UINT impl=0; impl<2; impl++)
+    {
+        startTime = GetTestTime();
+
+        for(UINT pass=0; pass<numPasses; pass++)
+        {
+            for(UINT i=0; i<queries.Num(); i++)
+            {
+                ConfigTestQuery &query = queries[i];
+                switch(query.type)
+                {
+                    case ConfigTest_String:
+                        {
+                            CTSTR lpValue = impl ? ref.GetStringPtr(query.strSection, query.strKey) : config.GetStringPtr(query.strSection, query.strKey);
+                            checksums[impl] += lpValue ? *lpValue : 1;
+                            break;
+                        }
+                    case ConfigTest_Int:
+                        checksums[impl] += impl ? ref.GetInt(query.strSection, query.strKey, 7) : config.GetInt(query.strSection, query.strKey, 7);
+                        break;
+                    case ConfigTest_Float:
+                        checksums[impl] += INT64(impl ? ref.GetFloat(query.strSection, query.strKey, 7.0f) : config.GetFloat(query.strSection, query.strKey, 7.0f));
+                        break;
+                }
+            }
+        }
+
+        times[impl] = GetTestTime()-startTime;
+    }
+
+    double numLookups = double(queries.Num())*double(numPasses);
+    wprintf(TEXT("%u lookups x %u passes: indexed %7.1f ns/lookup, scan %7.1f ns/lookup, %5.1fx\n"),
+        queries.Num(), numPasses, times[0]*1e9/numLookups, times[1]*1e9/numLookups, times[0] > 0.0 ? times[1]/times[0] : 0.0);
+
+    TestCheck(checksums[0] == checksums[1], TEXT("storm checksums differ"));
+
+    for(UINT i=0; i<queries.Num(); i++)
+    {
+        queries[i].strSection.Clear();
+        queries[i].strKey.Clear();
+    }
+
+    config.Close();
+    if(bGenerated)
+        OSDeleteFile(strPath);
+
+    return 0;
+}
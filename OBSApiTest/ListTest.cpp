@@ -0,0 +1,386 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//checks List against a copy of the old reallocate-on-every-change list after every operation, then
+//times Add/Insert/Remove/AppendArray on both.  the old list is kept here as the reference so the numbers
+//stay comparable after Template.h moves on
+
+#define LIST_TEST_DEFAULT_COUNT     65536
+#define LIST_TEST_RANDOM_OPS        20000
+
+//list layout before capacity was added.  on 32 bit builds List grew from 8 to 12 bytes, so a plugin
+//built against it sees the wrong offsets for anything placed after a List in an exported class.  64 bit
+//builds had the room in padding already
+struct ListTestOldLayout
+{
+    void *array;
+    unsigned int num;
+};
+
+//List as it was before it had a capacity, trimmed to what's compared here
+template<typename T> class OldTestList
+{
+    T *array;
+    unsigned int num;
+
+public:
+    inline OldTestList() : array(NULL), num(0) {}
+    inline ~OldTestList() {Clear();}
+
+    inline T* Array() const             {return array;}
+    inline unsigned int Num() const     {return num;}
+
+    inline unsigned int Add(const T& val)
+    {
+        array = (T*)ReAllocate(array, sizeof(T)*++num);
+        mcpy(&array[(num-1)], (void*)&val, sizeof(T));
+        return num-1;
+    }
+
+    inline void Insert(unsigned int index, const T& val)
+    {
+        if(index > num) return;
+
+        if(!num && !index)
+        {
+            Add(val);
+            return;
+        }
+
+        T *temp = (T*)Allocate(sizeof(T));
+        mcpy(temp, &val, sizeof(T));
+
+        UINT moveCount = num-index;
+        array = (T*)ReAllocate(array, sizeof(T)*++num);
+        if(moveCount)
+            mcpyrev(array+(index+1), array+index, moveCount*sizeof(T));
+        mcpy(&array[index], temp, sizeof(T));
+
+        Free(temp);
+    }
+
+    inline void Remove(unsigned int index)
+    {
+        if(index >= num) return;
+
+        if(!--num) {Free(array); array=NULL; return;}
+
+        mcpy(&array[index], &array[index+1], sizeof(T)*(num-index));
+
+        array = (T*)ReAllocate(array, sizeof(T)*num);
+    }
+
+    inline void AppendArray(const T *new_array, unsigned int n)
+    {
+        if(!n)
+            return;
+
+        int oldnum = num;
+
+        array = (T*)ReAllocate(array, sizeof(T)*(num+n));
+        num += n;
+        zero(&array[oldnum], sizeof(T)*n);
+
+        mcpy(&array[oldnum], (void*)new_array, sizeof(T)*n);
+    }
+
+    inline void Clear()
+    {
+        if(array)
+        {
+            Free(array);
+            array = NULL;
+            num = 0;
+        }
+    }
+};
+
+//roughly the size of the packet and source records that get appended per frame
+struct ListTestItem
+{
+    UINT id;
+    UINT size;
+    QWORD timestamp;
+    float values[4];
+};
+
+//-------------------------------------------------------------------
+
+static bool ListMatches(const OldTestList<UINT> &model, const List<UINT> &list)
+{
+    if(model.Num() != list.Num())
+        return false;
+    if(!list.Num())
+        return true;
+
+    return mcmp(model.Array(), list.Array(), sizeof(UINT)*list.Num()) != 0;
+}
+
+static void CheckListOps()
+{
+    List<UINT> list;
+    OldTestList<UINT> model;
+
+    SeedTestRand(41);
+
+    //random mix weighted towards growth, so the list goes through plenty of reallocations and shrinks
+    for(UINT i=0; i<LIST_TEST_RANDOM_OPS; i++)
+    {
+        UINT op = TestRand()%10;
+        UINT val = TestRand();
+
+        if(op < 4 || !list.Num())
+        {
+            list.Add(val);
+            model.Add(val);
+        }
+        else if(op < 6)
+        {
+            UINT index = TestRand()%(list.Num()+1);
+            list.Insert(index, val);
+            model.Insert(index, val);
+        }
+        else if(op < 8)
+        {
+            UINT index = TestRand()%list.Num();
+            list.Remove(index);
+            model.Remove(index);
+        }
+        else if(op < 9)
+        {
+            UINT chunk[37];
+            UINT count = TestRand()%37;
+            for(UINT j=0; j<count; j++)
+                chunk[j] = TestRand();
+
+            list.AppendArray(chunk, count);
+            model.AppendArray(chunk, count);
+        }
+        else
+        {
+            //an item of the list itself, which has to survive the list growing underneath it
+            UINT index = TestRand()%list.Num();
+            if(val & 1)
+            {
+                UINT item = list[index];
+                list.Add(list[index]);
+                model.Add(item);
+            }
+            else
+            {
+                UINT item = list[index];
+                UINT insertAt = TestRand()%(list.Num()+1);
+                list.Insert(insertAt, list[index]);
+                model.Insert(insertAt, item);
+            }
+        }
+
+        if(!ListMatches(model, list) || list.Capacity() < list.Num())
+        {
+            TestCheck(false, TEXT("list differs from the reference after operation %u (op %u, num %u, capacity %u)"),
+                i, op, list.Num(), list.Capacity());
+            return;
+        }
+    }
+
+    //reserve, shrink and set size keep the contents
+    UINT num = list.Num();
+    UINT *lpOldArray = list.Array();
+
+    list.Reserve(num/2);
+    TestCheck(list.Array() == lpOldArray, TEXT("Reserve below the capacity reallocated"));
+
+    list.Reserve(num*2);
+    TestCheck(list.Capacity() >= num*2 && ListMatches(model, list), TEXT("Reserve lost items or capacity"));
+
+    list.ShrinkToFit();
+    TestCheck(list.Capacity() == num && ListMatches(model, list), TEXT("ShrinkToFit left capacity %u for %u items"), list.Capacity(), num);
+
+    list.SetSize(num/2);
+    TestCheck(list.Num() == num/2 && list.Capacity() == num, TEXT("shrinking SetSize gave back memory"));
+    TestCheck(mcmp(list.Array(), model.Array(), sizeof(UINT)*(num/2)) != 0, TEXT("shrinking SetSize changed items"));
+
+    list.SetSize(num);
+    bool bZeroed = true;
+    for(UINT i=num/2; i<num; i++)
+        bZeroed = bZeroed && list[i] == 0;
+    TestCheck(bZeroed, TEXT("growing SetSize didn't zero the new items"));
+
+    //moves and transfers leave the source empty
+    list.CopyArray(model.Array(), model.Num());
+
+    List<UINT> moved(std::move(list));
+    TestCheck(!list.Array() && !list.Num() && !list.Capacity(), TEXT("move constructor left the source list set"));
+    TestCheck(ListMatches(model, moved), TEXT("move constructor lost items"));
+
+    List<UINT> assigned;
+    assigned << 1 << 2 << 3;
+    assigned = std::move(moved);
+    TestCheck(!moved.Array() && !moved.Num() && !moved.Capacity(), TEXT("move assignment left the source list set"));
+    TestCheck(ListMatches(model, assigned), TEXT("move assignment lost items"));
+
+    assigned.TransferTo(list);
+    TestCheck(!assigned.Array() && ListMatches(model, list), TEXT("TransferTo lost items"));
+
+    while(list.Num())
+        list.Remove(list.Num()-1);
+    TestCheck(list.Array() != NULL && list.Capacity() != 0, TEXT("removing every item gave back memory"));
+
+    list.ShrinkToFit();
+    TestCheck(!list.Array() && !list.Capacity(), TEXT("ShrinkToFit on an empty list kept memory"));
+}
+
+//appending has to stay amortized constant: the number of reallocations grows with log(n), not n
+static void CheckListGrowth(UINT count)
+{
+    List<UINT> list;
+    UINT numReallocs = 0;
+    UINT lastCapacity = 0;
+
+    for(UINT i=0; i<count; i++)
+    {
+        list << i;
+        if(list.Capacity() != lastCapacity)
+        {
+            numReallocs++;
+            lastCapacity = list.Capacity();
+        }
+    }
+
+    //4, then half again each time
+    UINT maxReallocs = 1;
+    for(UINT capacity=4; capacity < count; capacity += capacity/2)
+        maxReallocs++;
+
+    wprintf(TEXT("%u adds: %u reallocations, capacity %u\n"), count, numReallocs, list.Capacity());
+    TestCheck(numReallocs <= maxReallocs, TEXT("%u adds took %u reallocations, expected at most %u"), count, numReallocs, maxReallocs);
+}
+
+//-------------------------------------------------------------------
+
+template<typename T> static void FillListTestItem(T &item, UINT i)
+{
+    item = T(i);
+}
+
+template<> void FillListTestItem<ListTestItem>(ListTestItem &item, UINT i)
+{
+    zero(&item, sizeof(item));
+    item.id = i;
+    item.size = i*3;
+    item.timestamp = QWORD(i)*16;
+}
+
+//returns nanoseconds per item for each operation, in the order of listTestOps
+template<typename T, typename ListType> static void TimeListOps(UINT count, double *times)
+{
+    T item;
+    T chunk[64];
+    for(UINT i=0; i<64; i++)
+        FillListTestItem(chunk[i], i);
+
+    ListType *list = new ListType;
+
+    //Add
+    double startTime = GetTestTime();
+    for(UINT i=0; i<count; i++)
+    {
+        FillListTestItem(item, i);
+        list->Add(item);
+    }
+    times[0] = (GetTestTime()-startTime)*1e9/double(count);
+
+    //Remove from the back, which used to reallocate each time
+    startTime = GetTestTime();
+    for(UINT i=0; i<count; i++)
+        list->Remove(list->Num()-1);
+    times[1] = (GetTestTime()-startTime)*1e9/double(count);
+
+    //Insert in the middle.  it's quadratic either way, so fewer items
+    UINT insertCount = MIN(count, 8192);
+    startTime = GetTestTime();
+    for(UINT i=0; i<insertCount; i++)
+    {
+        FillListTestItem(item, i);
+        list->Insert(list->Num()/2, item);
+    }
+    times[2] = (GetTestTime()-startTime)*1e9/double(insertCount);
+
+    //Remove from the middle
+    startTime = GetTestTime();
+    for(UINT i=0; i<insertCount; i++)
+        list->Remove(list->Num()/2);
+    times[3] = (GetTestTime()-startTime)*1e9/double(insertCount);
+
+    //AppendArray in packet-sized chunks
+    list->Clear();
+    UINT numAppended = 0;
+    startTime = GetTestTime();
+    for(UINT i=0; numAppended<count; i++)
+    {
+        UINT n = 1 + (i*7)%64;
+        list->AppendArray(chunk, n);
+        numAppended += n;
+    }
+    times[4] = (GetTestTime()-startTime)*1e9/double(numAppended);
+
+    delete list;
+}
+
+static CTSTR listTestOps[] = {TEXT("add"), TEXT("remove last"), TEXT("insert middle"), TEXT("remove middle"), TEXT("append array")};
+#define LIST_TEST_NUM_OPS (sizeof(listTestOps)/sizeof(listTestOps[0]))
+
+template<typename T> static void BenchmarkList(CTSTR lpTypeName, UINT count)
+{
+    double newTimes[LIST_TEST_NUM_OPS], oldTimes[LIST_TEST_NUM_OPS];
+
+    //once to warm up the allocator, then the timed pair
+    TimeListOps<T, List<T> >(count, newTimes);
+    TimeListOps<T, OldTestList<T> >(count, oldTimes);
+    TimeListOps<T, List<T> >(count, newTimes);
+
+    for(UINT i=0; i<LIST_TEST_NUM_OPS; i++)
+    {
+        wprintf(TEXT("%-8s %-14s %8.1f ns  (old %9.1f ns, %6.1fx)\n"), lpTypeName, listTestOps[i],
+            newTimes[i], oldTimes[i], newTimes[i] > 0.0 ? oldTimes[i]/newTimes[i] : 0.0);
+    }
+}
+
+//usage: list [count]
+int RunListTest(int argc, TCHAR **argv)
+{
+    UINT count = (argc > 0) ? tstoi(argv[0]) : LIST_TEST_DEFAULT_COUNT;
+    if(!count)
+        count = LIST_TEST_DEFAULT_COUNT;
+
+    //the capacity member is what made this a major API version
+    wprintf(TEXT("sizeof(List) %u (was %u), API version 0x%04X\n"), UINT(sizeof(List<UINT>)), UINT(sizeof(ListTestOldLayout)), OBSGetAPIVersion());
+    TestCheck(sizeof(List<UINT>) == sizeof(ListTestOldLayout) || OBSGetAPIVersion() >= 0x0200,
+        TEXT("List layout changed without a major API version bump"));
+
+    CheckListOps();
+    CheckListGrowth(count);
+
+    BenchmarkList<UINT>(TEXT("UINT"), count);
+    BenchmarkList<ListTestItem>(TEXT("32 byte"), count);
+
+    return 0;
+}
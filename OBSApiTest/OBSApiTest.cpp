@@ -0,0 +1,46 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#define TEST_HARNESS_IMPLEMENTATION
+#include "OBSApiTest.h"
+
+
+static const TestSuite suites[] =
+{
+    {TEXT("xfile"), RunXFileTest},
+    {TEXT("list"), RunListTest},
+    {TEXT("alloc"), RunAllocTest},
+    {TEXT("config"), RunConfigTest},
+    {TEXT("xconfig"), RunXConfigTest},
+    {TEXT("string"), RunStringTest},
+    {TEXT("utf8"), RunUtf8Test},
+};
+
+//usage: OBSApiTest [suite [suite options]]
+//with no suite every suite runs with its defaults.  exits with the number of failed checks
+int wmain(int argc, TCHAR **argv)
+{
+    InitXT(NULL, TEXT("FastAlloc"));
+
+    int ret = RunTestSuites(suites, sizeof(suites)/sizeof(suites[0]), argc, argv);
+
+    TerminateXT();
+
+    return ret;
+}
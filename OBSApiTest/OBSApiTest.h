@@ -0,0 +1,39 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//regression checks and benchmarks for the OBSApi utility code (files, containers, allocator, config,
+//strings).  each suite prints what it measured and counts a failure for every check that falls
+//outside its limits.  everything runs against the real OBSApi.dll with FastAlloc, like OBS does
+
+#include "OBSApi.h"
+
+#ifdef UNICODE
+#define TEST_WIDE_STRINGS
+#endif
+#include "TestHarness.h"
+
+int RunXFileTest(int argc, TCHAR **argv);
+int RunListTest(int argc, TCHAR **argv);
+int RunAllocTest(int argc, TCHAR **argv);
+int RunConfigTest(int argc, TCHAR **argv);
+int RunXConfigTest(int argc, TCHAR **argv);
+int RunStringTest(int argc, TCHAR **argv);
+int RunUtf8Test(int argc, TCHAR **argv);
@@ -0,0 +1,589 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//checks String against a plain character buffer through random edits, checks that strings still work after
+//List moves them around with memcpy, that Array() pointers stay put when the list holding the strings grows
+//and that empty strings are still NULL.  then counts the heap allocations made by startup-like work: loading
+//the locale, a profile and a scene collection, and keeping the names and values OBS keeps
+
+#define STRING_TEST_OPS             20000
+#define STRING_TEST_MAX_LENGTH      200
+#define STRING_TEST_RELOCATIONS     4000
+#define STRING_TEST_SHORT_LENGTH    24
+#define STRING_TEST_DEFAULT_LOCALE  TEXT("locale/en.txt")
+#define STRING_TEST_PROFILE         TEXT("stringtest.ini")
+#define STRING_TEST_SCENES          TEXT("stringtest.xconfig")
+
+//counts everything that goes through MainAllocator while it's installed
+class CountingTestAlloc : public Alloc
+{
+public:
+    Alloc *allocator;
+    UINT numAllocs;
+    QWORD numBytes;
+
+    inline CountingTestAlloc() : allocator(MainAllocator), numAllocs(0), numBytes(0) {MainAllocator = this;}
+    inline ~CountingTestAlloc() {MainAllocator = allocator;}
+
+    void * __restrict _Allocate(size_t dwSize)          {numAllocs++; numBytes += dwSize; return allocator->_Allocate(dwSize);}
+    void * _ReAllocate(LPVOID lpData, size_t dwSize)    {numAllocs++; numBytes += dwSize; return allocator->_ReAllocate(lpData, dwSize);}
+    void   _Free(LPVOID lpData)                         {allocator->_Free(lpData);}
+    void   ErrorTermination()                           {allocator->ErrorTermination();}
+};
+
+//name and key sized most of the time, with the odd long one
+static void RandomTestString(TCHAR *lpStr, UINT maxLength)
+{
+    static const TCHAR chars[] = TEXT("ab cAB\x00e9\x4e2d");
+
+    UINT length = (TestRand()%8 == 0) ? TestRand()%maxLength : TestRand()%STRING_TEST_SHORT_LENGTH;
+    if(length > maxLength)
+        length = maxLength;
+
+    for(UINT i=0; i<length; i++)
+        lpStr[i] = chars[TestRand()%(sizeof(chars)/sizeof(TCHAR)-1)];
+    lpStr[length] = 0;
+}
+
+//-------------------------------------------------------------------
+
+struct StringTestModel
+{
+    TCHAR str[STRING_TEST_MAX_LENGTH*16];
+    UINT length;
+
+    inline void Set(CTSTR lpStr)            {length = slen(lpStr); mcpy(str, lpStr, (length+1)*sizeof(TCHAR));}
+    inline void Insert(UINT pos, CTSTR lpStr)
+    {
+        UINT strLength = slen(lpStr);
+        mcpyrev(str+pos+strLength, str+pos, (length+1-pos)*sizeof(TCHAR));
+        mcpy(str+pos, lpStr, strLength*sizeof(TCHAR));
+        length += strLength;
+    }
+    inline void Remove(UINT from, UINT to)
+    {
+        mcpy(str+from, str+to, (length+1-to)*sizeof(TCHAR));
+        length -= to-from;
+    }
+    void Replace(CTSTR lpFind, CTSTR lpReplace)
+    {
+        TCHAR temp[STRING_TEST_MAX_LENGTH*16];
+        UINT findLength = slen(lpFind), replaceLength = slen(lpReplace), newLength = 0;
+
+        for(UINT i=0; i<length;)
+        {
+            if(i+findLength <= length && mcmp(str+i, lpFind, findLength*sizeof(TCHAR)))
+            {
+                mcpy(temp+newLength, lpReplace, replaceLength*sizeof(TCHAR));
+                newLength += replaceLength;
+                i += findLength;
+            }
+            else
+                temp[newLength++] = str[i++];
+        }
+
+        temp[newLength] = 0;
+        Set(temp);
+    }
+};
+
+static bool StringMatches(const String &str, const StringTestModel &model)
+{
+    if(str.Length() != model.length)
+        return false;
+    if(!model.length)
+        return str.IsEmpty() != 0;
+
+    return str.Array() && mcmp(str.Array(), model.str, (model.length+1)*sizeof(TCHAR));
+}
+
+static void CheckStringOps()
+{
+    static CTSTR finds[] = {TEXT("a"), TEXT("ab"), TEXT("b c"), TEXT("\x00e9")};
+    static CTSTR replaces[] = {TEXT(""), TEXT("x"), TEXT("xyz"), TEXT("a\x4e2d\x4e2d")};
+
+    StringTestModel model;
+    String str;
+    TCHAR temp[STRING_TEST_MAX_LENGTH+1];
+    UINT numMismatches = 0;
+
+    model.Set(TEXT(""));
+    SeedTestRand(49);
+
+    for(UINT i=0; i<STRING_TEST_OPS; i++)
+    {
+        UINT op = TestRand()%14;
+        RandomTestString(temp, STRING_TEST_MAX_LENGTH);
+
+        //keep the model inside its buffer
+        if(model.length > STRING_TEST_MAX_LENGTH*4)
+            op = 0;
+
+        switch(op)
+        {
+            case 0:
+                str = temp;
+                model.Set(temp);
+                break;
+
+            case 1:
+                str << temp;
+                model.Insert(model.length, temp);
+                break;
+
+            case 2:
+                if(temp[0])
+                {
+                    str << temp[0];
+                    temp[1] = 0;
+                    model.Insert(model.length, temp);
+                }
+                break;
+
+            case 3:
+                if(*temp)
+                {
+                    UINT pos = TestRand()%(model.length+1);
+                    str.InsertString(pos, temp);
+                    model.Insert(pos, temp);
+                }
+                break;
+
+            case 4:
+                if(*temp)
+                {
+                    UINT pos = TestRand()%(model.length+1);
+                    str.InsertChar(pos, temp[0]);
+                    temp[1] = 0;
+                    model.Insert(pos, temp);
+                }
+                break;
+
+            case 5:
+                if(model.length)
+                {
+                    UINT pos = TestRand()%model.length;
+                    str.RemoveChar(pos);
+                    model.Remove(pos, pos+1);
+                }
+                break;
+
+            case 6:
+                if(model.length)
+                {
+                    UINT from = TestRand()%model.length;
+                    UINT to = from+1+TestRand()%(model.length-from);
+                    str.RemoveRange(from, to);
+                    model.Remove(from, to);
+                }
+                break;
+
+            case 7:
+                if(model.length)
+                {
+                    UINT length = TestRand()%(model.length+1);
+                    str.SetLength(length);
+                    model.Remove(length, model.length);
+                }
+                break;
+
+            case 8:
+                {
+                    UINT id = TestRand()%(sizeof(finds)/sizeof(finds[0]));
+                    str.FindReplace(finds[id], replaces[id]);
+                    model.Replace(finds[id], replaces[id]);
+                }
+                break;
+
+            case 9:
+                {
+                    String copy(str);
+                    if(!StringMatches(copy, model))
+                        numMismatches++;
+                    str = copy;
+                }
+                break;
+
+            case 10:
+                str += str;
+                model.Insert(model.length, model.str);
+                break;
+
+            case 11:
+                {
+                    String &self = str;
+                    str = self;
+                }
+                break;
+
+            case 12:
+                str.Clear();
+                model.Set(TEXT(""));
+                break;
+
+            case 13:
+                {
+                    int number = int(TestRand()%2000000)-1000000;
+                    str << number;
+                    itots_s(number, temp, 15, 10);
+                    model.Insert(model.length, temp);
+                }
+                break;
+        }
+
+        if(!StringMatches(str, model))
+            numMismatches++;
+    }
+
+    TestCheck(numMismatches == 0, TEXT("%u of %u string ops gave the wrong string"), numMismatches, STRING_TEST_OPS);
+}
+
+//empty strings have no buffer
+static void CheckStringStorage()
+{
+    String str;
+    TestCheck(str.Array() == NULL && str.IsEmpty(), TEXT("new string isn't NULL"));
+
+    str = TEXT("");
+    TestCheck(str.Array() == NULL, TEXT("string assigned \"\" isn't NULL"));
+
+    str = TEXT("short");
+    str.SetLength(0);
+    TestCheck(str.Array() == NULL, TEXT("string after SetLength(0) isn't NULL"));
+
+    str = TEXT("x");
+    str.RemoveChar(0);
+    TestCheck(str.Array() == NULL, TEXT("string after removing its last char isn't NULL"));
+
+    str = TEXT("abc");
+    str.RemoveRange(0, 3);
+    TestCheck(str.Array() == NULL, TEXT("string after removing everything isn't NULL"));
+
+    String copy(str);
+    TestCheck(copy.Array() == NULL, TEXT("copy of an empty string isn't NULL"));
+
+    TestCheck(String((CTSTR)NULL).Array() == NULL && String("").Array() == NULL, TEXT("string made from NULL or \"\" isn't NULL"));
+
+    //growing one character at a time keeps what's there
+    TCHAR expected[64];
+    str.Clear();
+    for(UINT i=0; i<63; i++)
+    {
+        str << TCHAR('a'+i%26);
+        expected[i] = TCHAR('a'+i%26);
+        expected[i+1] = 0;
+
+        TestCheck(scmp(str, expected) == 0, TEXT("appending char %u gave \"%s\""), i, str.Array());
+    }
+
+    String utf8String("caf\xc3\xa9");
+    TestCheck(utf8String.Length() == 4 && utf8String.Array()[3] == 0x00e9, TEXT("utf8 string came out wrong"));
+}
+
+//strings in a list get moved with memcpy whenever it grows, inserts or removes
+static void CheckStringRelocation()
+{
+    struct RelocationItem
+    {
+        UINT id;
+        String strName;
+    };
+
+    StringList strings;
+    List<RelocationItem> items;
+    List<UINT> ids;
+
+    //what each string should be, kept where nothing moves it
+    TCHAR (*expected)[41] = (TCHAR(*)[41])Allocate(STRING_TEST_RELOCATIONS*sizeof(*expected));
+
+    SeedTestRand(4949);
+
+    for(UINT i=0; i<STRING_TEST_RELOCATIONS; i++)
+    {
+        TSTR lpStr = expected[i];
+        RandomTestString(lpStr, 40);
+        if(!*lpStr)
+            scpy(lpStr, TEXT("-"));
+
+        UINT op = TestRand()%8;
+        if(op == 0 && strings.Num())
+        {
+            UINT index = TestRand()%strings.Num();
+            strings.Remove(index);
+            ids.Remove(index);
+        }
+        else if(op < 3)
+        {
+            UINT index = strings.Num() ? TestRand()%strings.Num() : 0;
+            strings.Insert(index, lpStr);
+            ids.Insert(index, i);
+        }
+        else
+        {
+            strings.Add(lpStr);
+            ids << i;
+        }
+
+        RelocationItem *item = items.CreateNew();
+        item->id = i;
+        item->strName = lpStr;
+    }
+
+    UINT numMismatches = 0;
+    for(UINT i=0; i<items.Num(); i++)
+    {
+        if(items[i].id != i || scmp(items[i].strName, expected[i]) != 0)
+            numMismatches++;
+    }
+
+    for(UINT i=0; i<strings.Num(); i++)
+    {
+        if(scmp(strings[i], expected[ids[i]]) != 0)
+            numMismatches++;
+    }
+
+    TestCheck(numMismatches == 0, TEXT("%u string(s) were wrong after being moved around in a list"), numMismatches);
+
+    for(UINT i=0; i<items.Num(); i++)
+        items[i].strName.Clear();
+    Free(expected);
+}
+
+//callers keep Array() of strings that live in lists (names handed to other lists, to windows, to the log)
+//while the list grows, so the characters can't move when the String does
+static void CheckArrayPointers()
+{
+    StringList strings;
+    List<CTSTR> pointers;
+    TCHAR temp[STRING_TEST_MAX_LENGTH+1];
+
+    SeedTestRand(494949);
+
+    for(UINT i=0; i<STRING_TEST_RELOCATIONS; i++)
+    {
+        RandomTestString(temp, 40);
+        if(!*temp)
+            scpy(temp, TEXT("-"));
+
+        //inserting at the front moves every string in the list, growing moves them to a new array
+        if(i%4 == 0)
+        {
+            strings.Insert(0, temp);
+            pointers.Insert(0, strings[0].Array());
+        }
+        else
+        {
+            strings.Add(temp);
+            pointers << strings.Last().Array();
+        }
+    }
+
+    UINT numMoved = 0;
+    for(UINT i=0; i<strings.Num(); i++)
+    {
+        if(strings[i].Array() != pointers[i])
+            numMoved++;
+    }
+
+    TestCheck(numMoved == 0, TEXT("%u of %u Array() pointers moved when the list grew"), numMoved, strings.Num());
+}
+
+//-------------------------------------------------------------------
+
+//names and values like the ones OBS keeps
+static CTSTR shortNames[] =
+{
+    TEXT("Video"), TEXT("Audio"), TEXT("Bitrate"), TEXT("Codec"), TEXT("Device"), TEXT("BaseWidth"), TEXT("FPS"),
+    TEXT("Preset"), TEXT("Scene 1"), TEXT("render"), TEXT("class"), TEXT("Webcam"), TEXT("Text"), TEXT("cx"),
+    TEXT("data"), TEXT("sources"), TEXT("hotkey"), TEXT("Default"), TEXT("veryfast"), TEXT("AAC"),
+};
+
+static CTSTR longNames[] =
+{
+    TEXT("GraphicsCapture"), TEXT("MicBoostMultiple"), TEXT("BitmapImageSource"), TEXT("UseCBR Buffer"),
+    TEXT("Audio Encoding"), TEXT("PlaybackDevice"), TEXT("WindowCaptureSource"), TEXT("DesktopVolume"),
+};
+
+#define STRING_TEST_NUM_SHORT_NAMES (sizeof(shortNames)/sizeof(shortNames[0]))
+#define STRING_TEST_NUM_LONG_NAMES  (sizeof(longNames)/sizeof(longNames[0]))
+
+//makes a name and builds a longer one from it a piece at a time, count times.  returns the seconds it took
+static double TimeNames(CTSTR *names, UINT numNames, UINT count, UINT &numAllocs)
+{
+    CountingTestAlloc counter;
+
+    double startTime = GetTestTime();
+    for(UINT i=0; i<count; i++)
+    {
+        String name = names[i%numNames];
+        String path;
+        path << TEXT("sources/") << name << TEXT("/") << names[(i+1)%numNames] << TEXT(" ") << i;
+    }
+    double time = GetTestTime()-startTime;
+
+    numAllocs = counter.numAllocs;
+    return time;
+}
+
+//-------------------------------------------------------------------
+
+static const CTSTR startupProfile =
+    TEXT("[General]\r\nLanguage=en\r\nMaxLogs=20\r\n")
+    TEXT("[Audio]\r\nDevice=Default\r\nPlaybackDevice=Default\r\nDesktopVolume=1\r\nMicVolume=0.85\r\nUsePushToTalk=0\r\n")
+    TEXT("[Audio Encoding]\r\nCodec=AAC\r\nBitrate=160\r\nFormat=1\r\n")
+    TEXT("[Video]\r\nMonitor=0\r\nBaseWidth=1920\r\nBaseHeight=1080\r\nFPS=30\r\nDownscale=1\r\nFilter=0\r\n")
+    TEXT("[Video Encoding]\r\nMaxBitrate=2500\r\nBufferSize=2500\r\nQuality=8\r\nUseCBR=1\r\nPreset=veryfast\r\n")
+    TEXT("[Publish]\r\nMode=0\r\nService=1\r\nURL=rtmp://live.twitch.tv/app\r\nPlayPath=live_1234567_abcdefghijklmnop\r\n")
+    TEXT("SaveToFile=0\r\nSavePath=C:\\Users\\user\\Videos\\recording.flv\r\n");
+
+static const CTSTR startupKeys[][2] =
+{
+    {TEXT("General"), TEXT("Language")}, {TEXT("Audio"), TEXT("Device")}, {TEXT("Audio"), TEXT("PlaybackDevice")},
+    {TEXT("Audio Encoding"), TEXT("Codec")}, {TEXT("Video"), TEXT("BaseWidth")}, {TEXT("Video"), TEXT("FPS")},
+    {TEXT("Video Encoding"), TEXT("Preset")}, {TEXT("Video Encoding"), TEXT("MaxBitrate")}, {TEXT("Publish"), TEXT("URL")},
+    {TEXT("Publish"), TEXT("PlayPath")}, {TEXT("Publish"), TEXT("SavePath")},
+};
+
+static CTSTR startupSources[] = {TEXT("GraphicsCapture"), TEXT("DeviceCapture"), TEXT("TextSource"), TEXT("BitmapImageSource")};
+
+static bool GenerateStartupFiles()
+{
+    XFile file;
+    if(!file.Open(STRING_TEST_PROFILE, XFILE_WRITE, XFILE_CREATEALWAYS))
+        return false;
+    file.Write("\xEF\xBB\xBF", 3);
+    file.WriteAsUTF8(startupProfile);
+    file.Close();
+
+    OSDeleteFile(STRING_TEST_SCENES);
+
+    XConfig config;
+    if(!config.Open(STRING_TEST_SCENES))
+        return false;
+
+    XElement *scenes = config.CreateElement(TEXT("scenes"));
+    for(UINT i=0; i<8; i++)
+    {
+        XElement *scene = scenes->CreateElement(FormattedString(TEXT("Scene %u"), i+1));
+        scene->SetString(TEXT("class"), TEXT("Scene"));
+
+        XElement *sources = scene->CreateElement(TEXT("sources"));
+        for(UINT j=0; j<10; j++)
+        {
+            CTSTR lpClass = startupSources[j%(sizeof(startupSources)/sizeof(startupSources[0]))];
+
+            XElement *source = sources->CreateElement((j%3 == 0) ? FormattedString(TEXT("%s %u"), lpClass, j) : FormattedString(TEXT("Src %u"), j));
+            source->SetString(TEXT("class"), lpClass);
+            source->SetInt(TEXT("render"), 1);
+            source->CreateElement(TEXT("data"))->SetString(TEXT("path"), TEXT("C:\\Users\\user\\Pictures\\overlay.png"));
+        }
+    }
+
+    config.Close(true);
+    return true;
+}
+
+//what OBS does at startup: the locale, the profile settings it keeps and the scene and source names
+static void RunStartupWork(CTSTR lpLocale, StringList &kept)
+{
+    LocaleStringLookup *locale = new LocaleStringLookup;
+    if(lpLocale)
+        locale->LoadStringFile(lpLocale);
+
+    ConfigFile profile;
+    profile.Open(STRING_TEST_PROFILE);
+    for(UINT i=0; i<sizeof(startupKeys)/sizeof(startupKeys[0]); i++)
+        kept.Add(profile.GetString(startupKeys[i][0], startupKeys[i][1]));
+
+    XConfig config;
+    config.Open(STRING_TEST_SCENES);
+
+    XElement *scenes = config.GetElement(TEXT("scenes"));
+    for(UINT i=0; scenes && i<scenes->NumElements(); i++)
+    {
+        XElement *scene = scenes->GetElementByID(i);
+        kept.Add(scene->GetName());
+        kept.Add(scene->GetString(TEXT("class")));
+
+        XElement *sources = scene->GetElement(TEXT("sources"));
+        for(UINT j=0; sources && j<sources->NumElements(); j++)
+        {
+            XElement *source = sources->GetElementByID(j);
+            kept.Add(source->GetName());
+            kept.Add(source->GetString(TEXT("class")));
+        }
+    }
+
+    delete locale;
+}
+
+//-------------------------------------------------------------------
+
+//usage: string [locale file]
+int RunStringTest(int argc, TCHAR **argv)
+{
+    wprintf(TEXT("sizeof(String) %u\n"), UINT(sizeof(String)));
+
+    CheckStringStorage();
+    CheckStringOps();
+    CheckStringRelocation();
+    CheckArrayPointers();
+
+    UINT count = 1000000, numShortAllocs, numLongAllocs;
+    double shortTime = TimeNames(shortNames, STRING_TEST_NUM_SHORT_NAMES, count, numShortAllocs);
+    double longTime = TimeNames(longNames, STRING_TEST_NUM_LONG_NAMES, count, numLongAllocs);
+
+    wprintf(TEXT("short names %6.1f ns, %.2f allocations each\n"), shortTime*1e9/double(count), double(numShortAllocs)/double(count));
+    wprintf(TEXT("long names  %6.1f ns, %.2f allocations each\n"), longTime*1e9/double(count), double(numLongAllocs)/double(count));
+
+    //startup
+    CTSTR lpLocale = (argc > 0) ? argv[0] : STRING_TEST_DEFAULT_LOCALE;
+    if(!OSFileExists(lpLocale))
+    {
+        wprintf(TEXT("no '%s', startup is counted without the locale\n"), lpLocale);
+        lpLocale = NULL;
+    }
+
+    bool bGenerated = GenerateStartupFiles();
+    TestCheck(bGenerated, TEXT("couldn't write the startup profile and scenes"));
+
+    if(bGenerated)
+    {
+        StringList kept;
+        UINT numAllocs;
+        QWORD numBytes;
+
+        {
+            CountingTestAlloc counter;
+            RunStartupWork(lpLocale, kept);
+            numAllocs = counter.numAllocs;
+            numBytes = counter.numBytes;
+        }
+
+        wprintf(TEXT("startup: %u allocations (%.1f KB), %u strings kept\n"), numAllocs, double(numBytes)/1024.0, kept.Num());
+    }
+
+    OSDeleteFile(STRING_TEST_PROFILE);
+    OSDeleteFile(STRING_TEST_SCENES);
+    OSDeleteFile(String(STRING_TEST_SCENES) + TEXT(".cache"));
+
+    return 0;
+}
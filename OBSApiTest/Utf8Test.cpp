@@ -0,0 +1,698 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//fuzzes the utf8 converters against the ones they replaced, which went through the state machines a character
+//at a time.  inputs are mostly ascii with multibyte, broken, forbidden and BOM characters mixed in, converted
+//with every flag combination into outputs that are big enough, exactly big enough and too small.  the return
+//value and everything in the output buffer have to be the same.  then times both on ascii heavy text like the
+//locale and config files and on text with no ascii at all
+
+#define UTF8_TEST_DEFAULT_ROUNDS    20000
+#define UTF8_TEST_MAX_CHARS         300
+#define UTF8_TEST_BENCH_CHARS       (1024*1024)
+#define UTF8_TEST_BENCH_PASSES      20
+#define UTF8_TEST_FILL              0x5A
+
+//-------------------------------------------------------------------
+//the converters from utf8.cpp as they were before the ascii runs (c) 2007 Alexey Vatchenko <av@bsdua.org>
+
+#define _NXT    0x80
+#define _SEQ2    0xc0
+#define _SEQ3    0xe0
+#define _SEQ4    0xf0
+#define _SEQ5    0xf8
+#define _SEQ6    0xfc
+
+#define _BOM    0xfeff
+
+static int
+RefWcharForbitten(wchar_t sym)
+{
+
+    // Surrogate pairs
+    if (sym >= 0xd800 && sym <= 0xdfff)
+        return (-1);
+
+    return (0);
+}
+
+static int
+RefUtf8Forbitten(unsigned char octet)
+{
+
+    switch (octet) {
+    case 0xc0:
+    case 0xc1:
+    case 0xf5:
+    case 0xff:
+        return (-1);
+    }
+
+    return (0);
+}
+
+static size_t
+RefUtf8ToWchar(const char *in, size_t insize, wchar_t *out, size_t outsize,
+    int flags)
+{
+    unsigned char *p, *lim;
+    wchar_t *wlim, high;
+    size_t n, total, i, n_bits;
+
+    if (in == NULL || insize == 0 || (outsize == 0 && out != NULL))
+        return (0);
+
+    total = 0;
+    p = (unsigned char *)in;
+    lim = p + insize;
+    wlim = out + outsize;
+
+    for (; p < lim; p += n) {
+        if (RefUtf8Forbitten(*p) != 0 &&
+            (flags & UTF8_IGNORE_ERROR) == 0)
+            return (0);
+
+        //
+        // Get number of bytes for one wide character.
+        //
+        n = 1;    // default: 1 byte. Used when skipping bytes.
+        if ((*p & 0x80) == 0)
+            high = (wchar_t)*p;
+        else if ((*p & 0xe0) == _SEQ2) {
+            n = 2;
+            high = (wchar_t)(*p & 0x1f);
+        } else if ((*p & 0xf0) == _SEQ3) {
+            n = 3;
+            high = (wchar_t)(*p & 0x0f);
+        } else if ((*p & 0xf8) == _SEQ4) {
+            n = 4;
+            high = (wchar_t)(*p & 0x07);
+        } else if ((*p & 0xfc) == _SEQ5) {
+            n = 5;
+            high = (wchar_t)(*p & 0x03);
+        } else if ((*p & 0xfe) == _SEQ6) {
+            n = 6;
+            high = (wchar_t)(*p & 0x01);
+        } else {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            continue;
+        }
+
+        // does the sequence header tell us truth about length?
+        if (lim - p <= (unsigned char)n - 1) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            n = 1;
+            continue;    // skip
+        }
+
+        //
+        // Validate sequence.
+        // All symbols must have higher bits set to 10xxxxxx
+        //
+        if (n > 1) {
+            for (i = 1; i < n; i++) {
+                if ((p[i] & 0xc0) != _NXT)
+                    break;
+            }
+            if (i != n) {
+                if ((flags & UTF8_IGNORE_ERROR) == 0)
+                    return (0);
+                n = 1;
+                continue;    // skip
+            }
+        }
+
+        total++;
+
+        if (out == NULL)
+            continue;
+
+        if (out >= wlim)
+            return (0);        // no space left
+
+        *out = 0;
+        n_bits = 0;
+        for (i = 1; i < n; i++) {
+            *out |= (wchar_t)(p[n - i] & 0x3f) << n_bits;
+            n_bits += 6;        // 6 low bits in every byte
+        }
+        *out |= high << n_bits;
+
+        if (RefWcharForbitten(*out) != 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);    // forbitten character
+            else {
+                total--;
+                out--;
+            }
+        } else if (*out == _BOM && (flags & UTF8_DONT_SKIP_BOM) == 0) {
+            total--;
+            out--;
+        }
+
+        out++;
+    }
+
+    return (total);
+}
+
+static size_t
+RefWcharToUtf8(const wchar_t *in, size_t insize, char *out, size_t outsize,
+    int flags)
+{
+    wchar_t *w, *wlim;
+    unsigned char *p, *lim, *oc;
+    unsigned int ch;
+    size_t total, n;
+
+    if (in == NULL || insize == 0 || (outsize == 0 && out != NULL))
+        return (0);
+
+    w = (wchar_t *)in;
+    wlim = w + insize;
+    p = (unsigned char *)out;
+    lim = p + outsize;
+    total = 0;
+    for (; w < wlim; w++) {
+        if (RefWcharForbitten(*w) != 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            else
+                continue;
+        }
+
+        if (*w == _BOM && (flags & UTF8_DONT_SKIP_BOM) == 0)
+            continue;
+
+        if (*w < 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            continue;
+        } else if (*w <= 0x0000007f)
+            n = 1;
+        else if (*w <= 0x000007ff)
+            n = 2;
+        else if (*w <= 0x0000ffff)
+            n = 3;
+        else if (*w <= 0x001fffff)
+            n = 4;
+        else if (*w <= 0x03ffffff)
+            n = 5;
+        else // if (*w <= 0x7fffffff)
+            n = 6;
+
+        total += n;
+
+        if (out == NULL)
+            continue;
+
+        if (lim - p <= (unsigned char)n - 1)
+            return (0);        // no space left
+
+        // make it work under different endians //jim - or how about, *no*.
+        ch = (*w);
+        oc = (unsigned char *)&ch;
+        switch (n) {
+        case 1:
+            *p = oc[0];
+            break;
+
+        case 2:
+            p[1] = _NXT | oc[0] & 0x3f;
+            p[0] = _SEQ2 | (oc[0] >> 6) | ((oc[1] & 0x07) << 2);
+            break;
+
+        case 3:
+            p[2] = _NXT | oc[0] & 0x3f;
+            p[1] = _NXT | (oc[0] >> 6) | ((oc[1] & 0x0f) << 2);
+            p[0] = _SEQ3 | ((oc[1] & 0xf0) >> 4);
+            break;
+
+        case 4:
+            p[3] = _NXT | oc[0] & 0x3f;
+            p[2] = _NXT | (oc[0] >> 6) | ((oc[1] & 0x0f) << 2);
+            p[1] = _NXT | ((oc[1] & 0xf0) >> 4) |
+                ((oc[2] & 0x03) << 4);
+            p[0] = _SEQ4 | ((oc[2] & 0x1f) >> 2);
+            break;
+
+        case 5:
+            p[4] = _NXT | oc[0] & 0x3f;
+            p[3] = _NXT | (oc[0] >> 6) | ((oc[1] & 0x0f) << 2);
+            p[2] = _NXT | ((oc[1] & 0xf0) >> 4) |
+                ((oc[2] & 0x03) << 4);
+            p[1] = _NXT | (oc[2] >> 2);
+            p[0] = _SEQ5 | oc[3] & 0x03;
+            break;
+
+        case 6:
+            p[5] = _NXT | oc[0] & 0x3f;
+            p[4] = _NXT | (oc[0] >> 6) | ((oc[1] & 0x0f) << 2);
+            p[3] = _NXT | (oc[1] >> 4) | ((oc[2] & 0x03) << 4);
+            p[2] = _NXT | (oc[2] >> 2);
+            p[1] = _NXT | oc[3] & 0x3f;
+            p[0] = _SEQ6 | ((oc[3] & 0x40) >> 6);
+            break;
+        }
+
+        //
+        // NOTE: do not check here for forbitten UTF-8 characters.
+        // They cannot appear here because we do proper convertion.
+        //
+
+        p += n;
+    }
+
+    return (total);
+}
+
+static size_t RefUtf8ToWcharLen(const char *in, size_t insize, int flags)
+{
+    unsigned char *p, *lim;
+    wchar_t high, val;
+    size_t n, total, i, n_bits;
+
+    if (in == NULL || insize == 0)
+        return (0);
+
+    total = 0;
+    p = (unsigned char *)in;
+    lim = p + insize;
+
+    for (; p < lim; p += n) {
+        if (RefUtf8Forbitten(*p) != 0 &&
+            (flags & UTF8_IGNORE_ERROR) == 0)
+            return (0);
+
+        //
+        // Get number of bytes for one wide character.
+        //
+        n = 1;    // default: 1 byte. Used when skipping bytes.
+        if ((*p & 0x80) == 0)
+            high = (wchar_t)*p;
+        else if ((*p & 0xe0) == _SEQ2) {
+            n = 2;
+            high = (wchar_t)(*p & 0x1f);
+        } else if ((*p & 0xf0) == _SEQ3) {
+            n = 3;
+            high = (wchar_t)(*p & 0x0f);
+        } else if ((*p & 0xf8) == _SEQ4) {
+            n = 4;
+            high = (wchar_t)(*p & 0x07);
+        } else if ((*p & 0xfc) == _SEQ5) {
+            n = 5;
+            high = (wchar_t)(*p & 0x03);
+        } else if ((*p & 0xfe) == _SEQ6) {
+            n = 6;
+            high = (wchar_t)(*p & 0x01);
+        } else {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            continue;
+        }
+
+        // does the sequence header tell us truth about length?
+        if (lim - p <= (unsigned char)n - 1) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            n = 1;
+            continue;    // skip
+        }
+
+        //
+        // Validate sequence.
+        // All symbols must have higher bits set to 10xxxxxx
+        //
+        if (n > 1) {
+            for (i = 1; i < n; i++) {
+                if ((p[i] & 0xc0) != _NXT)
+                    break;
+            }
+            if (i != n) {
+                if ((flags & UTF8_IGNORE_ERROR) == 0)
+                    return (0);
+                n = 1;
+                continue;    // skip
+            }
+        }
+
+        total++;
+
+        val = 0;
+        n_bits = 0;
+        for (i = 1; i < n; i++) {
+            val |= (wchar_t)(p[n - i] & 0x3f) << n_bits;
+            n_bits += 6;        // 6 low bits in every byte
+        }
+        val |= high << n_bits;
+
+        if (RefWcharForbitten(val) != 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);    // forbitten character
+            else {
+                total--;
+            }
+        } else if (val == _BOM && (flags & UTF8_DONT_SKIP_BOM) == 0) {
+            total--;
+        }
+    }
+
+    return (total);
+}
+
+static size_t RefWcharToUtf8Len(const wchar_t *in, size_t insize, int flags)
+{
+    wchar_t *w, *wlim;
+    size_t total, n;
+
+    if (in == NULL || insize == 0)
+        return (0);
+
+    w = (wchar_t *)in;
+    wlim = w + insize;
+    total = 0;
+    for (; w < wlim; w++) {
+        if (RefWcharForbitten(*w) != 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            else
+                continue;
+        }
+
+        if (*w == _BOM && (flags & UTF8_DONT_SKIP_BOM) == 0)
+            continue;
+
+        if (*w < 0) {
+            if ((flags & UTF8_IGNORE_ERROR) == 0)
+                return (0);
+            continue;
+        } else if (*w <= 0x0000007f)
+            n = 1;
+        else if (*w <= 0x000007ff)
+            n = 2;
+        else if (*w <= 0x0000ffff)
+            n = 3;
+        else if (*w <= 0x001fffff)
+            n = 4;
+        else if (*w <= 0x03ffffff)
+            n = 5;
+        else // if (*w <= 0x7fffffff)
+            n = 6;
+
+        total += n;
+    }
+
+    return (total);
+}
+
+//-------------------------------------------------------------------
+
+//one piece of utf8: an ascii run long enough to cross the 16 byte blocks now and then, or one multibyte,
+//broken, forbidden or BOM character.  returns how many bytes it wrote
+static UINT RandomUtf8Piece(BYTE *lpOut)
+{
+    static const BYTE special[][6] =
+    {
+        {2, 0xc3, 0xa9},                //e acute
+        {3, 0xe4, 0xb8, 0xad},          //cjk
+        {4, 0xf0, 0x9f, 0x98, 0x80},    //past the bmp
+        {3, 0xef, 0xbb, 0xbf},          //BOM
+        {3, 0xed, 0xa0, 0x80},          //surrogate
+        {1, 0xc0}, {1, 0xc1}, {1, 0xf5}, {1, 0xff}, {1, 0xfe},
+        {1, 0x80},                      //continuation on its own
+        {1, 0xc3}, {2, 0xe4, 0xb8},     //cut short
+        {5, 0xf8, 0x88, 0x80, 0x80, 0x80},
+    };
+
+    UINT val = TestRand();
+    if(val%8 < 5)
+    {
+        UINT length = 1+(val>>8)%40;
+        for(UINT i=0; i<length; i++)
+        {
+            UINT ch = TestRand();
+            lpOut[i] = (ch%64 == 0) ? BYTE(ch>>8)%0x80 : BYTE(0x20+(ch>>8)%0x5f);
+        }
+        return length;
+    }
+
+    const BYTE *lpSpecial = special[(val>>8)%(sizeof(special)/sizeof(special[0]))];
+    mcpy(lpOut, lpSpecial+1, lpSpecial[0]);
+    return lpSpecial[0];
+}
+
+static UINT RandomWcharPiece(wchar_t *lpOut)
+{
+    static const UINT special[] = {0xe9, 0x7f, 0x80, 0xff, 0x100, 0x7ff, 0x800, 0x4e2d, 0x8000, 0xd800, 0xdbff, 0xdc00, 0xdfff, 0xfeff, 0xff80, 0xffff};
+
+    UINT val = TestRand();
+    if(val%8 < 5)
+    {
+        UINT length = 1+(val>>8)%40;
+        for(UINT i=0; i<length; i++)
+        {
+            UINT ch = TestRand();
+            lpOut[i] = (ch%64 == 0) ? wchar_t((ch>>8)%0x80) : wchar_t(0x20+(ch>>8)%0x5f);
+        }
+        return length;
+    }
+
+    //and past the bmp when wchar_t can hold it
+    if(sizeof(wchar_t) > 2 && (val>>8)%8 == 0)
+        lpOut[0] = wchar_t(0x10000+(val>>12)%0x7ff0000);
+    else
+        lpOut[0] = wchar_t(special[(val>>8)%(sizeof(special)/sizeof(special[0]))]);
+
+    return 1;
+}
+
+static const int utf8TestFlags[] = {0, UTF8_IGNORE_ERROR, UTF8_DONT_SKIP_BOM, UTF8_IGNORE_ERROR|UTF8_DONT_SKIP_BOM};
+
+//output sizes to try: no buffer, exactly enough, plenty, and short by a bit or by a lot
+static size_t Utf8TestOutSize(UINT id, size_t needed, size_t maxSize)
+{
+    switch(id)
+    {
+        case 0:  return 0;
+        case 1:  return MIN(needed, maxSize);
+        case 2:  return maxSize;
+        case 3:  return needed > 1 ? needed-1 : 1;
+        default: return 1+TestRand()%(needed+1);
+    }
+}
+
+#define UTF8_TEST_NUM_OUT_SIZES 5
+
+//-------------------------------------------------------------------
+
+static BYTE utf8In[UTF8_TEST_MAX_CHARS*6+64], utf8Out[UTF8_TEST_MAX_CHARS*6+64], utf8RefOut[UTF8_TEST_MAX_CHARS*6+64];
+static wchar_t wideIn[UTF8_TEST_MAX_CHARS+64], wideOut[UTF8_TEST_MAX_CHARS*6+64], wideRefOut[UTF8_TEST_MAX_CHARS*6+64];
+
+static UINT FuzzUtf8ToWchar(UINT numRounds)
+{
+    UINT numMismatches = 0;
+    SeedTestRand(50);
+
+    for(UINT round=0; round<numRounds; round++)
+    {
+        //starts at a random offset so the 16 byte loads aren't always on the same alignment
+        UINT offset = TestRand()%4, target = TestRand()%UTF8_TEST_MAX_CHARS, size = 0;
+        while(size < target)
+            size += RandomUtf8Piece(utf8In+offset+size);
+
+        const char *lpIn = (const char*)utf8In+offset;
+
+        for(UINT i=0; i<sizeof(utf8TestFlags)/sizeof(utf8TestFlags[0]); i++)
+        {
+            int flags = utf8TestFlags[i];
+
+            size_t length = utf8_to_wchar_len(lpIn, size, flags);
+            if(length != RefUtf8ToWcharLen(lpIn, size, flags))
+                numMismatches++;
+
+            for(UINT j=0; j<UTF8_TEST_NUM_OUT_SIZES; j++)
+            {
+                size_t outSize = Utf8TestOutSize(j, length, sizeof(wideOut)/sizeof(wchar_t));
+
+                memset(wideOut, UTF8_TEST_FILL, sizeof(wideOut));
+                memset(wideRefOut, UTF8_TEST_FILL, sizeof(wideRefOut));
+
+                size_t ret = utf8_to_wchar(lpIn, size, outSize ? wideOut : NULL, outSize, flags);
+                size_t refRet = RefUtf8ToWchar(lpIn, size, outSize ? wideRefOut : NULL, outSize, flags);
+
+                if(ret != refRet || !mcmp(wideOut, wideRefOut, sizeof(wideOut)))
+                    numMismatches++;
+            }
+        }
+    }
+
+    return numMismatches;
+}
+
+static UINT FuzzWcharToUtf8(UINT numRounds)
+{
+    UINT numMismatches = 0;
+    SeedTestRand(5050);
+
+    for(UINT round=0; round<numRounds; round++)
+    {
+        UINT offset = TestRand()%4, target = TestRand()%UTF8_TEST_MAX_CHARS, size = 0;
+        while(size < target)
+            size += RandomWcharPiece(wideIn+offset+size);
+
+        const wchar_t *lpIn = wideIn+offset;
+
+        for(UINT i=0; i<sizeof(utf8TestFlags)/sizeof(utf8TestFlags[0]); i++)
+        {
+            int flags = utf8TestFlags[i];
+
+            size_t length = wchar_to_utf8_len(lpIn, size, flags);
+            if(length != RefWcharToUtf8Len(lpIn, size, flags))
+                numMismatches++;
+
+            for(UINT j=0; j<UTF8_TEST_NUM_OUT_SIZES; j++)
+            {
+                size_t outSize = Utf8TestOutSize(j, length, sizeof(utf8Out));
+
+                memset(utf8Out, UTF8_TEST_FILL, sizeof(utf8Out));
+                memset(utf8RefOut, UTF8_TEST_FILL, sizeof(utf8RefOut));
+
+                size_t ret = wchar_to_utf8(lpIn, size, outSize ? (char*)utf8Out : NULL, outSize, flags);
+                size_t refRet = RefWcharToUtf8(lpIn, size, outSize ? (char*)utf8RefOut : NULL, outSize, flags);
+
+                if(ret != refRet || !mcmp(utf8Out, utf8RefOut, sizeof(utf8Out)))
+                    numMismatches++;
+            }
+        }
+    }
+
+    return numMismatches;
+}
+
+//-------------------------------------------------------------------
+
+typedef size_t (*Utf8ToWcharFunc)(const char*, size_t, wchar_t*, size_t, int);
+typedef size_t (*WcharToUtf8Func)(const wchar_t*, size_t, char*, size_t, int);
+
+//seconds per conversion
+static double TimeUtf8ToWchar(Utf8ToWcharFunc convert, const char *lpIn, size_t size, wchar_t *lpOut, size_t outSize)
+{
+    double startTime = GetTestTime();
+    for(UINT i=0; i<UTF8_TEST_BENCH_PASSES; i++)
+        convert(lpIn, size, lpOut, outSize, 0);
+    return (GetTestTime()-startTime)/double(UTF8_TEST_BENCH_PASSES);
+}
+
+static double TimeWcharToUtf8(WcharToUtf8Func convert, const wchar_t *lpIn, size_t size, char *lpOut, size_t outSize)
+{
+    double startTime = GetTestTime();
+    for(UINT i=0; i<UTF8_TEST_BENCH_PASSES; i++)
+        convert(lpIn, size, lpOut, outSize, 0);
+    return (GetTestTime()-startTime)/double(UTF8_TEST_BENCH_PASSES);
+}
+
+//text with an accented character every couple hundred (like the locale and config files), or all cjk
+static void BenchmarkUtf8(bool bAscii)
+{
+    wchar_t *lpWide = (wchar_t*)Allocate(UTF8_TEST_BENCH_CHARS*sizeof(wchar_t));
+    wchar_t *lpWideOut = (wchar_t*)Allocate(UTF8_TEST_BENCH_CHARS*sizeof(wchar_t));
+    char *lpUTF8 = (char*)Allocate(UTF8_TEST_BENCH_CHARS*3);
+    char *lpUTF8Out = (char*)Allocate(UTF8_TEST_BENCH_CHARS*3);
+
+    SeedTestRand(bAscii ? 1 : 2);
+    for(UINT i=0; i<UTF8_TEST_BENCH_CHARS; i++)
+    {
+        UINT val = TestRand();
+        if(!bAscii)
+            lpWide[i] = wchar_t(0x4e00+val%0x5000);
+        else if(val%200 == 0)
+            lpWide[i] = 0xe9;
+        else
+            lpWide[i] = (val%40 == 0) ? '\n' : wchar_t(0x20+(val>>8)%0x5f);
+    }
+
+    size_t utf8Size = RefWcharToUtf8(lpWide, UTF8_TEST_BENCH_CHARS, lpUTF8, UTF8_TEST_BENCH_CHARS*3, 0);
+    TestCheck(wchar_to_utf8(lpWide, UTF8_TEST_BENCH_CHARS, lpUTF8Out, UTF8_TEST_BENCH_CHARS*3, 0) == utf8Size && mcmp(lpUTF8, lpUTF8Out, utf8Size),
+        TEXT("benchmark text converted to utf8 differently"));
+    TestCheck(utf8_to_wchar(lpUTF8, utf8Size, lpWideOut, UTF8_TEST_BENCH_CHARS, 0) == UTF8_TEST_BENCH_CHARS && mcmp(lpWide, lpWideOut, UTF8_TEST_BENCH_CHARS*sizeof(wchar_t)),
+        TEXT("benchmark text didn't come back from utf8 the same"));
+
+    double toWide = TimeUtf8ToWchar(utf8_to_wchar, lpUTF8, utf8Size, lpWideOut, UTF8_TEST_BENCH_CHARS);
+    double toWideRef = TimeUtf8ToWchar(RefUtf8ToWchar, lpUTF8, utf8Size, lpWideOut, UTF8_TEST_BENCH_CHARS);
+    double toUTF8 = TimeWcharToUtf8(wchar_to_utf8, lpWide, UTF8_TEST_BENCH_CHARS, lpUTF8Out, UTF8_TEST_BENCH_CHARS*3);
+    double toUTF8Ref = TimeWcharToUtf8(RefWcharToUtf8, lpWide, UTF8_TEST_BENCH_CHARS, lpUTF8Out, UTF8_TEST_BENCH_CHARS*3);
+
+    //the lengths get added up and the text is read through a volatile so the calls can't be left out or
+    //done once for every pass
+    const char *volatile lpLenIn = lpUTF8;
+    size_t totalLength = 0, totalRefLength = 0;
+
+    double startTime = GetTestTime();
+    for(UINT i=0; i<UTF8_TEST_BENCH_PASSES; i++)
+        totalLength += utf8_to_wchar_len(lpLenIn, utf8Size, 0);
+    double wideLen = (GetTestTime()-startTime)/double(UTF8_TEST_BENCH_PASSES);
+
+    startTime = GetTestTime();
+    for(UINT i=0; i<UTF8_TEST_BENCH_PASSES; i++)
+        totalRefLength += RefUtf8ToWcharLen(lpLenIn, utf8Size, 0);
+    double wideLenRef = (GetTestTime()-startTime)/double(UTF8_TEST_BENCH_PASSES);
+
+    TestCheck(totalLength == totalRefLength && totalLength == size_t(UTF8_TEST_BENCH_CHARS)*UTF8_TEST_BENCH_PASSES, TEXT("benchmark text has the wrong utf8 to wchar length"));
+
+    double mchars = double(UTF8_TEST_BENCH_CHARS)/1e6;
+    CTSTR lpText = bAscii ? TEXT("ascii") : TEXT("cjk  ");
+
+    wprintf(TEXT("%s utf8 to wchar    %8.1f M chars/s  (old %8.1f, %5.2fx)\n"), lpText, mchars/toWide, mchars/toWideRef, toWideRef/toWide);
+    wprintf(TEXT("%s utf8 to wchar len%8.1f M chars/s  (old %8.1f, %5.2fx)\n"), lpText, mchars/wideLen, mchars/wideLenRef, wideLenRef/wideLen);
+    wprintf(TEXT("%s wchar to utf8    %8.1f M chars/s  (old %8.1f, %5.2fx)\n"), lpText, mchars/toUTF8, mchars/toUTF8Ref, toUTF8Ref/toUTF8);
+
+    Free(lpWide);
+    Free(lpWideOut);
+    Free(lpUTF8);
+    Free(lpUTF8Out);
+}
+
+//-------------------------------------------------------------------
+
+//usage: utf8 [rounds]
+int RunUtf8Test(int argc, TCHAR **argv)
+{
+    UINT numRounds = (argc > 0) ? tstoi(argv[0]) : UTF8_TEST_DEFAULT_ROUNDS;
+    if(!numRounds)
+        numRounds = UTF8_TEST_DEFAULT_ROUNDS;
+
+    UINT numConversions = numRounds*(sizeof(utf8TestFlags)/sizeof(utf8TestFlags[0]))*(UTF8_TEST_NUM_OUT_SIZES+1);
+
+    UINT numMismatches = FuzzUtf8ToWchar(numRounds);
+    TestCheck(numMismatches == 0, TEXT("%u of %u utf8 to wchar conversions differ from the old converter"), numMismatches, numConversions);
+
+    numMismatches = FuzzWcharToUtf8(numRounds);
+    TestCheck(numMismatches == 0, TEXT("%u of %u wchar to utf8 conversions differ from the old converter"), numMismatches, numConversions);
+
+    wprintf(TEXT("%u rounds, %u conversions each way checked against the old converters\n"), numRounds, numConversions);
+
+    BenchmarkUtf8(true);
+    BenchmarkUtf8(false);
+
+    return 0;
+}
@@ -0,0 +1,281 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//times loading a scene collection from text against loading it from its binary snapshot.  works on a copy
+//of %APPDATA%\OBS\scenes.xconfig (or the file given, or a generated collection if there's neither) so the
+//real file and its snapshot are never touched.  the tree loaded from the snapshot has to be the same as the
+//one parsed from text, and a snapshot that's out of date or damaged has to be ignored
+
+#define XCONFIG_TEST_DEFAULT_PASSES     20
+#define XCONFIG_TEST_FILE               TEXT("xconfigtest.xconfig")
+
+#define XCONFIG_TEST_SCENES             40
+#define XCONFIG_TEST_SOURCES            25
+
+static CTSTR sourceClasses[] = {TEXT("GraphicsCapture"), TEXT("DeviceCapture"), TEXT("TextSource"), TEXT("BitmapImageSource"), TEXT("WindowCaptureSource")};
+
+//scenes full of sources with their settings, like a collection that's been built up over a while
+static bool GenerateSceneCollection(CTSTR lpFile)
+{
+    OSDeleteFile(lpFile);
+
+    XConfig config;
+    if(!config.Open(lpFile))
+        return false;
+
+    SeedTestRand(48);
+
+    XElement *scenes = config.CreateElement(TEXT("scenes"));
+    for(UINT i=0; i<XCONFIG_TEST_SCENES; i++)
+    {
+        XElement *scene = scenes->CreateElement(FormattedString(TEXT("Scene %u"), i));
+        scene->SetString(TEXT("class"), TEXT("Scene"));
+        scene->SetInt(TEXT("hotkey"), 0);
+
+        XElement *sources = scene->CreateElement(TEXT("sources"));
+        for(UINT j=0; j<XCONFIG_TEST_SOURCES; j++)
+        {
+            CTSTR lpClass = sourceClasses[TestRand()%(sizeof(sourceClasses)/sizeof(sourceClasses[0]))];
+
+            XElement *source = sources->CreateElement(FormattedString(TEXT("%s %u-%u"), lpClass, i, j));
+            source->SetString(TEXT("class"), lpClass);
+            source->SetInt(TEXT("render"), TestRand()&1);
+            source->SetInt(TEXT("x"), TestRand()%1920);
+            source->SetInt(TEXT("y"), TestRand()%1080);
+            source->SetInt(TEXT("cx"), 64+TestRand()%1856);
+            source->SetInt(TEXT("cy"), 64+TestRand()%1016);
+            source->SetFloat(TEXT("cropLeft"), 0.0f);
+            source->SetFloat(TEXT("cropTop"), float(TestRand()%64));
+
+            XElement *data = source->CreateElement(TEXT("data"));
+            data->SetString(TEXT("window"), FormattedString(TEXT("Game Window %u \"quoted\" {braces}"), TestRand()%100));
+            data->SetString(TEXT("windowClass"), TEXT("UnityWndClass"));
+            data->SetString(TEXT("executable"), TEXT("game.exe"));
+            data->SetString(TEXT("text"), TEXT("multi\r\nline text\twith tabs and unicode \x00e9\x4e2d\x6587"));
+            data->SetInt(TEXT("stretchImage"), 0);
+            data->SetInt(TEXT("captureMouse"), 1);
+            data->SetInt(TEXT("color"), 0xFFFFFFFF);
+            data->SetFloat(TEXT("gamma"), 1.0f + float(TestRand()%100)/100.0f);
+
+            List<int> colors;
+            for(UINT k=0; k<8; k++)
+                colors << int(TestRand());
+            data->SetIntList(TEXT("colors"), colors);
+        }
+    }
+
+    XElement *global = config.CreateElement(TEXT("global sources"));
+    for(UINT i=0; i<20; i++)
+    {
+        XElement *source = global->CreateElement(FormattedString(TEXT("Global %u"), i));
+        source->SetString(TEXT("class"), TEXT("DeviceCapture"));
+        source->CreateElement(TEXT("data"))->SetString(TEXT("device"), TEXT("USB Video Device"));
+    }
+
+    config.Close(true);
+    return true;
+}
+
+static bool CopyTestFile(CTSTR lpDest, CTSTR lpSrc)
+{
+    XFile src, dest;
+    if(!src.Open(lpSrc, XFILE_READ, XFILE_OPENEXISTING) || !dest.Open(lpDest, XFILE_WRITE, XFILE_CREATEALWAYS))
+        return false;
+
+    DWORD size = (DWORD)src.GetFileSize();
+    LPBYTE lpData = (LPBYTE)Allocate(size+1);
+    bool bSuccess = src.Read(lpData, size) == size && dest.Write(lpData, size) == size;
+    Free(lpData);
+
+    return bSuccess;
+}
+
+//-------------------------------------------------------------------
+
+static UINT CountItems(XElement *element)
+{
+    UINT count = element->NumBaseItems();
+    for(UINT i=0; i<element->NumBaseItems(); i++)
+    {
+        XBaseItem *item = element->GetBaseItemByID(i);
+        if(item->IsElement())
+            count += CountItems(static_cast<XElement*>(item));
+    }
+
+    return count;
+}
+
+static bool TreesMatch(XElement *a, XElement *b)
+{
+    if(scmp(a->GetName(), b->GetName()) != 0 || a->NumBaseItems() != b->NumBaseItems())
+        return false;
+
+    for(UINT i=0; i<a->NumBaseItems(); i++)
+    {
+        XBaseItem *itemA = a->GetBaseItemByID(i), *itemB = b->GetBaseItemByID(i);
+        if(itemA->GetType() != itemB->GetType() || scmp(itemA->GetName(), itemB->GetName()) != 0)
+            return false;
+
+        if(itemA->IsElement())
+        {
+            if(!TreesMatch(static_cast<XElement*>(itemA), static_cast<XElement*>(itemB)))
+                return false;
+        }
+        else
+        {
+            CTSTR lpDataA = static_cast<XDataItem*>(itemA)->GetData();
+            CTSTR lpDataB = static_cast<XDataItem*>(itemB)->GetData();
+            if(scmp(lpDataA ? lpDataA : TEXT(""), lpDataB ? lpDataB : TEXT("")) != 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+//average seconds per open
+static double TimeOpen(CTSTR lpFile, bool bBinaryCache, UINT numPasses)
+{
+    double totalTime = 0.0;
+    for(UINT i=0; i<numPasses; i++)
+    {
+        XConfig config;
+
+        double startTime = GetTestTime();
+        config.Open(lpFile, bBinaryCache);
+        totalTime += GetTestTime()-startTime;
+    }
+
+    return totalTime/double(numPasses);
+}
+
+//-------------------------------------------------------------------
+
+//usage: xconfig [file.xconfig [passes]]
+int RunXConfigTest(int argc, TCHAR **argv)
+{
+    UINT numPasses = (argc > 1) ? tstoi(argv[1]) : XCONFIG_TEST_DEFAULT_PASSES;
+    if(!numPasses)
+        numPasses = XCONFIG_TEST_DEFAULT_PASSES;
+
+    String strSource;
+    if(argc > 0)
+        strSource = argv[0];
+    else
+    {
+        CTSTR lpAppData = _wgetenv(TEXT("APPDATA"));
+        if(lpAppData)
+            strSource << lpAppData << TEXT("\\OBS\\scenes.xconfig");
+    }
+
+    String strFile = XCONFIG_TEST_FILE;
+    String strCache = strFile + TEXT(".cache");
+    OSDeleteFile(strCache);
+
+    bool bGenerated = strSource.IsEmpty() || !OSFileExists(strSource);
+    bool bReady = bGenerated ? GenerateSceneCollection(strFile) : CopyTestFile(strFile, strSource);
+
+    TestCheck(bReady, TEXT("couldn't write '%s'"), strFile.Array());
+    if(!bReady)
+        return 0;
+
+    XFile file(strFile, XFILE_READ, XFILE_OPENEXISTING);
+    QWORD fileSize = file.GetFileSize();
+    file.Close();
+
+    //the tree from text is what everything else gets compared with
+    XConfig textConfig;
+    TestCheck(textConfig.Open(strFile), TEXT("couldn't parse '%s'"), strFile.Array());
+
+    UINT numItems = CountItems(textConfig.GetRootElement());
+    wprintf(TEXT("%s'%s': %.1f KB, %u items\n"), bGenerated ? TEXT("generated ") : TEXT(""),
+        bGenerated ? strFile.Array() : strSource.Array(), double(fileSize)/1024.0, numItems);
+
+    //the first open with the snapshot on parses the text and writes the snapshot
+    double firstTime = TimeOpen(strFile, true, 1);
+    TestCheck(OSFileExists(strCache) != 0, TEXT("no snapshot was written"));
+
+    double textTime = TimeOpen(strFile, false, numPasses);
+    double cacheTime = TimeOpen(strFile, true, numPasses);
+
+    wprintf(TEXT("text %8.2f ms, snapshot %8.2f ms (%5.1fx), first open with snapshot write %8.2f ms\n"),
+        textTime*1000.0, cacheTime*1000.0, cacheTime > 0.0 ? textTime/cacheTime : 0.0, firstTime*1000.0);
+
+    {
+        XConfig cacheConfig;
+        cacheConfig.Open(strFile, true);
+        TestCheck(TreesMatch(textConfig.GetRootElement(), cacheConfig.GetRootElement()), TEXT("tree from the snapshot differs from the text"));
+    }
+
+    //a change to the text that the snapshot doesn't have.  saving without the snapshot leaves it behind
+    XElement *root = textConfig.GetRootElement();
+    XElement *changed = root->CreateElement(TEXT("changed after the snapshot"));
+    changed->SetString(TEXT("value"), TEXT("only in the text"));
+    textConfig.Save();
+
+    {
+        XConfig staleConfig;
+        staleConfig.Open(strFile, true);
+        TestCheck(TreesMatch(root, staleConfig.GetRootElement()), TEXT("an out of date snapshot was used"));
+    }
+
+    //damage the (rewritten) snapshot in the string offsets, the strings and the items.  the open that
+    //catches it writes a good one again for the next round
+    for(UINT i=1; i<4; i++)
+    {
+        XFile cacheFile(strCache, XFILE_READ|XFILE_WRITE, XFILE_OPENEXISTING);
+        QWORD cacheSize = cacheFile.GetFileSize();
+        TestCheck(cacheSize > 64, TEXT("snapshot wasn't rewritten after the text changed"));
+
+        if(cacheSize > 64)
+        {
+            BYTE garbage[16];
+            for(UINT j=0; j<sizeof(garbage); j++)
+                garbage[j] = BYTE(TestRand());
+
+            cacheFile.SetPos(cacheSize*i/4, XFILE_BEGIN);
+            cacheFile.Write(garbage, sizeof(garbage));
+        }
+        cacheFile.Close();
+
+        XConfig damagedConfig;
+        damagedConfig.Open(strFile, true);
+        TestCheck(TreesMatch(root, damagedConfig.GetRootElement()), TEXT("a snapshot damaged at %u/4 was used"), i);
+    }
+
+    //truncated
+    {
+        XFile cacheFile(strCache, XFILE_READ|XFILE_WRITE, XFILE_OPENEXISTING);
+        cacheFile.SetFileSize(DWORD(cacheFile.GetFileSize()/2));
+        cacheFile.Close();
+
+        XConfig truncatedConfig;
+        truncatedConfig.Open(strFile, true);
+        TestCheck(TreesMatch(root, truncatedConfig.GetRootElement()), TEXT("a truncated snapshot was used"));
+    }
+
+    textConfig.Close();
+
+    OSDeleteFile(strFile);
+    OSDeleteFile(strCache);
+
+    return 0;
+}
@@ -0,0 +1,322 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "OBSApiTest.h"
+
+//writes the same recording through each of the file writers and reads it back.  the stream looks like
+//a high bitrate local recording: 60fps video with a keyframe every 2 seconds and aac frames in between,
+//each packet written as a small header, the data and a trailer the way the FLV writer does it.  at the
+//end the header is patched through a seek like the FLV/MP4 writers do when they close
+
+#define XFILE_TEST_DEFAULT_MBPS     100
+#define XFILE_TEST_DEFAULT_SECONDS  20
+
+#define XFILE_TEST_FPS              60
+#define XFILE_TEST_KEYINT           120
+#define XFILE_TEST_KEYFRAME_SCALE   8       //keyframes are this many times the size of an average frame
+#define XFILE_TEST_AUDIO_RATE       44100
+#define XFILE_TEST_AUDIO_FRAME      1024
+#define XFILE_TEST_AUDIO_SIZE       400
+
+#define XFILE_TEST_PACKET_HEADER    11
+#define XFILE_TEST_PACKET_TRAILER   4
+#define XFILE_TEST_FILE_HEADER      16
+
+//file contents come from a random pattern indexed by file position.  the size isn't a multiple of any
+//buffer, sector or view size, so data that ends up in the wrong place can't match by accident
+#define XFILE_TEST_PATTERN_SIZE     (4*1024*1024 + 4093)
+
+static const BYTE fileMagic[8] = {'O', 'B', 'S', 'X', 'F', 'I', 'L', 'E'};
+
+struct XFileTestWriter
+{
+    CTSTR lpName;
+    bool bAsync;
+    DWORD flags;
+    QWORD preallocSize;
+};
+
+static const XFileTestWriter xfileTestWriters[] =
+{
+    {TEXT("buffered"),              false, 0,                       0},
+    {TEXT("async"),                 true,  0,                       0},
+    {TEXT("async prealloc 64MB"),   true,  0,                       64*1024*1024},
+    {TEXT("async unbuffered"),      true,  XFILE_ASYNC_UNBUFFERED,  0},
+    {TEXT("mapped"),                true,  XFILE_ASYNC_MAPPED,      0},
+    {TEXT("mapped extents 256MB"),  true,  XFILE_ASYNC_MAPPED,      256*1024*1024},
+};
+
+//packet sizes in stream order, headers and trailers not included
+static void MakeTestPackets(UINT mbps, UINT seconds, List<DWORD> &packetSizes)
+{
+    double audioBytesPerSec = double(XFILE_TEST_AUDIO_SIZE)*double(XFILE_TEST_AUDIO_RATE)/double(XFILE_TEST_AUDIO_FRAME);
+    double avgFrameSize = MAX(double(mbps)*1000000.0/8.0 - audioBytesPerSec, 0.0) / double(XFILE_TEST_FPS);
+    double keyframeSize = avgFrameSize*double(XFILE_TEST_KEYFRAME_SCALE);
+    double interFrameSize = (avgFrameSize*double(XFILE_TEST_KEYINT) - keyframeSize) / double(XFILE_TEST_KEYINT-1);
+
+    UINT numFrames = seconds*XFILE_TEST_FPS;
+    UINT audioFrame = 0;
+
+    SeedTestRand(1);
+
+    packetSizes.Clear();
+    for(UINT frame=0; frame<numFrames; frame++)
+    {
+        double frameTime = double(frame)/double(XFILE_TEST_FPS);
+
+        while(double(audioFrame)*double(XFILE_TEST_AUDIO_FRAME)/double(XFILE_TEST_AUDIO_RATE) <= frameTime)
+        {
+            packetSizes << DWORD(XFILE_TEST_AUDIO_SIZE - 32 + (TestRand()%64));
+            audioFrame++;
+        }
+
+        //+-25% so writes don't land on the same buffer offsets every time
+        double size = (frame % XFILE_TEST_KEYINT) ? interFrameSize : keyframeSize;
+        size *= 0.75 + double(TestRand()%1024)/2048.0;
+        packetSizes << MAX(DWORD(size), 1);
+    }
+}
+
+static int CompareQwords(const void *a, const void *b)
+{
+    QWORD valA = *(const QWORD*)a, valB = *(const QWORD*)b;
+    return (valA < valB) ? -1 : ((valA > valB) ? 1 : 0);
+}
+
+//returns the file size, and the time each packet took to serialize in microseconds
+static QWORD WriteTestStream(Serializer &s, const List<DWORD> &packetSizes, const BYTE *pattern, List<QWORD> &latencies)
+{
+    BYTE header[XFILE_TEST_FILE_HEADER];
+    zero(header, sizeof(header));
+    mcpy(header, fileMagic, sizeof(fileMagic));
+    s.Serialize(header, sizeof(header));
+
+    QWORD pos = XFILE_TEST_FILE_HEADER;
+
+    latencies.SetSize(packetSizes.Num());
+    for(UINT i=0; i<packetSizes.Num(); i++)
+    {
+        DWORD size = packetSizes[i];
+        const BYTE *lpData = pattern + (pos % XFILE_TEST_PATTERN_SIZE);
+
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        s.Serialize(lpData, XFILE_TEST_PACKET_HEADER);
+        s.Serialize(lpData+XFILE_TEST_PACKET_HEADER, size);
+        s.Serialize(lpData+XFILE_TEST_PACKET_HEADER+size, XFILE_TEST_PACKET_TRAILER);
+
+        latencies[i] = OSGetTimeMicroseconds()-startTime;
+
+        pos += XFILE_TEST_PACKET_HEADER+size+XFILE_TEST_PACKET_TRAILER;
+    }
+
+    s.Seek(sizeof(fileMagic));
+    s.OutputQword(pos);
+    s.Seek(0, SERIALIZE_SEEK_END);
+
+    return pos;
+}
+
+static void VerifyTestFile(CTSTR lpName, CTSTR lpFile, QWORD expectedSize, const BYTE *pattern)
+{
+    XFile file;
+    if(!file.Open(lpFile, XFILE_READ, XFILE_OPENEXISTING))
+    {
+        TestCheck(false, TEXT("%s: could not open the file to read it back"), lpName);
+        return;
+    }
+
+    QWORD fileSize = file.GetFileSize();
+    TestCheck(fileSize == expectedSize, TEXT("%s: file is %llu bytes, expected %llu"), lpName, fileSize, expectedSize);
+
+    BYTE header[XFILE_TEST_FILE_HEADER];
+    if(file.Read(header, sizeof(header)) != sizeof(header) ||
+       !mcmp(header, fileMagic, sizeof(fileMagic)) || *(QWORD*)(header+sizeof(fileMagic)) != expectedSize)
+    {
+        TestCheck(false, TEXT("%s: header wasn't patched"), lpName);
+        return;
+    }
+
+    DWORD bufferSize = 1024*1024;
+    LPBYTE buffer = (LPBYTE)Allocate(bufferSize);
+
+    QWORD pos = XFILE_TEST_FILE_HEADER;
+    while(pos < fileSize)
+    {
+        DWORD readSize = file.Read(buffer, bufferSize);
+        if(!readSize)
+            break;
+
+        for(DWORD offset=0; offset<readSize;)
+        {
+            DWORD patternPos = DWORD((pos+offset) % XFILE_TEST_PATTERN_SIZE);
+            DWORD compareSize = MIN(readSize-offset, XFILE_TEST_PATTERN_SIZE-patternPos);
+
+            if(!mcmp(buffer+offset, pattern+patternPos, compareSize))
+            {
+                DWORD badByte = 0;
+                while(buffer[offset+badByte] == pattern[patternPos+badByte])
+                    badByte++;
+
+                TestCheck(false, TEXT("%s: contents differ at offset %llu"), lpName, pos+offset+badByte);
+                Free(buffer);
+                return;
+            }
+
+            offset += compareSize;
+        }
+
+        pos += readSize;
+    }
+
+    Free(buffer);
+}
+
+static void RunWriter(const XFileTestWriter &writer, CTSTR lpFile, const List<DWORD> &packetSizes, const BYTE *pattern)
+{
+    List<QWORD> latencies;
+    QWORD fileSize = 0;
+
+    XFileWriteStats stats;
+    zero(&stats, sizeof(stats));
+
+    bool bWriteError = false;
+
+    double startTime = GetTestTime(), closeTime;
+
+    if(writer.bAsync)
+    {
+        XFileAsyncOutputSerializer fileOut;
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024, 4, writer.flags, writer.preallocSize))
+        {
+            TestCheck(false, TEXT("%s: could not open '%s'"), writer.lpName, lpFile);
+            return;
+        }
+
+        fileSize = WriteTestStream(fileOut, packetSizes, pattern, latencies);
+
+        closeTime = GetTestTime();
+        fileOut.Close();
+
+        fileOut.GetStats(stats);
+        bWriteError = fileOut.HasWriteError() != 0;
+    }
+    else
+    {
+        //what the FLV writer used before the async writer
+        XFileOutputSerializer fileOut;
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024))
+        {
+            TestCheck(false, TEXT("%s: could not open '%s'"), writer.lpName, lpFile);
+            return;
+        }
+
+        fileSize = WriteTestStream(fileOut, packetSizes, pattern, latencies);
+
+        closeTime = GetTestTime();
+        fileOut.Close();
+    }
+
+    double endTime = GetTestTime();
+
+    qsort(latencies.Array(), latencies.Num(), sizeof(QWORD), CompareQwords);
+
+    QWORD totalLatency = 0;
+    for(UINT i=0; i<latencies.Num(); i++)
+        totalLatency += latencies[i];
+
+    double avgLatency = double(totalLatency)/double(latencies.Num());
+    QWORD p99Latency = latencies[latencies.Num()*99/100];
+    QWORD maxLatency = latencies.Last();
+
+    double totalTime = endTime-startTime;
+
+    wprintf(TEXT("%-22s %8.1f MB/s  %6.2f s (close %6.1f ms)  packet avg %7.1f p99 %7llu max %8llu us"),
+        writer.lpName, double(fileSize)/(1024.0*1024.0)/totalTime, totalTime, (endTime-closeTime)*1000.0,
+        avgLatency, p99Latency, maxLatency);
+
+    if(writer.bAsync)
+    {
+        double avgWriteTime = stats.numWrites ? double(stats.totalWriteTime)/double(stats.numWrites)/1000.0 : 0.0;
+        wprintf(TEXT("  %s %5u avg %6.2f max %7.2f ms  stalls %u (%.1f ms)"),
+            (writer.flags & XFILE_ASYNC_MAPPED) ? TEXT("maps  ") : TEXT("writes"),
+            stats.numWrites, avgWriteTime, double(stats.maxWriteTime)/1000.0,
+            stats.numStalls, double(stats.totalStallTime)/1000.0);
+    }
+
+    wprintf(TEXT("\n"));
+
+    TestCheck(!bWriteError, TEXT("%s: write error"), writer.lpName);
+    TestCheck(!writer.bAsync || stats.totalWritten == fileSize+sizeof(QWORD),
+        TEXT("%s: serializer counted %llu bytes, %llu were written"), writer.lpName, stats.totalWritten, fileSize+sizeof(QWORD));
+
+    VerifyTestFile(writer.lpName, lpFile, fileSize, pattern);
+}
+
+//options: [directory [mbps [seconds [passes]]]]
+//the directory should be on the disk recordings go to.  the file is rewritten once per writer and pass,
+//so later writers may see a warmer cache than earlier ones; more passes show how much that matters
+int RunXFileTest(int argc, TCHAR **argv)
+{
+    String strDir = (argc > 0) ? argv[0] : TEXT(".");
+    UINT mbps    = (argc > 1) ? tstoi(argv[1]) : XFILE_TEST_DEFAULT_MBPS;
+    UINT seconds = (argc > 2) ? tstoi(argv[2]) : XFILE_TEST_DEFAULT_SECONDS;
+    UINT passes  = (argc > 3) ? tstoi(argv[3]) : 1;
+
+    if(!mbps)    mbps = XFILE_TEST_DEFAULT_MBPS;
+    if(!seconds) seconds = XFILE_TEST_DEFAULT_SECONDS;
+    if(!passes)  passes = 1;
+
+    String strFile = strDir;
+    if(strFile.IsValid() && strFile.Array()[strFile.Length()-1] != '\\' && strFile.Array()[strFile.Length()-1] != '/')
+        strFile << TEXT("\\");
+    strFile << TEXT("xfiletest.tmp");
+
+    List<DWORD> packetSizes;
+    MakeTestPackets(mbps, seconds, packetSizes);
+
+    DWORD maxPacket = 0;
+    for(UINT i=0; i<packetSizes.Num(); i++)
+        maxPacket = MAX(maxPacket, packetSizes[i]);
+
+    //packets read the pattern straight through, so it's padded by the largest one
+    DWORD patternSize = XFILE_TEST_PATTERN_SIZE + XFILE_TEST_PACKET_HEADER + maxPacket + XFILE_TEST_PACKET_TRAILER;
+    LPBYTE pattern = (LPBYTE)Allocate(patternSize);
+
+    SeedTestRand(2);
+    for(DWORD i=0; i<patternSize; i++)
+        pattern[i] = BYTE(TestRand() >> 11);
+    for(DWORD i=XFILE_TEST_PATTERN_SIZE; i<patternSize; i++)
+        pattern[i] = pattern[i-XFILE_TEST_PATTERN_SIZE];
+
+    wprintf(TEXT("%u Mbps for %u seconds, %u packets, to '%s'\n"), mbps, seconds, packetSizes.Num(), strFile.Array());
+
+    int numWriters = sizeof(xfileTestWriters)/sizeof(xfileTestWriters[0]);
+    for(UINT pass=0; pass<passes; pass++)
+    {
+        for(int i=0; i<numWriters; i++)
+        {
+            RunWriter(xfileTestWriters[i], strFile, packetSizes, pattern);
+            OSDeleteFile(strFile);
+        }
+    }
+
+    Free(pattern);
+    return 0;
+}
@@ -596,16 +596,12 @@ public:
 
     virtual void GetCurDesktopVolumeStats(float *rms, float *max, float *peak) const
     {
-        *rms = App->desktopMag;
-        *max = App->desktopMax;
-        *peak = App->desktopPeak;
+        App->desktopMeter.GetLevels(rms, max, peak);
     }
 
     virtual void GetCurMicVolumeStats(float *rms, float *max, float *peak) const
     {
-        *rms = App->micMag;
-        *max = App->micMax;
-        *peak = App->micPeak;
+        App->micMeter.GetLevels(rms, max, peak);
     }
 
     virtual void AddSettingsPane(SettingsPane *pane)    {App->AddSettingsPane(pane);}
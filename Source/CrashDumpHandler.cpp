@@ -100,6 +100,9 @@ LONG CALLBACK OBSExceptionHandler (PEXCEPTION_POINTERS exceptionInfo)
 
     inExceptionHandler = TRUE;
 
+    //get whatever the log thread hasn't written yet into the log file before anything else can go wrong
+    FlushLog();
+
     //load dbghelp dynamically
     hDbgHelp = LoadLibrary (TEXT("DBGHELP"));
 
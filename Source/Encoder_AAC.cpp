@@ -56,7 +56,7 @@ public:
         faacEncConfigurationPtr config = faacEncGetCurrentConfiguration(faac);
         config->bitRate = (bitRate*1000)/App->NumAudioChannels();
         config->quantqual = 100;
-        config->inputFormat = FAAC_INPUT_FLOAT;
+        config->inputFormat = FAAC_INPUT_FLOAT_NORM;
         config->mpegVersion = MPEG4;
         config->aacObjectType = LOW;
         config->useLfe = 0;
@@ -121,29 +121,7 @@ public:
 
         if(inputBuffer.Num() >= numReadSamples)
         {
-            //now we have to upscale the floats.  fortunately we almost always have SSE
-            UINT floatsLeft  = numReadSamples;
-            float *inputTemp = inputBuffer.Array();
-            if((UPARAM(inputTemp) & 0xF) == 0)
-            {
-                UINT alignedFloats = floatsLeft & 0xFFFFFFFC;
-
-                for(UINT i=0; i<alignedFloats; i += 4)
-                {
-                    float *pos = inputTemp+i;
-                    _mm_store_ps(pos, _mm_mul_ps(_mm_load_ps(pos), _mm_set_ps1(32767.0f)));
-                }
-
-                floatsLeft &= 0x3;
-                inputTemp  += alignedFloats;
-            }
-
-            if(floatsLeft)
-            {
-                for(UINT i=0; i<floatsLeft; i++)
-                    inputTemp[i] *= 32767.0f;
-            }
-
+            //faac scales normalized floats itself while deinterleaving
             ret = faacEncEncode(faac, (int32_t*)inputBuffer.Array(), numReadSamples, aacBuffer.Array()+2, outputSize);
             if(ret > 0)
             {
@@ -22,18 +22,58 @@
 
 
 
+//space kept at the end of onMetaData for the keyframe index, so writing it on close doesn't shift anything.
+//each keyframe takes 18 bytes, past that the index gets thinned out
+#define FLV_INDEX_RESERVE   (64*1024)
+
+//bytes the index and padding properties need on top of 18 bytes per keyframe (see EncodeReservedMetaData)
+#define FLV_INDEX_OVERHEAD  47
+#define FLV_PADDING_OVERHEAD 17
+
+SAVC(keyframes);
+SAVC(filepositions);
+SAVC(times);
+SAVC(padding);
+
+struct FLVKeyframe
+{
+    UINT64 filePos;
+    DWORD timestamp;
+};
+
 class FLVFileStream : public VideoFileStream
 {
-    XFileOutputSerializer fileOut;
-    String strFile;
+    XFileAsyncOutputSerializer fileOut;
+    String strFile, strSegmentFile;
+
+    DWORD writeFlags;
+    QWORD preallocSize;
+    XFileWriteStats writeStats;
 
     UINT64 metaDataPos;
+    List<BYTE> metaData;
+    UINT metaDataReservedPos;
+    UINT numMetaDataProperties;
+
     DWORD lastTimeStamp, initialTimestamp;
 
-    bool bSentFirstPacket, bSentSEI;
+    bool bSegmentOpened, bSentFirstPacket, bSentSEI;
+
+    List<FLVKeyframe> keyframes;
+
+    UINT segmentID;
+    UINT64 maxSegmentSize;
+    DWORD maxSegmentDuration;
 
     void AppendFLVPacket(LPBYTE lpData, UINT size, BYTE type, DWORD timestamp)
     {
+        if (type == 9 && lpData[0] == 0x17 && lpData[1] == 0x1 && (!keyframes.Num() || keyframes.Last().timestamp != timestamp)) {
+            FLVKeyframe keyframe;
+            keyframe.filePos = fileOut.GetPos();
+            keyframe.timestamp = timestamp;
+            keyframes << keyframe;
+        }
+
         if (!bSentSEI && type == 9 && lpData[0] == 0x17 && lpData[1] == 0x1) { //send SEI with first keyframe packet
             DataPacket sei;
             App->GetVideoEncoder()->GetSEI(sei);
@@ -49,7 +89,7 @@ class FLVFileStream : public VideoFileStream
             fileOut.Serialize(lpData, 5);
             fileOut.Serialize(sei.lpPacket, sei.size);
             fileOut.Serialize(lpData+5, size-5);
-            fileOut.OutputDword(fastHtonl(size+sei.size+14));
+            fileOut.OutputDword(fastHtonl(size+sei.size+11)); //previous tag size, header included
 
             bSentSEI = true;
         } else {
@@ -62,21 +102,85 @@ class FLVFileStream : public VideoFileStream
             fileOut.Serialize(&networkTimestamp, 1);
             fileOut.Serialize(&streamID, 3);
             fileOut.Serialize(lpData, size);
-            fileOut.OutputDword(fastHtonl(size+14));
+            fileOut.OutputDword(fastHtonl(size+11));
         }
 
         lastTimeStamp = timestamp;
     }
 
-public:
-    bool Init(CTSTR lpFile)
+    //fills the reserved part of onMetaData with the keyframe index (if any) and a padding string taking up the rest
+    void EncodeReservedMetaData(bool bWithIndex)
     {
-        strFile = lpFile;
+        char *enc  = (char*)metaData.Array()+metaDataReservedPos;
+        char *pend = (char*)metaData.Array()+metaData.Num();
+
+        UINT numProperties = numMetaDataProperties+1; //plus the padding
+
+        if(bWithIndex && keyframes.Num())
+        {
+            UINT maxKeyframes = (FLV_INDEX_RESERVE-FLV_INDEX_OVERHEAD-FLV_PADDING_OVERHEAD)/18;
+            UINT step = (keyframes.Num()+maxKeyframes-1)/maxKeyframes;
+            UINT numIndexed = (keyframes.Num()+step-1)/step;
+
+            enc = AMF_EncodeInt16(enc, pend, av_keyframes.av_len);
+            mcpy(enc, av_keyframes.av_val, av_keyframes.av_len);
+            enc += av_keyframes.av_len;
+            *enc++ = AMF_OBJECT;
+
+            enc = AMF_EncodeInt16(enc, pend, av_filepositions.av_len);
+            mcpy(enc, av_filepositions.av_val, av_filepositions.av_len);
+            enc += av_filepositions.av_len;
+            *enc++ = AMF_STRICT_ARRAY;
+            enc = AMF_EncodeInt32(enc, pend, numIndexed);
+            for(UINT i=0; i<keyframes.Num(); i+=step)
+                enc = AMF_EncodeNumber(enc, pend, double(keyframes[i].filePos));
+
+            enc = AMF_EncodeInt16(enc, pend, av_times.av_len);
+            mcpy(enc, av_times.av_val, av_times.av_len);
+            enc += av_times.av_len;
+            *enc++ = AMF_STRICT_ARRAY;
+            enc = AMF_EncodeInt32(enc, pend, numIndexed);
+            for(UINT i=0; i<keyframes.Num(); i+=step)
+                enc = AMF_EncodeNumber(enc, pend, double(keyframes[i].timestamp)/1000.0);
+
+            *enc++ = 0;
+            *enc++ = 0;
+            *enc++ = AMF_OBJECT_END;
+
+            numProperties++;
+        }
+
+        UINT paddingSize = UINT(pend-enc)-FLV_PADDING_OVERHEAD;
+
+        enc = AMF_EncodeInt16(enc, pend, av_padding.av_len);
+        mcpy(enc, av_padding.av_val, av_padding.av_len);
+        enc += av_padding.av_len;
+        *enc++ = AMF_LONG_STRING;
+        enc = AMF_EncodeInt32(enc, pend, paddingSize);
+        memset(enc, ' ', paddingSize);
+        enc += paddingSize;
+
+        *enc++ = 0;
+        *enc++ = 0;
+        *enc++ = AMF_OBJECT_END;
+
+        //ecma array count, right after the onMetaData string and the array marker
+        AMF_EncodeInt32((char*)metaData.Array()+14, pend, numProperties);
+    }
+
+    bool OpenSegment(CTSTR lpFile)
+    {
+        strSegmentFile = lpFile;
         initialTimestamp = -1;
+        lastTimeStamp = 0;
+        bSentFirstPacket = bSentSEI = false;
+        keyframes.Clear();
 
-        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024))
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024, 4, writeFlags, preallocSize))
             return false;
 
+        bSegmentOpened = true;
+
         fileOut.OutputByte('F');
         fileOut.OutputByte('L');
         fileOut.OutputByte('V');
@@ -93,45 +197,112 @@ public:
 
         enc = AMF_EncodeString(enc, pend, &av_onMetaData);
         char *endMetaData  = App->EncMetaData(enc, pend, true);
-        UINT  metaDataSize = endMetaData-metaDataBuffer;
 
-        AppendFLVPacket((LPBYTE)metaDataBuffer, metaDataSize, 18, 0);
+        //the reserved area replaces the object end marker
+        metaDataReservedPos = UINT(endMetaData-metaDataBuffer)-3;
+        metaData.CopyArray((LPBYTE)metaDataBuffer, metaDataReservedPos);
+        metaData.SetSize(metaDataReservedPos+FLV_INDEX_RESERVE);
+
+        //ecma array count, right after the onMetaData string and the array marker
+        numMetaDataProperties = AMF_DecodeInt32((char*)metaData.Array()+14);
+        EncodeReservedMetaData(false);
+
+        AppendFLVPacket(metaData.Array(), metaData.Num(), 18, 0);
         return true;
     }
 
-    ~FLVFileStream()
+    void CloseSegment()
     {
+        if(!bSegmentOpened)
+            return;
+
+        bSegmentOpened = false;
+
         UINT64 fileSize = fileOut.GetPos();
         fileOut.Close();
 
-        XFile file;
-        if(file.Open(strFile, XFILE_WRITE, XFILE_OPENEXISTING))
-        {
-            double doubleFileSize = double(fileSize);
-            double doubleDuration = double(lastTimeStamp/1000);
+        XFileWriteStats segmentStats;
+        fileOut.GetStats(segmentStats);
+        writeStats.Add(segmentStats);
 
-            file.SetPos(metaDataPos+0x28, XFILE_BEGIN);
-            QWORD outputVal = *reinterpret_cast<QWORD*>(&doubleDuration);
-            outputVal = fastHtonll(outputVal);
-            file.Write(&outputVal, 8);
+        //duration and file size are the first two properties
+        char *pend = (char*)metaData.Array()+metaData.Num();
+        AMF_EncodeNumber((char*)metaData.Array()+0x28-12, pend, double(lastTimeStamp)/1000.0);
+        AMF_EncodeNumber((char*)metaData.Array()+0x3B-12, pend, double(fileSize));
 
-            file.SetPos(metaDataPos+0x3B, XFILE_BEGIN);
-            outputVal = *reinterpret_cast<QWORD*>(&doubleFileSize);
-            outputVal = fastHtonll(outputVal);
-            file.Write(&outputVal, 8);
+        EncodeReservedMetaData(true);
 
+        XFile file;
+        if(file.Open(strSegmentFile, XFILE_WRITE, XFILE_OPENEXISTING))
+        {
+            file.SetPos(metaDataPos+11, XFILE_BEGIN);
+            file.Write(metaData.Array(), metaData.Num());
             file.Close();
         }
     }
 
+    inline bool SegmentFull(DWORD timestamp)
+    {
+        if(maxSegmentSize && fileOut.GetPos() >= maxSegmentSize)
+            return true;
+        if(maxSegmentDuration && (timestamp-initialTimestamp) >= maxSegmentDuration)
+            return true;
+
+        return false;
+    }
+
+public:
+    bool Init(CTSTR lpFile)
+    {
+        strFile = lpFile;
+
+        writeFlags = AppConfig->GetInt(TEXT("Publish"), TEXT("UnbufferedFileIO"), 0) ? XFILE_ASYNC_UNBUFFERED : 0;
+        if(AppConfig->GetInt(TEXT("Publish"), TEXT("MappedFileIO"), 0))
+            writeFlags = XFILE_ASYNC_MAPPED;
+        preallocSize = QWORD(AppConfig->GetInt(TEXT("Publish"), TEXT("FilePreallocationMB"), 0))*1024*1024;
+
+        maxSegmentSize = UINT64(AppConfig->GetInt(TEXT("Publish"), TEXT("SegmentSizeMB"), 0))*1024*1024;
+        maxSegmentDuration = DWORD(AppConfig->GetInt(TEXT("Publish"), TEXT("SegmentMinutes"), 0))*60*1000;
+
+        segmentID = 1;
+        zero(&writeStats, sizeof(writeStats));
+
+        return OpenSegment(lpFile);
+    }
+
+    ~FLVFileStream()
+    {
+        CloseSegment();
+        XFileAsyncOutputSerializer::LogStats(TEXT("FLVFileStream"), writeStats);
+    }
+
     virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
     {
+        if(bSegmentOpened && initialTimestamp != -1 && type != PacketType_Audio && data[0] == 0x17 &&
+           timestamp != initialTimestamp+lastTimeStamp && SegmentFull(timestamp))
+        {
+            //start the next file on this keyframe, so one segment ends exactly where the next begins
+            CloseSegment();
+
+            String strNextFile = GetPathWithoutExtension(strFile) + FormattedString(TEXT("-%03u."), ++segmentID) + GetPathExtension(strFile);
+            if(!OpenSegment(strNextFile))
+            {
+                Log(TEXT("FLVFileStream: Unable to create segment '%s'"), strNextFile.Array());
+                return;
+            }
+
+            Log(TEXT("FLVFileStream: Continuing in '%s'"), strNextFile.Array());
+        }
+
+        if(!bSegmentOpened)
+            return;
+
         if(!bSentFirstPacket)
         {
             bSentFirstPacket = true;
 
             DataPacket audioHeaders, videoHeaders;//, videoSEI;
-            App->GetAudioHeaders(audioHeaders);
+            App->GetRecordingAudioHeaders(audioHeaders);
             App->GetVideoHeaders(videoHeaders);
 
             AppendFLVPacket(audioHeaders.lpPacket, audioHeaders.size, 8, 0);
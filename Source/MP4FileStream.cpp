@@ -53,24 +53,45 @@ struct MP4AudioFrameInfo
     UINT    timestamp;
 };
 
+struct MP4FragmentSample
+{
+    UINT    size;
+    UINT    timestamp;
+    INT     compositionOffset;
+    bool    bKeyframe;
+};
+
 #define USE_64BIT_MP4 1
 
-inline UINT64 ConvertToAudioTime(DWORD timestamp, UINT64 minVal)
+//fragments are normally cut at every keyframe, these cap them if keyframes are far apart
+#define MP4_MAX_FRAGMENT_DURATION   10000
+#define MP4_MAX_FRAGMENT_SIZE       (32*1024*1024)
+
+//trun/trex sample flags
+#define MP4_SAMPLE_SYNC             0x02000000 //depends on no other samples
+#define MP4_SAMPLE_NONSYNC          0x01010000 //depends on others, not a sync sample
+
+inline UINT64 ConvertToAudioTime(DWORD timestamp, UINT sampleRate, UINT64 minVal)
 {
-    UINT val = UINT64(timestamp)*App->GetSampleRateHz()/1000;
+    UINT val = UINT64(timestamp)*sampleRate/1000;
     return MAX(val, minVal);
 }
 
+//streams that are still writing their moov after recording stopped
+static volatile LONG numFinishingStreams = 0;
+
 
 //code annoyance rating: nightmarish
 
-class MP4FileStream : public VideoFileStream
+class MP4FileStream
 {
-    XFileOutputSerializer fileOut;
+    XFileAsyncOutputSerializer fileOut;
     String strFile;
 
-    List<MP4VideoFrameInfo> videoFrames;
-    List<MP4AudioFrameInfo> audioFrames;
+    //only the sizes are needed for the moov, kept big endian so stsz can be written in one go
+    List<UINT> videoSampleSizes, audioSampleSizes;
+    MP4VideoFrameInfo lastVideoFrame;
+    MP4AudioFrameInfo lastAudioFrame;
 
     List<UINT>      IFrameIDs;
 
@@ -101,6 +122,20 @@ class MP4FileStream : public VideoFileStream
 
     bool bSentSEI;
 
+    //everything the moov needs from the encoders, grabbed up front because the
+    //moov is written after recording has stopped and the encoders may be gone
+    List<BYTE> SPS, PPS, AACHeader;
+    UINT outputWidth, outputHeight;
+    UINT audioBitRate, sampleRate, frameTime;
+
+    //fragmented mode: moov goes up front with empty sample tables, then each
+    //fragment is written as moof+mdat as soon as it's complete
+    bool bFragmented;
+    UINT fragmentSequence;
+    UINT64 fragmentAudioTime;
+    List<MP4FragmentSample> fragmentVideoSamples, fragmentAudioSamples;
+    List<BYTE> fragmentVideoData, fragmentAudioData;
+
     void PushBox(BufferOutputSerializer &output, DWORD boxName)
     {
         boxOffsets.Insert(0, (UINT)output.GetPos());
@@ -143,13 +178,20 @@ class MP4FileStream : public VideoFileStream
     }
 
 public:
-    bool Init(CTSTR lpFile)
+    bool Init(CTSTR lpFile, bool bFragmented)
     {
         strFile = lpFile;
 
         initialTimeStamp = -1;
 
-        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024))
+        this->bFragmented = bFragmented;
+
+        DWORD writeFlags = AppConfig->GetInt(TEXT("Publish"), TEXT("UnbufferedFileIO"), 0) ? XFILE_ASYNC_UNBUFFERED : 0;
+        if(AppConfig->GetInt(TEXT("Publish"), TEXT("MappedFileIO"), 0))
+            writeFlags = XFILE_ASYNC_MAPPED;
+        QWORD preallocSize = QWORD(AppConfig->GetInt(TEXT("Publish"), TEXT("FilePreallocationMB"), 0))*1024*1024;
+
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS, 1024*1024, 4, writeFlags, preallocSize))
             return false;
 
         fileOut.OutputDword(DWORD_BE(0x20));
@@ -157,23 +199,53 @@ public:
         fileOut.OutputDword(DWORD_BE('isom'));
         fileOut.OutputDword(DWORD_BE(0x200));
         fileOut.OutputDword(DWORD_BE('isom'));
-        fileOut.OutputDword(DWORD_BE('iso2'));
+        fileOut.OutputDword(bFragmented ? DWORD_BE('iso6') : DWORD_BE('iso2'));
         fileOut.OutputDword(DWORD_BE('avc1'));
         fileOut.OutputDword(DWORD_BE('mp41'));
 
-        fileOut.OutputDword(DWORD_BE(0x8));
-        fileOut.OutputDword(DWORD_BE('free'));
+        //fragmented files write the moov when the first keyframe comes in, and the mdats after it
+        if(!bFragmented)
+        {
+            fileOut.OutputDword(DWORD_BE(0x8));
+            fileOut.OutputDword(DWORD_BE('free'));
 
-        mdatStart = fileOut.GetPos();
-        fileOut.OutputDword(DWORD_BE(0x1));
-        fileOut.OutputDword(DWORD_BE('mdat'));
+            mdatStart = fileOut.GetPos();
+            fileOut.OutputDword(DWORD_BE(0x1));
+            fileOut.OutputDword(DWORD_BE('mdat'));
 #ifdef USE_64BIT_MP4
-        fileOut.OutputQword(0);
+            fileOut.OutputQword(0);
 #endif
+        }
+
+        AudioEncoder *audioEncoder = App->GetRecordingAudioEncoder();
+        bMP3 = scmp(audioEncoder->GetCodec(), TEXT("MP3")) == 0;
 
-        bMP3 = scmp(App->GetAudioEncoder()->GetCodec(), TEXT("MP3")) == 0;
+        audioFrameSize = audioEncoder->GetFrameSize();
+        audioBitRate = audioEncoder->GetBitRate();
+        sampleRate = App->GetSampleRateHz();
+        frameTime = App->GetFrameTime();
 
-        audioFrameSize = App->GetAudioEncoder()->GetFrameSize();
+        App->GetOutputSize(outputWidth, outputHeight);
+
+        //-------------------------------------------
+        // get video headers
+        DataPacket videoHeaders;
+        App->GetVideoHeaders(videoHeaders);
+
+        LPBYTE lpHeaderData = videoHeaders.lpPacket+11;
+        SPS.CopyArray(lpHeaderData+2, fastHtons(*(WORD*)lpHeaderData));
+
+        lpHeaderData += SPS.Num()+3;
+        PPS.CopyArray(lpHeaderData+2, fastHtons(*(WORD*)lpHeaderData));
+
+        //-------------------------------------------
+        // get AAC headers if using AAC
+        if(!bMP3)
+        {
+            DataPacket data;
+            App->GetRecordingAudioHeaders(data);
+            AACHeader.CopyArray(data.lpPacket+2, data.size-2);
+        }
 
         bStreamOpened = true;
 
@@ -226,9 +298,9 @@ public:
         UINT frameTime;
 
         if(bLast)
-            frameTime = videoDecodeTimes.Last().val;
+            frameTime = videoDecodeTimes.Num() ? videoDecodeTimes.Last().val : this->frameTime;
         else
-            frameTime = videoFrame.timestamp-videoFrames.Last().timestamp;
+            frameTime = videoFrame.timestamp-lastVideoFrame.timestamp;
 
         if(!videoDecodeTimes.Num() || videoDecodeTimes.Last().val != (UINT)frameTime)
         {
@@ -240,7 +312,7 @@ public:
         else
             videoDecodeTimes.Last().count++;
 
-        INT compositionOffset = videoFrames.Last().compositionOffset;
+        INT compositionOffset = lastVideoFrame.compositionOffset;
         if(!compositionOffsets.Num() || compositionOffsets.Last().val != (UINT)compositionOffset)
         {
             OffsetVal newVal;
@@ -252,17 +324,18 @@ public:
             compositionOffsets.Last().count++;
     }
 
+    //adds the duration of the previous sample, which runs up to audioFrame (or one frame if there's a gap before it)
     void GetAudioDecodeTime(MP4AudioFrameInfo &audioFrame, bool bLast)
     {
         UINT frameTime;
         if(bLast)
-            frameTime = audioDecodeTimes.Last().val;
+            frameTime = audioDecodeTimes.Num() ? audioDecodeTimes.Last().val : UINT(audioFrameSize);
         else
         {
             UINT64 newTimeVal = lastAudioTimeVal+audioFrameSize;
-            if(audioFrames.Num() > 1)
+            if(audioSampleSizes.Num() > 1)
             {
-                UINT64 convertedTime = ConvertToAudioTime(audioFrame.timestamp, audioFrameSize*audioFrames.Num());
+                UINT64 convertedTime = ConvertToAudioTime(audioFrame.timestamp, sampleRate, audioFrameSize*audioSampleSizes.Num());
                 if(convertedTime > newTimeVal)
                     newTimeVal = convertedTime;
             }
@@ -282,78 +355,33 @@ public:
             audioDecodeTimes.Last().count++;
     }
 
-    ~MP4FileStream()
+    void BuildMoov(BufferOutputSerializer &output)
     {
-        if(!bStreamOpened)
-            return;
-
-        App->EnableSceneSwitching(false);
-
-        //---------------------------------------------------
-
-        //HWND hwndProgressDialog = CreateDialog(hinstMain, MAKEINTRESOURCE(IDD_BUILDINGMP4), hwndMain, (DLGPROC)MP4ProgressDialogProc);
-        //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETRANGE32, 0, 100);
-
-        mdatStop = fileOut.GetPos();
-
-        BufferOutputSerializer output(endBuffer);
-
-        //set a reasonable initial buffer size
-        endBuffer.SetSize((videoFrames.Num() + audioFrames.Num()) * 20 + 131072);
+        DWORD macTime = fastHtonl(DWORD(GetMacTime()));
+        UINT videoDuration = 0, audioDuration = 0, audioUnitDuration = 0;
 
-        UINT64 audioFrameSize = App->GetAudioEncoder()->GetFrameSize();
+        //fragmented files don't know their duration up front, the fragments carry the timing
+        if(!bFragmented)
+        {
+            videoDuration = fastHtonl(lastVideoTimestamp + frameTime);
+            audioDuration = fastHtonl(lastVideoTimestamp + DWORD(double(audioFrameSize)*1000.0/double(sampleRate)));
+            audioUnitDuration = fastHtonl(UINT(lastAudioTimeVal));
+        }
 
-        DWORD macTime = fastHtonl(DWORD(GetMacTime()));
-        UINT videoDuration = fastHtonl(lastVideoTimestamp + App->GetFrameTime());
-        UINT audioDuration = fastHtonl(lastVideoTimestamp + DWORD(double(audioFrameSize)*1000.0/double(App->GetSampleRateHz())));
-        UINT width, height;
-        App->GetOutputSize(width, height);
+        UINT width = outputWidth, height = outputHeight;
 
         LPCSTR lpVideoTrack = "Video Media Handler";
         LPCSTR lpAudioTrack = "Sound Media Handler";
 
         const char videoCompressionName[31] = "AVC Coding";
 
-        //-------------------------------------------
-        // get video headers
-        DataPacket videoHeaders;
-        App->GetVideoHeaders(videoHeaders);
-        List<BYTE> SPS, PPS;
-
-        LPBYTE lpHeaderData = videoHeaders.lpPacket+11;
-        SPS.CopyArray(lpHeaderData+2, fastHtons(*(WORD*)lpHeaderData));
-
-        lpHeaderData += SPS.Num()+3;
-        PPS.CopyArray(lpHeaderData+2, fastHtons(*(WORD*)lpHeaderData));
-
-        //-------------------------------------------
-        // get AAC headers if using AAC
-        List<BYTE> AACHeader;
-        if(!bMP3)
-        {
-            DataPacket data;
-            App->GetAudioHeaders(data);
-            AACHeader.CopyArray(data.lpPacket+2, data.size-2);
-        }
-
         //-------------------------------------------
 
-        EndChunkInfo(videoChunks, videoSampleToChunk, curVideoChunkOffset, numVideoSamples);
-        EndChunkInfo(audioChunks, audioSampleToChunk, curAudioChunkOffset, numAudioSamples);
-
-        if (numVideoSamples > 1)
-            GetVideoDecodeTime(videoFrames.Last(), true);
-
-        if (numAudioSamples > 1)
-            GetAudioDecodeTime(audioFrames.Last(), true);
-
-        UINT audioUnitDuration = fastHtonl(UINT(lastAudioTimeVal));
-
         //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 25, 0);
 
         //-------------------------------------------
         // sound descriptor thingy.  this part made me die a little inside admittedly.
-        UINT maxBitRate = fastHtonl(App->GetAudioEncoder()->GetBitRate()*1000);
+        UINT maxBitRate = fastHtonl(audioBitRate*1000);
 
         List<BYTE> esDecoderDescriptor;
         BufferOutputSerializer esDecoderOut(esDecoderDescriptor);
@@ -455,7 +483,7 @@ public:
                 output.OutputDword(0); //version and flags (none)
                 output.OutputDword(macTime); //creation time
                 output.OutputDword(macTime); //modified time
-                output.OutputDword(DWORD_BE(App->GetSampleRateHz())); //time scale
+                output.OutputDword(fastHtonl(sampleRate)); //time scale
                 output.OutputDword(audioUnitDuration);
                 output.OutputDword(bMP3 ? DWORD_BE(0x55c40000) : DWORD_BE(0x15c70000));
               PopBox(output); //mdhd
@@ -497,7 +525,7 @@ public:
                       output.OutputWord(WORD_BE(16)); //sample size
                       output.OutputWord(0); //quicktime audio compression id
                       output.OutputWord(0); //quicktime audio packet size
-                      output.OutputDword(DWORD_BE(App->GetSampleRateHz()<<16)); //sample rate (fixed point)
+                      output.OutputDword(fastHtonl(sampleRate<<16)); //sample rate (fixed point)
                       PushBox(output, DWORD_BE('esds'));
                         output.OutputDword(0); //version and flags (none)
                         output.OutputByte(3); //ES descriptor type
@@ -536,9 +564,8 @@ public:
                   PushBox(output, DWORD_BE('stsz')); //sample sizes
                     output.OutputDword(0); //version and flags (none)
                     output.OutputDword(0); //block size for all (0 if differing sizes)
-                    output.OutputDword(fastHtonl(audioFrames.Num()));
-                    for(UINT i=0; i<audioFrames.Num(); i++)
-                        output.OutputDword(fastHtonl(audioFrames[i].size));
+                    output.OutputDword(fastHtonl(audioSampleSizes.Num()));
+                    output.Serialize(audioSampleSizes.Array(), audioSampleSizes.Num()*sizeof(UINT));
                   PopBox(output);
 
                   //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 40, 0);
@@ -694,17 +721,20 @@ public:
                         output.Serialize(IFrameIDs.Array(), IFrameIDs.Num()*sizeof(UINT));
                       PopBox(output); //stss
                   }
-                  PushBox(output, DWORD_BE('ctts')); //list of composition time offsets
-                    output.OutputDword(0); //version (0) and flags (none)
-                    //output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
+                  if(!bFragmented)
+                  {
+                      PushBox(output, DWORD_BE('ctts')); //list of composition time offsets
+                        output.OutputDword(0); //version (0) and flags (none)
+                        //output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
 
-                    output.OutputDword(fastHtonl(compositionOffsets.Num()));
-                    for(UINT i=0; i<compositionOffsets.Num(); i++)
-                    {
-                        output.OutputDword(fastHtonl(compositionOffsets[i].count));
-                        output.OutputDword(fastHtonl(compositionOffsets[i].val));
-                    }
-                  PopBox(output); //ctts
+                        output.OutputDword(fastHtonl(compositionOffsets.Num()));
+                        for(UINT i=0; i<compositionOffsets.Num(); i++)
+                        {
+                            output.OutputDword(fastHtonl(compositionOffsets[i].count));
+                            output.OutputDword(fastHtonl(compositionOffsets[i].val));
+                        }
+                      PopBox(output); //ctts
+                  }
 
                   //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 70, 0);
                   //ProcessEvents();
@@ -723,9 +753,8 @@ public:
                   PushBox(output, DWORD_BE('stsz')); //sample sizes
                     output.OutputDword(0); //version and flags (none)
                     output.OutputDword(0); //block size for all (0 if differing sizes)
-                    output.OutputDword(fastHtonl(videoFrames.Num()));
-                    for(UINT i=0; i<videoFrames.Num(); i++)
-                        output.OutputDword(fastHtonl(videoFrames[i].size));
+                    output.OutputDword(fastHtonl(videoSampleSizes.Num()));
+                    output.Serialize(videoSampleSizes.Array(), videoSampleSizes.Num()*sizeof(UINT));
                   PopBox(output);
 
                   if(videoChunks.Num() && videoChunks.Last() > 0xFFFFFFFFLL)
@@ -754,6 +783,25 @@ public:
           //SendMessage(GetDlgItem(hwndProgressDialog, IDC_PROGRESS1), PBM_SETPOS, 80, 0);
           //ProcessEvents();
 
+          //------------------------------------------------------
+          // movie extends, tells the player the samples are in the moof boxes that follow
+          if(bFragmented)
+          {
+              PushBox(output, DWORD_BE('mvex'));
+                for(UINT trackID=1; trackID<=2; trackID++)
+                {
+                    PushBox(output, DWORD_BE('trex'));
+                      output.OutputDword(0); //version and flags (none)
+                      output.OutputDword(fastHtonl(trackID)); //track ID
+                      output.OutputDword(DWORD_BE(1)); //default sample description index
+                      output.OutputDword(0); //default sample duration
+                      output.OutputDword(0); //default sample size
+                      output.OutputDword(trackID == 1 ? DWORD_BE(MP4_SAMPLE_SYNC) : DWORD_BE(MP4_SAMPLE_NONSYNC)); //default sample flags
+                    PopBox(output); //trex
+                }
+              PopBox(output); //mvex
+          }
+
           //------------------------------------------------------
           // info thingy
           PushBox(output, DWORD_BE('udta'));
@@ -782,33 +830,340 @@ public:
           PopBox(output); //udta
 
         PopBox(output); //moov
+    }
+
+    //-----------------------------------------------------------------
+
+    void WriteInitSegment()
+    {
+        BufferOutputSerializer output(endBuffer, FALSE);
+        BuildMoov(output);
 
         fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
-        fileOut.Close();
+        fileOut.Flush();
+    }
+
+    //returns the decode time right after the last sample
+    UINT64 BuildTrackFragment(BufferOutputSerializer &output, UINT trackID, UINT64 baseDecodeTime, List<MP4FragmentSample> &samples,
+                              DWORD nextTimestamp, UINT &dataOffsetPos)
+    {
+        bool bVideo = (trackID == 2);
+        UINT64 decodeTime = baseDecodeTime;
+
+        PushBox(output, DWORD_BE('traf'));
+          PushBox(output, DWORD_BE('tfhd'));
+            output.OutputDword(DWORD_BE(0x00020000)); //version (0) and flags (default-base-is-moof)
+            output.OutputDword(fastHtonl(trackID)); //track ID
+          PopBox(output); //tfhd
+          PushBox(output, DWORD_BE('tfdt'));
+            output.OutputDword(DWORD_BE(0x01000000)); //version (1) and flags (none)
+            output.OutputQword(fastHtonll(baseDecodeTime)); //decode time of the first sample
+          PopBox(output); //tfdt
+          PushBox(output, DWORD_BE('trun'));
+            //data offset, sample durations, sample sizes, and for video sample flags and composition offsets
+            output.OutputDword(bVideo ? DWORD_BE(0x00000F01) : DWORD_BE(0x00000301));
+            output.OutputDword(fastHtonl(samples.Num())); //sample count
+            dataOffsetPos = (UINT)output.GetPos();
+            output.OutputDword(0); //data offset (filled in when the moof size is known)
+
+            for(UINT i=0; i<samples.Num(); i++)
+            {
+                MP4FragmentSample &sample = samples[i];
+
+                UINT duration;
+                if(!bVideo)
+                {
+                    //back to back, unless the encoder skipped audio before the next sample
+                    UINT64 nextTime = decodeTime+audioFrameSize;
+                    if(i+1 < samples.Num())
+                        nextTime = ConvertToAudioTime(samples[i+1].timestamp, sampleRate, nextTime);
+                    duration = UINT(nextTime-decodeTime);
+                }
+                else if(i+1 < samples.Num())
+                    duration = samples[i+1].timestamp-sample.timestamp;
+                else
+                    duration = nextTimestamp-sample.timestamp;
+
+                decodeTime += duration;
+
+                output.OutputDword(fastHtonl(duration));
+                output.OutputDword(fastHtonl(sample.size));
+
+                if(bVideo)
+                {
+                    output.OutputDword(sample.bKeyframe ? DWORD_BE(MP4_SAMPLE_SYNC) : DWORD_BE(MP4_SAMPLE_NONSYNC));
+                    output.OutputDword(fastHtonl((DWORD)sample.compositionOffset));
+                }
+            }
+          PopBox(output); //trun
+        PopBox(output); //traf
+
+        return decodeTime;
+    }
+
+    //writes out everything buffered since the last fragment.  nextTimestamp is the
+    //decode time of the video frame that follows, which gives the last frame its duration
+    void FlushFragment(DWORD nextTimestamp)
+    {
+        if(!fragmentVideoSamples.Num() && !fragmentAudioSamples.Num())
+            return;
+
+        UINT64 videoBaseTime = fragmentVideoSamples.Num() ? fragmentVideoSamples[0].timestamp : 0;
+
+        //audio is laid out back to back, but jump ahead if the encoder skipped anything
+        UINT64 audioBaseTime = fragmentAudioTime;
+        if(fragmentAudioSamples.Num())
+            audioBaseTime = ConvertToAudioTime(fragmentAudioSamples[0].timestamp, sampleRate, fragmentAudioTime);
+
+        BufferOutputSerializer output(endBuffer, FALSE);
+        UINT videoDataOffsetPos = 0, audioDataOffsetPos = 0;
+        UINT64 audioEndTime = audioBaseTime;
+
+        PushBox(output, DWORD_BE('moof'));
+          PushBox(output, DWORD_BE('mfhd'));
+            output.OutputDword(0); //version and flags (none)
+            output.OutputDword(fastHtonl(++fragmentSequence)); //sequence number
+          PopBox(output); //mfhd
+
+          if(fragmentVideoSamples.Num())
+              BuildTrackFragment(output, 2, videoBaseTime, fragmentVideoSamples, nextTimestamp, videoDataOffsetPos);
+          if(fragmentAudioSamples.Num())
+              audioEndTime = BuildTrackFragment(output, 1, audioBaseTime, fragmentAudioSamples, nextTimestamp, audioDataOffsetPos);
+        PopBox(output); //moof
+
+        //sample data goes right after the mdat header, video first then audio
+        DWORD moofSize = (DWORD)output.GetPos();
+        if(videoDataOffsetPos)
+            *(DWORD*)(endBuffer.Array()+videoDataOffsetPos) = fastHtonl(moofSize+8);
+        if(audioDataOffsetPos)
+            *(DWORD*)(endBuffer.Array()+audioDataOffsetPos) = fastHtonl(moofSize+8+fragmentVideoData.Num());
+
+        output.OutputDword(fastHtonl(8+fragmentVideoData.Num()+fragmentAudioData.Num()));
+        output.OutputDword(DWORD_BE('mdat'));
+
+        fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
+        if(fragmentVideoData.Num())
+            fileOut.Serialize(fragmentVideoData.Array(), fragmentVideoData.Num());
+        if(fragmentAudioData.Num())
+            fileOut.Serialize(fragmentAudioData.Array(), fragmentAudioData.Num());
+
+        //hand it to the write thread right away so a crash loses as little as possible
+        fileOut.Flush();
+
+        fragmentAudioTime = audioEndTime;
+
+        fragmentVideoSamples.Clear();
+        fragmentAudioSamples.Clear();
+        fragmentVideoData.Clear();
+        fragmentAudioData.Clear();
+    }
+
+    //-----------------------------------------------------------------
 
-        XFile file;
-        if(file.Open(strFile, XFILE_WRITE, XFILE_OPENEXISTING))
+    //writes out whatever's left and closes the file.  runs on its own thread after recording
+    //stops, so nothing in here can touch the encoders
+    void Finish()
+    {
+        if(!bStreamOpened)
+            return;
+
+        //everything up to the current fragment is already on disk, so there's no moov to build
+        if(bFragmented)
         {
-#ifdef USE_64BIT_MP4
-            file.SetPos((INT64)mdatStart+8, XFILE_BEGIN);
+            if(initialTimeStamp != -1)
+                FlushFragment(lastVideoTimestamp+frameTime);
+
+            fileOut.Close();
+            fileOut.LogStats(TEXT("MP4FileStream"));
+            return;
+        }
 
-            UINT64 size = fastHtonll(mdatStop-mdatStart);
-            file.Write(&size, 8);
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        mdatStop = fileOut.GetPos();
+
+        BufferOutputSerializer output(endBuffer);
+
+        //set a reasonable initial buffer size
+        endBuffer.SetSize((videoSampleSizes.Num() + audioSampleSizes.Num()) * 4 + IFrameIDs.Num() * 4 +
+            (videoDecodeTimes.Num() + audioDecodeTimes.Num() + compositionOffsets.Num()) * 8 +
+            (videoChunks.Num() + audioChunks.Num()) * 8 + 131072);
+
+        //numVideoSamples/numAudioSamples only count the last chunk, the last sample's duration is needed either way
+        if(videoSampleSizes.Num())
+        {
+            EndChunkInfo(videoChunks, videoSampleToChunk, curVideoChunkOffset, numVideoSamples);
+            GetVideoDecodeTime(lastVideoFrame, true);
+        }
+
+        if(audioSampleSizes.Num())
+        {
+            EndChunkInfo(audioChunks, audioSampleToChunk, curAudioChunkOffset, numAudioSamples);
+            GetAudioDecodeTime(lastAudioFrame, true);
+        }
+
+        BuildMoov(output);
+
+        fileOut.Serialize(endBuffer.Array(), (DWORD)output.GetPos());
+
+        //patch the mdat size through the same handle rather than reopening the file
+#ifdef USE_64BIT_MP4
+        fileOut.Seek((INT64)mdatStart+8);
+        fileOut.OutputQword(fastHtonll(mdatStop-mdatStart));
 #else
-            file.SetPos((INT64)mdatStart, XFILE_BEGIN);
-            UINT size = fastHtonl((DWORD)(mdatStop-mdatStart));
-            file.Write(&size, 4);
+        fileOut.Seek((INT64)mdatStart);
+        fileOut.OutputDword(fastHtonl((DWORD)(mdatStop-mdatStart)));
 #endif
-            file.Close();
+
+        fileOut.Close();
+        fileOut.LogStats(TEXT("MP4FileStream"));
+
+        Log(TEXT("MP4FileStream: Wrote %u KB moov for %u video and %u audio samples in %g ms"),
+            UINT(output.GetPos()/1024), videoSampleSizes.Num(), audioSampleSizes.Num(),
+            double(OSGetTimeMicroseconds()-startTime)/1000.0);
+    }
+
+    static DWORD STDCALL FinishThread(LPVOID param)
+    {
+        MP4FileStream *fileStream = (MP4FileStream*)param;
+        fileStream->Finish();
+        delete fileStream;
+
+        InterlockedDecrement(&numFinishingStreams);
+        return 0;
+    }
+
+    void FinishAsync()
+    {
+        InterlockedIncrement(&numFinishingStreams);
+
+        HANDLE hThread = OSCreateThread((XTHREAD)FinishThread, this);
+        if(hThread)
+            OSCloseThread(hThread);
+        else
+            FinishThread(this);
+    }
+
+    //converts an FLV video packet to length-prefixed NALs, returns the number of bytes written
+    UINT WriteVideoPayload(Serializer &out, BYTE *data, UINT size)
+    {
+        UINT totalCopied = 0;
+
+        if(data[0] == 0x17 && data[1] == 0) //if SPS/PPS
+        {
+            LPBYTE lpData = data+11;
+
+            UINT spsSize = fastHtons(*(WORD*)lpData);
+            out.OutputWord(0);
+            out.Serialize(lpData, spsSize+2);
+
+            lpData += spsSize+3;
+
+            UINT ppsSize = fastHtons(*(WORD*)lpData);
+            out.OutputWord(0);
+            out.Serialize(lpData, ppsSize+2);
+
+            totalCopied = spsSize+ppsSize+8;
         }
+        else
+        {
+            if (!bSentSEI) {
+                DataPacket sei;
+                App->GetVideoEncoder()->GetSEI(sei);
+
+                if (sei.size > 0)
+                {
+                    out.Serialize(sei.lpPacket, sei.size);
+                    totalCopied += sei.size;
 
-        App->EnableSceneSwitching(true);
+                    bSentSEI = true;
+                }
+            }
 
-        //DestroyWindow(hwndProgressDialog);
+            totalCopied += size-5;
+            out.Serialize(data+5, size-5);
+        }
+
+        return totalCopied;
     }
 
-    virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    static INT GetCompositionOffset(BYTE *data)
+    {
+        INT timeOffset = 0;
+        mcpy(((BYTE*)&timeOffset)+1, data+2, 3);
+        if(data[2] >= 0x80)
+            timeOffset |= 0xFF;
+        return (INT)fastHtonl(DWORD(timeOffset));
+    }
+
+    void AddFragmentPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        if(initialTimeStamp == -1)
+        {
+            if(data[0] != 0x17)
+                return;
+
+            initialTimeStamp = timestamp;
+            WriteInitSegment();
+        }
+
+        timestamp -= initialTimeStamp;
+
+        if(type == PacketType_Audio)
+        {
+            UINT headerSize = bMP3 ? 1 : 2;
+
+            MP4FragmentSample sample;
+            sample.size                 = size-headerSize;
+            sample.timestamp            = timestamp;
+            sample.compositionOffset    = 0;
+            sample.bKeyframe            = true;
+
+            fragmentAudioData.AppendArray(data+headerSize, sample.size);
+            fragmentAudioSamples << sample;
+            return;
+        }
+
+        //packets with the same timestamp are parts of the same frame
+        bool bNewFrame = !numVideoSamples || timestamp != lastVideoTimestamp;
+
+        if(bNewFrame && fragmentVideoSamples.Num())
+        {
+            DWORD fragmentDuration = timestamp-fragmentVideoSamples[0].timestamp;
+            UINT fragmentSize = fragmentVideoData.Num()+fragmentAudioData.Num();
+
+            if(data[0] == 0x17 || fragmentDuration >= MP4_MAX_FRAGMENT_DURATION || fragmentSize >= MP4_MAX_FRAGMENT_SIZE)
+                FlushFragment(timestamp);
+        }
+
+        BufferOutputSerializer dataOut(fragmentVideoData);
+        UINT totalCopied = WriteVideoPayload(dataOut, data, size);
+
+        if(bNewFrame)
+        {
+            MP4FragmentSample sample;
+            sample.size                 = totalCopied;
+            sample.timestamp            = timestamp;
+            sample.compositionOffset    = GetCompositionOffset(data);
+            sample.bKeyframe            = (data[0] == 0x17);
+
+            fragmentVideoSamples << sample;
+            numVideoSamples++;
+        }
+        else
+            fragmentVideoSamples.Last().size += totalCopied;
+
+        lastVideoTimestamp = timestamp;
+    }
+
+    void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
     {
+        if(bFragmented)
+        {
+            AddFragmentPacket(data, size, timestamp, type);
+            return;
+        }
+
         UINT64 offset = fileOut.GetPos();
 
         if(initialTimeStamp == -1 && data[0] != 0x17)
@@ -837,63 +1192,25 @@ public:
             audioFrame.size         = copySize;
             audioFrame.timestamp    = timestamp-initialTimeStamp;
 
-            GetChunkInfo<MP4AudioFrameInfo>(audioFrame, audioFrames.Num(), audioChunks, audioSampleToChunk,
+            GetChunkInfo<MP4AudioFrameInfo>(audioFrame, audioSampleSizes.Num(), audioChunks, audioSampleToChunk,
                                             curAudioChunkOffset, connectedAudioSampleOffset, numAudioSamples);
 
-            if(audioFrames.Num())
-                GetAudioDecodeTime(audioFrames.Last(), false);
+            if(audioSampleSizes.Num())
+                GetAudioDecodeTime(audioFrame, false);
 
-            audioFrames << audioFrame;
+            audioSampleSizes << fastHtonl(copySize);
+            lastAudioFrame = audioFrame;
         }
         else
         {
-            UINT totalCopied = 0;
+            UINT totalCopied = WriteVideoPayload(fileOut, data, size);
 
-            if(data[0] == 0x17 && data[1] == 0) //if SPS/PPS
+            if(!videoSampleSizes.Num() || (timestamp-initialTimeStamp) != lastVideoTimestamp)
             {
-                LPBYTE lpData = data+11;
-
-                UINT spsSize = fastHtons(*(WORD*)lpData);
-                fileOut.OutputWord(0);
-                fileOut.Serialize(lpData, spsSize+2);
-
-                lpData += spsSize+3;
-
-                UINT ppsSize = fastHtons(*(WORD*)lpData);
-                fileOut.OutputWord(0);
-                fileOut.Serialize(lpData, ppsSize+2);
-
-                totalCopied = spsSize+ppsSize+8;
-            }
-            else
-            {
-                if (!bSentSEI) {
-                    DataPacket sei;
-                    App->GetVideoEncoder()->GetSEI(sei);
-
-                    if (sei.size > 0)
-                    {
-                        fileOut.Serialize(sei.lpPacket, sei.size);
-                        totalCopied += sei.size;
-
-                        bSentSEI = true;
-                    }
-                }
-
-                totalCopied += size-5;
-                fileOut.Serialize(data+5, size-5);
-            }
-
-            if(!videoFrames.Num() || (timestamp-initialTimeStamp) != lastVideoTimestamp)
-            {
-                INT timeOffset = 0;
-                mcpy(((BYTE*)&timeOffset)+1, data+2, 3);
-                if(data[2] >= 0x80)
-                    timeOffset |= 0xFF;
-                timeOffset = (INT)fastHtonl(DWORD(timeOffset));
+                INT timeOffset = GetCompositionOffset(data);
 
                 if(data[0] == 0x17) //i-frame
-                    IFrameIDs << fastHtonl(videoFrames.Num()+1);
+                    IFrameIDs << fastHtonl(videoSampleSizes.Num()+1);
 
                 MP4VideoFrameInfo frameInfo;
                 frameInfo.fileOffset        = offset;
@@ -901,16 +1218,23 @@ public:
                 frameInfo.timestamp         = timestamp-initialTimeStamp;
                 frameInfo.compositionOffset = timeOffset;
 
-                GetChunkInfo<MP4VideoFrameInfo>(frameInfo, videoFrames.Num(), videoChunks, videoSampleToChunk,
+                GetChunkInfo<MP4VideoFrameInfo>(frameInfo, videoSampleSizes.Num(), videoChunks, videoSampleToChunk,
                                                 curVideoChunkOffset, connectedVideoSampleOffset, numVideoSamples);
 
-                if(videoFrames.Num())
+                if(videoSampleSizes.Num())
                     GetVideoDecodeTime(frameInfo, false);
 
-                videoFrames << frameInfo;
+                videoSampleSizes << fastHtonl(totalCopied);
+                lastVideoFrame = frameInfo;
             }
             else
-                videoFrames.Last().size += totalCopied;
+            {
+                lastVideoFrame.size += totalCopied;
+                videoSampleSizes.Last() = fastHtonl(lastVideoFrame.size);
+
+                //the rest of the frame follows straight on, so it stays in the same chunk
+                connectedVideoSampleOffset += totalCopied;
+            }
 
             lastVideoTimestamp = timestamp-initialTimeStamp;
         }
@@ -918,12 +1242,37 @@ public:
 };
 
 
+//the muxer outlives this when recording stops, so the moov can be written without holding up the caller
+class MP4FileStreamHandle : public VideoFileStream
+{
+    MP4FileStream *fileStream;
+
+public:
+    inline MP4FileStreamHandle(MP4FileStream *fileStream) : fileStream(fileStream) {}
+    ~MP4FileStreamHandle() {fileStream->FinishAsync();}
+
+    virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        fileStream->AddPacket(data, size, timestamp, type);
+    }
+};
+
+
 VideoFileStream* CreateMP4FileStream(CTSTR lpFile)
 {
+    bool bFragmented = AppConfig->GetInt(TEXT("Publish"), TEXT("FragmentedMP4"), 0) != 0;
+
     MP4FileStream *fileStream = new MP4FileStream;
-    if(fileStream->Init(lpFile))
-        return fileStream;
+    if(fileStream->Init(lpFile, bFragmented))
+        return new MP4FileStreamHandle(fileStream);
 
     delete fileStream;
     return NULL;
 }
+
+//called on shutdown so no recording is left without its moov
+void WaitForMP4FileStreams()
+{
+    while(numFinishingStreams)
+        OSSleep(10);
+}
@@ -41,6 +41,10 @@ ConfigFile  *AppConfig      = NULL;
 OBS         *App            = NULL;
 bool        bIsPortable     = false;
 bool        bStreamOnStart  = false;
+TCHAR       lpReplayPacketLog[MAX_PATH];
+bool        bReplayPacketsFast = false, bReplayPacketsToStream = false;
+bool        bRunOutputTest = false;
+TCHAR       lpOutputTestDir[MAX_PATH];
 TCHAR       lpAppPath[MAX_PATH];
 TCHAR       lpAppDataPath[MAX_PATH];
 
@@ -188,7 +192,7 @@ void InvertPre47Scenes()
     strScenesPath << lpAppDataPath << TEXT("\\scenes.xconfig");
 
     XConfig scenesConfig;
-    if(scenesConfig.Open(strScenesPath))
+    if(scenesConfig.Open(strScenesPath, true))
     {
         XElement *scenes = scenesConfig.GetElement(TEXT("scenes"));
         if(!scenes)
@@ -421,6 +425,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     LPWSTR profile = NULL;
 
     bool bDisableMutex = false;
+    int exitCode = 0;
 
     for(int i=1; i<numArgs; i++)
     {
@@ -435,6 +440,21 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
             if (++i < numArgs)
                 profile = args[i];
         }
+        else if (scmpi(args[i], TEXT("-replaypackets")) == 0)
+        {
+            if (++i < numArgs)
+                scpy_n(lpReplayPacketLog, args[i], MAX_PATH-1);
+        }
+        else if (scmpi(args[i], TEXT("-replayfast")) == 0)
+            bReplayPacketsFast = true;
+        else if (scmpi(args[i], TEXT("-replaystream")) == 0)
+            bReplayPacketsToStream = true;
+        else if (scmpi(args[i], TEXT("-outputtest")) == 0)
+        {
+            bRunOutputTest = true;
+            if (i+1 < numArgs && args[i+1][0] != '-')
+                scpy_n(lpOutputTestDir, args[++i], MAX_PATH-1);
+        }
     }
 
     //------------------------------------------------------------
@@ -622,15 +642,23 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
         App = new OBS;
 
-        HACCEL hAccel = LoadAccelerators(hinstMain, MAKEINTRESOURCE(IDR_ACCELERATOR1));
-
-        MSG msg;
-        while(GetMessage(&msg, NULL, 0, 0))
+        //replaying a packet log or testing the outputs runs them and exits, nothing gets captured
+        if(*lpReplayPacketLog)
+            App->ReplayPacketLog(lpReplayPacketLog, !bReplayPacketsFast, bReplayPacketsToStream);
+        else if(bRunOutputTest)
+            exitCode = (int)App->RunOutputTest(lpOutputTestDir);
+        else
         {
-            if(!TranslateAccelerator(hwndMain, hAccel, &msg) && !IsDialogMessage(hwndMain, &msg))
+            HACCEL hAccel = LoadAccelerators(hinstMain, MAKEINTRESOURCE(IDR_ACCELERATOR1));
+
+            MSG msg;
+            while(GetMessage(&msg, NULL, 0, 0))
             {
-                TranslateMessage(&msg);
-                DispatchMessage(&msg);
+                if(!TranslateAccelerator(hwndMain, hAccel, &msg) && !IsDialogMessage(hwndMain, &msg))
+                {
+                    TranslateMessage(&msg);
+                    DispatchMessage(&msg);
+                }
             }
         }
 
@@ -691,5 +719,5 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     LocalFree(args);
 
-    return 0;
+    return exitCode;
 }
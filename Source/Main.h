@@ -73,6 +73,10 @@ extern ConfigFile   *AppConfig;
 extern OBS          *App;
 extern bool         bIsPortable;
 extern bool         bStreamOnStart;
+extern TCHAR        lpReplayPacketLog[MAX_PATH];
+extern bool         bReplayPacketsFast, bReplayPacketsToStream;
+extern bool         bRunOutputTest;
+extern TCHAR        lpOutputTestDir[MAX_PATH];
 extern TCHAR        lpAppPath[MAX_PATH];
 extern TCHAR        lpAppDataPath[MAX_PATH];
 
@@ -27,6 +27,7 @@ typedef bool (*LOADPLUGINPROC)();
 typedef bool (*LOADPLUGINEXPROC)(UINT);
 typedef void (*UNLOADPLUGINPROC)();
 typedef CTSTR (*GETPLUGINNAMEPROC)();
+typedef UINT (*GETPLUGINAPIVERSIONPROC)();
 
 ImageSource* STDCALL CreateDesktopSource(XElement *data);
 bool STDCALL ConfigureDesktopSource(XElement *data, bool bCreating);
@@ -48,6 +49,8 @@ void STDCALL SceneHotkey(DWORD hotkey, UPARAM param, bool bDown);
 
 APIInterface* CreateOBSApiInterface();
 
+void WaitForMP4FileStreams();
+
 
 #define QuickClearHotkey(hotkeyID) \
     if(hotkeyID) \
@@ -548,7 +551,7 @@ OBS::OBS()
     String strScenesConfig;
     strScenesConfig << lpAppDataPath << TEXT("\\scenes.xconfig");
 
-    if(!scenesConfig.Open(strScenesConfig))
+    if(!scenesConfig.Open(strScenesConfig, true))
         CrashError(TEXT("Could not open '%s'"), strScenesConfig.Array());
 
     XElement *scenes = scenesConfig.GetElement(TEXT("scenes"));
@@ -685,7 +688,22 @@ OBS::OBS()
                 strLocation << TEXT("plugins/") << ofd.fileName;
 
                 HMODULE hPlugin = LoadLibrary(strLocation);
-                if(hPlugin)
+
+                //a plugin built against another major version has a different idea of what List and String look
+                //like, so letting it pass them back and forth would wreck the heap
+                GETPLUGINAPIVERSIONPROC getAPIVersion = hPlugin ? (GETPLUGINAPIVERSIONPROC)GetProcAddress(hPlugin, "GetPluginAPIVersion") : NULL;
+                UINT pluginAPIVersion = getAPIVersion ? getAPIVersion() : 0;
+
+                if(hPlugin && OBS_API_VERSION_MAJOR(pluginAPIVersion) != OBS_API_VERSION_MAJOR(OBS_API_VERSION))
+                {
+                    if(getAPIVersion)
+                        Log(TEXT("Skipping plugin %s, it was built for API version 0x%04X and this is 0x%04X"), strLocation.Array(), pluginAPIVersion, OBS_API_VERSION);
+                    else
+                        Log(TEXT("Skipping plugin %s, it doesn't say which API version it was built for (this is 0x%04X)"), strLocation.Array(), OBS_API_VERSION);
+
+                    FreeLibrary(hPlugin);
+                }
+                else if(hPlugin)
                 {
                     bool bLoaded = false;
 
@@ -766,6 +784,9 @@ OBS::~OBS()
 {
     Stop(true);
 
+    //mp4 recordings finish writing in the background after they're stopped
+    WaitForMP4FileStreams();
+
     bShuttingDown = true;
 
     OSTerminateThread(hHotkeyThread, 250);
@@ -1373,6 +1394,8 @@ void OBS::ReloadIniSettings()
     QuickClearHotkey(startStreamHotkeyID);
     QuickClearHotkey(stopRecordingHotkeyID);
     QuickClearHotkey(startRecordingHotkeyID);
+    QuickClearHotkey(saveReplayHotkeyID);
+    QuickClearHotkey(saveTimelineHotkeyID);
 
     bUsingPushToTalk = AppConfig->GetInt(TEXT("Audio"), TEXT("UsePushToTalk")) != 0;
     DWORD hotkey = AppConfig->GetInt(TEXT("Audio"), TEXT("PushToTalkHotkey"));
@@ -1408,6 +1431,14 @@ void OBS::ReloadIniSettings()
     if (hotkey)
         startRecordingHotkeyID = API->CreateHotkey(hotkey, OBS::StartRecordingHotkey, NULL);
 
+    hotkey = AppConfig->GetInt(TEXT("Publish"), TEXT("SaveReplayHotkey"));
+    if (hotkey)
+        saveReplayHotkeyID = API->CreateHotkey(hotkey, OBS::SaveReplayHotkey, NULL);
+
+    hotkey = GlobalConfig->GetInt(TEXT("General"), TEXT("SaveProfileTimelineHotkey"));
+    if (hotkey)
+        saveTimelineHotkeyID = API->CreateHotkey(hotkey, OBS::SaveTimelineHotkey, NULL);
+
     //-------------------------------------------
     // Notification Area icon
     bool showIcon = AppConfig->GetInt(TEXT("General"), TEXT("ShowNotificationAreaIcon"), 0) != 0;
@@ -1447,8 +1478,13 @@ void OBS::ReloadIniSettings()
 
 void OBS::UpdateAudioMeters()
 {
-    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_DESKTOPVOLUMEMETER), desktopMag, desktopMax, desktopPeak);
-    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_MICVOLUMEMETER), micMag, micMax, micPeak);
+    float rms, max, peak;
+
+    desktopMeter.GetLevels(&rms, &max, &peak);
+    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_DESKTOPVOLUMEMETER), rms, max, peak);
+
+    micMeter.GetLevels(&rms, &max, &peak);
+    SetVolumeMeterValue(GetDlgItem(hwndMain, ID_MICVOLUMEMETER), rms, max, peak);
 }
 
 HICON OBS::GetIcon(HINSTANCE hInst, int resource)
@@ -133,6 +133,14 @@ public:
     virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)=0;
 };
 
+//keeps the last few seconds of encoded packets in memory so they can be saved on demand
+class ReplayBuffer : public VideoFileStream
+{
+public:
+    virtual void SaveReplay()=0;
+    virtual UINT64 GetMemoryUsage()=0;
+};
+
 //-------------------------------------------------------------------
 
 class AudioEncoder
@@ -592,6 +600,9 @@ class OBS
 
     AudioEncoder *audioEncoder;
 
+    //the recording gets its own encoder when its codec or bitrate differs from the stream's
+    AudioEncoder *recordingAudioEncoder;
+
     //---------------------------------------------------
     // scene/encoder
 
@@ -758,7 +769,7 @@ private:
 
     bool bRecievedFirstAudioFrame, bSentHeaders, bFirstAudioPacket;
 
-    DWORD lastAudioTimestamp;
+    DWORD lastAudioTimestamp, lastRecordingAudioTimestamp;
 
     QWORD firstSceneTimestamp;
     QWORD latestVideoTime;
@@ -768,6 +779,14 @@ private:
 
     bool bWriteToFile;
     VideoFileStream *fileStream;
+    ReplayBuffer *replayBuffer;
+    VideoFileStream *packetTap;
+
+    //recording write stats, logged when recording stops
+    UINT numFilePackets, numFileTimestampErrors;
+    UINT64 fileBytes;
+    QWORD filePacketTime, maxFilePacketTime;
+    DWORD lastFileVideoTimestamp, lastFileAudioTimestamp;
 
     bool bRequestKeyframe;
     int  keyframeWait;
@@ -780,6 +799,8 @@ private:
     static DWORD STDCALL MainCaptureThread(LPVOID lpUnused);
     bool BufferVideoData(const List<DataPacket> &inputPackets, const List<PacketType> &inputTypes, DWORD timestamp, VideoSegment &segmentOut);
     void SendFrame(VideoSegment &curSegment, QWORD firstFrameTime);
+    void SendAudioFrames(List<FrameAudio> &audioFrames, DWORD &lastTimestamp, DWORD videoTimestamp, QWORD firstFrameTime, bool bStreamOutput, bool bRecordingOutputs);
+    void AddFilePacket(VideoFileStream *stream, BYTE *data, UINT size, DWORD timestamp, PacketType type);
     bool ProcessFrame(FrameProcessInfo &frameInfo);
     void EncodeLoop();  
     void MainCaptureLoop();
@@ -795,15 +816,24 @@ private:
     QWORD   latestAudioTime;
 
     float   desktopVol, micVol, curMicVol, curDesktopVol;
-    float   desktopPeak, micPeak;
-    float   desktopMax, micMax;
-    float   desktopMag, micMag;
+    AudioLevelMeter desktopMeter, micMeter;
     List<FrameAudio> pendingAudioFrames;
+    List<FrameAudio> pendingRecordingAudioFrames;
     bool    bForceMicMono;
     float   desktopBoost, micBoost;
 
     HANDLE hAuxAudioMutex;
 
+    //the recording encoder runs on its own thread alongside the stream encoder
+    HANDLE hRecordingAudioThread, hRecordingAudioStart, hRecordingAudioDone;
+    float *recordingAudioBuffer;
+    UINT recordingAudioNumFrames;
+    QWORD recordingAudioTimestamp;
+    bool bRecordingAudioExit;
+
+    UINT numAudioEncodes;
+    QWORD audioEncodeTime, recordingAudioEncodeTime;
+
     //---------------------------------------------------
     // hotkey stuff
 
@@ -821,6 +851,8 @@ private:
     UINT stopStreamHotkeyID;
     UINT startRecordingHotkeyID;
     UINT stopRecordingHotkeyID;
+    UINT saveReplayHotkeyID;
+    UINT saveTimelineHotkeyID;
 
     bool bStartStreamHotkeyDown, bStopStreamHotkeyDown;
     bool bStartRecordingHotkeyDown, bStopRecordingHotkeyDown;
@@ -829,8 +861,12 @@ private:
     bool QueryAudioBuffers(bool bQueriedDesktopDebugParam);
     bool QueryNewAudio();
     void EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp);
+    void EncodeAudioPacket(AudioEncoder *encoder, List<FrameAudio> &audioFrames, float *buffer, UINT numFrames, QWORD timestamp);
     void MainAudioLoop();
 
+    static DWORD STDCALL RecordingAudioThread(LPVOID lpUnused);
+    void RecordingAudioLoop();
+
     //---------------------------------------------------
     // notification area icon
     UINT wmExplorerRestarted;
@@ -928,11 +964,14 @@ private:
     void Stop(bool overrideKeepRecording=false);
     bool StartRecording();
     void StopRecording();
+    void SaveTimeline();
 
     static void STDCALL StartStreamHotkey(DWORD hotkey, UPARAM param, bool bDown);
     static void STDCALL StopStreamHotkey(DWORD hotkey, UPARAM param, bool bDown);
     static void STDCALL StartRecordingHotkey(DWORD hotkey, UPARAM param, bool bDown);
     static void STDCALL StopRecordingHotkey(DWORD hotkey, UPARAM param, bool bDown);
+    static void STDCALL SaveReplayHotkey(DWORD hotkey, UPARAM param, bool bDown);
+    static void STDCALL SaveTimelineHotkey(DWORD hotkey, UPARAM param, bool bDown);
 
     static void STDCALL PushToTalkHotkey(DWORD hotkey, UPARAM param, bool bDown);
     static void STDCALL MuteMicHotkey(DWORD hotkey, UPARAM param, bool bDown);
@@ -1016,6 +1055,9 @@ public:
     OBS();
     virtual ~OBS();
 
+    void ReplayPacketLog(CTSTR lpLog, bool bRealTime, bool bStream);
+    UINT RunOutputTest(CTSTR lpDir);
+
     void ResizeWindow(bool bRedrawRenderFrame);
     void SetFullscreenMode(bool fullscreen);
 
@@ -1064,6 +1106,7 @@ public:
     inline Vect2 GetRenderFrameControlSize() const  {return Vect2(float(renderFrameCtrlWidth), float(renderFrameCtrlHeight));}
 
     inline AudioEncoder* GetAudioEncoder() const {return audioEncoder;}
+    inline AudioEncoder* GetRecordingAudioEncoder() const {return recordingAudioEncoder ? recordingAudioEncoder : audioEncoder;}
     inline VideoEncoder* GetVideoEncoder() const {return videoEncoder;}
 
     inline void EnterSceneMutex() {OSEnterMutex(hSceneMutex);}
@@ -1085,6 +1128,7 @@ public:
 
     inline void GetVideoHeaders(DataPacket &packet) {videoEncoder->GetHeaders(packet);}
     inline void GetAudioHeaders(DataPacket &packet) {audioEncoder->GetHeaders(packet);}
+    inline void GetRecordingAudioHeaders(DataPacket &packet) {GetRecordingAudioEncoder()->GetHeaders(packet);}
 
     inline void SetStreamReport(CTSTR lpStreamReport) {streamReport = lpStreamReport;}
 
@@ -43,6 +43,9 @@ NetworkStream* CreateNullNetwork();
 
 VideoFileStream* CreateMP4FileStream(CTSTR lpFile);
 VideoFileStream* CreateFLVFileStream(CTSTR lpFile);
+VideoFileStream* CreateTSFileStream(CTSTR lpFile);
+ReplayBuffer* CreateReplayBuffer(DWORD maxDuration, UINT64 maxMemory);
+VideoFileStream* CreatePacketTapStream();
 //VideoFileStream* CreateAVIFileStream(CTSTR lpFile);
 
 
@@ -145,6 +148,8 @@ bool OBS::StartRecording()
             fileStream = CreateFLVFileStream(strOutputFile);
         else if(strFileExtension.CompareI(TEXT("mp4")))
             fileStream = CreateMP4FileStream(strOutputFile);
+        else if(strFileExtension.CompareI(TEXT("ts")) || strFileExtension.CompareI(TEXT("m3u8")))
+            fileStream = CreateTSFileStream(strOutputFile);
 
         if(!fileStream)
         {
@@ -154,6 +159,11 @@ bool OBS::StartRecording()
             success = false;
         }
         else {
+            numFilePackets = numFileTimestampErrors = 0;
+            fileBytes = 0;
+            filePacketTime = maxFilePacketTime = 0;
+            lastFileVideoTimestamp = lastFileAudioTimestamp = 0;
+
             bRecording = true;
             ReportStartRecordingTrigger();
         }
@@ -178,11 +188,33 @@ void OBS::StopRecording()
     tempStream = NULL;
     bRecording = false;
 
+    if(numFilePackets)
+    {
+        Log(TEXT("Recording: %u packets, %g MB, AddPacket average %g us, max %g ms, %u out of order timestamps"),
+            numFilePackets, double(fileBytes)/(1024.0*1024.0), double(filePacketTime)/double(numFilePackets),
+            double(maxFilePacketTime)/1000.0, numFileTimestampErrors);
+    }
+
     ReportStopRecordingTrigger();
 
     SetWindowText(GetDlgItem(hwndMain, ID_TOGGLERECORDING), Str("MainWindow.StartRecording"));
 }
 
+//saves the last few seconds of the profiler timeline next to the logs
+void OBS::SaveTimeline()
+{
+    DWORD seconds = GlobalConfig->GetInt(TEXT("General"), TEXT("ProfileTimelineSeconds"), 10);
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+
+    String strFile;
+    strFile << lpAppDataPath << FormattedString(TEXT("\\logs\\%u-%02u-%02u-%02u%02u-%02u"), st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond) << TEXT(".json");
+
+    if(!SaveProfileTimeline(strFile, seconds))
+        Log(TEXT("Profiler: Timeline isn't enabled, set ProfileTimeline=1 under [General] in global.ini"));
+}
+
 void OBS::Start(bool recordingOnly)
 {
     if(bRunning && !bRecording) return;
@@ -236,6 +268,9 @@ void OBS::Start(bool recordingOnly)
 
     OSCheckForBuggyDLLs();
 
+    EnableAllocationProfiling(GlobalConfig->GetInt(TEXT("General"), TEXT("AllocationProfiling")) != 0);
+    EnableProfileTimeline(GlobalConfig->GetInt(TEXT("General"), TEXT("ProfileTimeline")) != 0);
+
     //-------------------------------------------------------------
 retryHookTest:
     bool alreadyWarnedAboutModules = false;
@@ -610,6 +645,34 @@ retryHookTestV2:
 #endif
         audioEncoder = CreateMP3Encoder(bitRate);
 
+    if (!bDisableEncoding && !bTestStream)
+    {
+        String strRecordingEncoder = AppConfig->GetString(TEXT("Audio Encoding"), TEXT("RecordingCodec"), strEncoder);
+        UINT recordingBitRate = (UINT)AppConfig->GetInt(TEXT("Audio Encoding"), TEXT("RecordingBitrate"), bitRate);
+
+        BOOL isRecordingAAC = strRecordingEncoder.CompareI(TEXT("AAC"));
+        if (isRecordingAAC != isAAC || recordingBitRate != bitRate)
+        {
+#ifdef USE_AAC
+            if(isRecordingAAC)
+                recordingAudioEncoder = CreateAACEncoder(recordingBitRate);
+            else
+#endif
+                recordingAudioEncoder = CreateMP3Encoder(recordingBitRate);
+
+            bRecordingAudioExit = false;
+            hRecordingAudioStart = CreateEvent(NULL, FALSE, FALSE, NULL);
+            hRecordingAudioDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+            hRecordingAudioThread = OSCreateThread((XTHREAD)OBS::RecordingAudioThread, NULL);
+
+            Log(TEXT("Recording audio: %s at %u kb/s, stream audio: %s at %u kb/s"), recordingAudioEncoder->GetCodec(),
+                recordingBitRate, audioEncoder->GetCodec(), bitRate);
+        }
+    }
+
+    numAudioEncodes = 0;
+    audioEncodeTime = recordingAudioEncodeTime = 0;
+
     //-------------------------------------------------------------
 
     desktopVol = AppConfig->GetFloat(TEXT("Audio"), TEXT("DesktopVolume"), 1.0f);
@@ -727,6 +790,18 @@ retryHookTestV2:
 
     //-------------------------------------------------------------
 
+    int replaySeconds = AppConfig->GetInt(TEXT("Publish"), TEXT("ReplayBufferSeconds"), 0);
+    if(replaySeconds > 0 && !bTestStream)
+    {
+        UINT64 replayMaxMemory = UINT64(AppConfig->GetInt(TEXT("Publish"), TEXT("ReplayBufferMaxMB"), 512))*1024*1024;
+        replayBuffer = CreateReplayBuffer(DWORD(replaySeconds)*1000, replayMaxMemory);
+    }
+
+    if(AppConfig->GetInt(TEXT("Publish"), TEXT("PacketTap"), 0) && !bTestStream)
+        packetTap = CreatePacketTapStream();
+
+    //-------------------------------------------------------------
+
     if (!StartRecording() && !bStreaming)
     {
         Stop(true);
@@ -857,12 +932,46 @@ void OBS::Stop(bool overrideKeepRecording)
     
     if(bRecording) StopRecording();
 
+    //waits for a replay that's still being saved, which needs the encoders
+    ReplayBuffer *tempReplayBuffer = replayBuffer;
+    replayBuffer = NULL;
+    delete tempReplayBuffer;
+
+    VideoFileStream *tempPacketTap = packetTap;
+    packetTap = NULL;
+    delete tempPacketTap;
+
     delete micAudio;
     micAudio = NULL;
 
     delete desktopAudio;
     desktopAudio = NULL;
 
+    if(hRecordingAudioThread)
+    {
+        bRecordingAudioExit = true;
+        SetEvent(hRecordingAudioStart);
+
+        OSWaitForThread(hRecordingAudioThread, NULL);
+        OSCloseThread(hRecordingAudioThread);
+        CloseHandle(hRecordingAudioStart);
+        CloseHandle(hRecordingAudioDone);
+
+        hRecordingAudioThread = hRecordingAudioStart = hRecordingAudioDone = NULL;
+    }
+
+    if(numAudioEncodes)
+    {
+        if(recordingAudioEncoder)
+            Log(TEXT("Audio encoding: stream %g us, recording %g us per segment on average"),
+                double(audioEncodeTime)/double(numAudioEncodes), double(recordingAudioEncodeTime)/double(numAudioEncodes));
+        else
+            Log(TEXT("Audio encoding: %g us per segment on average"), double(audioEncodeTime)/double(numAudioEncodes));
+    }
+
+    delete recordingAudioEncoder;
+    recordingAudioEncoder = NULL;
+
     delete audioEncoder;
     audioEncoder = NULL;
 
@@ -875,6 +984,10 @@ void OBS::Stop(bool overrideKeepRecording)
         pendingAudioFrames[i].audioData.Clear();
     pendingAudioFrames.Clear();
 
+    for(UINT i=0; i<pendingRecordingAudioFrames.Num(); i++)
+        pendingRecordingAudioFrames[i].audioData.Clear();
+    pendingRecordingAudioFrames.Clear();
+
     //-------------------------------------------------------------
 
     if(GS)
@@ -960,7 +1073,10 @@ void OBS::Stop(bool overrideKeepRecording)
     ClearStreamInfo();
 
     DumpProfileData();
+    DumpAllocationProfileData();
     FreeProfileData();
+    EnableAllocationProfiling(FALSE);
+    EnableProfileTimeline(FALSE);
     Log(TEXT("=====Stream End: %s================================================="), CurrentDateTimeString().Array());
 
     //update notification icon to reflect current status
@@ -995,6 +1111,7 @@ void OBS::Stop(bool overrideKeepRecording)
 
 DWORD STDCALL OBS::MainAudioThread(LPVOID lpUnused)
 {
+    allocationTag("audio");
     CoInitialize(0);
     App->MainAudioLoop();
     CoUninitialize();
@@ -1003,62 +1120,6 @@ DWORD STDCALL OBS::MainAudioThread(LPVOID lpUnused)
 
 #define INVALID_LL 0xFFFFFFFFFFFFFFFFLL
 
-inline void CalculateVolumeLevels(float *buffer, int totalFloats, float mulVal, float &RMS, float &MAX)
-{
-    float sum = 0.0f;
-    int totalFloatsStore = totalFloats;
-
-    float Max = 0.0f;
-
-    if((UPARAM(buffer) & 0xF) == 0)
-    {
-        UINT alignedFloats = totalFloats & 0xFFFFFFFC;
-        __m128 sseMulVal = _mm_set_ps1(mulVal);
-
-        for(UINT i=0; i<alignedFloats; i += 4)
-        {
-            __m128 sseScaledVals = _mm_mul_ps(_mm_load_ps(buffer+i), sseMulVal);
-
-            /*compute squares and add them to the sum*/
-            __m128 sseSquares = _mm_mul_ps(sseScaledVals, sseScaledVals);
-            sum += sseSquares.m128_f32[0] + sseSquares.m128_f32[1] + sseSquares.m128_f32[2] + sseSquares.m128_f32[3];
-
-            /* 
-                sse maximum of squared floats 
-                concept from: http://stackoverflow.com/questions/9795529/how-to-find-the-horizontal-maximum-in-a-256-bit-avx-vector
-            */
-            __m128 sseSquaresP = _mm_shuffle_ps(sseSquares, sseSquares, _MM_SHUFFLE(1, 0, 3, 2));
-            __m128 halfmax = _mm_max_ps(sseSquares, sseSquaresP);
-            __m128 halfmaxP = _mm_shuffle_ps(halfmax, halfmax, _MM_SHUFFLE(0,1,2,3));
-            __m128 maxs = _mm_max_ps(halfmax, halfmaxP);
-
-            Max = max(Max, maxs.m128_f32[0]);
-        }
-
-        buffer      += alignedFloats;
-        totalFloats -= alignedFloats;
-    }
-
-    for(int i=0; i<totalFloats; i++)
-    {
-        float val = buffer[i] * mulVal;
-        float pow2Val = val * val;
-        sum += pow2Val;
-        Max = max(Max, pow2Val);
-    }
-
-    RMS = sqrt(sum / totalFloatsStore);
-    MAX = sqrt(Max);
-}
-
-inline float toDB(float RMS)
-{
-    float db = 20.0f * log10(RMS);
-    if(!_finite(db))
-        return VOL_MIN;
-    return db;
-}
-
 bool OBS::QueryAudioBuffers(bool bQueriedDesktopDebugParam)
 {
     bool bGotSomeAudio = false;
@@ -1155,14 +1216,14 @@ bool OBS::QueryNewAudio()
     return bAudioBufferFilled;
 }
 
-void OBS::EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp)
+void OBS::EncodeAudioPacket(AudioEncoder *encoder, List<FrameAudio> &audioFrames, float *buffer, UINT numFrames, QWORD timestamp)
 {
     DataPacket packet;
-    if(audioEncoder->Encode(buffer, numFrames, packet, timestamp))
+    if(encoder->Encode(buffer, numFrames, packet, timestamp))
     {
         OSEnterMutex(hSoundDataMutex);
 
-        FrameAudio *frameAudio = pendingAudioFrames.CreateNew();
+        FrameAudio *frameAudio = audioFrames.CreateNew();
         frameAudio->audioData.CopyArray(packet.lpPacket, packet.size);
         frameAudio->timestamp = timestamp;
 
@@ -1170,6 +1231,51 @@ void OBS::EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp)
     }
 }
 
+void OBS::EncodeAudioSegment(float *buffer, UINT numFrames, QWORD timestamp)
+{
+    //both encoders read the same mix buffer, so the recording encoder has to be done before it's reused
+    if(recordingAudioEncoder)
+    {
+        recordingAudioBuffer = buffer;
+        recordingAudioNumFrames = numFrames;
+        recordingAudioTimestamp = timestamp;
+        SetEvent(hRecordingAudioStart);
+    }
+
+    QWORD startTime = OSGetTimeMicroseconds();
+    EncodeAudioPacket(audioEncoder, pendingAudioFrames, buffer, numFrames, timestamp);
+    audioEncodeTime += OSGetTimeMicroseconds()-startTime;
+    numAudioEncodes++;
+
+    if(recordingAudioEncoder)
+        WaitForSingleObject(hRecordingAudioDone, INFINITE);
+}
+
+DWORD STDCALL OBS::RecordingAudioThread(LPVOID lpUnused)
+{
+    allocationTag("recording audio");
+    CoInitialize(0);
+    App->RecordingAudioLoop();
+    CoUninitialize();
+    return 0;
+}
+
+void OBS::RecordingAudioLoop()
+{
+    while(true)
+    {
+        WaitForSingleObject(hRecordingAudioStart, INFINITE);
+        if(bRecordingAudioExit)
+            break;
+
+        QWORD startTime = OSGetTimeMicroseconds();
+        EncodeAudioPacket(recordingAudioEncoder, pendingRecordingAudioFrames, recordingAudioBuffer, recordingAudioNumFrames, recordingAudioTimestamp);
+        recordingAudioEncodeTime += OSGetTimeMicroseconds()-startTime;
+
+        SetEvent(hRecordingAudioDone);
+    }
+}
+
 void OBS::MainAudioLoop()
 {
     const unsigned int audioSamplesPerSec = App->GetSampleRateHz();
@@ -1182,16 +1288,13 @@ void OBS::MainAudioLoop()
 
     bPushToTalkOn = false;
 
-    micMax = desktopMax = VOL_MIN;
-    micPeak = desktopPeak = VOL_MIN;
+    desktopMeter.Reset();
+    micMeter.Reset();
 
     UINT audioFramesSinceMeterUpdate = 0;
-    UINT audioFramesSinceMicMaxUpdate = 0;
-    UINT audioFramesSinceDesktopMaxUpdate = 0;
 
-    List<float> mixBuffer, levelsBuffer;
+    List<float> mixBuffer;
     mixBuffer.SetSize(audioSampleSize*2);
-    levelsBuffer.SetSize(audioSampleSize*2);
 
     latestAudioTime = 0;
 
@@ -1224,46 +1327,24 @@ void OBS::MainAudioLoop()
             QWORD timestamp = bufferedAudioTimes[0];
             bufferedAudioTimes.Remove(0);
 
-            zero(mixBuffer.Array(),    audioSampleSize*2*sizeof(float));
-            zero(levelsBuffer.Array(), audioSampleSize*2*sizeof(float));
+            zero(mixBuffer.Array(), audioSampleSize*2*sizeof(float));
 
             //----------------------------------------------------------------------------
-            // get latest sample for calculating the volume levels
-
-            float *latestDesktopBuffer = NULL, *latestMicBuffer = NULL;
+            // mix desktop samples
 
             desktopAudio->GetBuffer(&desktopBuffer, timestamp);
-            desktopAudio->GetNewestFrame(&latestDesktopBuffer);
 
-            if (micAudio != NULL) {
+            if (micAudio != NULL)
                 micAudio->GetBuffer(&micBuffer, timestamp);
-                micAudio->GetNewestFrame(&latestMicBuffer);
-            }
-
-            //----------------------------------------------------------------------------
-            // mix desktop samples
 
             if (desktopBuffer)
                 MixAudio(mixBuffer.Array(), desktopBuffer, audioSampleSize*2, false);
 
-            if (latestDesktopBuffer)
-                MixAudio(levelsBuffer.Array(), latestDesktopBuffer, audioSampleSize*2, false);
-
             //----------------------------------------------------------------------------
-            // get latest aux volume level samples and mix
+            // mix output aux sound samples with the desktop
 
             OSEnterMutex(hAuxAudioMutex);
 
-            for (UINT i=0; i<auxAudioSources.Num(); i++) {
-                float *latestAuxBuffer;
-
-                if(auxAudioSources[i]->GetNewestFrame(&latestAuxBuffer))
-                    MixAudio(levelsBuffer.Array(), latestAuxBuffer, audioSampleSize*2, false);
-            }
-
-            //----------------------------------------------------------------------------
-            // mix output aux sound samples with the desktop
-
             for (UINT i=0; i<auxAudioSources.Num(); i++) {
                 float *auxBuffer;
 
@@ -1271,75 +1352,42 @@ void OBS::MainAudioLoop()
                     MixAudio(mixBuffer.Array(), auxBuffer, audioSampleSize*2, false);
             }
 
-            OSLeaveMutex(hAuxAudioMutex);
-
             //----------------------------------------------------------------------------
-            // multiply samples by volume and compute RMS and max of samples
-            // Use 1.0f instead of curDesktopVol, since aux audio sources already have their volume set, and shouldn't be boosted anyway.
-
-            float desktopRMS = 0, micRMS = 0, desktopMx = 0, micMx = 0;
-            if (latestDesktopBuffer)
-                CalculateVolumeLevels(levelsBuffer.Array(), audioSampleSize*2, 1.0f, desktopRMS, desktopMx);
-            if (bMicEnabled && latestMicBuffer)
-                CalculateVolumeLevels(latestMicBuffer, audioSampleSize*2, curMicVol, micRMS, micMx);
-
-            //----------------------------------------------------------------------------
-            // convert RMS and Max of samples to dB 
-
-            desktopRMS = toDB(desktopRMS);
-            micRMS = toDB(micRMS);
-            desktopMx = toDB(desktopMx);
-            micMx = toDB(micMx);
-
-            //----------------------------------------------------------------------------
-            // update max if sample max is greater or after 1 second
-
-            float maxAlpha = 0.15f;
-            UINT peakMeterDelayFrames = audioSamplesPerSec * 3;
+            // the desktop meter has to see the mix rather than each source on its own, since
+            // sources that play at the same time add up to more than their average.
+            // aux sources already have their volume applied, so this is measured at 1.0
 
-            if (micMx > micMax)
-                micMax = micMx;
-            else
-                micMax = maxAlpha * micMx + (1.0f - maxAlpha) * micMax;
-
-            if(desktopMx > desktopMax)
-                desktopMax = desktopMx;
-            else
-                desktopMax = maxAlpha * desktopMx + (1.0f - maxAlpha) * desktopMax;
+            double desktopSumSquares = 0.0;
+            float desktopPeakSquared = 0.0f;
+            CalculateAudioLevels(mixBuffer.Array(), audioSampleSize*2, 1.0f, desktopSumSquares, desktopPeakSquared);
+            desktopMeter.Accumulate(desktopSumSquares, desktopPeakSquared, audioSampleSize*2);
 
             //----------------------------------------------------------------------------
-            // update delayed peak meter
+            // update the meters about every 50ms.  sources measure their own levels as their
+            // segments come in, so all that's left here is the dB conversion and smoothing
 
-            if (micMax > micPeak || audioFramesSinceMicMaxUpdate > peakMeterDelayFrames) {
-                micPeak = micMax;
-                audioFramesSinceMicMaxUpdate = 0;
-            } else {
-                audioFramesSinceMicMaxUpdate += audioSampleSize;
-            }
+            audioFramesSinceMeterUpdate += audioSampleSize;
+            if (audioFramesSinceMeterUpdate >= (audioSampleSize*5)) {
+                desktopAudio->GetLevelMeter().Update(audioFramesSinceMeterUpdate, audioSamplesPerSec);
 
-            if (desktopMax > desktopPeak || audioFramesSinceDesktopMaxUpdate > peakMeterDelayFrames) {
-                desktopPeak = desktopMax;
-                audioFramesSinceDesktopMaxUpdate = 0;
-            } else {
-                audioFramesSinceDesktopMaxUpdate += audioSampleSize;
-            }
+                for (UINT i=0; i<auxAudioSources.Num(); i++)
+                    auxAudioSources[i]->GetLevelMeter().Update(audioFramesSinceMeterUpdate, audioSamplesPerSec);
 
-            //----------------------------------------------------------------------------
-            // low pass the level sampling
-
-            float rmsAlpha = 0.15f;
-            desktopMag = rmsAlpha * desktopRMS + desktopMag * (1.0f - rmsAlpha);
-            micMag = rmsAlpha * micRMS + micMag * (1.0f - rmsAlpha);
+                if (bMicEnabled) {
+                    AudioLevelMeter &micLevels = micAudio->GetLevelMeter();
+                    micMeter.Accumulate(micLevels);
+                    micLevels.Update(audioFramesSinceMeterUpdate, audioSamplesPerSec);
+                }
 
-            //----------------------------------------------------------------------------
-            // update the meter about every 50ms
+                desktopMeter.Update(audioFramesSinceMeterUpdate, audioSamplesPerSec);
+                micMeter.Update(audioFramesSinceMeterUpdate, audioSamplesPerSec);
 
-            audioFramesSinceMeterUpdate += audioSampleSize;
-            if (audioFramesSinceMeterUpdate >= (audioSampleSize*5)) {
                 PostMessage(hwndMain, WM_COMMAND, MAKEWPARAM(ID_MICVOLUMEMETER, VOLN_METERED), 0);
                 audioFramesSinceMeterUpdate = 0;
             }
 
+            OSLeaveMutex(hAuxAudioMutex);
+
             //----------------------------------------------------------------------------
             // mix mic and desktop sound
             // also, it's perfectly fine to just mix into the returned buffer
@@ -1356,13 +1404,15 @@ void OBS::MainAudioLoop()
             bRecievedFirstAudioFrame = true;
     }
 
-    desktopMag = desktopMax = desktopPeak = VOL_MIN;
-    micMag = micMax = micPeak = VOL_MIN;
+    desktopMeter.Reset();
+    micMeter.Reset();
 
     PostMessage(hwndMain, WM_COMMAND, MAKEWPARAM(ID_MICVOLUMEMETER, VOLN_METERED), 0);
 
     for (UINT i=0; i<pendingAudioFrames.Num(); i++)
         pendingAudioFrames[i].audioData.Clear();
+    for (UINT i=0; i<pendingRecordingAudioFrames.Num(); i++)
+        pendingRecordingAudioFrames[i].audioData.Clear();
 
     AvRevertMmThreadCharacteristics(hTask);
 }
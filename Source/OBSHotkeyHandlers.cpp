@@ -81,6 +81,18 @@ void STDCALL OBS::StopRecordingHotkey(DWORD hotkey, UPARAM param, bool bDown)
     }
 }
 
+void STDCALL OBS::SaveReplayHotkey(DWORD hotkey, UPARAM param, bool bDown)
+{
+    if (bDown && App->bRunning && App->replayBuffer)
+        App->replayBuffer->SaveReplay();
+}
+
+void STDCALL OBS::SaveTimelineHotkey(DWORD hotkey, UPARAM param, bool bDown)
+{
+    if (bDown && App->bRunning)
+        App->SaveTimeline();
+}
+
 void STDCALL OBS::PushToTalkHotkey(DWORD hotkey, UPARAM param, bool bDown)
 {
     if(bDown)
@@ -35,12 +35,14 @@ void Convert444toNV12(LPBYTE input, int width, int inPitch, int outPitch, int he
 
 DWORD STDCALL OBS::EncodeThread(LPVOID lpUnused)
 {
+    allocationTag("encode");
     App->EncodeLoop();
     return 0;
 }
 
 DWORD STDCALL OBS::MainCaptureThread(LPVOID lpUnused)
 {
+    allocationTag("video");
     App->MainCaptureLoop();
     return 0;
 }
@@ -125,58 +127,79 @@ struct FrameProcessInfo
     QWORD firstFrameTime;
 };
 
-void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
+void OBS::SendAudioFrames(List<FrameAudio> &audioFrames, DWORD &lastTimestamp, DWORD videoTimestamp, QWORD firstFrameTime, bool bStreamOutput, bool bRecordingOutputs)
 {
-    if(!bSentHeaders)
+    while(audioFrames.Num())
     {
-        if(network && curSegment.packets[0].data[0] == 0x17) {
-            network->BeginPublishing();
-            bSentHeaders = true;
-        }
-    }
+        if(firstFrameTime < audioFrames[0].timestamp)
+        {
+            UINT audioTimestamp = UINT(audioFrames[0].timestamp-firstFrameTime);
 
-    OSEnterMutex(hSoundDataMutex);
+            //stop sending audio packets when we reach an audio timestamp greater than the video timestamp
+            if(audioTimestamp > videoTimestamp)
+                break;
 
-    if(pendingAudioFrames.Num())
-    {
-        while(pendingAudioFrames.Num())
-        {
-            if(firstFrameTime < pendingAudioFrames[0].timestamp)
+            if(audioTimestamp == 0 || audioTimestamp > lastTimestamp)
             {
-                UINT audioTimestamp = UINT(pendingAudioFrames[0].timestamp-firstFrameTime);
+                List<BYTE> &audioData = audioFrames[0].audioData;
+                if(audioData.Num())
+                {
+                    //Log(TEXT("a:%u, %llu"), audioTimestamp, frameInfo.firstFrameTime+audioTimestamp);
 
-                //stop sending audio packets when we reach an audio timestamp greater than the video timestamp
-                if(audioTimestamp > curSegment.timestamp)
-                    break;
+                    if(bStreamOutput && network)
+                        network->SendPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
 
-                if(audioTimestamp == 0 || audioTimestamp > lastAudioTimestamp)
-                {
-                    List<BYTE> &audioData = pendingAudioFrames[0].audioData;
-                    if(audioData.Num())
+                    if(bRecordingOutputs)
                     {
-                        //Log(TEXT("a:%u, %llu"), audioTimestamp, frameInfo.firstFrameTime+audioTimestamp);
-
-                        if(network)
-                            network->SendPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
-                        if(fileStream)
-                            fileStream->AddPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
+                        VideoFileStream *curFileStream = fileStream;
+                        if(curFileStream)
+                            AddFilePacket(curFileStream, audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
+                        if(replayBuffer)
+                            replayBuffer->AddPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
+                        if(packetTap)
+                            packetTap->AddPacket(audioData.Array(), audioData.Num(), audioTimestamp, PacketType_Audio);
+                    }
 
-                        audioData.Clear();
+                    audioData.Clear();
 
-                        lastAudioTimestamp = audioTimestamp;
-                    }
+                    lastTimestamp = audioTimestamp;
                 }
             }
-            else
-                nop();
+        }
+        else
+            nop();
 
-            pendingAudioFrames[0].audioData.Clear();
-            pendingAudioFrames.Remove(0);
+        audioFrames[0].audioData.Clear();
+        audioFrames.Remove(0);
+    }
+}
+
+void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
+{
+    if(!bSentHeaders)
+    {
+        if(network && curSegment.packets[0].data[0] == 0x17) {
+            network->BeginPublishing();
+            bSentHeaders = true;
         }
     }
 
+    OSEnterMutex(hSoundDataMutex);
+
+    //with a separate recording encoder, the stream and the recording outputs each get their own audio
+    if(recordingAudioEncoder)
+    {
+        SendAudioFrames(pendingAudioFrames, lastAudioTimestamp, curSegment.timestamp, firstFrameTime, true, false);
+        SendAudioFrames(pendingRecordingAudioFrames, lastRecordingAudioTimestamp, curSegment.timestamp, firstFrameTime, false, true);
+    }
+    else
+        SendAudioFrames(pendingAudioFrames, lastAudioTimestamp, curSegment.timestamp, firstFrameTime, true, true);
+
     OSLeaveMutex(hSoundDataMutex);
 
+    //StopRecording can clear fileStream at any time, so it's only read once here
+    VideoFileStream *curFileStream = fileStream;
+
     for(UINT i=0; i<curSegment.packets.Num(); i++)
     {
         VideoPacketData &packet = curSegment.packets[i];
@@ -188,11 +211,40 @@ void OBS::SendFrame(VideoSegment &curSegment, QWORD firstFrameTime)
 
         if(network)
             network->SendPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
-        if(fileStream)
-            fileStream->AddPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
+        if(curFileStream)
+            AddFilePacket(curFileStream, packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
+        if(replayBuffer)
+            replayBuffer->AddPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
+        if(packetTap)
+            packetTap->AddPacket(packet.data.Array(), packet.data.Num(), curSegment.timestamp, packet.type);
     }
 }
 
+//times each write and checks that timestamps never go backwards, a file stream that
+//falls behind here holds up the encode thread
+void OBS::AddFilePacket(VideoFileStream *stream, BYTE *data, UINT size, DWORD timestamp, PacketType type)
+{
+    DWORD &lastTimestamp = (type == PacketType_Audio) ? lastFileAudioTimestamp : lastFileVideoTimestamp;
+    if(numFilePackets && timestamp < lastTimestamp)
+    {
+        if(!numFileTimestampErrors++)
+            Log(TEXT("AddFilePacket: %s timestamp went backwards (%u after %u)"),
+                (type == PacketType_Audio) ? TEXT("audio") : TEXT("video"), timestamp, lastTimestamp);
+    }
+    lastTimestamp = timestamp;
+
+    QWORD startTime = OSGetTimeMicroseconds();
+    stream->AddPacket(data, size, timestamp, type);
+    QWORD packetTime = OSGetTimeMicroseconds()-startTime;
+
+    filePacketTime += packetTime;
+    if(packetTime > maxFilePacketTime)
+        maxFilePacketTime = packetTime;
+
+    fileBytes += size;
+    numFilePackets++;
+}
+
 bool OBS::ProcessFrame(FrameProcessInfo &frameInfo)
 {
     List<DataPacket> videoPackets;
@@ -539,6 +591,15 @@ void OBS::MainCaptureLoop()
     bool bLogLongFramesProfile = GlobalConfig->GetInt(TEXT("General"), TEXT("LogLongFramesProfile"), LOGLONGFRAMESDEFAULT) != 0;
     float logLongFramesProfilePercentage = GlobalConfig->GetFloat(TEXT("General"), TEXT("LogLongFramesProfilePercentage"), 10.f);
 
+    //only does anything with AllocationProfiling on
+    UINT logTopAllocatorsSeconds = GlobalConfig->GetInt(TEXT("General"), TEXT("LogTopAllocatorsSeconds"));
+    UINT topAllocatorsSeconds = 0;
+
+    //long frames save the profiler timeline too, at most once per timeline length so the saves don't overlap
+    bool bProfileTimeline = GlobalConfig->GetInt(TEXT("General"), TEXT("ProfileTimeline")) != 0;
+    QWORD profileTimelineLength = QWORD(GlobalConfig->GetInt(TEXT("General"), TEXT("ProfileTimelineSeconds"), 10))*1000000;
+    QWORD lastTimelineSaveTime = 0;
+
     Vect2 baseSize    = Vect2(float(baseCX), float(baseCY));
     Vect2 outputSize  = Vect2(float(outputCX), float(outputCY));
     Vect2 scaleSize   = Vect2(float(scaleCX), float(scaleCY));
@@ -603,7 +664,7 @@ void OBS::MainCaptureLoop()
     bool bWasLaggedFrame = false;
 
     totalStreamTime = 0;
-    lastAudioTimestamp = 0;
+    lastAudioTimestamp = lastRecordingAudioTimestamp = 0;
 
     //----------------------------------------
     // start audio capture streams
@@ -808,6 +869,12 @@ void OBS::MainCaptureLoop()
             fpsCounter = 0;
 
             bUpdateBPS = true;
+
+            if(logTopAllocatorsSeconds && ++topAllocatorsSeconds >= logTopAllocatorsSeconds)
+            {
+                LogTopAllocators(5);
+                topAllocatorsSeconds = 0;
+            }
         }
 
         fpsCounter++;
@@ -1245,7 +1312,16 @@ void OBS::MainCaptureLoop()
         {
             numLongFrames++;
             if(bLogLongFramesProfile && (numLongFrames/float(max(1, numTotalFrames)) * 100.) > logLongFramesProfilePercentage)
+            {
                 DumpLastProfileData();
+
+                QWORD curTime = OSGetTimeMicroseconds();
+                if(bProfileTimeline && (!lastTimelineSaveTime || curTime-lastTimelineSaveTime >= profileTimelineLength))
+                {
+                    SaveTimeline();
+                    lastTimelineSaveTime = curTime;
+                }
+            }
         }
 
         //OSDebugOut(TEXT("Frame adjust time: %d, "), frameTimeAdjust-totalTime);
@@ -0,0 +1,2166 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+#include "RTMPStuff.h"
+#include <algorithm>
+
+
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile);
+VideoFileStream* CreateFLVFileStream(CTSTR lpFile);
+VideoFileStream* CreateTSFileStream(CTSTR lpFile);
+void WaitForMP4FileStreams();
+
+//integrity and throughput test for the file outputs, run with -outputtest [directory].
+//
+//synthetic AVC/AAC packet sequences are fed to each output the way SendFrame hands them over, then
+//the file is read back with the minimal FLV, MP4 and TS readers below and checked against what was
+//sent: every frame's order, timestamps, composition offset, keyframe flag and contents, and the indexes
+//a player seeks with (the FLV keyframe list, the MP4 sample tables or fragment runs).  transport
+//streams also get their PAT/PMT, PCR and continuity counters checked, and HLS output its playlist.
+//each case also reports its write throughput and how long AddPacket held up the caller.
+//
+//it runs inside OBS like -replaypackets does, because the outputs take their headers and settings
+//from the encoders through App.
+
+#define OUTPUT_TEST_SAMPLE_RATE     44100
+#define OUTPUT_TEST_AUDIO_FRAME     1024
+
+//audio is placed by sample count and only pulled forward to its timestamp after a gap, and a
+//millisecond timestamp is only worth 44 samples.  a sample placed a whole frame off is a real error
+#define MAX_AUDIO_TIME_ERROR        (OUTPUT_TEST_AUDIO_FRAME/4)
+
+#define OUTPUT_TEST_HLS_SEGMENT_SECONDS 2
+#define OUTPUT_TEST_HLS_PLAYLIST_SIZE   3
+
+//these have to match TSFileStream
+#define TS_TEST_PACKET_SIZE         188
+#define TS_TEST_PTS_OFFSET          63000
+#define TS_TEST_STREAM_H264         0x1B
+#define TS_TEST_STREAM_AAC          0x0F
+#define HLS_TEST_DELETE_DELAY       2
+
+#define TS_TEST_NO_PID              0x1FFF
+
+//the longest ISO 13818-1 allows between PCRs, and how far ahead of the PCR a frame can be sent (in 90khz)
+#define MAX_PCR_INTERVAL            9000
+#define MAX_PCR_LEAD                90000
+
+//after this many problems in one stream the rest are only counted
+#define MAX_REPORTED_STREAM_ERRORS  5
+
+//stand-in headers, nothing decodes them.  the AAC config is LC, 44.1khz, stereo
+static const BYTE testSPS[] = {0x67, 0x64, 0x00, 0x1F, 0xAC, 0xD9, 0x40, 0x50, 0x05, 0xBB, 0x01, 0x10, 0x00, 0x00, 0x03, 0x00, 0x10, 0x00, 0x00, 0x03, 0x03, 0xC0, 0xF1, 0x83, 0x19, 0x60};
+static const BYTE testPPS[] = {0x68, 0xEB, 0xE3, 0xCB, 0x22, 0xC0};
+static const BYTE testSEI[] = {0x00, 0x00, 0x00, 0x0A, 0x06, 0x05, 0x06, 'o', 'b', 's', 't', 'e', 's', 0x80};
+static const BYTE testAudioHeaders[] = {0xAF, 0x00, 0x12, 0x10};
+
+enum OutputTestFormat
+{
+    OutputTest_FLV,
+    OutputTest_MP4,
+    OutputTest_FragmentedMP4,
+    OutputTest_TS,
+    OutputTest_HLS,
+    OutputTest_HLSRolling,
+
+    OutputTest_NumFormats
+};
+
+static CTSTR outputTestFormatNames[] = {TEXT("flv"), TEXT("mp4"), TEXT("fragmented-mp4"), TEXT("ts"), TEXT("hls"), TEXT("hls-rolling")};
+
+struct OutputTestScenario
+{
+    CTSTR lpName;
+    UINT seconds, fps;
+    UINT keyframeInterval;      //frames
+    UINT numBFrames;
+    UINT frameBytes;            //average for a P frame, keyframes are four times that and B frames half
+    UINT hugeKeyframeBytes;     //if set, every keyframe is about this big
+    bool bAudio;
+    DWORD audioGapStart, audioGapEnd;   //milliseconds with no audio
+    DWORD startTimestamp;       //timestamps carry on from here, wrapping past 0xFFFFFFFF
+    bool bSplitKeyframes;       //keyframes come in two packets with the same timestamp
+};
+
+static const OutputTestScenario outputTestScenarios[] =
+{
+    //name                  sec  fps  key  b  bytes   huge            audio  gap         start               split
+    {TEXT("basic"),          10,  30,  60, 0, 10000,  0,              true,  0,    0,    1000,               false},
+    {TEXT("bframes"),        10,  30,  60, 2, 10000,  0,              true,  0,    0,    1000,               false},
+    {TEXT("splitkeyframes"), 10,  30,  60, 2, 10000,  0,              true,  0,    0,    1000,               true},
+    {TEXT("noaudio"),        10,  30,  60, 0, 10000,  0,              false, 0,    0,    1000,               false},
+    {TEXT("audiogap"),       10,  30,  60, 2, 10000,  0,              true,  3000, 5500, 1000,               false},
+    {TEXT("wrap"),           10,  30,  60, 2, 10000,  0,              true,  0,    0,    0xFFFFFFFF-4000,    false},
+    {TEXT("hugekeyframes"),   6,  30,  30, 0, 10000,  6*1024*1024,    true,  0,    0,    1000,               false},
+    {TEXT("throughput"),     60,  60, 120, 2, 12500,  0,              true,  0,    0,    1000,               false},
+};
+
+//-------------------------------------------------------------------
+
+struct TestPacket
+{
+    PacketType type;
+    DWORD timestamp;            //as sent
+    DWORD relTimestamp;         //from the first keyframe
+    List<BYTE> data;
+};
+
+//what a packet sequence should come out as in an mp4.  video packets with the same timestamp make one sample
+struct ExpectedSample
+{
+    DWORD timestamp;
+    INT compositionOffset;
+    bool bKeyframe;
+    UINT size;
+    UINT firstPacket, numPackets;
+};
+
+static DWORD outputTestRandState = 1;
+
+static inline DWORD OutputTestRand()
+{
+    outputTestRandState ^= outputTestRandState << 13;
+    outputTestRandState ^= outputTestRandState >> 17;
+    outputTestRandState ^= outputTestRandState << 5;
+    return outputTestRandState;
+}
+
+//never zero, so no payload can contain a start code once it's been turned into annex b
+static void FillPayload(LPBYTE lpData, UINT size)
+{
+    for(UINT i=0; i<size; i++)
+        lpData[i] = BYTE(1 + OutputTestRand()%255);
+}
+
+static inline DWORD OutputTestFrameTime(UINT frame, UINT fps)
+{
+    return DWORD(UINT64(frame)*1000/fps);
+}
+
+static inline DWORD OutputTestAudioTime(UINT frame)
+{
+    return DWORD(UINT64(frame)*OUTPUT_TEST_AUDIO_FRAME*1000/OUTPUT_TEST_SAMPLE_RATE);
+}
+
+//display position of the nth frame of a gop in decode order.  each anchor is sent ahead of the B
+//frames that come before it, the tail of a gop too short for a full group is all P frames
+static UINT DisplayIndex(UINT n, UINT gopLength, UINT numBFrames)
+{
+    if(!n || !numBFrames)
+        return n;
+
+    UINT groupStart = 1 + ((n-1)/(numBFrames+1))*(numBFrames+1);
+    UINT pos = (n-1)%(numBFrames+1);
+
+    if(groupStart+numBFrames >= gopLength)
+        return n;
+
+    return pos ? groupStart+pos-1 : groupStart+numBFrames;
+}
+
+static inline INT ReadCompositionOffset(const BYTE *lpData)
+{
+    INT offset = (lpData[2]<<16) | (lpData[3]<<8) | lpData[4];
+    if(offset & 0x800000)
+        offset |= 0xFF000000;
+    return offset;
+}
+
+static void AddVideoFrame(const OutputTestScenario &scenario, UINT frame, UINT numFrames, List<TestPacket> &packets)
+{
+    UINT gopStart = frame - frame%scenario.keyframeInterval;
+    UINT gopLength = MIN(scenario.keyframeInterval, numFrames-gopStart);
+    UINT pos = frame-gopStart;
+    UINT display = DisplayIndex(pos, gopLength, scenario.numBFrames);
+
+    bool bKeyframe = (pos == 0);
+    bool bBFrame = (display < pos);
+
+    //decode time runs a frame behind presentation when there are B frames, so offsets stay positive
+    DWORD dts = OutputTestFrameTime(frame, scenario.fps);
+    DWORD pts = OutputTestFrameTime(gopStart+display+(scenario.numBFrames ? 1 : 0), scenario.fps);
+    INT compositionOffset = INT(pts-dts);
+
+    UINT frameSize = scenario.frameBytes;
+    if(bKeyframe)
+        frameSize = scenario.hugeKeyframeBytes ? scenario.hugeKeyframeBytes : frameSize*4;
+    else if(bBFrame)
+        frameSize /= 2;
+    frameSize = frameSize - frameSize/4 + OutputTestRand()%(frameSize/2+1);
+
+    UINT numParts = (bKeyframe && scenario.bSplitKeyframes) ? 2 : 1;
+    for(UINT part=0; part<numParts; part++)
+    {
+        UINT nalSize = frameSize/numParts;
+
+        TestPacket *packet = packets.CreateNew();
+        packet->type = bKeyframe ? PacketType_VideoHighest : (bBFrame ? PacketType_VideoDisposable : PacketType_VideoHigh);
+        packet->relTimestamp = dts;
+        packet->timestamp = scenario.startTimestamp+dts;
+
+        packet->data.SetSize(9+nalSize);
+        LPBYTE lpData = packet->data.Array();
+        lpData[0] = bKeyframe ? 0x17 : 0x27;
+        lpData[1] = 1;
+        lpData[2] = BYTE(compositionOffset>>16);
+        lpData[3] = BYTE(compositionOffset>>8);
+        lpData[4] = BYTE(compositionOffset);
+        *(DWORD*)(lpData+5) = fastHtonl(nalSize);
+        lpData[9] = bKeyframe ? 0x65 : (bBFrame ? 0x01 : 0x41);
+        FillPayload(lpData+10, nalSize-1);
+    }
+}
+
+static void AddAudioFrame(DWORD relTimestamp, const OutputTestScenario &scenario, List<TestPacket> &packets)
+{
+    UINT size = 400 + OutputTestRand()%128;
+
+    TestPacket *packet = packets.CreateNew();
+    packet->type = PacketType_Audio;
+    packet->relTimestamp = relTimestamp;
+    packet->timestamp = scenario.startTimestamp+relTimestamp;
+
+    packet->data.SetSize(2+size);
+    packet->data[0] = 0xAF;
+    packet->data[1] = 1;
+    FillPayload(packet->data.Array()+2, size);
+}
+
+//video and audio interleaved by timestamp like the encoders produce them, starting on a keyframe
+static void MakeTestPackets(const OutputTestScenario &scenario, List<TestPacket> &packets)
+{
+    UINT numFrames = scenario.seconds*scenario.fps;
+    UINT numAudioFrames = scenario.bAudio ? UINT(UINT64(scenario.seconds)*OUTPUT_TEST_SAMPLE_RATE/OUTPUT_TEST_AUDIO_FRAME) : 0;
+    UINT frame = 0, audioFrame = 0;
+
+    outputTestRandState = 0x2545F491;
+
+    while(frame < numFrames || audioFrame < numAudioFrames)
+    {
+        DWORD videoTime = OutputTestFrameTime(frame, scenario.fps);
+        DWORD audioTime = OutputTestAudioTime(audioFrame);
+
+        if(frame < numFrames && (audioFrame >= numAudioFrames || videoTime <= audioTime))
+        {
+            AddVideoFrame(scenario, frame, numFrames, packets);
+            frame++;
+        }
+        else
+        {
+            if(audioTime < scenario.audioGapStart || audioTime >= scenario.audioGapEnd)
+                AddAudioFrame(audioTime, scenario, packets);
+            audioFrame++;
+        }
+    }
+}
+
+static void FreeTestPackets(List<TestPacket> &packets)
+{
+    for(UINT i=0; i<packets.Num(); i++)
+        packets[i].data.Clear();
+    packets.Clear();
+}
+
+//outputs drop everything before the first keyframe, and the SEI goes in front of the first frame
+static void GetExpectedSamples(const List<TestPacket> &packets, List<ExpectedSample> &videoSamples, List<ExpectedSample> &audioSamples)
+{
+    bool bStarted = false;
+    DWORD firstTimestamp = 0;
+
+    for(UINT i=0; i<packets.Num(); i++)
+    {
+        const TestPacket &packet = packets[i];
+        bool bVideo = (packet.type != PacketType_Audio);
+
+        if(!bStarted)
+        {
+            if(!bVideo || packet.data[0] != 0x17)
+                continue;
+
+            bStarted = true;
+            firstTimestamp = packet.relTimestamp;
+        }
+
+        DWORD timestamp = packet.relTimestamp-firstTimestamp;
+        UINT payloadSize = packet.data.Num() - (bVideo ? 5 : 2);
+
+        if(bVideo && videoSamples.Num() && videoSamples.Last().timestamp == timestamp)
+        {
+            videoSamples.Last().size += payloadSize;
+            videoSamples.Last().numPackets++;
+            continue;
+        }
+
+        ExpectedSample *sample = bVideo ? videoSamples.CreateNew() : audioSamples.CreateNew();
+        sample->timestamp = timestamp;
+        sample->compositionOffset = bVideo ? ReadCompositionOffset(packet.data.Array()) : 0;
+        sample->bKeyframe = !bVideo || packet.data[0] == 0x17;
+        sample->size = payloadSize;
+        sample->firstPacket = i;
+        sample->numPackets = 1;
+
+        if(bVideo && videoSamples.Num() == 1)
+            sample->size += sizeof(testSEI);
+    }
+}
+
+static void GetTestVideoHeaders(List<BYTE> &headers)
+{
+    BYTE header[] = {0x17, 0x00, 0x00, 0x00, 0x00, 0x01, testSPS[1], testSPS[2], testSPS[3], 0xFF, 0xE1};
+
+    headers.CopyArray(header, sizeof(header));
+    headers << BYTE(sizeof(testSPS)>>8) << BYTE(sizeof(testSPS));
+    headers.AppendArray(testSPS, sizeof(testSPS));
+    headers << 1 << BYTE(sizeof(testPPS)>>8) << BYTE(sizeof(testPPS));
+    headers.AppendArray(testPPS, sizeof(testPPS));
+}
+
+//-------------------------------------------------------------------
+
+class TestVideoEncoder : public VideoEncoder
+{
+    List<BYTE> headers;
+
+protected:
+    bool Encode(LPVOID picIn, List<DataPacket> &packets, List<PacketType> &packetTypes, DWORD timestamp) {return false;}
+
+public:
+    TestVideoEncoder() {GetTestVideoHeaders(headers);}
+
+    int  GetBitRate() const {return 6000;}
+    bool DynamicBitrateSupported() const {return false;}
+    bool SetBitRate(DWORD maxBitrate, DWORD bufferSize) {return false;}
+
+    void GetHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = headers.Array();
+        packet.size = headers.Num();
+    }
+
+    void GetSEI(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)testSEI;
+        packet.size = sizeof(testSEI);
+    }
+
+    String GetInfoString() const {return TEXT("Output test");}
+};
+
+class TestAudioEncoder : public AudioEncoder
+{
+protected:
+    bool Encode(float *input, UINT numInputFrames, DataPacket &packet, QWORD &timestamp) {return false;}
+
+    void GetHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = (LPBYTE)testAudioHeaders;
+        packet.size = sizeof(testAudioHeaders);
+    }
+
+public:
+    UINT    GetFrameSize() const {return OUTPUT_TEST_AUDIO_FRAME;}
+    int     GetBitRate() const {return 160;}
+    CTSTR   GetCodec() const {return TEXT("AAC");}
+
+    String  GetInfoString() const {return TEXT("Output test");}
+};
+
+//-------------------------------------------------------------------
+
+//sets a Publish setting for the length of a test, then puts back whatever was there (or nothing)
+class ConfigOverride
+{
+    CTSTR lpKey;
+    bool bHadKey;
+    String strOldValue;
+
+public:
+    ConfigOverride(CTSTR lpKey, int value) : lpKey(lpKey)
+    {
+        bHadKey = AppConfig->HasKey(TEXT("Publish"), lpKey) != 0;
+        if(bHadKey)
+            strOldValue = AppConfig->GetString(TEXT("Publish"), lpKey);
+
+        AppConfig->SetInt(TEXT("Publish"), lpKey, value);
+    }
+
+    ~ConfigOverride()
+    {
+        if(bHadKey)
+            AppConfig->SetString(TEXT("Publish"), lpKey, strOldValue);
+        else
+            AppConfig->Remove(TEXT("Publish"), lpKey);
+    }
+};
+
+//-------------------------------------------------------------------
+// just enough of FLV and MP4 to read back what the outputs write
+
+static inline WORD ReadBE16(const BYTE *lpData)   {return WORD((lpData[0]<<8) | lpData[1]);}
+static inline DWORD ReadBE24(const BYTE *lpData)  {return (lpData[0]<<16) | (lpData[1]<<8) | lpData[2];}
+static inline DWORD ReadBE32(const BYTE *lpData)  {return (lpData[0]<<24) | (lpData[1]<<16) | (lpData[2]<<8) | lpData[3];}
+static inline QWORD ReadBE64(const BYTE *lpData)  {return (QWORD(ReadBE32(lpData))<<32) | ReadBE32(lpData+4);}
+
+static inline double ReadBEDouble(const BYTE *lpData)
+{
+    QWORD val = ReadBE64(lpData);
+    return *(double*)&val;
+}
+
+struct FLVTag
+{
+    BYTE type;
+    DWORD timestamp;
+    UINT64 offset;          //of the tag header
+    UINT size;
+
+    inline UINT64 DataOffset() const {return offset+11;}
+};
+
+struct FLVMetaData
+{
+    double duration, fileSize;
+    List<double> filePositions, times;
+};
+
+static inline bool AMFNameIs(const BYTE *lpName, UINT nameLen, const char *lpCompare)
+{
+    return lpName && nameLen == strlen(lpCompare) && memcmp(lpName, lpCompare, nameLen) == 0;
+}
+
+static bool ReadAMFValue(const BYTE *&lpData, const BYTE *lpEnd, const BYTE *lpName, UINT nameLen, UINT depth, FLVMetaData &metaData, List<double> *arrayOut);
+
+static bool ReadAMFProperties(const BYTE *&lpData, const BYTE *lpEnd, UINT depth, FLVMetaData &metaData)
+{
+    while(true)
+    {
+        if(lpEnd-lpData < 3)
+            return false;
+
+        UINT nameLen = ReadBE16(lpData);
+        if(!nameLen && lpData[2] == AMF_OBJECT_END)
+        {
+            lpData += 3;
+            return true;
+        }
+
+        lpData += 2;
+        if(UINT(lpEnd-lpData) < nameLen)
+            return false;
+
+        const BYTE *lpName = lpData;
+        lpData += nameLen;
+
+        if(!ReadAMFValue(lpData, lpEnd, lpName, nameLen, depth+1, metaData, NULL))
+            return false;
+    }
+}
+
+//walks one AMF0 value, picking out the top level duration and file size and the keyframe index arrays
+static bool ReadAMFValue(const BYTE *&lpData, const BYTE *lpEnd, const BYTE *lpName, UINT nameLen, UINT depth, FLVMetaData &metaData, List<double> *arrayOut)
+{
+    if(lpData >= lpEnd || depth > 8)
+        return false;
+
+    BYTE type = *(lpData++);
+    UINT size;
+
+    switch(type)
+    {
+        case AMF_NUMBER:
+            {
+                if(lpEnd-lpData < 8)
+                    return false;
+
+                double val = ReadBEDouble(lpData);
+                lpData += 8;
+
+                if(arrayOut)
+                    *arrayOut << val;
+                else if(depth == 1 && AMFNameIs(lpName, nameLen, "duration"))
+                    metaData.duration = val;
+                else if(depth == 1 && AMFNameIs(lpName, nameLen, "filesize"))
+                    metaData.fileSize = val;
+                return true;
+            }
+
+        case AMF_BOOLEAN:
+            lpData++;
+            return lpData <= lpEnd;
+
+        case AMF_STRING:
+            if(lpEnd-lpData < 2)
+                return false;
+            size = ReadBE16(lpData);
+            lpData += 2;
+            if(UINT(lpEnd-lpData) < size)
+                return false;
+            lpData += size;
+            return true;
+
+        case AMF_LONG_STRING:
+            if(lpEnd-lpData < 4)
+                return false;
+            size = ReadBE32(lpData);
+            lpData += 4;
+            if(UINT(lpEnd-lpData) < size)
+                return false;
+            lpData += size;
+            return true;
+
+        case AMF_ECMA_ARRAY:
+            if(lpEnd-lpData < 4)
+                return false;
+            lpData += 4;
+            return ReadAMFProperties(lpData, lpEnd, depth, metaData);
+
+        case AMF_OBJECT:
+            return ReadAMFProperties(lpData, lpEnd, depth, metaData);
+
+        case AMF_STRICT_ARRAY:
+            {
+                if(lpEnd-lpData < 4)
+                    return false;
+                UINT count = ReadBE32(lpData);
+                lpData += 4;
+
+                List<double> *elementsOut = NULL;
+                if(depth == 2 && AMFNameIs(lpName, nameLen, "filepositions"))
+                    elementsOut = &metaData.filePositions;
+                else if(depth == 2 && AMFNameIs(lpName, nameLen, "times"))
+                    elementsOut = &metaData.times;
+
+                for(UINT i=0; i<count; i++)
+                {
+                    if(!ReadAMFValue(lpData, lpEnd, NULL, 0, depth+1, metaData, elementsOut))
+                        return false;
+                }
+                return true;
+            }
+
+        case AMF_NULL:
+        case AMF_UNDEFINED:
+            return true;
+    }
+
+    return false;
+}
+
+struct MP4Box
+{
+    DWORD type;
+    UINT64 offset, size;    //the whole box
+    UINT headerSize;
+
+    inline UINT64 DataOffset() const {return offset+headerSize;}
+    inline UINT64 DataSize() const   {return size-headerSize;}
+};
+
+//splits a range of the file into boxes, false if any of them don't fit exactly
+static bool ReadBoxes(const List<BYTE> &file, UINT64 start, UINT64 end, List<MP4Box> &boxes)
+{
+    boxes.Clear();
+
+    while(start < end)
+    {
+        if(end-start < 8)
+            return false;
+
+        const BYTE *lpHeader = file.Array()+start;
+        MP4Box box;
+        box.type = ReadBE32(lpHeader+4);
+        box.offset = start;
+        box.size = ReadBE32(lpHeader);
+        box.headerSize = 8;
+
+        if(box.size == 1)
+        {
+            if(end-start < 16)
+                return false;
+            box.size = ReadBE64(lpHeader+8);
+            box.headerSize = 16;
+        }
+        else if(box.size == 0)
+            box.size = end-start;
+
+        if(box.size < box.headerSize || box.size > end-start)
+            return false;
+
+        boxes << box;
+        start += box.size;
+    }
+
+    return true;
+}
+
+//finds the first child box of a type.  skip is the size of any fields in front of the children
+static bool FindChildBox(const List<BYTE> &file, const MP4Box &parent, DWORD type, MP4Box &child, UINT skip=0)
+{
+    List<MP4Box> children;
+    if(parent.DataSize() < skip || !ReadBoxes(file, parent.DataOffset()+skip, parent.offset+parent.size, children))
+        return false;
+
+    for(UINT i=0; i<children.Num(); i++)
+    {
+        if(children[i].type == type)
+        {
+            child = children[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//a full box's table: the entry count sits at countPos, the entries follow it
+static const BYTE* GetBoxTable(const List<BYTE> &file, const MP4Box &box, UINT countPos, UINT entrySize, UINT &count)
+{
+    count = 0;
+    if(box.DataSize() < countPos+4)
+        return NULL;
+
+    const BYTE *lpData = file.Array()+box.DataOffset();
+    count = ReadBE32(lpData+countPos);
+
+    if(UINT64(count)*entrySize > box.DataSize()-countPos-4)
+    {
+        count = 0;
+        return NULL;
+    }
+
+    return lpData+countPos+4;
+}
+
+struct MP4Sample
+{
+    UINT64 offset;
+    UINT size;
+    UINT64 decodeTime;
+    INT compositionOffset;
+    bool bSync;
+};
+
+struct MP4Track
+{
+    DWORD trackID, handler, timeScale;
+    DWORD defaultSampleFlags;   //from trex
+    UINT64 endTime;             //decode time after the last sample read so far
+    MP4Box sampleEntry;
+    List<MP4Sample> samples;
+};
+
+//MPEG-2 CRC-32.  run over a whole section including its CRC it comes out to 0
+static DWORD SectionCRC(const BYTE *lpData, UINT size)
+{
+    DWORD crc = 0xFFFFFFFF;
+    while(size--)
+    {
+        crc ^= DWORD(*(lpData++))<<24;
+        for(int bit=0; bit<8; bit++)
+            crc = (crc & 0x80000000) ? (crc<<1)^0x04C11DB7 : (crc<<1);
+    }
+    return crc;
+}
+
+static bool ReadPESTimestamp(const BYTE *lpData, BYTE prefix, UINT64 &timestamp)
+{
+    if((lpData[0]>>4) != prefix || !(lpData[0] & 1) || !(lpData[2] & 1) || !(lpData[4] & 1))
+        return false;
+
+    timestamp = (UINT64(lpData[0] & 0x0E)<<29) | (UINT64(lpData[1])<<22) | (UINT64(lpData[2] & 0xFE)<<14) |
+                (UINT64(lpData[3])<<7) | (lpData[4]>>1);
+    return true;
+}
+
+static void AppendAnnexB(List<BYTE> &data, const BYTE *lpNAL, UINT size)
+{
+    static const BYTE startCode[4] = {0, 0, 0, 1};
+    data.AppendArray(startCode, 4);
+    data.AppendArray(lpNAL, size);
+}
+
+static void AppendAVCCAsAnnexB(List<BYTE> &data, const BYTE *lpData, UINT size)
+{
+    while(size > 4)
+    {
+        UINT nalSize = ReadBE32(lpData);
+        if(nalSize > size-4)
+            break;
+
+        AppendAnnexB(data, lpData+4, nalSize);
+
+        lpData += nalSize+4;
+        size -= nalSize+4;
+    }
+}
+
+//an elementary stream being pulled out of a transport stream
+struct TSStream
+{
+    UINT pid;
+    bool bVideo;
+    bool bStarted;          //a PES is being collected
+    List<BYTE> pes;
+    UINT64 pesOffset;       //of the packet the PES started in
+    bool bRandomAccess;     //that packet had the random access indicator
+    bool bCarriesPCR;       //that packet had a PCR
+    UINT64 pcr;             //latest PCR as of that packet
+    INT nextSample;         //expected sample the next PES should hold, -1 until the first one lines up
+};
+
+//-------------------------------------------------------------------
+
+class OutputTester
+{
+    String strDir, strCase;
+    UINT numFailures, caseFailures;
+
+    List<BYTE> videoHeaders;
+    List<TestPacket> packets;
+    List<ExpectedSample> videoSamples, audioSamples;
+
+    UINT numStreamErrors;
+    List<BYTE> expectedPES;
+
+    void Check(bool bCondition, CTSTR lpFormat, ...)
+    {
+        if(bCondition)
+            return;
+
+        va_list arglist;
+        va_start(arglist, lpFormat);
+        String strMessage = FormattedStringva(lpFormat, arglist);
+        va_end(arglist);
+
+        Log(TEXT("OutputTest: FAILED %s: %s"), strCase.Array(), strMessage.Array());
+
+        numFailures++;
+        caseFailures++;
+    }
+
+    //a broken stream tends to break everything after it, so only the first few problems are reported in full
+    void StreamCheck(bool bCondition, CTSTR lpFormat, ...)
+    {
+        if(bCondition || numStreamErrors++ >= MAX_REPORTED_STREAM_ERRORS)
+            return;
+
+        va_list arglist;
+        va_start(arglist, lpFormat);
+        String strMessage = FormattedStringva(lpFormat, arglist);
+        va_end(arglist);
+
+        Log(TEXT("OutputTest: FAILED %s: %s"), strCase.Array(), strMessage.Array());
+
+        numFailures++;
+        caseFailures++;
+    }
+
+    bool ReadFile(CTSTR lpFile, List<BYTE> &file)
+    {
+        XFile input;
+        if(!input.Open(lpFile, XFILE_READ, XFILE_OPENEXISTING))
+            return false;
+
+        file.SetSize((UINT)input.GetFileSize());
+        return file.Num() && input.Read(file.Array(), file.Num()) == file.Num();
+    }
+
+    //-----------------------------------------------------------------
+
+    void VerifyFLV(const List<BYTE> &file)
+    {
+        const BYTE *lpFile = file.Array();
+
+        if(file.Num() < 13 || memcmp(lpFile, "FLV\x01", 4) != 0 || ReadBE32(lpFile+5) != 9 || ReadBE32(lpFile+9) != 0)
+        {
+            Check(false, TEXT("no FLV header"));
+            return;
+        }
+
+        //every tag, checking each one's back pointer on the way
+        List<FLVTag> tags;
+        UINT64 pos = 13;
+        while(pos < file.Num())
+        {
+            if(file.Num()-pos < 15)
+                break;
+
+            FLVTag tag;
+            tag.type = lpFile[pos];
+            tag.size = ReadBE24(lpFile+pos+1);
+            tag.timestamp = ReadBE24(lpFile+pos+4) | (lpFile[pos+7]<<24);
+            tag.offset = pos;
+
+            if(file.Num()-pos < 15+UINT64(tag.size))
+                break;
+
+            if(ReadBE32(lpFile+pos+11+tag.size) != tag.size+11)
+            {
+                Check(false, TEXT("tag %u at %llu has a bad previous tag size"), tags.Num(), pos);
+                return;
+            }
+
+            tags << tag;
+            pos += 15+tag.size;
+        }
+
+        Check(pos == file.Num(), TEXT("%llu bytes after the last complete tag"), UINT64(file.Num())-pos);
+
+        if(tags.Num() < 3 || tags[0].type != 18 || tags[1].type != 8 || tags[2].type != 9)
+        {
+            Check(false, TEXT("doesn't start with metadata, audio headers and video headers"));
+            return;
+        }
+
+        Check(tags[1].size == sizeof(testAudioHeaders) && memcmp(lpFile+tags[1].DataOffset(), testAudioHeaders, tags[1].size) == 0,
+            TEXT("audio headers differ"));
+        Check(tags[2].size == videoHeaders.Num() && memcmp(lpFile+tags[2].DataOffset(), videoHeaders.Array(), tags[2].size) == 0,
+            TEXT("video headers differ"));
+
+        //-------------------------------------------------------------
+        // the rest has to be the packets from the first keyframe on, as they were sent
+
+        UINT first = 0;
+        while(first < packets.Num() && (packets[first].type == PacketType_Audio || packets[first].data[0] != 0x17))
+            first++;
+
+        UINT numPackets = packets.Num()-first;
+        Check(tags.Num()-3 == numPackets, TEXT("%u tags for %u packets"), tags.Num()-3, numPackets);
+
+        UINT numBad = 0, firstBad = 0;
+        bool bSentSEI = false;
+        List<DWORD> keyframeTimes;
+
+        for(UINT i=0; i<MIN(numPackets, tags.Num()-3); i++)
+        {
+            const TestPacket &packet = packets[first+i];
+            const FLVTag &tag = tags[i+3];
+            const BYTE *lpTag = lpFile+tag.DataOffset();
+
+            bool bVideo = (packet.type != PacketType_Audio);
+            bool bKeyframe = bVideo && packet.data[0] == 0x17;
+            bool bMatches = (tag.type == (bVideo ? 9 : 8)) && tag.timestamp == packet.relTimestamp-packets[first].relTimestamp;
+
+            if(bKeyframe && (!keyframeTimes.Num() || keyframeTimes.Last() != tag.timestamp))
+                keyframeTimes << tag.timestamp;
+
+            //the SEI goes between the first keyframe's header and its NALs
+            if(bMatches && bKeyframe && !bSentSEI)
+            {
+                bMatches = tag.size == packet.data.Num()+sizeof(testSEI) &&
+                           memcmp(lpTag, packet.data.Array(), 5) == 0 &&
+                           memcmp(lpTag+5, testSEI, sizeof(testSEI)) == 0 &&
+                           memcmp(lpTag+5+sizeof(testSEI), packet.data.Array()+5, packet.data.Num()-5) == 0;
+                bSentSEI = true;
+            }
+            else if(bMatches)
+                bMatches = tag.size == packet.data.Num() && memcmp(lpTag, packet.data.Array(), tag.size) == 0;
+
+            if(!bMatches && !numBad++)
+                firstBad = i;
+        }
+
+        Check(numBad == 0, TEXT("%u tags differ from the packets sent, the first is tag %u"), numBad, firstBad+3);
+
+        //-------------------------------------------------------------
+        // onMetaData, filled in on close
+
+        FLVMetaData metaData;
+        metaData.duration = metaData.fileSize = -1.0;
+
+        const BYTE *lpData = lpFile+tags[0].DataOffset();
+        const BYTE *lpEnd = lpData+tags[0].size;
+
+        if(lpEnd-lpData < 13 || lpData[0] != AMF_STRING || ReadBE16(lpData+1) != 10 || memcmp(lpData+3, "onMetaData", 10) != 0)
+        {
+            Check(false, TEXT("first tag isn't onMetaData"));
+            return;
+        }
+
+        lpData += 13;
+        if(!ReadAMFValue(lpData, lpEnd, NULL, 0, 0, metaData, NULL))
+        {
+            Check(false, TEXT("onMetaData can't be read"));
+            return;
+        }
+
+        Check(fabs(metaData.duration - double(tags.Last().timestamp)/1000.0) < 0.0005, TEXT("metadata duration is %g, the last tag is at %u ms"),
+            metaData.duration, tags.Last().timestamp);
+        Check(metaData.fileSize == double(file.Num()), TEXT("metadata file size is %g, the file is %u bytes"), metaData.fileSize, file.Num());
+
+        //every index entry has to land on the keyframe it names.  the index only gets thinned out past a few
+        //thousand keyframes, none of the scenarios come near that
+        Check(metaData.filePositions.Num() == keyframeTimes.Num() && metaData.times.Num() == keyframeTimes.Num(),
+            TEXT("keyframe index has %u positions and %u times for %u keyframes"), metaData.filePositions.Num(), metaData.times.Num(), keyframeTimes.Num());
+
+        numBad = 0;
+        for(UINT i=0; i<MIN(metaData.filePositions.Num(), metaData.times.Num()); i++)
+        {
+            UINT64 filePos = UINT64(metaData.filePositions[i]);
+            DWORD timestamp = DWORD(metaData.times[i]*1000.0 + 0.5);
+
+            UINT tag;
+            for(tag=0; tag<tags.Num(); tag++)
+            {
+                if(tags[tag].offset == filePos)
+                    break;
+            }
+
+            bool bMatches = tag < tags.Num() && tags[tag].type == 9 && tags[tag].timestamp == timestamp &&
+                            lpFile[tags[tag].DataOffset()] == 0x17 && lpFile[tags[tag].DataOffset()+1] == 1;
+
+            if(!bMatches && !numBad++)
+                firstBad = i;
+        }
+
+        Check(numBad == 0, TEXT("%u keyframe index entries don't point at their keyframe, the first is %u"), numBad, firstBad);
+    }
+
+    //-----------------------------------------------------------------
+
+    bool ReadMP4Track(const List<BYTE> &file, const MP4Box &trak, MP4Track &track)
+    {
+        MP4Box tkhd, mdia, mdhd, hdlr, minf, stbl, stsd;
+        if(!FindChildBox(file, trak, 'tkhd', tkhd) || !FindChildBox(file, trak, 'mdia', mdia) ||
+           !FindChildBox(file, mdia, 'mdhd', mdhd) || !FindChildBox(file, mdia, 'hdlr', hdlr) ||
+           !FindChildBox(file, mdia, 'minf', minf) || !FindChildBox(file, minf, 'stbl', stbl) ||
+           !FindChildBox(file, stbl, 'stsd', stsd) || tkhd.DataSize() < 24 || mdhd.DataSize() < 24 || hdlr.DataSize() < 12)
+        {
+            Check(false, TEXT("track at %llu is missing boxes"), trak.offset);
+            return false;
+        }
+
+        const BYTE *lpTkhd = file.Array()+tkhd.DataOffset();
+        const BYTE *lpMdhd = file.Array()+mdhd.DataOffset();
+        track.trackID   = ReadBE32(lpTkhd + (lpTkhd[0] == 1 ? 20 : 12));
+        track.timeScale = ReadBE32(lpMdhd + (lpMdhd[0] == 1 ? 20 : 12));
+        track.handler   = ReadBE32(file.Array()+hdlr.DataOffset()+8);
+        track.defaultSampleFlags = 0;
+        track.endTime = 0;
+
+        List<MP4Box> entries;
+        if(stsd.DataSize() < 8 || !ReadBoxes(file, stsd.DataOffset()+8, stsd.offset+stsd.size, entries) || entries.Num() != 1)
+        {
+            Check(false, TEXT("track %u needs exactly one sample description"), track.trackID);
+            return false;
+        }
+        track.sampleEntry = entries[0];
+
+        //-------------------------------------------------------------
+
+        MP4Box stsz, stts, stsc, stco, ctts, stss;
+        bool bCo64 = false;
+
+        if(!FindChildBox(file, stbl, 'stco', stco))
+            bCo64 = FindChildBox(file, stbl, 'co64', stco);
+
+        if(!FindChildBox(file, stbl, 'stsz', stsz) || !FindChildBox(file, stbl, 'stts', stts) || !FindChildBox(file, stbl, 'stsc', stsc) ||
+           (!bCo64 && stco.type != 'stco'))
+        {
+            Check(false, TEXT("track %u is missing sample tables"), track.trackID);
+            return false;
+        }
+
+        UINT numSamples, numChunks, numStsc, numStts;
+        const BYTE *lpSizes   = GetBoxTable(file, stsz, 8, 4, numSamples);
+        const BYTE *lpChunks  = GetBoxTable(file, stco, 4, bCo64 ? 8 : 4, numChunks);
+        const BYTE *lpStsc    = GetBoxTable(file, stsc, 4, 12, numStsc);
+        const BYTE *lpStts    = GetBoxTable(file, stts, 4, 8, numStts);
+        UINT fixedSize = (stsz.DataSize() >= 8) ? ReadBE32(file.Array()+stsz.DataOffset()+4) : 0;
+
+        if(fixedSize)
+            lpSizes = GetBoxTable(file, stsz, 8, 0, numSamples);
+
+        if(!lpSizes || !lpChunks || !lpStsc || !lpStts)
+        {
+            Check(false, TEXT("track %u has a sample table that runs past its box"), track.trackID);
+            return false;
+        }
+
+        track.samples.SetSize(numSamples);
+        for(UINT i=0; i<numSamples; i++)
+        {
+            track.samples[i].size = fixedSize ? fixedSize : ReadBE32(lpSizes+i*4);
+            track.samples[i].bSync = true;
+        }
+
+        //chunk offsets, with the samples of each chunk following straight on
+        UINT sample = 0, stscEntry = 0;
+        for(UINT chunk=0; chunk<numChunks; chunk++)
+        {
+            while(stscEntry+1 < numStsc && ReadBE32(lpStsc+(stscEntry+1)*12) <= chunk+1)
+                stscEntry++;
+
+            UINT samplesPerChunk = numStsc ? ReadBE32(lpStsc+stscEntry*12+4) : 0;
+            UINT64 offset = bCo64 ? ReadBE64(lpChunks+chunk*8) : ReadBE32(lpChunks+chunk*4);
+
+            for(UINT i=0; i<samplesPerChunk && sample<numSamples; i++)
+            {
+                track.samples[sample].offset = offset;
+                offset += track.samples[sample++].size;
+            }
+        }
+
+        Check(sample == numSamples, TEXT("track %u: the chunks hold %u of %u samples"), track.trackID, sample, numSamples);
+
+        UINT64 decodeTime = 0;
+        sample = 0;
+        for(UINT i=0; i<numStts; i++)
+        {
+            UINT count = ReadBE32(lpStts+i*8), delta = ReadBE32(lpStts+i*8+4);
+            for(UINT j=0; j<count; j++, sample++)
+            {
+                if(sample < numSamples)
+                    track.samples[sample].decodeTime = decodeTime;
+                decodeTime += delta;
+            }
+        }
+
+        track.endTime = decodeTime;
+        Check(sample == numSamples, TEXT("track %u: stts covers %u of %u samples"), track.trackID, sample, numSamples);
+
+        if(FindChildBox(file, stbl, 'ctts', ctts))
+        {
+            UINT numCtts;
+            const BYTE *lpCtts = GetBoxTable(file, ctts, 4, 8, numCtts);
+
+            sample = 0;
+            for(UINT i=0; i<numCtts; i++)
+            {
+                UINT count = ReadBE32(lpCtts+i*8);
+                INT offset = (INT)ReadBE32(lpCtts+i*8+4);
+                for(UINT j=0; j<count; j++, sample++)
+                {
+                    if(sample < numSamples)
+                        track.samples[sample].compositionOffset = offset;
+                }
+            }
+
+            Check(sample == numSamples, TEXT("track %u: ctts covers %u of %u samples"), track.trackID, sample, numSamples);
+        }
+
+        if(FindChildBox(file, stbl, 'stss', stss))
+        {
+            UINT numSync, lastSync = 0;
+            const BYTE *lpSync = GetBoxTable(file, stss, 4, 4, numSync);
+
+            for(UINT i=0; i<numSamples; i++)
+                track.samples[i].bSync = false;
+
+            for(UINT i=0; i<numSync; i++)
+            {
+                UINT syncSample = ReadBE32(lpSync+i*4);
+                if(syncSample <= lastSync || syncSample > numSamples)
+                {
+                    Check(false, TEXT("track %u: stss entry %u (%u) is out of order or range"), track.trackID, i, syncSample);
+                    break;
+                }
+
+                track.samples[syncSample-1].bSync = true;
+                lastSync = syncSample;
+            }
+        }
+
+        return true;
+    }
+
+    //moof/mdat pairs after the moov.  the sample tables in the moov have to be empty
+    void ReadMP4Fragments(const List<BYTE> &file, const List<MP4Box> &boxes, MP4Track *tracks, UINT numTracks)
+    {
+        UINT sequence = 0, numBadRanges = 0, numBadStarts = 0;
+
+        for(UINT i=0; i<numTracks; i++)
+            Check(tracks[i].samples.Num() == 0, TEXT("track %u has samples in the moov"), tracks[i].trackID);
+
+        for(UINT i=0; i<boxes.Num(); i++)
+        {
+            if(boxes[i].type != 'moof')
+                continue;
+
+            const MP4Box &moof = boxes[i];
+            if(i+1 == boxes.Num() || boxes[i+1].type != 'mdat')
+            {
+                Check(false, TEXT("fragment %u isn't followed by an mdat"), sequence+1);
+                continue;
+            }
+
+            const MP4Box &mdat = boxes[i+1];
+            UINT64 fragmentBytes = 0;
+
+            MP4Box mfhd;
+            if(!FindChildBox(file, moof, 'mfhd', mfhd) || mfhd.DataSize() < 8)
+            {
+                Check(false, TEXT("fragment at %llu has no mfhd"), moof.offset);
+                continue;
+            }
+
+            UINT fragmentSequence = ReadBE32(file.Array()+mfhd.DataOffset()+4);
+            Check(fragmentSequence == sequence+1, TEXT("fragment %u has sequence number %u"), sequence+1, fragmentSequence);
+            sequence++;
+
+            List<MP4Box> trafs;
+            ReadBoxes(file, moof.DataOffset(), moof.offset+moof.size, trafs);
+
+            for(UINT traf=0; traf<trafs.Num(); traf++)
+            {
+                if(trafs[traf].type != 'traf')
+                    continue;
+
+                MP4Box tfhd, tfdt;
+                if(!FindChildBox(file, trafs[traf], 'tfhd', tfhd) || !FindChildBox(file, trafs[traf], 'tfdt', tfdt) ||
+                   tfhd.DataSize() < 8 || tfdt.DataSize() < 8)
+                {
+                    Check(false, TEXT("fragment %u has a traf without tfhd/tfdt"), sequence);
+                    continue;
+                }
+
+                //-----------------------------------------------------
+
+                const BYTE *lpTfhd = file.Array()+tfhd.DataOffset();
+                DWORD tfhdFlags = ReadBE32(lpTfhd) & 0xFFFFFF;
+                DWORD trackID = ReadBE32(lpTfhd+4);
+
+                MP4Track *track = NULL;
+                for(UINT j=0; j<numTracks; j++)
+                {
+                    if(tracks[j].trackID == trackID)
+                        track = tracks+j;
+                }
+
+                if(!track || !(tfhdFlags & 0x020000))
+                {
+                    Check(false, TEXT("fragment %u has a traf for track %u with flags %x"), sequence, trackID, tfhdFlags);
+                    continue;
+                }
+
+                UINT fieldPos = 8;
+                DWORD defaultDuration = 0, defaultSize = 0, defaultFlags = track->defaultSampleFlags;
+                if(tfhdFlags & 0x01) fieldPos += 8;
+                if(tfhdFlags & 0x02) fieldPos += 4;
+                if(tfhdFlags & 0x08) {defaultDuration = ReadBE32(lpTfhd+fieldPos); fieldPos += 4;}
+                if(tfhdFlags & 0x10) {defaultSize = ReadBE32(lpTfhd+fieldPos); fieldPos += 4;}
+                if(tfhdFlags & 0x20) {defaultFlags = ReadBE32(lpTfhd+fieldPos); fieldPos += 4;}
+
+                const BYTE *lpTfdt = file.Array()+tfdt.DataOffset();
+                UINT64 baseTime = (lpTfdt[0] == 1) ? ReadBE64(lpTfdt+4) : ReadBE32(lpTfdt+4);
+
+                //video runs on without a break, audio can jump ahead over a gap
+                if(track->handler == 'vide')
+                    Check(baseTime == track->endTime, TEXT("fragment %u video starts at %llu, the last one ended at %llu"), sequence, baseTime, track->endTime);
+                else
+                    Check(baseTime >= track->endTime, TEXT("fragment %u audio starts at %llu, before the last one ended at %llu"), sequence, baseTime, track->endTime);
+
+                //-----------------------------------------------------
+
+                List<MP4Box> runs;
+                ReadBoxes(file, trafs[traf].DataOffset(), trafs[traf].offset+trafs[traf].size, runs);
+
+                UINT64 decodeTime = baseTime;
+                UINT firstSample = track->samples.Num();
+
+                for(UINT run=0; run<runs.Num(); run++)
+                {
+                    if(runs[run].type != 'trun' || runs[run].DataSize() < 8)
+                        continue;
+
+                    const BYTE *lpTrun = file.Array()+runs[run].DataOffset();
+                    const BYTE *lpTrunEnd = lpTrun+runs[run].DataSize();
+                    DWORD trunFlags = ReadBE32(lpTrun) & 0xFFFFFF;
+                    UINT numSamples = ReadBE32(lpTrun+4);
+                    const BYTE *lpField = lpTrun+8;
+
+                    INT dataOffset = 0;
+                    DWORD firstFlags = defaultFlags;
+                    if(trunFlags & 0x001) {dataOffset = (INT)ReadBE32(lpField); lpField += 4;}
+                    if(trunFlags & 0x004) {firstFlags = ReadBE32(lpField); lpField += 4;}
+
+                    UINT sampleFieldSize = 4*(((trunFlags>>8) & 1) + ((trunFlags>>9) & 1) + ((trunFlags>>10) & 1) + ((trunFlags>>11) & 1));
+                    if(UINT64(lpTrunEnd-lpField) < UINT64(numSamples)*sampleFieldSize)
+                    {
+                        Check(false, TEXT("fragment %u has a trun that runs past its box"), sequence);
+                        continue;
+                    }
+
+                    UINT64 offset = moof.offset+dataOffset;
+
+                    for(UINT j=0; j<numSamples; j++)
+                    {
+                        MP4Sample *sample = track->samples.CreateNew();
+                        DWORD duration = defaultDuration, flags = j ? defaultFlags : firstFlags;
+
+                        sample->size = defaultSize;
+                        sample->compositionOffset = 0;
+
+                        if(trunFlags & 0x100) {duration = ReadBE32(lpField); lpField += 4;}
+                        if(trunFlags & 0x200) {sample->size = ReadBE32(lpField); lpField += 4;}
+                        if(trunFlags & 0x400) {flags = ReadBE32(lpField); lpField += 4;}
+                        if(trunFlags & 0x800) {sample->compositionOffset = (INT)ReadBE32(lpField); lpField += 4;}
+
+                        sample->offset = offset;
+                        sample->decodeTime = decodeTime;
+                        sample->bSync = (flags & 0x00010000) == 0;
+
+                        if(offset < mdat.DataOffset() || offset+sample->size > mdat.offset+mdat.size)
+                            numBadRanges++;
+
+                        offset += sample->size;
+                        decodeTime += duration;
+                        fragmentBytes += sample->size;
+                    }
+                }
+
+                track->endTime = decodeTime;
+
+                //fragments are cut on keyframes, the duration and size caps are never reached here
+                if(track->handler == 'vide' && track->samples.Num() > firstSample && !track->samples[firstSample].bSync)
+                    numBadStarts++;
+            }
+
+            Check(fragmentBytes == mdat.DataSize(), TEXT("fragment %u describes %llu bytes of its %llu byte mdat"), sequence, fragmentBytes, mdat.DataSize());
+        }
+
+        Check(sequence > 0, TEXT("no fragments"));
+        Check(numBadRanges == 0, TEXT("%u samples lie outside their fragment's mdat"), numBadRanges);
+        Check(numBadStarts == 0, TEXT("%u fragments don't start on a keyframe"), numBadStarts);
+    }
+
+    bool SampleMatches(const List<BYTE> &file, const MP4Sample &sample, const ExpectedSample &expected, bool bVideo, bool bFirst)
+    {
+        if(sample.size != expected.size || sample.offset+sample.size > file.Num())
+            return false;
+
+        const BYTE *lpData = file.Array()+sample.offset;
+        if(bVideo && bFirst)
+        {
+            if(memcmp(lpData, testSEI, sizeof(testSEI)) != 0)
+                return false;
+            lpData += sizeof(testSEI);
+        }
+
+        UINT headerSize = bVideo ? 5 : 2;
+        for(UINT i=0; i<expected.numPackets; i++)
+        {
+            const TestPacket &packet = packets[expected.firstPacket+i];
+            if(memcmp(lpData, packet.data.Array()+headerSize, packet.data.Num()-headerSize) != 0)
+                return false;
+            lpData += packet.data.Num()-headerSize;
+        }
+
+        return true;
+    }
+
+    void CompareMP4Track(const List<BYTE> &file, const MP4Track &track, const List<ExpectedSample> &expected, const List<MP4Box> &boxes, bool bFragmented)
+    {
+        bool bVideo = (track.handler == 'vide');
+        CTSTR lpTrack = bVideo ? TEXT("video") : TEXT("audio");
+
+        Check(track.timeScale == (bVideo ? 1000 : OUTPUT_TEST_SAMPLE_RATE), TEXT("%s time scale is %u"), lpTrack, track.timeScale);
+        Check(track.samples.Num() == expected.Num(), TEXT("%s has %u samples, %u were sent"), lpTrack, track.samples.Num(), expected.Num());
+
+        UINT numBadData = 0, numBadTimes = 0, numBadOffsets = 0, numBadSync = 0, numOutside = 0;
+        UINT firstBadData = 0, firstBadTime = 0;
+
+        for(UINT i=0; i<MIN(track.samples.Num(), expected.Num()); i++)
+        {
+            const MP4Sample &sample = track.samples[i];
+            const ExpectedSample &expectedSample = expected[i];
+
+            if(!SampleMatches(file, sample, expectedSample, bVideo, i == 0) && !numBadData++)
+                firstBadData = i;
+
+            bool bTimeMatches;
+            if(bVideo)
+                bTimeMatches = sample.decodeTime == expectedSample.timestamp;
+            else
+                bTimeMatches = fabs(double(sample.decodeTime) - double(expectedSample.timestamp)*OUTPUT_TEST_SAMPLE_RATE/1000.0) <= MAX_AUDIO_TIME_ERROR;
+
+            if(!bTimeMatches && !numBadTimes++)
+                firstBadTime = i;
+
+            if(bVideo && sample.compositionOffset != expectedSample.compositionOffset)
+                numBadOffsets++;
+            if(sample.bSync != expectedSample.bKeyframe)
+                numBadSync++;
+
+            //progressive files have everything in the one mdat
+            if(!bFragmented)
+            {
+                bool bInside = false;
+                for(UINT j=0; j<boxes.Num(); j++)
+                {
+                    if(boxes[j].type == 'mdat' && sample.offset >= boxes[j].DataOffset() && sample.offset+sample.size <= boxes[j].offset+boxes[j].size)
+                        bInside = true;
+                }
+
+                if(!bInside)
+                    numOutside++;
+            }
+        }
+
+        Check(numBadData == 0, TEXT("%u %s samples differ from what was sent, the first is %u"), numBadData, lpTrack, firstBadData);
+        Check(numBadTimes == 0, TEXT("%u %s samples have the wrong decode time, the first is %u (%llu)"), numBadTimes, lpTrack, firstBadTime,
+            firstBadTime < track.samples.Num() ? track.samples[firstBadTime].decodeTime : 0);
+        Check(numBadOffsets == 0, TEXT("%u %s samples have the wrong composition offset"), numBadOffsets, lpTrack);
+        Check(numBadSync == 0, TEXT("%u %s samples are marked sync wrongly"), numBadSync, lpTrack);
+        Check(numOutside == 0, TEXT("%u %s samples lie outside the mdat"), numOutside, lpTrack);
+    }
+
+    void VerifyMP4(const List<BYTE> &file, bool bFragmented)
+    {
+        List<MP4Box> boxes;
+        if(!ReadBoxes(file, 0, file.Num(), boxes))
+        {
+            Check(false, TEXT("top level boxes don't add up to the file size"));
+            return;
+        }
+
+        const MP4Box *moov = NULL;
+        for(UINT i=0; i<boxes.Num(); i++)
+        {
+            if(boxes[i].type == 'moov')
+                moov = &boxes[i];
+        }
+
+        if(!boxes.Num() || boxes[0].type != 'ftyp' || !moov)
+        {
+            Check(false, TEXT("no ftyp or moov"));
+            return;
+        }
+
+        //-------------------------------------------------------------
+
+        List<MP4Box> moovBoxes;
+        ReadBoxes(file, moov->DataOffset(), moov->offset+moov->size, moovBoxes);
+
+        MP4Track tracks[2];
+        UINT numTracks = 0;
+
+        for(UINT i=0; i<moovBoxes.Num(); i++)
+        {
+            if(moovBoxes[i].type != 'trak')
+                continue;
+
+            if(numTracks == 2)
+            {
+                Check(false, TEXT("more than two tracks"));
+                break;
+            }
+
+            if(ReadMP4Track(file, moovBoxes[i], tracks[numTracks]))
+                numTracks++;
+        }
+
+        MP4Track *videoTrack = NULL, *audioTrack = NULL;
+        for(UINT i=0; i<numTracks; i++)
+        {
+            if(tracks[i].handler == 'vide')
+                videoTrack = tracks+i;
+            else if(tracks[i].handler == 'soun')
+                audioTrack = tracks+i;
+        }
+
+        if(!videoTrack || !audioTrack)
+        {
+            for(UINT i=0; i<2; i++)
+                tracks[i].samples.Clear();
+
+            Check(false, TEXT("no video or audio track"));
+            return;
+        }
+
+        //the decoder configurations have to be the ones the encoders gave
+        MP4Box avcC, esds;
+        Check(videoTrack->sampleEntry.type == 'avc1' && FindChildBox(file, videoTrack->sampleEntry, 'avcC', avcC, 78) &&
+              avcC.DataSize() == videoHeaders.Num()-5 && memcmp(file.Array()+avcC.DataOffset(), videoHeaders.Array()+5, videoHeaders.Num()-5) == 0,
+              TEXT("avcC doesn't hold the encoder's SPS and PPS"));
+
+        bool bFoundConfig = false;
+        if(audioTrack->sampleEntry.type == 'mp4a' && FindChildBox(file, audioTrack->sampleEntry, 'esds', esds, 28))
+        {
+            const BYTE decoderConfig[] = {0x05, 0x02, testAudioHeaders[2], testAudioHeaders[3]};
+            for(UINT64 i=esds.DataOffset(); i+sizeof(decoderConfig) <= esds.offset+esds.size; i++)
+            {
+                if(memcmp(file.Array()+i, decoderConfig, sizeof(decoderConfig)) == 0)
+                    bFoundConfig = true;
+            }
+        }
+        Check(bFoundConfig, TEXT("esds doesn't hold the encoder's AAC config"));
+
+        //-------------------------------------------------------------
+
+        if(bFragmented)
+        {
+            MP4Box mvex;
+            List<MP4Box> trexs;
+
+            if(FindChildBox(file, *moov, 'mvex', mvex) && ReadBoxes(file, mvex.DataOffset(), mvex.offset+mvex.size, trexs))
+            {
+                for(UINT i=0; i<trexs.Num(); i++)
+                {
+                    if(trexs[i].type != 'trex' || trexs[i].DataSize() < 24)
+                        continue;
+
+                    const BYTE *lpTrex = file.Array()+trexs[i].DataOffset();
+                    for(UINT j=0; j<numTracks; j++)
+                    {
+                        if(tracks[j].trackID == ReadBE32(lpTrex+4))
+                            tracks[j].defaultSampleFlags = ReadBE32(lpTrex+20);
+                    }
+                }
+            }
+            else
+                Check(false, TEXT("no mvex"));
+
+            ReadMP4Fragments(file, boxes, tracks, numTracks);
+        }
+
+        CompareMP4Track(file, *videoTrack, videoSamples, boxes, bFragmented);
+        CompareMP4Track(file, *audioTrack, audioSamples, boxes, bFragmented);
+
+        for(UINT i=0; i<2; i++)
+            tracks[i].samples.Clear();
+    }
+
+    //-----------------------------------------------------------------
+
+    //what TSFileStream makes of a video sample: an access unit delimiter, SPS and PPS in front of
+    //keyframes, the SEI in front of the very first frame, then the frame's NALs, all with start codes
+    void GetExpectedVideoPES(UINT sampleIndex, List<BYTE> &data)
+    {
+        static const BYTE accessUnitDelimiter[2] = {0x09, 0xF0};
+        const ExpectedSample &sample = videoSamples[sampleIndex];
+
+        data.Clear();
+        AppendAnnexB(data, accessUnitDelimiter, sizeof(accessUnitDelimiter));
+
+        if(sample.bKeyframe)
+        {
+            AppendAnnexB(data, testSPS, sizeof(testSPS));
+            AppendAnnexB(data, testPPS, sizeof(testPPS));
+        }
+
+        if(sampleIndex == 0)
+            AppendAVCCAsAnnexB(data, testSEI, sizeof(testSEI));
+
+        for(UINT i=0; i<sample.numPackets; i++)
+        {
+            const TestPacket &packet = packets[sample.firstPacket+i];
+            AppendAVCCAsAnnexB(data, packet.data.Array()+5, packet.data.Num()-5);
+        }
+    }
+
+    //a PAT or PMT section, every copy of which has to be the same as the first
+    bool ReadPSISection(const BYTE *lpPayload, UINT payloadSize, BYTE tableID, List<BYTE> &firstSection, const BYTE *&lpSection, UINT &sectionSize)
+    {
+        if(!payloadSize || 1+UINT(lpPayload[0])+3 > payloadSize)
+            return false;
+
+        lpSection = lpPayload+1+lpPayload[0];
+        sectionSize = 3 + (ReadBE16(lpSection+1) & 0xFFF);
+
+        if(lpSection[0] != tableID || !(lpSection[1] & 0x80) || sectionSize < 16 ||
+           sectionSize > payloadSize-1-lpPayload[0] || SectionCRC(lpSection, sectionSize) != 0)
+        {
+            return false;
+        }
+
+        if(!firstSection.Num())
+            firstSection.CopyArray(lpSection, sectionSize);
+
+        return firstSection.Num() == sectionSize && memcmp(firstSection.Array(), lpSection, sectionSize) == 0;
+    }
+
+    void FinishPES(TSStream &stream, bool bWholeStream, const List<UINT64> &segmentOffsets, List<DWORD> &segmentStartTimes)
+    {
+        if(!stream.bStarted)
+            return;
+
+        stream.bStarted = false;
+
+        CTSTR lpStream = stream.bVideo ? TEXT("video") : TEXT("audio");
+        const BYTE *lpPES = stream.pes.Array();
+        UINT size = stream.pes.Num();
+        UINT64 pts = 0, dts = 0;
+
+        bool bValid = size >= 9 && lpPES[0] == 0 && lpPES[1] == 0 && lpPES[2] == 1 && size >= 9+UINT(lpPES[8]);
+        if(bValid)
+        {
+            UINT pesLength = ReadBE16(lpPES+4);
+            BYTE timestampFlags = lpPES[7] & 0xC0;
+
+            //only video can leave the length open
+            bValid = (stream.bVideo ? (lpPES[3] & 0xF0) == 0xE0 : (lpPES[3] & 0xE0) == 0xC0) &&
+                     (pesLength ? pesLength == size-6 : stream.bVideo);
+
+            if(timestampFlags == 0xC0)
+                bValid = bValid && lpPES[8] >= 10 && ReadPESTimestamp(lpPES+9, 3, pts) && ReadPESTimestamp(lpPES+14, 1, dts);
+            else if(timestampFlags == 0x80)
+            {
+                bValid = bValid && lpPES[8] >= 5 && ReadPESTimestamp(lpPES+9, 2, pts);
+                dts = pts;
+            }
+            else
+                bValid = false;
+        }
+
+        if(!bValid)
+        {
+            StreamCheck(false, TEXT("malformed %s PES at %llu"), lpStream, stream.pesOffset);
+            stream.pes.Clear();
+            return;
+        }
+
+        const BYTE *lpPayload = lpPES+9+lpPES[8];
+        UINT payloadSize = size-9-lpPES[8];
+
+        //a decoder has to have the data in hand before it's due, but not so far ahead it has to buffer seconds of it
+        if(stream.bVideo)
+            StreamCheck(stream.bCarriesPCR && dts >= stream.pcr && dts-stream.pcr <= MAX_PCR_LEAD,
+                TEXT("video PES at %llu has DTS %llu against PCR %llu"), stream.pesOffset, dts, stream.pcr);
+        else
+            StreamCheck(pts >= stream.pcr, TEXT("audio PES at %llu has PTS %llu, behind the PCR %llu"), stream.pesOffset, pts, stream.pcr);
+
+        //the first video in each segment is where that segment starts
+        UINT segment = segmentStartTimes.Num();
+        if(stream.bVideo && segment < segmentOffsets.Num() && stream.pesOffset >= segmentOffsets[segment])
+        {
+            StreamCheck(segment+1 == segmentOffsets.Num() || stream.pesOffset < segmentOffsets[segment+1], TEXT("segment %u has no video"), segment);
+            StreamCheck(stream.bRandomAccess, TEXT("segment %u doesn't start on a keyframe"), segment);
+            segmentStartTimes << DWORD((dts-TS_TEST_PTS_OFFSET)/90);
+        }
+
+        //-------------------------------------------------------------
+
+        List<ExpectedSample> &expected = stream.bVideo ? videoSamples : audioSamples;
+        UINT64 timestamp = stream.bVideo ? dts : pts;
+
+        //a whole stream starts with the first frame sent, the segments left in a rolling playlist pick up partway
+        if(stream.nextSample == -1)
+        {
+            UINT first;
+            for(first=0; first<expected.Num(); first++)
+            {
+                if(UINT64(expected[first].timestamp)*90+TS_TEST_PTS_OFFSET == timestamp)
+                    break;
+            }
+
+            StreamCheck(first < expected.Num() && (!bWholeStream || first == 0), TEXT("first %s PES (%llu) doesn't line up with the frames sent"), lpStream, timestamp);
+            stream.nextSample = INT(first);
+        }
+
+        UINT sampleIndex = UINT(stream.nextSample++);
+        if(sampleIndex >= expected.Num())
+        {
+            StreamCheck(false, TEXT("%s PES at %llu is past the last frame sent"), lpStream, stream.pesOffset);
+            stream.pes.Clear();
+            return;
+        }
+
+        const ExpectedSample &sample = expected[sampleIndex];
+        UINT64 expectedTime = UINT64(sample.timestamp)*90+TS_TEST_PTS_OFFSET;
+
+        if(stream.bVideo)
+        {
+            StreamCheck(dts == expectedTime && INT64(pts-dts) == INT64(sample.compositionOffset)*90,
+                TEXT("video frame %u has PTS %llu DTS %llu, expected %llu (offset %d ms)"), sampleIndex, pts, dts, expectedTime, sample.compositionOffset);
+            StreamCheck(stream.bRandomAccess == sample.bKeyframe, TEXT("video frame %u random access indicator is %d"), sampleIndex, stream.bRandomAccess);
+
+            GetExpectedVideoPES(sampleIndex, expectedPES);
+            StreamCheck(payloadSize == expectedPES.Num() && memcmp(lpPayload, expectedPES.Array(), payloadSize) == 0,
+                TEXT("video frame %u differs from what was sent (%u bytes, expected %u)"), sampleIndex, payloadSize, expectedPES.Num());
+        }
+        else
+        {
+            const TestPacket &packet = packets[sample.firstPacket];
+            UINT frameSize = packet.data.Num()-2;
+
+            StreamCheck(pts == expectedTime, TEXT("audio frame %u has PTS %llu, expected %llu"), sampleIndex, pts, expectedTime);
+
+            //ADTS header from the encoder's config: sync, mpeg-4, no crc, LC, 44.1khz, stereo, then the frame length
+            bool bMatches = payloadSize == frameSize+7 &&
+                            lpPayload[0] == 0xFF && lpPayload[1] == 0xF1 &&
+                            (lpPayload[2]>>6) == 1 && ((lpPayload[2]>>2) & 0xF) == 4 &&
+                            (((lpPayload[2] & 1)<<2) | (lpPayload[3]>>6)) == 2 &&
+                            (((lpPayload[3] & 3)<<11) | (lpPayload[4]<<3) | (lpPayload[5]>>5)) == payloadSize &&
+                            memcmp(lpPayload+7, packet.data.Array()+2, frameSize) == 0;
+
+            StreamCheck(bMatches, TEXT("audio frame %u differs from what was sent"), sampleIndex);
+        }
+
+        stream.pes.Clear();
+    }
+
+    //reads a transport stream (or hls segments back to back), checking the packet layer as it goes and
+    //each PES against the frame it should hold.  segmentOffsets are where each segment starts,
+    //segmentStartTimes gets the time of each one's first video frame.  unless bWholeStream is set, the
+    //stream only has to hold the tail end of what was sent
+    void VerifyTS(const List<BYTE> &file, const List<UINT64> &segmentOffsets, bool bWholeStream, List<DWORD> &segmentStartTimes)
+    {
+        numStreamErrors = 0;
+
+        if(!file.Num() || file.Num()%TS_TEST_PACKET_SIZE)
+        {
+            Check(false, TEXT("%u bytes isn't a whole number of packets"), file.Num());
+            return;
+        }
+
+        TSStream streams[2];
+        for(UINT i=0; i<2; i++)
+        {
+            streams[i].pid = TS_TEST_NO_PID;
+            streams[i].bVideo = (i == 0);
+            streams[i].bStarted = false;
+            streams[i].nextSample = -1;
+        }
+
+        List<BYTE> nextCC, firstPAT, firstPMT;
+        nextCC.SetSize(0x2000); //0x10 plus the next continuity counter for each pid, 0 until it's seen
+
+        UINT pmtPID = TS_TEST_NO_PID, pcrPID = TS_TEST_NO_PID;
+        UINT64 lastPCR = 0;
+        bool bHavePCR = false, bPATSinceVideo = false, bPMTSinceVideo = false;
+
+        for(UINT64 pos=0; pos<file.Num(); pos+=TS_TEST_PACKET_SIZE)
+        {
+            const BYTE *lpPacket = file.Array()+pos;
+            UINT pid = ReadBE16(lpPacket+1) & 0x1FFF;
+            bool bUnitStart = (lpPacket[1] & 0x40) != 0;
+            BYTE adaptationControl = (lpPacket[3]>>4) & 3;
+            BYTE cc = lpPacket[3] & 0xF;
+
+            if(lpPacket[0] != 0x47 || (lpPacket[1] & 0x80) || (lpPacket[3] & 0xC0) || !adaptationControl)
+            {
+                StreamCheck(false, TEXT("bad packet header at %llu"), pos);
+                continue;
+            }
+
+            //counters only go up on packets with payload, and every packet here has some
+            if(adaptationControl & 1)
+            {
+                StreamCheck(!nextCC[pid] || cc == (nextCC[pid] & 0xF), TEXT("pid %x continuity counter is %u at %llu, expected %u"),
+                    pid, cc, pos, nextCC[pid] & 0xF);
+                nextCC[pid] = BYTE(0x10 | ((cc+1) & 0xF));
+            }
+
+            UINT payloadPos = 4;
+            bool bRandomAccess = false, bPCR = false;
+
+            if(adaptationControl & 2)
+            {
+                UINT adaptationSize = lpPacket[4];
+                if(adaptationSize > ((adaptationControl & 1) ? 182U : 183U))
+                {
+                    StreamCheck(false, TEXT("adaptation field at %llu is too long"), pos);
+                    continue;
+                }
+
+                if(adaptationSize)
+                {
+                    bRandomAccess = (lpPacket[5] & 0x40) != 0;
+
+                    if(lpPacket[5] & 0x10)
+                    {
+                        if(adaptationSize < 7)
+                        {
+                            StreamCheck(false, TEXT("adaptation field at %llu is too short for its PCR"), pos);
+                            continue;
+                        }
+
+                        UINT64 pcr = (UINT64(ReadBE32(lpPacket+6))<<1) | (lpPacket[10]>>7);
+
+                        StreamCheck(pid == pcrPID, TEXT("PCR at %llu on pid %x"), pos, pid);
+                        StreamCheck(!bHavePCR || (pcr >= lastPCR && pcr-lastPCR <= MAX_PCR_INTERVAL), TEXT("PCR goes from %llu to %llu at %llu"), lastPCR, pcr, pos);
+
+                        lastPCR = pcr;
+                        bHavePCR = bPCR = true;
+                    }
+                }
+
+                payloadPos = 5+adaptationSize;
+            }
+
+            if(!(adaptationControl & 1))
+                continue;
+
+            const BYTE *lpPayload = lpPacket+payloadPos;
+            UINT payloadSize = TS_TEST_PACKET_SIZE-payloadPos;
+            const BYTE *lpSection;
+            UINT sectionSize;
+
+            //---------------------------------------------------------
+
+            if(pid == 0)
+            {
+                if(!bUnitStart || !ReadPSISection(lpPayload, payloadSize, 0x00, firstPAT, lpSection, sectionSize))
+                {
+                    StreamCheck(false, TEXT("bad PAT at %llu"), pos);
+                    continue;
+                }
+
+                //one program, pointing at the PMT
+                StreamCheck(sectionSize == 16 && ReadBE16(lpSection+8) != 0, TEXT("PAT doesn't hold exactly one program"));
+                pmtPID = ReadBE16(lpSection+10) & 0x1FFF;
+                bPATSinceVideo = true;
+                continue;
+            }
+
+            if(pid == pmtPID)
+            {
+                if(!bUnitStart || !ReadPSISection(lpPayload, payloadSize, 0x02, firstPMT, lpSection, sectionSize))
+                {
+                    StreamCheck(false, TEXT("bad PMT at %llu"), pos);
+                    continue;
+                }
+
+                pcrPID = ReadBE16(lpSection+8) & 0x1FFF;
+
+                UINT streamPos = 12 + (ReadBE16(lpSection+10) & 0xFFF);
+                while(streamPos+5 <= sectionSize-4)
+                {
+                    BYTE streamType = lpSection[streamPos];
+                    UINT streamPID = ReadBE16(lpSection+streamPos+1) & 0x1FFF;
+
+                    if(streamType == TS_TEST_STREAM_H264)
+                        streams[0].pid = streamPID;
+                    else if(streamType == TS_TEST_STREAM_AAC)
+                        streams[1].pid = streamPID;
+                    else
+                        StreamCheck(false, TEXT("PMT has an unexpected stream type %x"), streamType);
+
+                    streamPos += 5 + (ReadBE16(lpSection+streamPos+3) & 0xFFF);
+                }
+
+                StreamCheck(streams[0].pid != TS_TEST_NO_PID && streams[1].pid != TS_TEST_NO_PID && pcrPID == streams[0].pid,
+                    TEXT("PMT doesn't describe the H.264 and AAC streams with the PCR on the video"));
+                bPMTSinceVideo = true;
+                continue;
+            }
+
+            //---------------------------------------------------------
+
+            TSStream *stream = NULL;
+            for(UINT i=0; i<2; i++)
+            {
+                if(streams[i].pid == pid)
+                    stream = streams+i;
+            }
+
+            if(!stream)
+            {
+                StreamCheck(false, TEXT("packet at %llu on pid %x, which isn't in the PMT"), pos, pid);
+                continue;
+            }
+
+            if(bUnitStart)
+            {
+                FinishPES(*stream, bWholeStream, segmentOffsets, segmentStartTimes);
+
+                stream->bStarted = true;
+                stream->pesOffset = pos;
+                stream->bRandomAccess = bRandomAccess;
+                stream->bCarriesPCR = bPCR;
+                stream->pcr = lastPCR;
+
+                //players can only join at a keyframe if the tables come right before it
+                if(stream->bVideo)
+                {
+                    StreamCheck(!bRandomAccess || (bPATSinceVideo && bPMTSinceVideo), TEXT("random access point at %llu without a PAT and PMT in front of it"), pos);
+                    bPATSinceVideo = bPMTSinceVideo = false;
+                }
+            }
+            else if(!stream->bStarted)
+            {
+                StreamCheck(false, TEXT("%s payload at %llu before any PES starts"), stream->bVideo ? TEXT("video") : TEXT("audio"), pos);
+                continue;
+            }
+
+            stream->pes.AppendArray(lpPayload, payloadSize);
+        }
+
+        for(UINT i=0; i<2; i++)
+            FinishPES(streams[i], bWholeStream, segmentOffsets, segmentStartTimes);
+
+        //-------------------------------------------------------------
+
+        //each segment has to be decodable on its own, so it opens with the tables
+        for(UINT i=0; i<segmentOffsets.Num(); i++)
+        {
+            UINT64 offset = segmentOffsets[i];
+            bool bTablesFirst = offset+TS_TEST_PACKET_SIZE*2 <= file.Num() &&
+                                (ReadBE16(file.Array()+offset+1) & 0x1FFF) == 0 &&
+                                (ReadBE16(file.Array()+offset+TS_TEST_PACKET_SIZE+1) & 0x1FFF) == pmtPID;
+
+            StreamCheck(bTablesFirst, TEXT("segment %u doesn't start with a PAT and PMT"), i);
+        }
+
+        StreamCheck(segmentStartTimes.Num() == segmentOffsets.Num(), TEXT("%u of %u segments have video"), segmentStartTimes.Num(), segmentOffsets.Num());
+
+        //both streams have to run to the last frame sent
+        for(UINT i=0; i<2; i++)
+        {
+            List<ExpectedSample> &expected = streams[i].bVideo ? videoSamples : audioSamples;
+            UINT numRead = (streams[i].nextSample == -1) ? 0 : UINT(streams[i].nextSample);
+
+            StreamCheck(numRead == expected.Num(), TEXT("%s ends at frame %u of %u"),
+                streams[i].bVideo ? TEXT("video") : TEXT("audio"), numRead, expected.Num());
+
+            streams[i].pes.Clear();
+        }
+
+        Check(numStreamErrors <= MAX_REPORTED_STREAM_ERRORS, TEXT("%u more problems in the stream"), numStreamErrors-MAX_REPORTED_STREAM_ERRORS);
+    }
+
+    //-----------------------------------------------------------------
+
+    inline String GetHLSSegmentFile(CTSTR lpPlaylist, UINT sequence)
+    {
+        return FormattedString(TEXT("%s-%u.ts"), GetPathWithoutExtension(lpPlaylist).Array(), sequence);
+    }
+
+    //checks the playlist, then reads the segments it lists back to back as one stream
+    void VerifyHLS(CTSTR lpPlaylist, bool bRolling, const OutputTestScenario &scenario)
+    {
+        List<BYTE> playlistData;
+        if(!ReadFile(lpPlaylist, playlistData))
+        {
+            Check(false, TEXT("unable to read back '%s'"), lpPlaylist);
+            return;
+        }
+
+        playlistData << 0;
+        String strPlaylist((LPCSTR)playlistData.Array());
+        playlistData.Clear();
+
+        StringList lines;
+        strPlaylist.GetTokenList(lines, '\n', FALSE);
+
+        String strBase = GetPathWithoutExtension(lpPlaylist);
+        CTSTR lpNameBase = srchr(strBase, '/');
+        lpNameBase = lpNameBase ? lpNameBase+1 : strBase.Array();
+
+        //-------------------------------------------------------------
+
+        int version = -1, targetDuration = -1, firstSequence = -1;
+        bool bEnd = false, bPendingDuration = false;
+        List<double> durations;
+        List<UINT64> segmentOffsets;
+        List<BYTE> stream;
+
+        for(UINT i=1; i<lines.Num(); i++)
+        {
+            String &strLine = lines[i];
+            Check(!bEnd, TEXT("playlist goes on after #EXT-X-ENDLIST"));
+
+            if(scmp_n(strLine, TEXT("#EXT-X-VERSION:"), 15) == 0)
+                version = tstoi(strLine.Array()+15);
+            else if(scmp_n(strLine, TEXT("#EXT-X-TARGETDURATION:"), 22) == 0)
+                targetDuration = tstoi(strLine.Array()+22);
+            else if(scmp_n(strLine, TEXT("#EXT-X-MEDIA-SEQUENCE:"), 22) == 0)
+                firstSequence = tstoi(strLine.Array()+22);
+            else if(scmp_n(strLine, TEXT("#EXTINF:"), 8) == 0)
+            {
+                String strDuration = String(strLine.Array()+8).GetToken(0, ',');
+                durations << tstof(strDuration.Array());
+
+                Check(!bPendingDuration, TEXT("two #EXTINF in a row"));
+                bPendingDuration = true;
+            }
+            else if(strLine == TEXT("#EXT-X-ENDLIST"))
+                bEnd = true;
+            else if(strLine.Array()[0] != '#')
+            {
+                UINT segment = segmentOffsets.Num();
+                String strExpectedName = FormattedString(TEXT("%s-%u.ts"), lpNameBase, UINT(firstSequence)+segment);
+
+                Check(bPendingDuration && firstSequence >= 0, TEXT("segment '%s' comes without #EXTINF or #EXT-X-MEDIA-SEQUENCE"), strLine.Array());
+                Check(strLine == strExpectedName, TEXT("segment %u is '%s', expected '%s'"), segment, strLine.Array(), strExpectedName.Array());
+                bPendingDuration = false;
+
+                List<BYTE> segmentData;
+                String strSegmentFile = GetPathDirectory(lpPlaylist) + TEXT("/") + strLine;
+                if(!ReadFile(strSegmentFile, segmentData))
+                {
+                    Check(false, TEXT("unable to read segment '%s'"), strSegmentFile.Array());
+                    return;
+                }
+
+                segmentOffsets << stream.Num();
+                stream.AppendList(segmentData);
+            }
+        }
+
+        Check(lines.Num() && lines[0] == TEXT("#EXTM3U") && version == 3 && targetDuration > 0 && firstSequence >= 0,
+            TEXT("playlist header is incomplete"));
+        Check(bEnd, TEXT("playlist has no #EXT-X-ENDLIST"));
+        Check(!OSFileExists(String(lpPlaylist) + TEXT(".tmp")), TEXT("the temporary playlist was left behind"));
+
+        if(!segmentOffsets.Num() || durations.Num() != segmentOffsets.Num())
+        {
+            Check(false, TEXT("playlist lists %u segments with %u durations"), segmentOffsets.Num(), durations.Num());
+            return;
+        }
+
+        //a player may fetch a segment for as long as it could still be in the playlist it saw last
+        if(bRolling)
+        {
+            Check(segmentOffsets.Num() == OUTPUT_TEST_HLS_PLAYLIST_SIZE, TEXT("rolling playlist holds %u segments"), segmentOffsets.Num());
+
+            if(firstSequence > 0)
+                Check(OSFileExists(GetHLSSegmentFile(lpPlaylist, firstSequence-1)) != 0, TEXT("segment %u was deleted too soon"), firstSequence-1);
+            if(firstSequence > HLS_TEST_DELETE_DELAY)
+                Check(!OSFileExists(GetHLSSegmentFile(lpPlaylist, firstSequence-HLS_TEST_DELETE_DELAY-1)), TEXT("segment %u wasn't deleted"), firstSequence-HLS_TEST_DELETE_DELAY-1);
+        }
+        else
+            Check(firstSequence == 0, TEXT("playlist starts at segment %d"), firstSequence);
+
+        //-------------------------------------------------------------
+
+        List<DWORD> startTimes;
+        VerifyTS(stream, segmentOffsets, !bRolling, startTimes);
+        stream.Clear();
+
+        if(startTimes.Num() != durations.Num())
+            return;
+
+        //each #EXTINF runs from its segment's keyframe to the next one's, and segments are only cut once they've run long enough
+        DWORD endTime = videoSamples.Last().timestamp + 1000/scenario.fps;
+        UINT numBadDurations = 0, numShort = 0;
+
+        for(UINT i=0; i<durations.Num(); i++)
+        {
+            DWORD nextStart = (i+1 < startTimes.Num()) ? startTimes[i+1] : endTime;
+            double duration = double(nextStart-startTimes[i])/1000.0;
+
+            if(fabs(durations[i]-duration) > 0.0005 || UINT(durations[i]+0.5) > UINT(targetDuration))
+                numBadDurations++;
+            if(i+1 < startTimes.Num() && nextStart-startTimes[i] < OUTPUT_TEST_HLS_SEGMENT_SECONDS*1000)
+                numShort++;
+        }
+
+        Check(numBadDurations == 0, TEXT("%u segment durations don't match their contents or the target duration"), numBadDurations);
+        Check(numShort == 0, TEXT("%u segments were cut short"), numShort);
+    }
+
+    void DeleteHLSFiles(CTSTR lpPlaylist, UINT maxSegments)
+    {
+        for(UINT i=0; i<maxSegments; i++)
+            OSDeleteFile(GetHLSSegmentFile(lpPlaylist, i));
+
+        OSDeleteFile(lpPlaylist);
+    }
+
+    //-----------------------------------------------------------------
+
+    void RunCase(const OutputTestScenario &scenario, OutputTestFormat format)
+    {
+        strCase = FormattedString(TEXT("%s %s"), scenario.lpName, outputTestFormatNames[format]);
+        caseFailures = 0;
+
+        bool bHLS = (format == OutputTest_HLS || format == OutputTest_HLSRolling);
+
+        CTSTR lpExtension = TEXT("mp4");
+        if(format == OutputTest_FLV)
+            lpExtension = TEXT("flv");
+        else if(format == OutputTest_TS)
+            lpExtension = TEXT("ts");
+        else if(bHLS)
+            lpExtension = TEXT("m3u8");
+
+        String strFile = FormattedString(TEXT("%s/outputtest-%s-%s.%s"), strDir.Array(), scenario.lpName, outputTestFormatNames[format], lpExtension);
+
+        ConfigOverride fragmented(TEXT("FragmentedMP4"), format == OutputTest_FragmentedMP4 ? 1 : 0);
+        ConfigOverride segmentSeconds(TEXT("HLSSegmentSeconds"), OUTPUT_TEST_HLS_SEGMENT_SECONDS);
+        ConfigOverride playlistSize(TEXT("HLSPlaylistSize"), format == OutputTest_HLSRolling ? OUTPUT_TEST_HLS_PLAYLIST_SIZE : 0);
+        ConfigOverride deleteSegments(TEXT("HLSDeleteSegments"), format == OutputTest_HLSRolling ? 1 : 0);
+
+        VideoFileStream *stream;
+        if(format == OutputTest_FLV)
+            stream = CreateFLVFileStream(strFile);
+        else if(format == OutputTest_TS || bHLS)
+            stream = CreateTSFileStream(strFile);
+        else
+            stream = CreateMP4FileStream(strFile);
+        if(!stream)
+        {
+            Check(false, TEXT("unable to create '%s'"), strFile.Array());
+            return;
+        }
+
+        List<UINT> packetTimes;
+        packetTimes.SetSize(packets.Num());
+        UINT64 totalBytes = 0, totalPacketTime = 0;
+
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        for(UINT i=0; i<packets.Num(); i++)
+        {
+            TestPacket &packet = packets[i];
+
+            QWORD packetStartTime = OSGetTimeMicroseconds();
+            stream->AddPacket(packet.data.Array(), packet.data.Num(), packet.timestamp, packet.type);
+            packetTimes[i] = UINT(OSGetTimeMicroseconds()-packetStartTime);
+
+            totalPacketTime += packetTimes[i];
+            totalBytes += packet.data.Num();
+        }
+
+        QWORD closeStartTime = OSGetTimeMicroseconds();
+
+        delete stream;
+        WaitForMP4FileStreams();
+
+        QWORD endTime = OSGetTimeMicroseconds();
+
+        //-------------------------------------------------------------
+
+        std::sort(packetTimes.Array(), packetTimes.Array()+packetTimes.Num());
+
+        double megabytes = double(totalBytes)/(1024.0*1024.0);
+        double seconds = double(endTime-startTime)/1000000.0;
+
+        Log(TEXT("OutputTest: %-30s %7.1f MB  %7.1f MB/s  AddPacket avg %6.1f us, 99%% %6u us, max %7.2f ms  close %7.1f ms"),
+            strCase.Array(), megabytes, seconds > 0.0 ? megabytes/seconds : 0.0,
+            double(totalPacketTime)/double(packets.Num()), packetTimes[packetTimes.Num()*99/100], double(packetTimes.Last())/1000.0,
+            double(endTime-closeStartTime)/1000.0);
+
+        //-------------------------------------------------------------
+
+        if(bHLS)
+            VerifyHLS(strFile, format == OutputTest_HLSRolling, scenario);
+        else
+        {
+            List<BYTE> file;
+            List<UINT64> segmentOffsets;
+            List<DWORD> segmentStartTimes;
+
+            if(!ReadFile(strFile, file))
+                Check(false, TEXT("unable to read back '%s'"), strFile.Array());
+            else if(format == OutputTest_FLV)
+                VerifyFLV(file);
+            else if(format == OutputTest_TS)
+            {
+                segmentOffsets << 0;
+                VerifyTS(file, segmentOffsets, true, segmentStartTimes);
+            }
+            else
+                VerifyMP4(file, format == OutputTest_FragmentedMP4);
+        }
+
+        //failed files are left behind to look at.  hls segments run a couple of seconds, so there are fewer of them than seconds
+        if(caseFailures)
+            Log(TEXT("OutputTest: Kept '%s'"), strFile.Array());
+        else if(bHLS)
+            DeleteHLSFiles(strFile, scenario.seconds+1);
+        else
+            OSDeleteFile(strFile);
+    }
+
+public:
+    OutputTester(CTSTR lpDir) : strDir(lpDir), numFailures(0), caseFailures(0), numStreamErrors(0)
+    {
+        GetTestVideoHeaders(videoHeaders);
+    }
+
+    void RunScenario(const OutputTestScenario &scenario)
+    {
+        MakeTestPackets(scenario, packets);
+        GetExpectedSamples(packets, videoSamples, audioSamples);
+
+        for(UINT format=0; format<OutputTest_NumFormats; format++)
+            RunCase(scenario, (OutputTestFormat)format);
+
+        FreeTestPackets(packets);
+        videoSamples.Clear();
+        audioSamples.Clear();
+    }
+
+    inline UINT NumFailures() const {return numFailures;}
+};
+
+//-------------------------------------------------------------------
+
+//runs every scenario through every file output with stand-in encoders.  only used from the command
+//line while nothing is running, returns the number of failed checks
+UINT OBS::RunOutputTest(CTSTR lpDir)
+{
+    if(bRunning)
+        return 1;
+
+    String strDir = lpDir;
+    if(strDir.IsEmpty())
+        strDir = GetPathDirectory(AppConfig->GetString(TEXT("Publish"), TEXT("SavePath")));
+    strDir.FindReplace(TEXT("\\"), TEXT("/"));
+
+    if(!OSFileExists(strDir) && !CreatePath(strDir))
+    {
+        Log(TEXT("OutputTest: Unable to create '%s'"), strDir.Array());
+        return 1;
+    }
+
+    //-------------------------------------------------------------
+
+    AudioEncoder *savedAudioEncoder = audioEncoder, *savedRecordingAudioEncoder = recordingAudioEncoder;
+    VideoEncoder *savedVideoEncoder = videoEncoder;
+    UINT savedCX = outputCX, savedCY = outputCY;
+    UINT savedFrameTime = frameTime, savedFPS = fps, savedSampleRate = sampleRateHz;
+
+    TestVideoEncoder testVideoEncoder;
+    TestAudioEncoder testAudioEncoder;
+
+    videoEncoder = &testVideoEncoder;
+    audioEncoder = &testAudioEncoder;
+    recordingAudioEncoder = NULL;
+    outputCX = 1280;
+    outputCY = 720;
+    sampleRateHz = OUTPUT_TEST_SAMPLE_RATE;
+
+    //one file at a time, so segmenting would only get in the way
+    ConfigOverride segmentSize(TEXT("SegmentSizeMB"), 0);
+    ConfigOverride segmentMinutes(TEXT("SegmentMinutes"), 0);
+
+    Log(TEXT("OutputTest: Writing to '%s'"), strDir.Array());
+
+    OutputTester tester(strDir);
+    for(UINT i=0; i<sizeof(outputTestScenarios)/sizeof(outputTestScenarios[0]); i++)
+    {
+        fps = outputTestScenarios[i].fps;
+        frameTime = 1000/fps;
+
+        tester.RunScenario(outputTestScenarios[i]);
+    }
+
+    if(tester.NumFailures())
+        Log(TEXT("OutputTest: %u check(s) failed"), tester.NumFailures());
+    else
+        Log(TEXT("OutputTest: All checks passed"));
+
+    //-------------------------------------------------------------
+
+    videoEncoder = savedVideoEncoder;
+    audioEncoder = savedAudioEncoder;
+    recordingAudioEncoder = savedRecordingAudioEncoder;
+    outputCX = savedCX;
+    outputCY = savedCY;
+    frameTime = savedFrameTime;
+    fps = savedFPS;
+    sampleRateHz = savedSampleRate;
+
+    return tester.NumFailures();
+}
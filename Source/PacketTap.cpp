@@ -0,0 +1,352 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+
+
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile);
+VideoFileStream* CreateFLVFileStream(CTSTR lpFile);
+VideoFileStream* CreateTSFileStream(CTSTR lpFile);
+NetworkStream* CreateRTMPPublisher();
+void WaitForMP4FileStreams();
+
+//packet logs are the encoder settings and headers followed by every packet exactly as it was
+//sent to the outputs, so the outputs can be run again later without capturing anything
+#define PACKET_LOG_MAGIC    0x5053424F //'OBSP'
+#define PACKET_LOG_VERSION  1
+
+#define PACKET_LOG_AAC      0
+#define PACKET_LOG_MP3      1
+
+struct PacketLogHeader
+{
+    DWORD magic, version;
+
+    UINT outputCX, outputCY;
+    UINT frameTime, sampleRateHz;
+
+    UINT audioCodec;
+    UINT audioFrameSize;
+    int audioBitRate, videoBitRate;
+
+    List<BYTE> videoHeaders, audioHeaders, sei;
+
+    void Serialize(Serializer &s)
+    {
+        s << magic << version;
+        if(magic != PACKET_LOG_MAGIC || version != PACKET_LOG_VERSION)
+            return;
+
+        s << outputCX << outputCY << frameTime << sampleRateHz;
+        s << audioCodec << audioFrameSize << audioBitRate << videoBitRate;
+        s << videoHeaders << audioHeaders << sei;
+    }
+};
+
+//-------------------------------------------------------------------
+
+class PacketTapStream : public VideoFileStream
+{
+    XFileAsyncOutputSerializer fileOut;
+    UINT numPackets;
+
+public:
+    bool Init(CTSTR lpFile)
+    {
+        numPackets = 0;
+
+        if(!fileOut.Open(lpFile, XFILE_CREATEALWAYS))
+            return false;
+
+        PacketLogHeader header;
+        header.magic = PACKET_LOG_MAGIC;
+        header.version = PACKET_LOG_VERSION;
+
+        App->GetOutputSize(header.outputCX, header.outputCY);
+        header.frameTime = App->GetFrameTime();
+        header.sampleRateHz = App->GetSampleRateHz();
+
+        AudioEncoder *audioEncoder = App->GetRecordingAudioEncoder();
+        header.audioCodec = scmp(audioEncoder->GetCodec(), TEXT("MP3")) == 0 ? PACKET_LOG_MP3 : PACKET_LOG_AAC;
+        header.audioFrameSize = audioEncoder->GetFrameSize();
+        header.audioBitRate = audioEncoder->GetBitRate();
+        header.videoBitRate = App->GetVideoEncoder()->GetBitRate();
+
+        DataPacket packet;
+        App->GetVideoHeaders(packet);
+        header.videoHeaders.CopyArray(packet.lpPacket, packet.size);
+
+        App->GetRecordingAudioHeaders(packet);
+        header.audioHeaders.CopyArray(packet.lpPacket, packet.size);
+
+        packet.size = 0;
+        App->GetVideoEncoder()->GetSEI(packet);
+        if(packet.size)
+            header.sei.CopyArray(packet.lpPacket, packet.size);
+
+        header.Serialize(fileOut);
+        return true;
+    }
+
+    ~PacketTapStream()
+    {
+        fileOut.Close();
+        Log(TEXT("PacketTap: Logged %u packets"), numPackets);
+    }
+
+    virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        fileOut.OutputByte((BYTE)type);
+        fileOut.OutputDword(timestamp);
+        fileOut.OutputDword(size);
+        fileOut.Serialize(data, size);
+
+        numPackets++;
+    }
+};
+
+
+VideoFileStream* CreatePacketTapStream()
+{
+    String strSavePath = AppConfig->GetString(TEXT("Publish"), TEXT("SavePath"));
+    strSavePath.FindReplace(TEXT("\\"), TEXT("/"));
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+
+    String strFile = FormattedString(TEXT("%s/%u-%02u-%02u-%02u%02u-%02u.obspkt"), GetPathDirectory(strSavePath).Array(),
+        st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond);
+
+    PacketTapStream *tap = new PacketTapStream;
+    if(tap->Init(strFile))
+    {
+        Log(TEXT("PacketTap: Logging packets to '%s'"), strFile.Array());
+        return tap;
+    }
+
+    Log(TEXT("PacketTap: Unable to create '%s'"), strFile.Array());
+    delete tap;
+    return NULL;
+}
+
+//-------------------------------------------------------------------
+// stand-in encoders so the outputs see the same settings and headers they did when the log was made
+
+class ReplayVideoEncoder : public VideoEncoder
+{
+    PacketLogHeader &header;
+
+protected:
+    bool Encode(LPVOID picIn, List<DataPacket> &packets, List<PacketType> &packetTypes, DWORD timestamp) {return false;}
+
+public:
+    ReplayVideoEncoder(PacketLogHeader &header) : header(header) {}
+
+    int  GetBitRate() const {return header.videoBitRate;}
+    bool DynamicBitrateSupported() const {return false;}
+    bool SetBitRate(DWORD maxBitrate, DWORD bufferSize) {return false;}
+
+    void GetHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = header.videoHeaders.Array();
+        packet.size = header.videoHeaders.Num();
+    }
+
+    void GetSEI(DataPacket &packet)
+    {
+        packet.lpPacket = header.sei.Array();
+        packet.size = header.sei.Num();
+    }
+
+    String GetInfoString() const {return TEXT("Packet log replay");}
+};
+
+class ReplayAudioEncoder : public AudioEncoder
+{
+    PacketLogHeader &header;
+
+protected:
+    bool Encode(float *input, UINT numInputFrames, DataPacket &packet, QWORD &timestamp) {return false;}
+
+    void GetHeaders(DataPacket &packet)
+    {
+        packet.lpPacket = header.audioHeaders.Array();
+        packet.size = header.audioHeaders.Num();
+    }
+
+public:
+    ReplayAudioEncoder(PacketLogHeader &header) : header(header) {}
+
+    UINT    GetFrameSize() const {return header.audioFrameSize;}
+    int     GetBitRate() const {return header.audioBitRate;}
+    CTSTR   GetCodec() const {return header.audioCodec == PACKET_LOG_MP3 ? TEXT("MP3") : TEXT("AAC");}
+
+    String  GetInfoString() const {return TEXT("Packet log replay");}
+};
+
+//-------------------------------------------------------------------
+
+//feeds a packet log to the file output (and the stream, if asked) the same way SendFrame does.
+//only used from the command line while nothing is running
+void OBS::ReplayPacketLog(CTSTR lpLog, bool bRealTime, bool bStream)
+{
+    if(bRunning)
+        return;
+
+    XFileInputSerializer input;
+    if(!input.Open(lpLog))
+    {
+        Log(TEXT("PacketReplay: Unable to open '%s'"), lpLog);
+        return;
+    }
+
+    UINT64 logSize = input.GetFile().GetFileSize();
+
+    PacketLogHeader header;
+    header.magic = header.version = 0;
+    header.Serialize(input);
+    if(header.magic != PACKET_LOG_MAGIC || header.version != PACKET_LOG_VERSION)
+    {
+        Log(TEXT("PacketReplay: '%s' is not a packet log this version can read"), lpLog);
+        return;
+    }
+
+    //-------------------------------------------------------------
+
+    AudioEncoder *savedAudioEncoder = audioEncoder;
+    VideoEncoder *savedVideoEncoder = videoEncoder;
+    UINT savedCX = outputCX, savedCY = outputCY;
+    UINT savedFrameTime = frameTime, savedSampleRate = sampleRateHz;
+
+    ReplayVideoEncoder replayVideoEncoder(header);
+    ReplayAudioEncoder replayAudioEncoder(header);
+
+    videoEncoder = &replayVideoEncoder;
+    audioEncoder = &replayAudioEncoder;
+    outputCX = header.outputCX;
+    outputCY = header.outputCY;
+    frameTime = header.frameTime;
+    sampleRateHz = header.sampleRateHz;
+
+    //-------------------------------------------------------------
+
+    String strSavePath = AppConfig->GetString(TEXT("Publish"), TEXT("SavePath"));
+    String strExtension = GetPathExtension(strSavePath);
+    if(!strExtension.CompareI(TEXT("flv")) && !strExtension.CompareI(TEXT("ts")) && !strExtension.CompareI(TEXT("m3u8")))
+        strExtension = TEXT("mp4");
+
+    String strOutputFile = GetPathWithoutExtension(lpLog) + TEXT("-replay.") + strExtension;
+
+    if(strExtension.CompareI(TEXT("flv")))
+        fileStream = CreateFLVFileStream(strOutputFile);
+    else if(strExtension.CompareI(TEXT("mp4")))
+        fileStream = CreateMP4FileStream(strOutputFile);
+    else
+        fileStream = CreateTSFileStream(strOutputFile);
+
+    if(!fileStream)
+        Log(TEXT("PacketReplay: Unable to create '%s'"), strOutputFile.Array());
+
+    if(bStream)
+    {
+        network = CreateRTMPPublisher();
+        network->BeginPublishing();
+    }
+
+    numFilePackets = numFileTimestampErrors = 0;
+    fileBytes = 0;
+    filePacketTime = maxFilePacketTime = 0;
+    lastFileVideoTimestamp = lastFileAudioTimestamp = 0;
+
+    Log(TEXT("PacketReplay: Replaying '%s' to '%s'%s, %s"), lpLog, strOutputFile.Array(),
+        bStream ? TEXT(" and the stream") : TEXT(""), bRealTime ? TEXT("in real time") : TEXT("as fast as possible"));
+
+    //-------------------------------------------------------------
+
+    List<BYTE> packetData;
+    UINT numPackets = 0;
+    UINT64 totalBytes = 0;
+    DWORD firstTimestamp = 0;
+
+    QWORD startTime = OSGetTimeMicroseconds();
+
+    while(input.GetPos() < logSize)
+    {
+        BYTE type;
+        DWORD timestamp, size;
+        input << type << timestamp << size;
+
+        if(input.GetPos()+size > logSize)
+        {
+            Log(TEXT("PacketReplay: Log ends partway through a packet, stopping there"));
+            break;
+        }
+
+        packetData.SetSize(size);
+        input.Serialize(packetData.Array(), size);
+
+        if(!numPackets)
+            firstTimestamp = timestamp;
+
+        if(bRealTime)
+        {
+            QWORD dueTime = startTime + QWORD(timestamp-firstTimestamp)*1000;
+            QWORD curTime = OSGetTimeMicroseconds();
+            if(dueTime > curTime)
+                OSSleep(DWORD((dueTime-curTime)/1000));
+        }
+
+        if(network)
+            network->SendPacket(packetData.Array(), size, timestamp, (PacketType)type);
+        if(fileStream)
+            AddFilePacket(fileStream, packetData.Array(), size, timestamp, (PacketType)type);
+
+        numPackets++;
+        totalBytes += size;
+    }
+
+    //-------------------------------------------------------------
+
+    NetworkStream *tempNetwork = network;
+    network = NULL;
+    delete tempNetwork;
+
+    VideoFileStream *tempStream = fileStream;
+    fileStream = NULL;
+    delete tempStream;
+
+    double replayTime = double(OSGetTimeMicroseconds()-startTime)/1000000.0;
+    double megabytes = double(totalBytes)/(1024.0*1024.0);
+
+    Log(TEXT("PacketReplay: %u packets, %g MB in %g seconds, %g MB/s"), numPackets, megabytes, replayTime,
+        replayTime > 0.0 ? megabytes/replayTime : 0.0);
+    if(numFilePackets)
+        Log(TEXT("PacketReplay: AddPacket average %g us, max %g ms, %u out of order timestamps"),
+            double(filePacketTime)/double(numFilePackets), double(maxFilePacketTime)/1000.0, numFileTimestampErrors);
+
+    //mp4 output finishes on its own thread, and needs the stand-in encoder settings until then
+    WaitForMP4FileStreams();
+
+    videoEncoder = savedVideoEncoder;
+    audioEncoder = savedAudioEncoder;
+    outputCX = savedCX;
+    outputCY = savedCY;
+    frameTime = savedFrameTime;
+    sampleRateHz = savedSampleRate;
+}
@@ -1426,12 +1426,14 @@ void RTMPPublisher::SendLoop()
 
 DWORD RTMPPublisher::SendThread(RTMPPublisher *publisher)
 {
+    allocationTag("rtmp send");
     publisher->SendLoop();
     return 0;
 }
 
 DWORD RTMPPublisher::SocketThread(RTMPPublisher *publisher)
 {
+    allocationTag("rtmp socket");
     publisher->SocketLoop();
     return 0;
 }
@@ -219,8 +219,9 @@ char* OBS::EncMetaData(char *enc, char *pend, bool bFLVFile)
 {
     int    maxBitRate    = GetVideoEncoder()->GetBitRate();
     int    fps           = GetFPS();
-    int    audioBitRate  = GetAudioEncoder()->GetBitRate();
-    CTSTR  lpAudioCodec  = GetAudioEncoder()->GetCodec();
+    AudioEncoder *metaAudioEncoder = bFLVFile ? GetRecordingAudioEncoder() : GetAudioEncoder();
+    int    audioBitRate  = metaAudioEncoder->GetBitRate();
+    CTSTR  lpAudioCodec  = metaAudioEncoder->GetCodec();
 
     //double audioCodecID;
     const AVal *av_codecFourCC;
@@ -238,10 +239,13 @@ char* OBS::EncMetaData(char *enc, char *pend, bool bFLVFile)
         //audioCodecID = 2.0;
     }
 
+    char *lpNumProperties = NULL;
+
     if(bFLVFile)
     {
         *enc++ = AMF_ECMA_ARRAY;
-        enc = AMF_EncodeInt32(enc, pend, 14);
+        lpNumProperties = enc;
+        enc = AMF_EncodeInt32(enc, pend, 0);
     }
     else
         *enc++ = AMF_OBJECT;
@@ -279,5 +283,16 @@ char* OBS::EncMetaData(char *enc, char *pend, bool bFLVFile)
     *enc++ = 0;
     *enc++ = AMF_OBJECT_END;
 
+    //the ecma array count comes from what was actually written, so properties can be added above freely
+    if(lpNumProperties)
+    {
+        char *lpProperties = lpNumProperties+4;
+
+        AMFObject properties;
+        AMF_Decode(&properties, lpProperties, int(enc-lpProperties), TRUE);
+        AMF_EncodeInt32(lpNumProperties, pend, properties.o_num);
+        AMF_Reset(&properties);
+    }
+
     return enc;
 }
@@ -0,0 +1,281 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+
+
+VideoFileStream* CreateMP4FileStream(CTSTR lpFile);
+VideoFileStream* CreateFLVFileStream(CTSTR lpFile);
+
+//packet data is shared by the ring and any save in progress, so the ring can
+//evict packets while they're still being written out
+struct ReplayPacketData
+{
+    volatile LONG refs;
+    UINT size;
+    BYTE data[1];
+};
+
+struct ReplayPacket
+{
+    ReplayPacketData *packet;
+    DWORD timestamp;
+    PacketType type;
+};
+
+struct ReplayKeyframe
+{
+    UINT64 packetID;
+    DWORD timestamp;
+};
+
+inline void ReleaseReplayPacket(ReplayPacketData *packet)
+{
+    if(!InterlockedDecrement(&packet->refs))
+        Free(packet);
+}
+
+struct ReplaySaveJob
+{
+    List<ReplayPacket> packets;
+    String strFile;
+    UINT64 totalBytes;
+    DWORD duration;
+};
+
+//-------------------------------------------------------------------
+
+class ReplayBufferStream : public ReplayBuffer
+{
+    HANDLE hPacketMutex;
+
+    List<ReplayPacket> packets;
+    List<ReplayKeyframe> keyframes;
+    UINT64 firstPacketID;
+
+    UINT64 memoryUsage, peakMemoryUsage;
+    DWORD lastVideoTimestamp;
+    bool bHaveKeyframe;
+
+    DWORD maxDuration;
+    UINT64 maxMemory;
+
+    HANDLE hSaveThread;
+
+    //drops whole GOPs off the front while what's left still covers the duration, or while over the memory cap.
+    //the newest GOP is never dropped, so the ring always starts on a keyframe
+    void EvictPackets()
+    {
+        while(keyframes.Num() >= 2)
+        {
+            bool bOverDuration = (lastVideoTimestamp-keyframes[1].timestamp) >= maxDuration;
+            if(!bOverDuration && memoryUsage <= maxMemory)
+                break;
+
+            UINT count = UINT(keyframes[1].packetID-firstPacketID);
+            for(UINT i=0; i<count; i++)
+            {
+                memoryUsage -= packets[i].packet->size;
+                ReleaseReplayPacket(packets[i].packet);
+            }
+
+            packets.RemoveRange(0, count);
+            keyframes.Remove(0);
+            firstPacketID += count;
+        }
+    }
+
+    static DWORD STDCALL SaveThread(LPVOID param)
+    {
+        ReplaySaveJob *job = (ReplaySaveJob*)param;
+
+        QWORD startTime = OSGetTimeMicroseconds();
+
+        VideoFileStream *fileStream = NULL;
+        if(GetPathExtension(job->strFile).CompareI(TEXT("flv")))
+            fileStream = CreateFLVFileStream(job->strFile);
+        else
+            fileStream = CreateMP4FileStream(job->strFile);
+
+        if(fileStream)
+        {
+            for(UINT i=0; i<job->packets.Num(); i++)
+            {
+                ReplayPacket &packet = job->packets[i];
+                fileStream->AddPacket(packet.packet->data, packet.packet->size, packet.timestamp, packet.type);
+            }
+
+            delete fileStream;
+
+            double saveTime = double(OSGetTimeMicroseconds()-startTime)/1000000.0;
+            double megabytes = double(job->totalBytes)/(1024.0*1024.0);
+
+            Log(TEXT("ReplayBuffer: Saved %g seconds (%u packets, %g MB) to '%s' in %g seconds, %g MB/s"),
+                double(job->duration)/1000.0, job->packets.Num(), megabytes, job->strFile.Array(),
+                saveTime, saveTime > 0.0 ? megabytes/saveTime : 0.0);
+        }
+        else
+            Log(TEXT("ReplayBuffer: Unable to create '%s'"), job->strFile.Array());
+
+        for(UINT i=0; i<job->packets.Num(); i++)
+            ReleaseReplayPacket(job->packets[i].packet);
+
+        delete job;
+        return 0;
+    }
+
+    String GetReplayFileName()
+    {
+        String strSavePath = AppConfig->GetString(TEXT("Publish"), TEXT("SavePath"));
+        strSavePath.FindReplace(TEXT("\\"), TEXT("/"));
+
+        String strDirectory = GetPathDirectory(strSavePath);
+        String strExtension = GetPathExtension(strSavePath);
+        if(!strExtension.CompareI(TEXT("flv")))
+            strExtension = TEXT("mp4");
+
+        SYSTEMTIME st;
+        GetLocalTime(&st);
+
+        return FormattedString(TEXT("%s/Replay %u-%02u-%02u-%02u%02u-%02u.%s"), strDirectory.Array(),
+            st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond, strExtension.Array());
+    }
+
+public:
+    ReplayBufferStream(DWORD maxDuration, UINT64 maxMemory)
+    {
+        hPacketMutex = OSCreateMutex();
+
+        this->maxDuration = maxDuration;
+        this->maxMemory = maxMemory;
+
+        Log(TEXT("ReplayBuffer: Keeping the last %u seconds, up to %u MB"), maxDuration/1000, UINT(maxMemory/(1024*1024)));
+    }
+
+    ~ReplayBufferStream()
+    {
+        if(hSaveThread)
+        {
+            OSWaitForThread(hSaveThread, NULL);
+            OSCloseThread(hSaveThread);
+        }
+
+        for(UINT i=0; i<packets.Num(); i++)
+            ReleaseReplayPacket(packets[i].packet);
+
+        OSCloseMutex(hPacketMutex);
+
+        Log(TEXT("ReplayBuffer: Peak memory use %g MB"), double(peakMemoryUsage)/(1024.0*1024.0));
+    }
+
+    virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        bool bVideo = (type != PacketType_Audio);
+        bool bKeyframe = bVideo && data[0] == 0x17 && (!bHaveKeyframe || timestamp != lastVideoTimestamp);
+
+        //the ring has to start on a keyframe to be playable
+        if(!bHaveKeyframe && !bKeyframe)
+            return;
+
+        //copy outside of the lock so the save thread never waits on a memcpy
+        ReplayPacketData *packetData = (ReplayPacketData*)Allocate(sizeof(ReplayPacketData)+size);
+        packetData->refs = 1;
+        packetData->size = size;
+        mcpy(packetData->data, data, size);
+
+        OSEnterMutex(hPacketMutex);
+
+        if(bKeyframe)
+        {
+            ReplayKeyframe keyframe;
+            keyframe.packetID = firstPacketID+packets.Num();
+            keyframe.timestamp = timestamp;
+            keyframes << keyframe;
+
+            bHaveKeyframe = true;
+        }
+
+        ReplayPacket packet;
+        packet.packet = packetData;
+        packet.timestamp = timestamp;
+        packet.type = type;
+        packets << packet;
+
+        if(bVideo)
+            lastVideoTimestamp = timestamp;
+
+        memoryUsage += size;
+        if(memoryUsage > peakMemoryUsage)
+            peakMemoryUsage = memoryUsage;
+
+        EvictPackets();
+
+        OSLeaveMutex(hPacketMutex);
+    }
+
+    virtual void SaveReplay()
+    {
+        if(hSaveThread)
+        {
+            if(WaitForSingleObject(hSaveThread, 0) == WAIT_TIMEOUT)
+            {
+                Log(TEXT("ReplayBuffer: Still saving the last replay, ignoring save request"));
+                return;
+            }
+
+            OSCloseThread(hSaveThread);
+            hSaveThread = NULL;
+        }
+
+        ReplaySaveJob *job = new ReplaySaveJob;
+        job->strFile = GetReplayFileName();
+
+        //only references are taken here, the ring keeps going while the save thread writes
+        OSEnterMutex(hPacketMutex);
+
+        job->packets.CopyList(packets);
+        for(UINT i=0; i<packets.Num(); i++)
+            InterlockedIncrement(&packets[i].packet->refs);
+
+        job->totalBytes = memoryUsage;
+        job->duration = packets.Num() ? lastVideoTimestamp-packets[0].timestamp : 0;
+
+        OSLeaveMutex(hPacketMutex);
+
+        if(!job->packets.Num())
+        {
+            Log(TEXT("ReplayBuffer: Nothing buffered yet"));
+            delete job;
+            return;
+        }
+
+        hSaveThread = OSCreateThread((XTHREAD)SaveThread, job);
+    }
+
+    virtual UINT64 GetMemoryUsage()
+    {
+        return memoryUsage;
+    }
+};
+
+
+ReplayBuffer* CreateReplayBuffer(DWORD maxDuration, UINT64 maxMemory)
+{
+    return new ReplayBufferStream(maxDuration, maxMemory);
+}
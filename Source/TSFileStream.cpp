@@ -0,0 +1,597 @@
+/********************************************************************************
+ Copyright (C) 2012 Hugh Bailey <obs.jim@gmail.com>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#include "Main.h"
+
+
+#define TS_PACKET_SIZE      188
+#define TS_PAYLOAD_SIZE     184
+
+#define TS_PID_PAT          0x0000
+#define TS_PID_PMT          0x1000
+#define TS_PID_VIDEO        0x0100
+#define TS_PID_AUDIO        0x0101
+
+#define TS_STREAM_H264      0x1B
+#define TS_STREAM_AAC       0x0F //ADTS
+#define TS_STREAM_MP3       0x03
+
+//PTS/DTS run 0.7 seconds ahead of the PCR so decoders have data buffered before it's due
+#define TS_PTS_OFFSET       63000
+
+//old segments are only deleted once they've been out of the playlist for a while, players may still be fetching them
+#define HLS_DELETE_DELAY    2
+
+static DWORD mpegCRCTable[256];
+
+static void InitMPEGCRC()
+{
+    if(mpegCRCTable[1])
+        return;
+
+    for(DWORD i=0; i<256; i++)
+    {
+        DWORD crc = i<<24;
+        for(int bit=0; bit<8; bit++)
+            crc = (crc & 0x80000000) ? (crc<<1)^0x04C11DB7 : (crc<<1);
+        mpegCRCTable[i] = crc;
+    }
+}
+
+static DWORD MPEGCRC(const BYTE *data, UINT size)
+{
+    DWORD crc = 0xFFFFFFFF;
+    while(size--)
+        crc = (crc<<8) ^ mpegCRCTable[((crc>>24) ^ *(data++)) & 0xFF];
+    return crc;
+}
+
+inline LPBYTE WriteTimestamp(LPBYTE lpData, BYTE prefix, UINT64 timestamp)
+{
+    lpData[0] = BYTE((prefix<<4) | ((timestamp>>29) & 0x0E) | 1);
+    lpData[1] = BYTE(timestamp>>22);
+    lpData[2] = BYTE(((timestamp>>14) & 0xFE) | 1);
+    lpData[3] = BYTE(timestamp>>7);
+    lpData[4] = BYTE(((timestamp<<1) & 0xFE) | 1);
+    return lpData+5;
+}
+
+struct HLSSegment
+{
+    String strName;
+    UINT sequence;
+    double duration;
+};
+
+//-------------------------------------------------------------------
+
+class TSFileStream : public VideoFileStream
+{
+    XFileAsyncOutputSerializer fileOut;
+    XFileWriteStats writeStats;
+    String strFile;
+    DWORD writeFlags;
+    QWORD preallocSize;
+
+    bool bHLS, bMP3;
+
+    //hls
+    String strSegmentBase, strSegmentNameBase;
+    List<HLSSegment> segments;
+    UINT segmentSequence, playlistSize;
+    DWORD segmentDuration, segmentStartTime;
+    double maxSegmentDuration;
+    bool bDeleteSegments, bSegmentStarted;
+    bool bSegmentOpen;
+
+    BYTE ccPAT, ccPMT, ccVideo, ccAudio;
+
+    List<BYTE> videoHeaders;    //SPS and PPS as annex b
+    BYTE aacProfile, aacFreqIndex, aacChannels;
+
+    DWORD initialTimestamp;
+    bool bSentSEI;
+
+    //a frame can come in multiple packets, so video is collected until the timestamp changes
+    List<BYTE> videoFrame;
+    DWORD videoFrameTimestamp;
+    INT videoFrameOffset;
+    bool bVideoFrameKeyframe;
+
+    List<BYTE> pesData;
+
+    void WriteTSPackets(UINT pid, BYTE &cc, LPBYTE lpData, UINT size, bool bPCR, UINT64 pcr, bool bRandomAccess)
+    {
+        BYTE packet[TS_PACKET_SIZE];
+        bool bFirst = true;
+
+        while(size)
+        {
+            bool bWritePCR = bFirst && bPCR;
+            bool bWriteRAI = bFirst && bRandomAccess;
+
+            UINT minAdaptationSize = (bWritePCR || bWriteRAI) ? (bWritePCR ? 8 : 2) : 0;
+            UINT payloadSize = MIN(size, TS_PAYLOAD_SIZE-minAdaptationSize);
+            UINT adaptationSize = TS_PAYLOAD_SIZE-payloadSize; //includes any stuffing
+
+            packet[0] = 0x47;
+            packet[1] = BYTE((bFirst ? 0x40 : 0) | ((pid>>8) & 0x1F));
+            packet[2] = BYTE(pid);
+            packet[3] = BYTE((adaptationSize ? 0x30 : 0x10) | cc);
+            cc = (cc+1) & 0xF;
+
+            if(adaptationSize)
+            {
+                packet[4] = BYTE(adaptationSize-1);
+
+                if(adaptationSize > 1)
+                {
+                    UINT pos = 6;
+                    packet[5] = BYTE((bWriteRAI ? 0x40 : 0) | (bWritePCR ? 0x10 : 0));
+
+                    if(bWritePCR)
+                    {
+                        packet[6]  = BYTE(pcr>>25);
+                        packet[7]  = BYTE(pcr>>17);
+                        packet[8]  = BYTE(pcr>>9);
+                        packet[9]  = BYTE(pcr>>1);
+                        packet[10] = BYTE(((pcr & 1)<<7) | 0x7E);
+                        packet[11] = 0;
+                        pos = 12;
+                    }
+
+                    memset(packet+pos, 0xFF, 4+adaptationSize-pos);
+                }
+            }
+
+            mcpy(packet+4+adaptationSize, lpData, payloadSize);
+            fileOut.Serialize(packet, TS_PACKET_SIZE);
+
+            lpData += payloadSize;
+            size -= payloadSize;
+            bFirst = false;
+        }
+    }
+
+    void WritePSI(UINT pid, BYTE &cc, LPBYTE section, UINT sectionSize)
+    {
+        BYTE packet[TS_PACKET_SIZE];
+        packet[0] = 0x47;
+        packet[1] = BYTE(0x40 | ((pid>>8) & 0x1F));
+        packet[2] = BYTE(pid);
+        packet[3] = BYTE(0x10 | cc);
+        packet[4] = 0; //pointer field
+        cc = (cc+1) & 0xF;
+
+        DWORD crc = MPEGCRC(section, sectionSize);
+        mcpy(packet+5, section, sectionSize);
+        packet[5+sectionSize]   = BYTE(crc>>24);
+        packet[5+sectionSize+1] = BYTE(crc>>16);
+        packet[5+sectionSize+2] = BYTE(crc>>8);
+        packet[5+sectionSize+3] = BYTE(crc);
+
+        memset(packet+9+sectionSize, 0xFF, TS_PACKET_SIZE-9-sectionSize);
+        fileOut.Serialize(packet, TS_PACKET_SIZE);
+    }
+
+    void WritePATPMT()
+    {
+        BYTE pat[] =
+        {
+            0x00,                                               //table id
+            0xB0, 13,                                           //section length
+            0x00, 0x01,                                         //transport stream id
+            0xC1, 0x00, 0x00,                                   //version 0, current, section 0 of 0
+            0x00, 0x01,                                         //program number
+            BYTE(0xE0 | (TS_PID_PMT>>8)), BYTE(TS_PID_PMT),     //pmt pid
+        };
+
+        BYTE pmt[] =
+        {
+            0x02,                                               //table id
+            0xB0, 23,                                           //section length
+            0x00, 0x01,                                         //program number
+            0xC1, 0x00, 0x00,                                   //version 0, current, section 0 of 0
+            BYTE(0xE0 | (TS_PID_VIDEO>>8)), BYTE(TS_PID_VIDEO), //pcr pid
+            0xF0, 0x00,                                         //program info length
+            TS_STREAM_H264, BYTE(0xE0 | (TS_PID_VIDEO>>8)), BYTE(TS_PID_VIDEO), 0xF0, 0x00,
+            bMP3 ? TS_STREAM_MP3 : TS_STREAM_AAC, BYTE(0xE0 | (TS_PID_AUDIO>>8)), BYTE(TS_PID_AUDIO), 0xF0, 0x00,
+        };
+
+        WritePSI(TS_PID_PAT, ccPAT, pat, sizeof(pat));
+        WritePSI(TS_PID_PMT, ccPMT, pmt, sizeof(pmt));
+    }
+
+    //-----------------------------------------------------------------
+
+    inline void AppendAnnexB(List<BYTE> &data, LPBYTE lpNAL, UINT size)
+    {
+        static const BYTE startCode[4] = {0, 0, 0, 1};
+        data.AppendArray(startCode, 4);
+        data.AppendArray(lpNAL, size);
+    }
+
+    //converts 4 byte length prefixed NALs to start codes
+    void AppendAVCC(List<BYTE> &data, LPBYTE lpData, UINT size)
+    {
+        while(size > 4)
+        {
+            UINT nalSize = fastHtonl(*(DWORD*)lpData);
+            if(nalSize > size-4)
+                break;
+
+            AppendAnnexB(data, lpData+4, nalSize);
+
+            lpData += nalSize+4;
+            size -= nalSize+4;
+        }
+    }
+
+    void FlushVideoFrame()
+    {
+        if(!videoFrame.Num())
+            return;
+
+        UINT64 dts = UINT64(videoFrameTimestamp)*90 + TS_PTS_OFFSET;
+        UINT64 pts = dts + INT64(videoFrameOffset)*90;
+
+        pesData.SetSize(19);
+        LPBYTE lpHeader = pesData.Array();
+        lpHeader[0] = 0;
+        lpHeader[1] = 0;
+        lpHeader[2] = 1;
+        lpHeader[3] = 0xE0;     //stream id
+        lpHeader[4] = 0;        //packet length (unbounded for video)
+        lpHeader[5] = 0;
+        lpHeader[6] = 0x84;     //data alignment
+        lpHeader[7] = 0xC0;     //pts and dts
+        lpHeader[8] = 10;       //header data length
+        WriteTimestamp(WriteTimestamp(lpHeader+9, 3, pts), 1, dts);
+
+        pesData.AppendList(videoFrame);
+
+        if(bVideoFrameKeyframe)
+            WritePATPMT();
+
+        WriteTSPackets(TS_PID_VIDEO, ccVideo, pesData.Array(), pesData.Num(), true, dts-TS_PTS_OFFSET, bVideoFrameKeyframe);
+
+        videoFrame.Clear();
+    }
+
+    void WriteAudio(LPBYTE lpData, UINT size, DWORD timestamp)
+    {
+        UINT headerSize = bMP3 ? 0 : 7;
+        UINT64 pts = UINT64(timestamp)*90 + TS_PTS_OFFSET;
+
+        pesData.SetSize(14+headerSize+size);
+        LPBYTE lpHeader = pesData.Array();
+
+        UINT pesLength = 8+headerSize+size;
+        lpHeader[0] = 0;
+        lpHeader[1] = 0;
+        lpHeader[2] = 1;
+        lpHeader[3] = 0xC0;     //stream id
+        lpHeader[4] = BYTE(pesLength>>8);
+        lpHeader[5] = BYTE(pesLength);
+        lpHeader[6] = 0x80;
+        lpHeader[7] = 0x80;     //pts only
+        lpHeader[8] = 5;        //header data length
+        WriteTimestamp(lpHeader+9, 2, pts);
+
+        if(!bMP3)
+        {
+            UINT frameLength = size+7;
+
+            LPBYTE lpADTS = lpHeader+14;
+            lpADTS[0] = 0xFF;
+            lpADTS[1] = 0xF1;   //mpeg-4, no crc
+            lpADTS[2] = BYTE(((aacProfile-1)<<6) | (aacFreqIndex<<2) | (aacChannels>>2));
+            lpADTS[3] = BYTE(((aacChannels & 3)<<6) | (frameLength>>11));
+            lpADTS[4] = BYTE(frameLength>>3);
+            lpADTS[5] = BYTE(((frameLength & 7)<<5) | 0x1F);
+            lpADTS[6] = 0xFC;
+        }
+
+        mcpy(lpHeader+14+headerSize, lpData, size);
+
+        WriteTSPackets(TS_PID_AUDIO, ccAudio, pesData.Array(), pesData.Num(), false, 0, false);
+    }
+
+    //-----------------------------------------------------------------
+
+    bool OpenSegment()
+    {
+        String strSegmentFile = strFile;
+
+        if(bHLS)
+        {
+            HLSSegment *segment = segments.CreateNew();
+            segment->sequence = segmentSequence;
+            segment->strName = FormattedString(TEXT("%s-%u.ts"), strSegmentNameBase.Array(), segmentSequence);
+            segment->duration = 0.0;
+
+            strSegmentFile = FormattedString(TEXT("%s-%u.ts"), strSegmentBase.Array(), segmentSequence);
+            segmentSequence++;
+        }
+
+        if(!fileOut.Open(strSegmentFile, XFILE_CREATEALWAYS, 1024*1024, 4, writeFlags, preallocSize))
+        {
+            Log(TEXT("TSFileStream: Unable to create '%s'"), strSegmentFile.Array());
+
+            //keep the failed segment out of the playlist
+            if(bHLS)
+                segments.Remove(segments.Num()-1);
+            return false;
+        }
+
+        bSegmentOpen = true;
+        WritePATPMT();
+        return true;
+    }
+
+    void CloseSegment(DWORD endTimestamp)
+    {
+        fileOut.Close();
+        bSegmentOpen = false;
+
+        XFileWriteStats segmentStats;
+        fileOut.GetStats(segmentStats);
+        writeStats.Add(segmentStats);
+
+        if(bHLS && segments.Num())
+        {
+            double duration = double(endTimestamp-segmentStartTime)/1000.0;
+            segments.Last().duration = duration;
+            if(duration > maxSegmentDuration)
+                maxSegmentDuration = duration;
+        }
+    }
+
+    void WritePlaylist(bool bEnd)
+    {
+        //the last segment is still being written
+        UINT numSegments = bEnd ? segments.Num() : segments.Num()-1;
+        UINT first = (playlistSize && numSegments > playlistSize) ? numSegments-playlistSize : 0;
+
+        if(bDeleteSegments && playlistSize && first > HLS_DELETE_DELAY)
+        {
+            UINT numExpired = first-HLS_DELETE_DELAY;
+            for(UINT i=0; i<numExpired; i++)
+                OSDeleteFile(GetPathDirectory(strFile) + TEXT("/") + segments[i].strName);
+
+            segments.RemoveRange(0, numExpired);
+            numSegments -= numExpired;
+            first -= numExpired;
+        }
+
+        String strPlaylist;
+        strPlaylist << TEXT("#EXTM3U\n#EXT-X-VERSION:3\n");
+        strPlaylist << TEXT("#EXT-X-TARGETDURATION:") << UIntString(UINT(ceil(maxSegmentDuration))) << TEXT("\n");
+        strPlaylist << TEXT("#EXT-X-MEDIA-SEQUENCE:") << UIntString(numSegments ? segments[first].sequence : 0) << TEXT("\n");
+
+        for(UINT i=first; i<numSegments; i++)
+        {
+            strPlaylist << FormattedString(TEXT("#EXTINF:%.3f,\n"), segments[i].duration);
+            strPlaylist << segments[i].strName << TEXT("\n");
+        }
+
+        if(bEnd)
+            strPlaylist << TEXT("#EXT-X-ENDLIST\n");
+
+        //write it to the side and swap it in so players never see a partial playlist
+        String strTempFile = strFile + TEXT(".tmp");
+
+        XFile playlistFile;
+        if(!playlistFile.Open(strTempFile, XFILE_WRITE, XFILE_CREATEALWAYS))
+        {
+            Log(TEXT("TSFileStream: Unable to write playlist '%s'"), strTempFile.Array());
+            return;
+        }
+
+        playlistFile.WriteAsUTF8(strPlaylist, strPlaylist.Length());
+        playlistFile.Close();
+
+        if(!MoveFileEx(strTempFile, strFile, MOVEFILE_REPLACE_EXISTING))
+            Log(TEXT("TSFileStream: Unable to replace playlist '%s': %s"), strFile.Array(), OSGetErrorString(GetLastError()));
+    }
+
+public:
+    bool Init(CTSTR lpFile)
+    {
+        InitMPEGCRC();
+
+        strFile = lpFile;
+        initialTimestamp = -1;
+        zero(&writeStats, sizeof(writeStats));
+
+        writeFlags = AppConfig->GetInt(TEXT("Publish"), TEXT("UnbufferedFileIO"), 0) ? XFILE_ASYNC_UNBUFFERED : 0;
+        if(AppConfig->GetInt(TEXT("Publish"), TEXT("MappedFileIO"), 0))
+            writeFlags = XFILE_ASYNC_MAPPED;
+        preallocSize = QWORD(AppConfig->GetInt(TEXT("Publish"), TEXT("FilePreallocationMB"), 0))*1024*1024;
+
+        bHLS = GetPathExtension(lpFile).CompareI(TEXT("m3u8"));
+        bMP3 = scmp(App->GetRecordingAudioEncoder()->GetCodec(), TEXT("MP3")) == 0;
+
+        if(bHLS)
+        {
+            strSegmentBase = GetPathWithoutExtension(lpFile);
+
+            CTSTR lpName = srchr(strSegmentBase, '/');
+            strSegmentNameBase = lpName ? lpName+1 : strSegmentBase.Array();
+
+            segmentDuration = DWORD(AppConfig->GetInt(TEXT("Publish"), TEXT("HLSSegmentSeconds"), 4))*1000;
+            playlistSize = AppConfig->GetInt(TEXT("Publish"), TEXT("HLSPlaylistSize"), 6);
+            bDeleteSegments = AppConfig->GetInt(TEXT("Publish"), TEXT("HLSDeleteSegments"), 1) != 0;
+        }
+
+        //-------------------------------------------
+        // get video headers
+        DataPacket packet;
+        App->GetVideoHeaders(packet);
+
+        LPBYTE lpHeaderData = packet.lpPacket+11;
+        UINT spsSize = fastHtons(*(WORD*)lpHeaderData);
+        AppendAnnexB(videoHeaders, lpHeaderData+2, spsSize);
+
+        lpHeaderData += spsSize+3;
+        UINT ppsSize = fastHtons(*(WORD*)lpHeaderData);
+        AppendAnnexB(videoHeaders, lpHeaderData+2, ppsSize);
+
+        //-------------------------------------------
+        // get AAC headers to build the ADTS headers from
+        if(!bMP3)
+        {
+            App->GetRecordingAudioHeaders(packet);
+
+            LPBYTE lpConfig = packet.lpPacket+2;
+            aacProfile   = lpConfig[0]>>3;
+            aacFreqIndex = ((lpConfig[0] & 7)<<1) | (lpConfig[1]>>7);
+            aacChannels  = (lpConfig[1]>>3) & 0xF;
+        }
+
+        return OpenSegment();
+    }
+
+    ~TSFileStream()
+    {
+        if(bSegmentOpen)
+        {
+            FlushVideoFrame();
+
+            CloseSegment(initialTimestamp == -1 ? 0 : videoFrameTimestamp+App->GetFrameTime());
+        }
+
+        if(bHLS && initialTimestamp != -1)
+            WritePlaylist(true);
+
+        XFileAsyncOutputSerializer::LogStats(TEXT("TSFileStream"), writeStats);
+    }
+
+    virtual void AddPacket(BYTE *data, UINT size, DWORD timestamp, PacketType type)
+    {
+        if(initialTimestamp == -1)
+        {
+            if(data[0] != 0x17)
+                return;
+
+            initialTimestamp = timestamp;
+        }
+
+        timestamp -= initialTimestamp;
+
+        //after a segment fails to open there's nowhere to write, so everything is dropped until
+        //a later keyframe manages to open a new segment
+        if(!bSegmentOpen)
+        {
+            if(!bHLS || type == PacketType_Audio || data[0] != 0x17 || data[1] == 0 || timestamp == videoFrameTimestamp)
+                return;
+
+            videoFrameTimestamp = timestamp;
+
+            if(!OpenSegment())
+                return;
+
+            segmentStartTime = timestamp;
+            WritePlaylist(false);
+        }
+
+        if(type == PacketType_Audio)
+        {
+            if(bMP3)
+                WriteAudio(data+1, size-1, timestamp);
+            else
+                WriteAudio(data+2, size-2, timestamp);
+            return;
+        }
+
+        //SPS/PPS are sent in front of every keyframe instead
+        if(data[1] == 0)
+            return;
+
+        bool bKeyframe = (data[0] == 0x17);
+
+        if(!videoFrame.Num() || timestamp != videoFrameTimestamp)
+        {
+            FlushVideoFrame();
+
+            //cut hls segments on keyframes so every segment can be decoded on its own
+            if(bHLS && bKeyframe)
+            {
+                if(!bSegmentStarted)
+                {
+                    segmentStartTime = timestamp;
+                    bSegmentStarted = true;
+                }
+                else if(timestamp-segmentStartTime >= segmentDuration)
+                {
+                    CloseSegment(timestamp);
+                    segmentStartTime = timestamp;
+
+                    if(!OpenSegment())
+                    {
+                        videoFrameTimestamp = timestamp;
+                        return;
+                    }
+
+                    WritePlaylist(false);
+                }
+            }
+
+            INT timeOffset = 0;
+            mcpy(((BYTE*)&timeOffset)+1, data+2, 3);
+            if(data[2] >= 0x80)
+                timeOffset |= 0xFF;
+            videoFrameOffset = (INT)fastHtonl(DWORD(timeOffset));
+
+            videoFrameTimestamp = timestamp;
+            bVideoFrameKeyframe = bKeyframe;
+
+            static const BYTE accessUnitDelimiter[2] = {0x09, 0xF0};
+            AppendAnnexB(videoFrame, (LPBYTE)accessUnitDelimiter, 2);
+
+            if(bKeyframe)
+                videoFrame.AppendList(videoHeaders);
+
+            if(!bSentSEI)
+            {
+                DataPacket sei;
+                App->GetVideoEncoder()->GetSEI(sei);
+
+                if(sei.size > 0)
+                {
+                    AppendAVCC(videoFrame, sei.lpPacket, sei.size);
+                    bSentSEI = true;
+                }
+            }
+        }
+
+        AppendAVCC(videoFrame, data+5, size-5);
+    }
+};
+
+
+VideoFileStream* CreateTSFileStream(CTSTR lpFile)
+{
+    TSFileStream *fileStream = new TSFileStream;
+    if(fileStream->Init(lpFile))
+        return fileStream;
+
+    delete fileStream;
+    return NULL;
+}
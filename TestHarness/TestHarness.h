@@ -0,0 +1,174 @@
+/********************************************************************************
+ Copyright (C) 2026 agent <agent@local>
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation; either version 2 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307, USA.
+********************************************************************************/
+
+
+#pragma once
+
+//what the test runners (OBSApiTest, AudioTest) have in common: the checks, the test data generator,
+//the timer and running the suites from the command line.  a runner that passes wide strings to its
+//suites defines TEST_WIDE_STRINGS first, and its main file defines TEST_HARNESS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#ifdef TEST_WIDE_STRINGS
+#include <wchar.h>
+typedef wchar_t TestChar;
+#define TEST_TEXT(str)  L##str
+#define TestVPrintf     vwprintf
+#define TestStrCmp      wcscmp
+#else
+typedef char TestChar;
+#define TEST_TEXT(str)  str
+#define TestVPrintf     vprintf
+#define TestStrCmp      strcmp
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//seconds from an arbitrary start, high resolution
+double GetTestTime(void);
+
+//xorshift, deterministic so runs on different builds see the same input
+unsigned int TestRand(void);
+void SeedTestRand(unsigned int seed);
+
+//counts a failure (and prints it) if bCondition is false
+void TestCheck(int bCondition, const TestChar *format, ...);
+
+typedef struct
+{
+    const TestChar *lpName;
+    int (*run)(int argc, TestChar **argv);
+} TestSuite;
+
+//usage: <runner> [suite [suite options]]
+//with no suite every suite runs with its defaults.  returns the number of failed checks, or 1 if the suite doesn't exist
+int RunTestSuites(const TestSuite *suites, int numSuites, int argc, TestChar **argv);
+
+#ifdef __cplusplus
+}
+#endif
+
+//-------------------------------------------------------------------
+
+#ifdef TEST_HARNESS_IMPLEMENTATION
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static int numFailures = 0;
+static unsigned int randState = 1;
+
+double GetTestTime(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec/1000000000.0;
+#endif
+}
+
+void SeedTestRand(unsigned int seed)
+{
+    randState = seed ? seed : 1;
+}
+
+unsigned int TestRand(void)
+{
+    randState ^= randState << 13;
+    randState ^= randState >> 17;
+    randState ^= randState << 5;
+    return randState;
+}
+
+static void TestPrintf(const TestChar *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    TestVPrintf(format, args);
+    va_end(args);
+}
+
+void TestCheck(int bCondition, const TestChar *format, ...)
+{
+    va_list args;
+
+    if(bCondition)
+        return;
+
+    numFailures++;
+
+    TestPrintf(TEST_TEXT("FAILED: "));
+    va_start(args, format);
+    TestVPrintf(format, args);
+    va_end(args);
+    TestPrintf(TEST_TEXT("\n"));
+}
+
+int RunTestSuites(const TestSuite *suites, int numSuites, int argc, TestChar **argv)
+{
+    //a suite's options come after its name.  with no suite named they're empty, argv[argc] is the terminating null
+    int suiteArgc = (argc > 2) ? argc-2 : 0;
+    TestChar **suiteArgv = argv + ((argc > 2) ? 2 : argc);
+    int i, bRan = 0;
+
+    for(i=0; i<numSuites; i++)
+    {
+        if(argc > 1 && TestStrCmp(argv[1], suites[i].lpName) != 0)
+            continue;
+
+        TestPrintf(TEST_TEXT("---- %s ----\n"), suites[i].lpName);
+        suites[i].run(suiteArgc, suiteArgv);
+        TestPrintf(TEST_TEXT("\n"));
+        bRan = 1;
+    }
+
+    if(!bRan)
+    {
+        TestPrintf(TEST_TEXT("unknown suite '%s', available:"), argv[1]);
+        for(i=0; i<numSuites; i++)
+            TestPrintf(TEST_TEXT(" %s"), suites[i].lpName);
+        TestPrintf(TEST_TEXT("\n"));
+        return 1;
+    }
+
+    if(numFailures)
+        TestPrintf(TEST_TEXT("%d check(s) failed\n"), numFailures);
+    else
+        TestPrintf(TEST_TEXT("all checks passed\n"));
+
+    return numFailures;
+}
+
+#endif
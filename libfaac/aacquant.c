@@ -32,20 +32,33 @@
 
 #define TAKEHIRO_IEEE754_HACK 1
 
+/* the vector paths work on packed singles, so they need float spectra.
+   AACQUANT_NO_SSE builds the scalar paths only, for comparing the two */
+#if !defined(FAAC_PRECISION_DOUBLE) && !defined(AACQUANT_NO_SSE) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define AACQUANT_SSE 1
+#include <emmintrin.h>
+#endif
+
 #define XRPOW_FTOI(src,dest) ((dest) = (int)(src))
 #define QUANTFAC(rx)  adj43[rx]
 #define ROUNDFAC 0.4054
 
 static int FixNoise(CoderInfo *coderInfo,
-		    const double *xr,
-		    double *xr_pow,
+		    const faac_real *xr,
+		    faac_real *xr_pow,
 		    int *xi,
-		    double *xmin,
-		    double *pow43,
-		    double *adj43);
+		    faac_real *xmin,
+		    faac_real *pow43,
+		    faac_real *adj43);
 
 static void CalcAllowedDist(CoderInfo *coderInfo, PsyInfo *psyInfo,
-			    double *xr, double *xmin, int quality);
+			    faac_real *xr, faac_real *xmin, int quality);
+
+static int CalcXrPow(const faac_real *xr, faac_real *xr_pow);
+static double BandMax(const faac_real *x, int start, int end);
+static void BandScale(faac_real *x, int start, int end, double fac);
+static double BandEnergy(const int *xi, int start, int end);
 
 
 void AACQuantizeInit(CoderInfo *coderInfo, unsigned int numChannels,
@@ -53,8 +66,8 @@ void AACQuantizeInit(CoderInfo *coderInfo, unsigned int numChannels,
 {
     unsigned int channel, i;
 
-    aacquantCfg->pow43 = (double*)AllocMemory(PRECALC_SIZE*sizeof(double));
-    aacquantCfg->adj43 = (double*)AllocMemory(PRECALC_SIZE*sizeof(double));
+    aacquantCfg->pow43 = (faac_real*)AllocMemory(PRECALC_SIZE*sizeof(faac_real));
+    aacquantCfg->adj43 = (faac_real*)AllocMemory(PRECALC_SIZE*sizeof(faac_real));
 
     aacquantCfg->pow43[0] = 0.0;
     for(i=1;i<PRECALC_SIZE;i++)
@@ -71,7 +84,7 @@ void AACQuantizeInit(CoderInfo *coderInfo, unsigned int numChannels,
 #endif
 
     for (channel = 0; channel < numChannels; channel++) {
-        coderInfo[channel].requantFreq = (double*)AllocMemory(BLOCK_LEN_LONG*sizeof(double));
+        coderInfo[channel].requantFreq = (faac_real*)AllocMemory(BLOCK_LEN_LONG*sizeof(faac_real));
     }
 }
 
@@ -97,8 +110,8 @@ void AACQuantizeEnd(CoderInfo *coderInfo, unsigned int numChannels,
 }
 
 static void BalanceEnergy(CoderInfo *coderInfo,
-			  const double *xr, const int *xi,
-			  double *pow43)
+			  const faac_real *xr, const int *xi,
+			  faac_real *pow43)
 {
   const double ifqstep = pow(2.0, 0.25);
   const double logstep_1 = 1.0 / log(ifqstep);
@@ -147,9 +160,9 @@ static void BalanceEnergy(CoderInfo *coderInfo,
 }
 
 static void UpdateRequant(CoderInfo *coderInfo, int *xi,
-			  double *pow43)
+			  faac_real *pow43)
 {
-  double *requant_xr = coderInfo->requantFreq;
+  faac_real *requant_xr = coderInfo->requantFreq;
   int sb;
   int i;
 
@@ -170,13 +183,13 @@ int AACQuantize(CoderInfo *coderInfo,
                 ChannelInfo *channelInfo,
                 int *cb_width,
                 int num_cb,
-                double *xr,
+                faac_real *xr,
 		AACQuantCfg *aacquantCfg)
 {
     int sb, i, do_q = 0;
     int bits = 0, sign;
-    double xr_pow[FRAME_LEN];
-    double xmin[MAX_SCFAC_BANDS];
+    faac_real xr_pow[FRAME_LEN];
+    faac_real xmin[MAX_SCFAC_BANDS];
     int xi[FRAME_LEN];
 
     /* Use local copy's */
@@ -188,11 +201,7 @@ int AACQuantize(CoderInfo *coderInfo,
         scale_factor[sb] = 0;
 
     /* Compute xr_pow */
-    for (i = 0; i < FRAME_LEN; i++) {
-        double temp = fabs(xr[i]);
-        xr_pow[i] = sqrt(temp * sqrt(temp));
-        do_q += (temp > 1E-20);
-    }
+    do_q = CalcXrPow(xr, xr_pow);
 
     if (do_q) {
         CalcAllowedDist(coderInfo, psyInfo, xr, xmin, aacquantCfg->quality);
@@ -291,7 +300,7 @@ typedef union {
 #define MAGIC_INT 0x4b000000
 
 #if 0
-static void Quantize(const double *xp, int *pi, double istep)
+static void Quantize(const faac_real *xp, int *pi, double istep)
 {
     int j;
     fi_union *fi;
@@ -322,14 +331,37 @@ static void Quantize(const double *xp, int *pi, double istep)
     }
 }
 #endif
-static void QuantizeBand(const double *xp, int *pi, double istep,
-			 int offset, int end, double *adj43)
+static void QuantizeBand(const faac_real *xp, int *pi, double istep,
+			 int offset, int end, faac_real *adj43)
 {
-  int j;
+  int j = offset;
   fi_union *fi;
 
   fi = (fi_union *)pi;
-  for (j = offset; j < end; j++)
+#ifdef AACQUANT_SSE
+  {
+    const __m128 step = _mm_set1_ps((float)istep);
+    const __m128 magic = _mm_set1_ps((float)MAGIC_FLOAT);
+    const __m128i magicint = _mm_set1_epi32(MAGIC_INT);
+    int idx[4];
+
+    for (; j + 4 <= end; j += 4)
+    {
+      __m128 x = _mm_mul_ps(_mm_loadu_ps(xp + j), step);
+      __m128 adj;
+
+      /* round to get the table index; SSE2 has no gather, so the
+         rounding offsets are fetched one at a time */
+      _mm_storeu_si128((__m128i *)idx,
+		       _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(x, magic)), magicint));
+      adj = _mm_set_ps(adj43[idx[3]], adj43[idx[2]], adj43[idx[1]], adj43[idx[0]]);
+      x = _mm_add_ps(_mm_add_ps(x, adj), magic);
+      _mm_storeu_si128((__m128i *)(pi + j),
+		       _mm_sub_epi32(_mm_castps_si128(x), magicint));
+    }
+  }
+#endif
+  for (; j < end; j++)
   {
     double x0 = istep * xp[j];
 
@@ -340,7 +372,7 @@ static void QuantizeBand(const double *xp, int *pi, double istep,
 }
 #else
 #if 0
-static void Quantize(const double *xr, int *ix, double istep)
+static void Quantize(const faac_real *xr, int *ix, double istep)
 {
     int j;
 
@@ -383,8 +415,8 @@ static void Quantize(const double *xr, int *ix, double istep)
     }
 }
 #endif
-static void QuantizeBand(const double *xp, int *ix, double istep,
-			 int offset, int end, double *adj43)
+static void QuantizeBand(const faac_real *xp, int *ix, double istep,
+			 int offset, int end, faac_real *adj43)
 {
   int j;
 
@@ -398,7 +430,7 @@ static void QuantizeBand(const double *xp, int *ix, double istep,
 #endif
 
 static void CalcAllowedDist(CoderInfo *coderInfo, PsyInfo *psyInfo,
-                            double *xr, double *xmin, int quality)
+                            faac_real *xr, faac_real *xmin, int quality)
 {
   int sfb, start, end, l;
   const double globalthr = 132.0 / (double)quality;
@@ -469,13 +501,123 @@ static void CalcAllowedDist(CoderInfo *coderInfo, PsyInfo *psyInfo,
   }
 }
 
+/* xr_pow = |xr|^(3/4); returns the number of lines worth quantizing */
+static int CalcXrPow(const faac_real *xr, faac_real *xr_pow)
+{
+    int i = 0, count = 0;
+
+#ifdef AACQUANT_SSE
+    {
+        const __m128 absmask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 minval = _mm_set1_ps(1E-20f);
+        __m128i nonzero = _mm_setzero_si128();
+        int lanes[4];
+
+        for (; i + 4 <= FRAME_LEN; i += 4)
+        {
+            __m128 x = _mm_and_ps(_mm_loadu_ps(xr + i), absmask);
+
+            /* sqrt(x * sqrt(x)): both roots are correctly rounded, so the
+               relative error stays below 2^-23 without a pow() call */
+            _mm_storeu_ps(xr_pow + i, _mm_sqrt_ps(_mm_mul_ps(x, _mm_sqrt_ps(x))));
+
+            /* compare masks are -1, so subtracting them counts the hits */
+            nonzero = _mm_sub_epi32(nonzero, _mm_castps_si128(_mm_cmpgt_ps(x, minval)));
+        }
+
+        _mm_storeu_si128((__m128i *)lanes, nonzero);
+        count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i < FRAME_LEN; i++) {
+        double temp = fabs(xr[i]);
+        xr_pow[i] = sqrt(temp * sqrt(temp));
+        count += (temp > 1E-20);
+    }
+
+    return count;
+}
+
+static double BandMax(const faac_real *x, int start, int end)
+{
+    int i = start;
+    double maxx = 0.0;
+
+#ifdef AACQUANT_SSE
+    {
+        __m128 vmax = _mm_setzero_ps();
+        float lanes[4];
+        int k;
+
+        for (; i + 4 <= end; i += 4)
+            vmax = _mm_max_ps(vmax, _mm_loadu_ps(x + i));
+
+        _mm_storeu_ps(lanes, vmax);
+        for (k = 0; k < 4; k++)
+            if (lanes[k] > maxx)
+                maxx = lanes[k];
+    }
+#endif
+    for (; i < end; i++)
+        if (x[i] > maxx)
+            maxx = x[i];
+
+    return maxx;
+}
+
+static void BandScale(faac_real *x, int start, int end, double fac)
+{
+    int i = start;
+
+#ifdef AACQUANT_SSE
+    {
+        const __m128 vfac = _mm_set1_ps((float)fac);
+
+        for (; i + 4 <= end; i += 4)
+            _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), vfac));
+    }
+#endif
+    for (; i < end; i++)
+        x[i] *= fac;
+}
+
+/* sum of squares of the quantized values, exact in double */
+static double BandEnergy(const int *xi, int start, int end)
+{
+    int i = start;
+    double energy = 0.0;
+
+#ifdef AACQUANT_SSE
+    {
+        __m128d sum = _mm_setzero_pd();
+        double lanes[2];
+
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(xi + i));
+            __m128d lo = _mm_cvtepi32_pd(v);
+            __m128d hi = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+
+            sum = _mm_add_pd(sum, _mm_add_pd(_mm_mul_pd(lo, lo), _mm_mul_pd(hi, hi)));
+        }
+
+        _mm_storeu_pd(lanes, sum);
+        energy = lanes[0] + lanes[1];
+    }
+#endif
+    for (; i < end; i++)
+        energy += (double)xi[i] * xi[i];
+
+    return energy;
+}
+
 static int FixNoise(CoderInfo *coderInfo,
-		    const double *xr,
-		    double *xr_pow,
+		    const faac_real *xr,
+		    faac_real *xr_pow,
 		    int *xi,
-		    double *xmin,
-		    double *pow43,
-		    double *adj43)
+		    faac_real *xmin,
+		    faac_real *pow43,
+		    faac_real *adj43)
 {
     int i, sb;
     int start, end;
@@ -501,12 +643,7 @@ static int FixNoise(CoderInfo *coderInfo,
       if (!xmin[sb])
 	goto nullsfb;
 
-      maxx = 0.0;
-      for (i = start; i < end; i++)
-      {
-	if (xr_pow[i] > maxx)
-	  maxx = xr_pow[i];
-      }
+      maxx = BandMax(xr_pow, start, end);
 
       //printf("band %d: maxx: %f\n", sb, maxx);
       if (maxx < 10.0)
@@ -520,8 +657,7 @@ static int FixNoise(CoderInfo *coderInfo,
 
       sfacfix = 1.0 / maxx;
       sfac = (int)(log(sfacfix) * log_ifqstep - 0.5);
-      for (i = start; i < end; i++)
-	xr_pow[i] *= sfacfix;
+      BandScale(xr_pow, start, end, sfacfix);
       maxx *= sfacfix;
       coderInfo->scale_factor[sb] = sfac;
       QuantizeBand(xr_pow, xi, IPOW20(coderInfo->global_gain), start, end,
@@ -529,12 +665,7 @@ static int FixNoise(CoderInfo *coderInfo,
       //printf("\tsfac: %d\n", sfac);
 
     calcdist:
-      diffvol = 0.0;
-      for (i = start; i < end; i++)
-      {
-	tmp = xi[i];
-	diffvol += tmp * tmp;  // ~x^(3/2)
-      }
+      diffvol = BandEnergy(xi, start, end);  // ~x^(3/2)
 
       if (diffvol < 1e-6)
 	diffvol = 1e-6;
@@ -595,8 +726,7 @@ static int FixNoise(CoderInfo *coderInfo,
 	{
 	  // restore best noise
 	  fac = sfacfix0 / sfacfix;
-	  for (i = start; i < end; i++)
-	    xr_pow[i] *= fac;
+	  BandScale(xr_pow, start, end, fac);
 	  maxx *= fac;
 	  sfacfix *= fac;
 	  coderInfo->scale_factor[sb] = log(sfacfix) * log_ifqstep - 0.5;
@@ -607,8 +737,7 @@ static int FixNoise(CoderInfo *coderInfo,
 
 	if (coderInfo->scale_factor[sb] < -10)
 	{
-	  for (i = start; i < end; i++)
-	    xr_pow[i] *= fac;
+	  BandScale(xr_pow, start, end, fac);
           maxx *= fac;
           sfacfix *= fac;
 	  coderInfo->scale_factor[sb] = log(sfacfix) * log_ifqstep - 0.5;
@@ -625,11 +754,11 @@ int SortForGrouping(CoderInfo* coderInfo,
                            PsyInfo *psyInfo,
                            ChannelInfo *channelInfo,
                            int *sfb_width_table,
-                           double *xr)
+                           faac_real *xr)
 {
     int i,j,ii;
     int index = 0;
-    double xr_tmp[FRAME_LEN];
+    faac_real xr_tmp[FRAME_LEN];
     int group_offset=0;
     int k=0;
     int windowOffset = 0;
@@ -686,7 +815,7 @@ int SortForGrouping(CoderInfo* coderInfo,
 }
 
 void CalcAvgEnrg(CoderInfo *coderInfo,
-		 const double *xr)
+		 const faac_real *xr)
 {
   int end, l;
   int last = 0;
@@ -40,8 +40,8 @@ extern "C" {
 #pragma pack(push, 1)
 typedef struct
   {
-    double *pow43;
-    double *adj43;
+    faac_real *pow43;
+    faac_real *adj43;
     double quality;
   } AACQuantCfg;
 #pragma pack(pop)
@@ -56,16 +56,16 @@ int AACQuantize(CoderInfo *coderInfo,
                 ChannelInfo *channelInfo,
                 int *cb_width,
                 int num_cb,
-                double *xr,
+                faac_real *xr,
 		AACQuantCfg *aacquantcfg);
 
 int SortForGrouping(CoderInfo* coderInfo,
 		    PsyInfo *psyInfo,
 		    ChannelInfo *channelInfo,
 		    int *sfb_width_table,
-		    double *xr);
+		    faac_real *xr);
 void CalcAvgEnrg(CoderInfo *coderInfo,
-		 const double *xr);
+		 const faac_real *xr);
 
 #ifdef __cplusplus
 }
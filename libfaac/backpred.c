@@ -46,7 +46,7 @@ void PredInit(faacEncHandle hEncoder)
     }
 }
 
-void PredCalcPrediction(double *act_spec, double *last_spec, int btype,
+void PredCalcPrediction(faac_real *act_spec, faac_real *last_spec, int btype,
                         int nsfb,
                         int *isfb_width,
                         CoderInfo *coderInfo,
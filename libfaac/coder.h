@@ -32,6 +32,8 @@ extern "C" {
 /* Allow encoding of Digital Radio Mondiale (DRM) with transform length 1024 */
 //#define DRM_1024
 
+#include "faac_real.h"
+
 #define MAX_CHANNELS 64
 
 #ifdef DRM
@@ -124,11 +126,11 @@ typedef struct
     int delay[MAX_SHORT_WINDOWS];
     int global_pred_flag;
     int side_info;
-    double *buffer;
-    double *mdct_predicted;
+    faac_real *buffer;
+    faac_real *mdct_predicted;
 
-    double *time_buffer;
-    double *ltp_overlap_buffer;
+    faac_real *time_buffer;
+    faac_real *ltp_overlap_buffer;
 } LtpInfo;
 
 typedef struct
@@ -182,7 +184,7 @@ typedef struct {
 #endif
 
     /* Holds the requantized spectrum */
-    double *requantFreq;
+    faac_real *requantFreq;
 
     TnsInfo tnsInfo;
     LtpInfo ltpInfo;
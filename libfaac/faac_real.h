@@ -0,0 +1,35 @@
+/*
+ * FAAC - Freeware Advanced Audio Coder
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef FAAC_REAL_H
+#define FAAC_REAL_H
+
+/*
+ * Storage type of the sample, window and spectrum buffers on the analysis
+ * path (filterbank, FFT, psychoacoustics, TNS, quantizer).  Single precision
+ * halves the memory traffic of every pass over the frame; scalar
+ * accumulators and filter coefficients stay double.
+ * Define FAAC_PRECISION_DOUBLE to build the old all-double encoder.
+ */
+#ifdef FAAC_PRECISION_DOUBLE
+typedef double faac_real;
+#else
+typedef float faac_real;
+#endif
+
+#endif /* FAAC_REAL_H */
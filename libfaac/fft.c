@@ -29,6 +29,13 @@
 #define MAXLOGM 9
 #define MAXLOGR 8
 
+/* the vector butterflies work on packed singles, so they need float buffers */
+#if !defined(FAAC_PRECISION_DOUBLE) && \
+    (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+#define FFT_SSE 1
+#include <xmmintrin.h>
+#endif
+
 #if defined DRM && !defined DRM_1024
 
 #include "kiss_fft/kiss_fft.h"
@@ -66,11 +73,11 @@ void fft_terminate( FFT_Tables *fft_tables )
     }
 }
 
-void rfft( FFT_Tables *fft_tables, double *x, int logm )
+void rfft( FFT_Tables *fft_tables, faac_real *x, int logm )
 {
 #if 0
 /* sur: do not use real-only optimized FFT */
-    double xi[1 << MAXLOGR];
+    faac_real xi[1 << MAXLOGR];
 
     int nfft;
 
@@ -155,7 +162,7 @@ void rfft( FFT_Tables *fft_tables, double *x, int logm )
 #endif
 }
 
-void fft( FFT_Tables *fft_tables, double *xr, double *xi, int logm )
+void fft( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm )
 {
     int nfft = 0;
 
@@ -208,7 +215,7 @@ void fft( FFT_Tables *fft_tables, double *xr, double *xi, int logm )
     }
 }
 
-void ffti( FFT_Tables *fft_tables, double *xr, double *xi, int logm )
+void ffti( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm )
 {
     int nfft = 0;
 
@@ -509,7 +516,7 @@ void fft_terminate( FFT_Tables *fft_tables )
 	fft_tables->reordertbl	= NULL;
 }
 
-static void reorder( FFT_Tables *fft_tables, double *x, int logm)
+static void reorder( FFT_Tables *fft_tables, faac_real *x, int logm)
 {
 	int i;
 	int size = 1 << logm;
@@ -540,7 +547,7 @@ static void reorder( FFT_Tables *fft_tables, double *x, int logm)
 	for (i = 0; i < size; i++)
 	{
 		int j = r[i];
-		double tmp;
+		faac_real tmp;
 
 		if (j <= i)
 			continue;
@@ -551,9 +558,60 @@ static void reorder( FFT_Tables *fft_tables, double *x, int logm)
 	}
 }
 
+#ifdef FFT_SSE
+/* one radix-2 pass, four butterflies at a time.  a pass reads the twiddle
+   tables with a stride of estep, so its twiddles are gathered into
+   contiguous arrays first; step is always a multiple of 4 here */
+static void fft_pass_sse(
+		faac_real *xr,
+		faac_real *xi,
+		const fftfloat *refac,
+		const fftfloat *imfac,
+		int step,
+		int estep,
+		int size)
+{
+	fftfloat wr[1 << (MAXLOGM - 1)];
+	fftfloat wi[1 << (MAXLOGM - 1)];
+	int shift, pos;
+
+	for (shift = 0; shift < step; shift++)
+	{
+		wr[shift] = refac[shift * estep];
+		wi[shift] = imfac[shift * estep];
+	}
+
+	for (pos = 0; pos < size; pos += (2 * step))
+	{
+		faac_real *r1 = xr + pos;
+		faac_real *i1 = xi + pos;
+		faac_real *r2 = r1 + step;
+		faac_real *i2 = i1 + step;
+
+		for (shift = 0; shift < step; shift += 4)
+		{
+			__m128 cr = _mm_loadu_ps(wr + shift);
+			__m128 ci = _mm_loadu_ps(wi + shift);
+			__m128 ar = _mm_loadu_ps(r1 + shift);
+			__m128 ai = _mm_loadu_ps(i1 + shift);
+			__m128 br = _mm_loadu_ps(r2 + shift);
+			__m128 bi = _mm_loadu_ps(i2 + shift);
+
+			__m128 v2r = _mm_sub_ps(_mm_mul_ps(br, cr), _mm_mul_ps(bi, ci));
+			__m128 v2i = _mm_add_ps(_mm_mul_ps(br, ci), _mm_mul_ps(bi, cr));
+
+			_mm_storeu_ps(r2 + shift, _mm_sub_ps(ar, v2r));
+			_mm_storeu_ps(r1 + shift, _mm_add_ps(ar, v2r));
+			_mm_storeu_ps(i2 + shift, _mm_sub_ps(ai, v2i));
+			_mm_storeu_ps(i1 + shift, _mm_add_ps(ai, v2i));
+		}
+	}
+}
+#endif
+
 static void fft_proc(
-		double *xr, 
-		double *xi,
+		faac_real *xr, 
+		faac_real *xi,
 		fftfloat *refac, 
 		fftfloat *imfac, 
 		int size)	
@@ -567,6 +625,14 @@ static void fft_proc(
 		int x1;
 		int x2 = 0;
 		estep >>= 1;
+#ifdef FFT_SSE
+		/* the first two passes are too narrow to fill a vector */
+		if (step >= 4)
+		{
+			fft_pass_sse(xr, xi, refac, imfac, step, estep, size);
+			continue;
+		}
+#endif
 		for (pos = 0; pos < size; pos += (2 * step))
 		{
 			x1 = x2;
@@ -574,7 +640,7 @@ static void fft_proc(
 			exp = 0;
 			for (shift = 0; shift < step; shift++)
 			{
-				double v2r, v2i;
+				faac_real v2r, v2i;
 
 				v2r = xr[x2] * refac[exp] - xi[x2] * imfac[exp];
 				v2i = xr[x2] * imfac[exp] + xi[x2] * refac[exp];
@@ -617,7 +683,7 @@ static void check_tables( FFT_Tables *fft_tables, int logm)
 	}
 }
 
-void fft( FFT_Tables *fft_tables, double *xr, double *xi, int logm)
+void fft( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm)
 {
 	if (logm > MAXLOGM)
 	{
@@ -639,9 +705,9 @@ void fft( FFT_Tables *fft_tables, double *xr, double *xi, int logm)
 	fft_proc( xr, xi, fft_tables->costbl[logm], fft_tables->negsintbl[logm], 1 << logm );
 }
 
-void rfft( FFT_Tables *fft_tables, double *x, int logm)
+void rfft( FFT_Tables *fft_tables, faac_real *x, int logm)
 {
-	double xi[1 << MAXLOGR];
+	faac_real xi[1 << MAXLOGR];
 
 	if (logm > MAXLOGR)
 	{
@@ -656,11 +722,11 @@ void rfft( FFT_Tables *fft_tables, double *x, int logm)
 	memcpy(x + (1 << (logm - 1)), xi, (1 << (logm - 1)) * sizeof(*x));
 }
 
-void ffti( FFT_Tables *fft_tables, double *xr, double *xi, int logm)
+void ffti( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm)
 {
 	int i, size;
 	double fac;
-	double *xrp, *xip;
+	faac_real *xrp, *xip;
 
 	fft( fft_tables, xi, xr, logm);
 
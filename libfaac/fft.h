@@ -22,6 +22,8 @@
 #ifndef _FFT_H_
 #define _FFT_H_
 
+#include "faac_real.h"
+
 typedef float fftfloat;
 
 #if defined DRM && !defined DRM_1024
@@ -48,8 +50,8 @@ typedef struct
 void fft_initialize		( FFT_Tables *fft_tables );
 void fft_terminate	( FFT_Tables *fft_tables );
 
-void rfft			( FFT_Tables *fft_tables, double *x, int logm );
-void fft			( FFT_Tables *fft_tables, double *xr, double *xi, int logm );
-void ffti			( FFT_Tables *fft_tables, double *xr, double *xi, int logm );
+void rfft			( FFT_Tables *fft_tables, faac_real *x, int logm );
+void fft			( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm );
+void ffti			( FFT_Tables *fft_tables, faac_real *xr, faac_real *xi, int logm );
 
 #endif
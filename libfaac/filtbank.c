@@ -44,10 +44,10 @@ Copyright(c)1996.
 #define  TWOPI       2*M_PI
 
 
-static void		CalculateKBDWindow	( double* win, double alpha, int length );
+static void		CalculateKBDWindow	( faac_real* win, double alpha, int length );
 static double	Izero				( double x);
-static void		MDCT				( FFT_Tables *fft_tables, double *data, int N );
-static void		IMDCT				( FFT_Tables *fft_tables, double *data, int N );
+static void		MDCT				( FFT_Tables *fft_tables, faac_real *data, int N );
+static void		IMDCT				( FFT_Tables *fft_tables, faac_real *data, int N );
 
 
 
@@ -56,15 +56,15 @@ void FilterBankInit(faacEncHandle hEncoder)
     unsigned int i, channel;
 
     for (channel = 0; channel < hEncoder->numChannels; channel++) {
-        hEncoder->freqBuff[channel] = (double*)AllocMemory(2*FRAME_LEN*sizeof(double));
-        hEncoder->overlapBuff[channel] = (double*)AllocMemory(FRAME_LEN*sizeof(double));
-        SetMemory(hEncoder->overlapBuff[channel], 0, FRAME_LEN*sizeof(double));
+        hEncoder->freqBuff[channel] = (faac_real*)AllocMemory(2*FRAME_LEN*sizeof(faac_real));
+        hEncoder->overlapBuff[channel] = (faac_real*)AllocMemory(FRAME_LEN*sizeof(faac_real));
+        SetMemory(hEncoder->overlapBuff[channel], 0, FRAME_LEN*sizeof(faac_real));
     }
 
-    hEncoder->sin_window_long = (double*)AllocMemory(BLOCK_LEN_LONG*sizeof(double));
-    hEncoder->sin_window_short = (double*)AllocMemory(BLOCK_LEN_SHORT*sizeof(double));
-    hEncoder->kbd_window_long = (double*)AllocMemory(BLOCK_LEN_LONG*sizeof(double));
-    hEncoder->kbd_window_short = (double*)AllocMemory(BLOCK_LEN_SHORT*sizeof(double));
+    hEncoder->sin_window_long = (faac_real*)AllocMemory(BLOCK_LEN_LONG*sizeof(faac_real));
+    hEncoder->sin_window_short = (faac_real*)AllocMemory(BLOCK_LEN_SHORT*sizeof(faac_real));
+    hEncoder->kbd_window_long = (faac_real*)AllocMemory(BLOCK_LEN_LONG*sizeof(faac_real));
+    hEncoder->kbd_window_short = (faac_real*)AllocMemory(BLOCK_LEN_SHORT*sizeof(faac_real));
 
     for( i=0; i<BLOCK_LEN_LONG; i++ )
         hEncoder->sin_window_long[i] = sin((M_PI/(2*BLOCK_LEN_LONG)) * (i + 0.5));
@@ -92,26 +92,26 @@ void FilterBankEnd(faacEncHandle hEncoder)
 
 void FilterBank(faacEncHandle hEncoder,
                 CoderInfo *coderInfo,
-                double *p_in_data,
-                double *p_out_mdct,
-                double *p_overlap,
+                faac_real *p_in_data,
+                faac_real *p_out_mdct,
+                faac_real *p_overlap,
                 int overlap_select)
 {
-    double *p_o_buf, *first_window, *second_window;
-    double *transf_buf;
+    faac_real *p_o_buf, *first_window, *second_window;
+    faac_real *transf_buf;
     int k, i;
     int block_type = coderInfo->block_type;
 
-    transf_buf = (double*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(double));
+    transf_buf = (faac_real*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(faac_real));
 
     /* create / shift old values */
     /* We use p_overlap here as buffer holding the last frame time signal*/
     if(overlap_select != MNON_OVERLAPPED) {
-        memcpy(transf_buf, p_overlap, FRAME_LEN*sizeof(double));
-        memcpy(transf_buf+BLOCK_LEN_LONG, p_in_data, FRAME_LEN*sizeof(double));
-        memcpy(p_overlap, p_in_data, FRAME_LEN*sizeof(double));
+        memcpy(transf_buf, p_overlap, FRAME_LEN*sizeof(faac_real));
+        memcpy(transf_buf+BLOCK_LEN_LONG, p_in_data, FRAME_LEN*sizeof(faac_real));
+        memcpy(p_overlap, p_in_data, FRAME_LEN*sizeof(faac_real));
     } else {
-        memcpy(transf_buf, p_in_data, 2*FRAME_LEN*sizeof(double));
+        memcpy(transf_buf, p_in_data, 2*FRAME_LEN*sizeof(faac_real));
     }
 
     /*  Window shape processing */
@@ -167,18 +167,18 @@ void FilterBank(faacEncHandle hEncoder,
     case LONG_SHORT_WINDOW :
         for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
             p_out_mdct[i] = p_o_buf[i] * first_window[i];
-        memcpy(p_out_mdct+BLOCK_LEN_LONG,p_o_buf+BLOCK_LEN_LONG,NFLAT_LS*sizeof(double));
+        memcpy(p_out_mdct+BLOCK_LEN_LONG,p_o_buf+BLOCK_LEN_LONG,NFLAT_LS*sizeof(faac_real));
         for ( i = 0 ; i < BLOCK_LEN_SHORT ; i++)
             p_out_mdct[i+BLOCK_LEN_LONG+NFLAT_LS] = p_o_buf[i+BLOCK_LEN_LONG+NFLAT_LS] * second_window[BLOCK_LEN_SHORT-i-1];
-        SetMemory(p_out_mdct+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(double));
+        SetMemory(p_out_mdct+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(faac_real));
         MDCT( &hEncoder->fft_tables, p_out_mdct, 2*BLOCK_LEN_LONG );
         break;
 
     case SHORT_LONG_WINDOW :
-        SetMemory(p_out_mdct,0,NFLAT_LS*sizeof(double));
+        SetMemory(p_out_mdct,0,NFLAT_LS*sizeof(faac_real));
         for ( i = 0 ; i < BLOCK_LEN_SHORT ; i++)
             p_out_mdct[i+NFLAT_LS] = p_o_buf[i+NFLAT_LS] * first_window[i];
-        memcpy(p_out_mdct+NFLAT_LS+BLOCK_LEN_SHORT,p_o_buf+NFLAT_LS+BLOCK_LEN_SHORT,NFLAT_LS*sizeof(double));
+        memcpy(p_out_mdct+NFLAT_LS+BLOCK_LEN_SHORT,p_o_buf+NFLAT_LS+BLOCK_LEN_SHORT,NFLAT_LS*sizeof(faac_real));
         for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
             p_out_mdct[i+BLOCK_LEN_LONG] = p_o_buf[i+BLOCK_LEN_LONG] * second_window[BLOCK_LEN_LONG-i-1];
         MDCT( &hEncoder->fft_tables, p_out_mdct, 2*BLOCK_LEN_LONG );
@@ -204,20 +204,20 @@ void FilterBank(faacEncHandle hEncoder,
 
 void IFilterBank(faacEncHandle hEncoder,
                  CoderInfo *coderInfo,
-                 double *p_in_data,
-                 double *p_out_data,
-                 double *p_overlap,
+                 faac_real *p_in_data,
+                 faac_real *p_out_data,
+                 faac_real *p_overlap,
                  int overlap_select)
 {
-    double *o_buf, *transf_buf, *overlap_buf;
-    double *first_window, *second_window;
+    faac_real *o_buf, *transf_buf, *overlap_buf;
+    faac_real *first_window, *second_window;
 
-    double  *fp;
+    faac_real  *fp;
     int k, i;
     int block_type = coderInfo->block_type;
 
-    transf_buf = (double*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(double));
-    overlap_buf = (double*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(double));
+    transf_buf = (faac_real*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(faac_real));
+    overlap_buf = (faac_real*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(faac_real));
 
     /*  Window shape processing */
     if (overlap_select != MNON_OVERLAPPED) {
@@ -257,13 +257,13 @@ void IFilterBank(faacEncHandle hEncoder,
     }
 
     /* Assemble overlap buffer */
-    memcpy(overlap_buf,p_overlap,BLOCK_LEN_LONG*sizeof(double));
+    memcpy(overlap_buf,p_overlap,BLOCK_LEN_LONG*sizeof(faac_real));
     o_buf = overlap_buf;
 
     /* Separate action for each Block Type */
     switch( block_type ) {
     case ONLY_LONG_WINDOW :
-        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(double));
+        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(faac_real));
         IMDCT( &hEncoder->fft_tables, transf_buf, 2*BLOCK_LEN_LONG );
         for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
             transf_buf[i] *= first_window[i];
@@ -279,37 +279,37 @@ void IFilterBank(faacEncHandle hEncoder,
         break;
 
     case LONG_SHORT_WINDOW :
-        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(double));
+        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(faac_real));
         IMDCT( &hEncoder->fft_tables, transf_buf, 2*BLOCK_LEN_LONG );
         for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
             transf_buf[i] *= first_window[i];
         if (overlap_select != MNON_OVERLAPPED) {
             for ( i = 0 ; i < BLOCK_LEN_LONG; i++ )
                 o_buf[i] += transf_buf[i];
-            memcpy(o_buf+BLOCK_LEN_LONG,transf_buf+BLOCK_LEN_LONG,NFLAT_LS*sizeof(double));
+            memcpy(o_buf+BLOCK_LEN_LONG,transf_buf+BLOCK_LEN_LONG,NFLAT_LS*sizeof(faac_real));
             for ( i = 0 ; i < BLOCK_LEN_SHORT ; i++)
                 o_buf[i+BLOCK_LEN_LONG+NFLAT_LS] = transf_buf[i+BLOCK_LEN_LONG+NFLAT_LS] * second_window[BLOCK_LEN_SHORT-i-1];
-            SetMemory(o_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(double));
+            SetMemory(o_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(faac_real));
         } else { /* overlap_select == NON_OVERLAPPED */
             for ( i = 0 ; i < BLOCK_LEN_SHORT ; i++)
                 transf_buf[i+BLOCK_LEN_LONG+NFLAT_LS] *= second_window[BLOCK_LEN_SHORT-i-1];
-            SetMemory(transf_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(double));
+            SetMemory(transf_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(faac_real));
         }
         break;
 
     case SHORT_LONG_WINDOW :
-        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(double));
+        memcpy(transf_buf, p_in_data,BLOCK_LEN_LONG*sizeof(faac_real));
         IMDCT( &hEncoder->fft_tables, transf_buf, 2*BLOCK_LEN_LONG );
         for ( i = 0 ; i < BLOCK_LEN_SHORT ; i++)
             transf_buf[i+NFLAT_LS] *= first_window[i];
         if (overlap_select != MNON_OVERLAPPED) {
             for ( i = 0 ; i < BLOCK_LEN_SHORT; i++ )
                 o_buf[i+NFLAT_LS] += transf_buf[i+NFLAT_LS];
-            memcpy(o_buf+BLOCK_LEN_SHORT+NFLAT_LS,transf_buf+BLOCK_LEN_SHORT+NFLAT_LS,NFLAT_LS*sizeof(double));
+            memcpy(o_buf+BLOCK_LEN_SHORT+NFLAT_LS,transf_buf+BLOCK_LEN_SHORT+NFLAT_LS,NFLAT_LS*sizeof(faac_real));
             for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
                 o_buf[i+BLOCK_LEN_LONG] = transf_buf[i+BLOCK_LEN_LONG] * second_window[BLOCK_LEN_LONG-i-1];
         } else { /* overlap_select == NON_OVERLAPPED */
-            SetMemory(transf_buf,0,NFLAT_LS*sizeof(double));
+            SetMemory(transf_buf,0,NFLAT_LS*sizeof(faac_real));
             for ( i = 0 ; i < BLOCK_LEN_LONG ; i++)
                 transf_buf[i+BLOCK_LEN_LONG] *= second_window[BLOCK_LEN_LONG-i-1];
         }
@@ -322,7 +322,7 @@ void IFilterBank(faacEncHandle hEncoder,
             fp = transf_buf;
         }
         for ( k=0; k < MAX_SHORT_WINDOWS; k++ ) {
-            memcpy(transf_buf,p_in_data,BLOCK_LEN_SHORT*sizeof(double));
+            memcpy(transf_buf,p_in_data,BLOCK_LEN_SHORT*sizeof(faac_real));
             IMDCT( &hEncoder->fft_tables, transf_buf, 2*BLOCK_LEN_SHORT );
             p_in_data += BLOCK_LEN_SHORT;
             if (overlap_select != MNON_OVERLAPPED) {
@@ -341,23 +341,23 @@ void IFilterBank(faacEncHandle hEncoder,
             }
             first_window = second_window;
         }
-        SetMemory(o_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(double));
+        SetMemory(o_buf+BLOCK_LEN_LONG+NFLAT_LS+BLOCK_LEN_SHORT,0,NFLAT_LS*sizeof(faac_real));
         break;
     }
 
     if (overlap_select != MNON_OVERLAPPED)
-        memcpy(p_out_data,o_buf,BLOCK_LEN_LONG*sizeof(double));
+        memcpy(p_out_data,o_buf,BLOCK_LEN_LONG*sizeof(faac_real));
     else  /* overlap_select == NON_OVERLAPPED */
-        memcpy(p_out_data,transf_buf,2*BLOCK_LEN_LONG*sizeof(double));
+        memcpy(p_out_data,transf_buf,2*BLOCK_LEN_LONG*sizeof(faac_real));
 
     /* save unused output data */
-    memcpy(p_overlap,o_buf+BLOCK_LEN_LONG,BLOCK_LEN_LONG*sizeof(double));
+    memcpy(p_overlap,o_buf+BLOCK_LEN_LONG,BLOCK_LEN_LONG*sizeof(faac_real));
 
     if (overlap_buf) FreeMemory(overlap_buf);
     if (transf_buf) FreeMemory(transf_buf);
 }
 
-void specFilter(double *freqBuff,
+void specFilter(faac_real *freqBuff,
                 int sampleRate,
                 int lowpassFreq,
                 int specLen
@@ -369,7 +369,7 @@ void specFilter(double *freqBuff,
     lowpass = (lowpassFreq * specLen) / (sampleRate>>1) + 1;
     xlowpass = (lowpass < specLen) ? lowpass : specLen ;
 
-    SetMemory(freqBuff+xlowpass,0,(specLen-xlowpass)*sizeof(double));
+    SetMemory(freqBuff+xlowpass,0,(specLen-xlowpass)*sizeof(faac_real));
 }
 
 static double Izero(double x)
@@ -391,7 +391,7 @@ static double Izero(double x)
     return(sum);
 }
 
-static void CalculateKBDWindow(double* win, double alpha, int length)
+static void CalculateKBDWindow(faac_real* win, double alpha, int length)
 {
     int i;
     double IBeta;
@@ -418,16 +418,17 @@ static void CalculateKBDWindow(double* win, double alpha, int length)
     }
 }
 
-static void MDCT( FFT_Tables *fft_tables, double *data, int N )
+static void MDCT( FFT_Tables *fft_tables, faac_real *data, int N )
 {
-    double *xi, *xr;
-    double tempr, tempi, c, s, cold, cfreq, sfreq; /* temps for pre and post twiddle */
+    faac_real *xi, *xr;
+    faac_real tempr, tempi;
+    faac_real c, s, cold, cfreq, sfreq; /* temps for pre and post twiddle */
     double freq = TWOPI / N;
-    double cosfreq8, sinfreq8;
+    faac_real cosfreq8, sinfreq8;
     int i, n;
 
-    xi = (double*)AllocMemory((N >> 2)*sizeof(double));
-    xr = (double*)AllocMemory((N >> 2)*sizeof(double));
+    xi = (faac_real*)AllocMemory((N >> 2)*sizeof(faac_real));
+    xr = (faac_real*)AllocMemory((N >> 2)*sizeof(faac_real));
 
     /* prepare for recurrence relation in pre-twiddle */
     cfreq = cos (freq);
@@ -497,16 +498,17 @@ static void MDCT( FFT_Tables *fft_tables, double *data, int N )
     if (xi) FreeMemory(xi);
 }
 
-static void IMDCT( FFT_Tables *fft_tables, double *data, int N)
+static void IMDCT( FFT_Tables *fft_tables, faac_real *data, int N)
 {
-    double *xi, *xr;
-    double tempr, tempi, c, s, cold, cfreq, sfreq; /* temps for pre and post twiddle */
+    faac_real *xi, *xr;
+    faac_real tempr, tempi;
+    faac_real c, s, cold, cfreq, sfreq; /* temps for pre and post twiddle */
     double freq = 2.0 * M_PI / N;
-    double fac, cosfreq8, sinfreq8;
+    faac_real fac, cosfreq8, sinfreq8;
     int i;
 
-    xi = (double*)AllocMemory((N >> 2)*sizeof(double));
-    xr = (double*)AllocMemory((N >> 2)*sizeof(double));
+    xi = (faac_real*)AllocMemory((N >> 2)*sizeof(faac_real));
+    xr = (faac_real*)AllocMemory((N >> 2)*sizeof(faac_real));
 
     /* Choosing to allocate 2/N factor to Inverse Xform! */
     fac = 2. / N; /* remaining 2/N from 4/N IFFT factor */
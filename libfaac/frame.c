@@ -147,6 +147,7 @@ int FAACAPI faacEncSetConfiguration(faacEncHandle hEncoder,
         //case FAAC_INPUT_24BIT:
         case FAAC_INPUT_32BIT:
         case FAAC_INPUT_FLOAT:
+        case FAAC_INPUT_FLOAT_NORM:
             break;
 
         default:
@@ -370,8 +371,8 @@ faacEncHandle FAACAPI faacEncOpen(unsigned long sampleRate,
         hEncoder->sampleBuff[channel] = NULL;
         hEncoder->nextSampleBuff[channel] = NULL;
         hEncoder->next2SampleBuff[channel] = NULL;
-        hEncoder->ltpTimeBuff[channel] = (double*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(double));
-        SetMemory(hEncoder->ltpTimeBuff[channel], 0, 2*BLOCK_LEN_LONG*sizeof(double));
+        hEncoder->ltpTimeBuff[channel] = (faac_real*)AllocMemory(2*BLOCK_LEN_LONG*sizeof(faac_real));
+        SetMemory(hEncoder->ltpTimeBuff[channel], 0, 2*BLOCK_LEN_LONG*sizeof(faac_real));
     }
 
     /* Initialize coder functions */
@@ -489,7 +490,7 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
     /* Update current sample buffers */
     for (channel = 0; channel < numChannels; channel++) 
 	{
-		double *tmp;
+		faac_real *tmp;
 
         if (hEncoder->sampleBuff[channel]) {
             for(i = 0; i < FRAME_LEN; i++) {
@@ -504,7 +505,7 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
         }
 
 		if (!hEncoder->sampleBuff[channel])
-			hEncoder->sampleBuff[channel] = (double*)AllocMemory(FRAME_LEN*sizeof(double));
+			hEncoder->sampleBuff[channel] = (faac_real*)AllocMemory(FRAME_LEN*sizeof(faac_real));
 		
 		tmp = hEncoder->sampleBuff[channel];
 
@@ -532,7 +533,7 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
 
 						for (i = 0; i < samples_per_channel; i++)
 						{
-							hEncoder->next3SampleBuff[channel][i] = (double)*input_channel;
+							hEncoder->next3SampleBuff[channel][i] = (faac_real)*input_channel;
 							input_channel += numChannels;
 						}
 					}
@@ -544,7 +545,7 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
 						
 						for (i = 0; i < samples_per_channel; i++)
 						{
-							hEncoder->next3SampleBuff[channel][i] = (1.0/256) * (double)*input_channel;
+							hEncoder->next3SampleBuff[channel][i] = (faac_real)((1.0/256) * (double)*input_channel);
 							input_channel += numChannels;
 						}
 					}
@@ -556,7 +557,22 @@ int FAACAPI faacEncEncode(faacEncHandle hEncoder,
 
 						for (i = 0; i < samples_per_channel; i++)
 						{
-							hEncoder->next3SampleBuff[channel][i] = (double)*input_channel;
+							hEncoder->next3SampleBuff[channel][i] = *input_channel;
+							input_channel += numChannels;
+						}
+					}
+                    break;
+
+                case FAAC_INPUT_FLOAT_NORM:
+					{
+						/* the model and quantizer are tuned for 16 bit levels,
+						   so scale by 32767 while deinterleaving instead of
+						   making the caller do an extra pass over the buffer */
+						float *input_channel = (float*)inputBuffer + hEncoder->config.channel_map[channel];
+
+						for (i = 0; i < samples_per_channel; i++)
+						{
+							hEncoder->next3SampleBuff[channel][i] = 32767.0f * *input_channel;
 							input_channel += numChannels;
 						}
 					}
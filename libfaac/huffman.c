@@ -36,6 +36,97 @@ must be included in all copies or derivative works. Copyright 1996.
 
 #include "hufftab.h"
 
+#define LOW_BOOK_BITS(b)  ((int)((b) & 0xffff))
+#define HIGH_BOOK_BITS(b) ((int)((b) >> 16))
+
+/*
+   Section bit counters.  Each returns the packed cost of both books of a
+   huffbits table for quant[offset] .. quant[end-1]; the sign bits of the
+   unsigned books are already part of the table entries.
+*/
+static unsigned int SignedQuadBits(const unsigned int *table,
+                                   const int *quant, int offset, int end)
+{
+    unsigned int bits = 0;
+    int i;
+
+    for (i = offset; i < end; i += 4)
+        bits += table[27*quant[i] + 9*quant[i+1] + 3*quant[i+2] + quant[i+3] + 40];
+
+    return bits;
+}
+
+static unsigned int UnsignedQuadBits(const unsigned int *table,
+                                     const int *quant, int offset, int end)
+{
+    unsigned int bits = 0;
+    int i;
+
+    for (i = offset; i < end; i += 4)
+        bits += table[27*abs(quant[i]) + 9*abs(quant[i+1]) + 3*abs(quant[i+2]) + abs(quant[i+3])];
+
+    return bits;
+}
+
+static unsigned int SignedPairBits(const unsigned int *table,
+                                   const int *quant, int offset, int end)
+{
+    unsigned int bits = 0;
+    int i;
+
+    for (i = offset; i < end; i += 2)
+        bits += table[9*quant[i] + quant[i+1] + 40];
+
+    return bits;
+}
+
+static unsigned int UnsignedPairBits(const unsigned int *table, int mul,
+                                     const int *quant, int offset, int end)
+{
+    unsigned int bits = 0;
+    int i;
+
+    for (i = offset; i < end; i += 2)
+        bits += table[mul*abs(quant[i]) + abs(quant[i+1])];
+
+    return bits;
+}
+
+/* length of the escape sequence for a value of 16 or more: 2*N+5 bits,
+   with N = floor(log2(value/16)) */
+static int EscLength(int value)
+{
+    int n = 0;
+
+    for (value >>= 5; value; value >>= 1)
+        n++;
+
+    return 2*n + 5;
+}
+
+static int EscBits(const int *quant, int offset, int end)
+{
+    int bits = 0;
+    int i;
+
+    for (i = offset; i < end; i += 2) {
+        int x = abs(quant[i]);
+        int y = abs(quant[i+1]);
+
+        if (x >= 16) {
+            bits += EscLength(x);
+            x = 16;
+        }
+        if (y >= 16) {
+            bits += EscLength(y);
+            y = 16;
+        }
+        bits += huffbits11[17*x + y];
+    }
+
+    return bits;
+}
+
 void HuffmanInit(CoderInfo *coderInfo, unsigned int numChannels)
 {
     unsigned int channel;
@@ -198,7 +289,7 @@ int NoiselessBitCount(CoderInfo *coderInfo,
     int max_sb_coeff;
     int book_choice[12][2];
     int total_bits_cost = 0;
-    int offset, length, end;
+    int offset, end;
     int q;
 
     /* set local pointer to sfb_offset */
@@ -231,56 +322,68 @@ int NoiselessBitCount(CoderInfo *coderInfo,
             } else
 #endif
                 end = sfb_offset[q];
-            length = end - offset;
 
             /* all spectral coefficients in this section are zero */
             if (max_sb_coeff == 0) {
-                book_choice[j][0] = CalcBits(coderInfo,0,quant,offset,length);
+                book_choice[j][0] = 0;
                 book_choice[j++][1] = 0;
 
             }
             else {  /* if the section does have non-zero coefficients */
+                /* the candidate books come in pairs sharing one packed
+                   table, so two passes cover all three candidates */
+                unsigned int bits, bits2;
+
                 if(max_sb_coeff < 2){
-                    book_choice[j][0] = CalcBits(coderInfo,1,quant,offset,length);
+                    bits = SignedQuadBits(huffbits12,quant,offset,end);
+                    bits2 = UnsignedQuadBits(huffbits34,quant,offset,end);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits);
                     book_choice[j++][1] = 1;
-                    book_choice[j][0] = CalcBits(coderInfo,2,quant,offset,length);
+                    book_choice[j][0] = HIGH_BOOK_BITS(bits);
                     book_choice[j++][1] = 2;
-                    book_choice[j][0] = CalcBits(coderInfo,3,quant,offset,length);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits2);
                     book_choice[j++][1] = 3;
                 }
                 else if (max_sb_coeff < 3){
-                    book_choice[j][0] = CalcBits(coderInfo,3,quant,offset,length);
+                    bits = UnsignedQuadBits(huffbits34,quant,offset,end);
+                    bits2 = SignedPairBits(huffbits56,quant,offset,end);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits);
                     book_choice[j++][1] = 3;
-                    book_choice[j][0] = CalcBits(coderInfo,4,quant,offset,length);
+                    book_choice[j][0] = HIGH_BOOK_BITS(bits);
                     book_choice[j++][1] = 4;
-                    book_choice[j][0] = CalcBits(coderInfo,5,quant,offset,length);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits2);
                     book_choice[j++][1] = 5;
                 }
                 else if (max_sb_coeff < 5){
-                    book_choice[j][0] = CalcBits(coderInfo,5,quant,offset,length);
+                    bits = SignedPairBits(huffbits56,quant,offset,end);
+                    bits2 = UnsignedPairBits(huffbits78,8,quant,offset,end);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits);
                     book_choice[j++][1] = 5;
-                    book_choice[j][0] = CalcBits(coderInfo,6,quant,offset,length);
+                    book_choice[j][0] = HIGH_BOOK_BITS(bits);
                     book_choice[j++][1] = 6;
-                    book_choice[j][0] = CalcBits(coderInfo,7,quant,offset,length);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits2);
                     book_choice[j++][1] = 7;
                 }
                 else if (max_sb_coeff < 8){
-                    book_choice[j][0] = CalcBits(coderInfo,7,quant,offset,length);
+                    bits = UnsignedPairBits(huffbits78,8,quant,offset,end);
+                    bits2 = UnsignedPairBits(huffbits910,13,quant,offset,end);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits);
                     book_choice[j++][1] = 7;
-                    book_choice[j][0] = CalcBits(coderInfo,8,quant,offset,length);
+                    book_choice[j][0] = HIGH_BOOK_BITS(bits);
                     book_choice[j++][1] = 8;
-                    book_choice[j][0] = CalcBits(coderInfo,9,quant,offset,length);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits2);
                     book_choice[j++][1] = 9;
                 }
                 else if (max_sb_coeff < 13){
-                    book_choice[j][0] = CalcBits(coderInfo,9,quant,offset,length);
+                    bits = UnsignedPairBits(huffbits910,13,quant,offset,end);
+                    book_choice[j][0] = LOW_BOOK_BITS(bits);
                     book_choice[j++][1] = 9;
-                    book_choice[j][0] = CalcBits(coderInfo,10,quant,offset,length);
+                    book_choice[j][0] = HIGH_BOOK_BITS(bits);
                     book_choice[j++][1] = 10;
                 }
                 /* (max_sb_coeff >= 13), choose table 11 */
                 else {
-                    book_choice[j][0] = CalcBits(coderInfo,11,quant,offset,length);
+                    book_choice[j][0] = EscBits(quant,offset,end);
                     book_choice[j++][1] = 11;
                 }
             }
@@ -902,133 +1005,31 @@ int CalcBits(CoderInfo *coderInfo,
 
    */
 
-    int len_esc;
-    int index;
-    int bits = 0;
-    int i, j;
+    int end = offset + length;
 
     switch (book) {
     case 1:
-        for(i=offset;i<offset+length;i=i+4){
-            index = 27*quant[i] + 9*quant[i+1] + 3*quant[i+2] + quant[i+3] + 40;
-            bits += huff1[index][FIRSTINTAB];
-        }
-        return (bits);
+        return LOW_BOOK_BITS(SignedQuadBits(huffbits12,quant,offset,end));
     case 2:
-        for(i=offset;i<offset+length;i=i+4){
-            index = 27*quant[i] + 9*quant[i+1] + 3*quant[i+2] + quant[i+3] + 40;
-            bits += huff2[index][FIRSTINTAB];
-        }
-        return (bits);
+        return HIGH_BOOK_BITS(SignedQuadBits(huffbits12,quant,offset,end));
     case 3:
-        for(i=offset;i<offset+length;i=i+4){
-            index = 27*ABS(quant[i]) + 9*ABS(quant[i+1]) + 3*ABS(quant[i+2]) + ABS(quant[i+3]);
-            bits += huff3[index][FIRSTINTAB];
-            for(j=0;j<4;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return LOW_BOOK_BITS(UnsignedQuadBits(huffbits34,quant,offset,end));
     case 4:
-        for(i=offset;i<offset+length;i=i+4){
-            index = 27*ABS(quant[i]) + 9*ABS(quant[i+1]) + 3*ABS(quant[i+2]) + ABS(quant[i+3]);
-            bits += huff4[index][FIRSTINTAB];
-            for(j=0;j<4;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return HIGH_BOOK_BITS(UnsignedQuadBits(huffbits34,quant,offset,end));
     case 5:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 9*(quant[i]) + (quant[i+1]) + 40;
-            bits += huff5[index][FIRSTINTAB];
-        }
-        return (bits);
+        return LOW_BOOK_BITS(SignedPairBits(huffbits56,quant,offset,end));
     case 6:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 9*(quant[i]) + (quant[i+1]) + 40;
-            bits += huff6[index][FIRSTINTAB];
-        }
-        return (bits);
+        return HIGH_BOOK_BITS(SignedPairBits(huffbits56,quant,offset,end));
     case 7:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 8*ABS(quant[i]) + ABS(quant[i+1]);
-            bits += huff7[index][FIRSTINTAB];
-            for(j=0;j<2;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return LOW_BOOK_BITS(UnsignedPairBits(huffbits78,8,quant,offset,end));
     case 8:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 8*ABS(quant[i]) + ABS(quant[i+1]);
-            bits += huff8[index][FIRSTINTAB];
-            for(j=0;j<2;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return HIGH_BOOK_BITS(UnsignedPairBits(huffbits78,8,quant,offset,end));
     case 9:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 13*ABS(quant[i]) + ABS(quant[i+1]);
-            bits += huff9[index][FIRSTINTAB];
-            for(j=0;j<2;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return LOW_BOOK_BITS(UnsignedPairBits(huffbits910,13,quant,offset,end));
     case 10:
-        for(i=offset;i<offset+length;i=i+2){
-            index = 13*ABS(quant[i]) + ABS(quant[i+1]);
-            bits += huff10[index][FIRSTINTAB];
-            for(j=0;j<2;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-        }
-        return (bits);
+        return HIGH_BOOK_BITS(UnsignedPairBits(huffbits910,13,quant,offset,end));
     case 11:
-        /* First, calculate the indecies into the huffman tables */
-        for(i=offset;i<offset+length;i=i+2){
-            if ((ABS(quant[i]) >= 16) && (ABS(quant[i+1]) >= 16)) {  /* both codewords were above 16 */
-                /* first, code the orignal pair, with the larger value saturated to +/- 16 */
-                index = 17*16 + 16;
-            } else if (ABS(quant[i]) >= 16) {  /* the first codeword was above 16, not the second one */
-                /* first, code the orignal pair, with the larger value saturated to +/- 16 */
-                index = 17*16 + ABS(quant[i+1]);
-            } else if (ABS(quant[i+1]) >= 16) { /* the second codeword was above 16, not the first one */
-                index = 17*ABS(quant[i]) + 16;
-            } else {  /* there were no values above 16, so no escape sequences */
-                index = 17*ABS(quant[i]) + ABS(quant[i+1]);
-            }
-
-            /* write out the codewords */
-            bits += huff11[index][FIRSTINTAB];
-
-            /* Take care of the sign bits */
-            for(j=0;j<2;j++){
-                if(quant[i+j] != 0) bits += 1; /* only for non-zero spectral coefficients */
-            }
-
-            /* write out the escape sequences */
-            if ((ABS(quant[i]) >= 16) && (ABS(quant[i+1]) >= 16)) {  /* both codewords were above 16 */
-                /* code and transmit the first escape_sequence */
-                CalculateEscSequence(quant[i],&len_esc);
-                bits += len_esc;
-
-                /* then code and transmit the second escape_sequence */
-                CalculateEscSequence(quant[i+1],&len_esc);
-                bits += len_esc;
-            } else if (ABS(quant[i]) >= 16) {  /* the first codeword was above 16, not the second one */
-                /* code and transmit the escape_sequence */
-                CalculateEscSequence(quant[i],&len_esc);
-                bits += len_esc;
-            } else if (ABS(quant[i+1]) >= 16) { /* the second codeword was above 16, not the first one */
-                /* code and transmit the escape_sequence */
-                CalculateEscSequence(quant[i+1],&len_esc);
-                bits += len_esc;
-            }
-        }
-        return (bits);
+        return EscBits(quant,offset,end);
     }
     return 0;
 }
@@ -328,4 +328,140 @@ unsigned int huff12[][2] = {
         { 19,  524261},{ 19,  524247},{ 19,  524268},{ 19,  524276},{ 19,  524275}
     };
 
+/*
+   Codeword lengths for bit counting.  Books that are searched together and
+   share an index are packed into one word (lower book in the low 16 bits),
+   so one pass over a section yields both costs; a section never needs 64k
+   bits, so the halves cannot carry into each other.
+*/
+
+/* books 1 (low half) and 2 (high half), indexed like huff1/huff2 */
+unsigned int huffbits12[81] = {
+        0x0009000b, 0x00070009, 0x0009000b, 0x0008000a, 0x00060007, 0x0008000a,
+        0x0009000b, 0x00080009, 0x0009000b, 0x0008000a, 0x00060007, 0x0007000a,
+        0x00060007, 0x00050005, 0x00060007, 0x00070009, 0x00060007, 0x0008000a,
+        0x0009000b, 0x00070009, 0x0008000b, 0x00080009, 0x00060007, 0x00080009,
+        0x0009000b, 0x00070009, 0x0009000b, 0x00080009, 0x00060007, 0x00070009,
+        0x00060007, 0x00050005, 0x00060007, 0x00070009, 0x00060007, 0x00080009,
+        0x00060007, 0x00050005, 0x00060007, 0x00050005, 0x00030001, 0x00050005,
+        0x00060007, 0x00050005, 0x00060007, 0x00080009, 0x00060007, 0x00070009,
+        0x00060007, 0x00050005, 0x00060007, 0x00080009, 0x00060007, 0x00080009,
+        0x0009000b, 0x00070009, 0x0009000b, 0x00080009, 0x00060007, 0x00080009,
+        0x0008000b, 0x00070009, 0x0009000b, 0x0008000a, 0x00060007, 0x00070009,
+        0x00060007, 0x00040005, 0x00060007, 0x00080009, 0x00060007, 0x0007000a,
+        0x0009000b, 0x00070009, 0x0009000b, 0x0007000a, 0x00060007, 0x00080009,
+        0x0009000b, 0x00070009, 0x0009000b
+    };
+
+/* books 3 and 4, sign bits of the non-zero values included */
+unsigned int huffbits34[81] = {
+        0x00040001, 0x00060005, 0x00090009, 0x00060005, 0x00060007, 0x000a000a,
+        0x000a000a, 0x000a000b, 0x000d000c, 0x00060005, 0x00070008, 0x000a000b,
+        0x00070008, 0x00070009, 0x000b000c, 0x000a000b, 0x000a000c, 0x000d000d,
+        0x000a000a, 0x000a000c, 0x000d000f, 0x000a000b, 0x000b000c, 0x000d000e,
+        0x000d000d, 0x000d000d, 0x000e000f, 0x00050005, 0x00070008, 0x000a000c,
+        0x00060008, 0x0007000a, 0x000b000d, 0x000a000c, 0x000b000d, 0x000d000f,
+        0x00060007, 0x0007000a, 0x000b000e, 0x00070009, 0x0008000b, 0x000b000e,
+        0x000b000c, 0x000b000d, 0x000d000f, 0x000a000b, 0x000b000d, 0x000d0010,
+        0x000a000b, 0x000b000d, 0x000d0010, 0x000d000d, 0x000d000f, 0x000e0010,
+        0x00090009, 0x000a000c, 0x000d0011, 0x000a000b, 0x000a000e, 0x000d0012,
+        0x000d000f, 0x000d0011, 0x000f0013, 0x000a000a, 0x000a000d, 0x000d0011,
+        0x000a000c, 0x000b000e, 0x000d0012, 0x000d000f, 0x000d0010, 0x000f0013,
+        0x000d000d, 0x000d000f, 0x000f0013, 0x000d000d, 0x000d000f, 0x000f0013,
+        0x000e000f, 0x000e0010, 0x000f0013
+    };
+
+/* books 5 and 6 */
+unsigned int huffbits56[81] = {
+        0x000b000d, 0x000a000c, 0x0009000b, 0x0009000b, 0x0009000a, 0x0009000b,
+        0x0009000b, 0x000a000c, 0x000b000d, 0x000a000c, 0x0009000b, 0x0008000a,
+        0x00070009, 0x00070008, 0x00070009, 0x0008000a, 0x0009000b, 0x000a000c,
+        0x0009000c, 0x0008000a, 0x00060009, 0x00060008, 0x00060007, 0x00060008,
+        0x00060009, 0x0008000a, 0x0009000b, 0x0009000b, 0x00070009, 0x00060008,
+        0x00040005, 0x00040004, 0x00040005, 0x00060008, 0x00070009, 0x0009000b,
+        0x0009000a, 0x00070008, 0x00060007, 0x00040004, 0x00040001, 0x00040004,
+        0x00060007, 0x00070008, 0x0009000b, 0x0009000b, 0x00070009, 0x00060008,
+        0x00040005, 0x00040004, 0x00040005, 0x00060008, 0x00070009, 0x0009000b,
+        0x0009000b, 0x0008000a, 0x00060009, 0x00060008, 0x00060007, 0x00060008,
+        0x00060009, 0x0008000a, 0x0009000b, 0x000a000c, 0x0009000b, 0x0008000a,
+        0x00070009, 0x00070008, 0x00070009, 0x0007000a, 0x0008000b, 0x000a000c,
+        0x000b000d, 0x000a000c, 0x0009000c, 0x0009000b, 0x0009000a, 0x0009000a,
+        0x0009000b, 0x000a000c, 0x000b000d
+    };
+
+/* books 7 and 8, sign bits included */
+unsigned int huffbits78[64] = {
+        0x00050001, 0x00050004, 0x00060007, 0x00070008, 0x00080009, 0x0009000a,
+        0x000a000b, 0x000b000c, 0x00050004, 0x00050006, 0x00060008, 0x00070009,
+        0x0008000a, 0x0009000a, 0x0009000b, 0x000a000b, 0x00060007, 0x00060008,
+        0x00060009, 0x0007000a, 0x0008000a, 0x0009000b, 0x0009000b, 0x000a000c,
+        0x00070008, 0x00070009, 0x0007000a, 0x0008000a, 0x0008000b, 0x0009000b,
+        0x000a000c, 0x000a000c, 0x00080009, 0x0008000a, 0x0008000b, 0x0008000b,
+        0x0009000c, 0x0009000c, 0x000a000c, 0x000b000d, 0x0009000a, 0x0009000a,
+        0x0008000b, 0x0009000b, 0x0009000c, 0x000a000c, 0x000a000d, 0x000c000d,
+        0x000a000b, 0x0009000b, 0x0009000b, 0x000a000c, 0x000a000c, 0x000a000d,
+        0x000b000e, 0x000b000e, 0x000b000c, 0x000a000c, 0x000a000c, 0x000a000c,
+        0x000b000d, 0x000b000d, 0x000b000e, 0x000c000e
+    };
 
+/* books 9 and 10, sign bits included */
+unsigned int huffbits910[169] = {
+        0x00060001, 0x00060004, 0x00070007, 0x00070009, 0x0008000a, 0x0009000b,
+        0x000a000b, 0x000b000c, 0x000b000c, 0x000b000d, 0x000c000d, 0x000c000e,
+        0x000d000e, 0x00060004, 0x00060006, 0x00060008, 0x00070009, 0x0008000a,
+        0x0009000a, 0x0009000b, 0x000a000c, 0x000a000c, 0x000b000c, 0x000c000d,
+        0x000c000e, 0x000d000e, 0x00070007, 0x00060008, 0x00070009, 0x0007000a,
+        0x0008000a, 0x0008000b, 0x0009000c, 0x000a000c, 0x000a000c, 0x000b000d,
+        0x000b000e, 0x000c000e, 0x000c000e, 0x00070009, 0x00070009, 0x0007000a,
+        0x0007000b, 0x0008000b, 0x0009000c, 0x0009000c, 0x000a000d, 0x000a000d,
+        0x000b000d, 0x000b000e, 0x000c000e, 0x000c000f, 0x0008000a, 0x0008000a,
+        0x0008000b, 0x0008000b, 0x0008000c, 0x0009000c, 0x0009000d, 0x000a000d,
+        0x000a000d, 0x000b000e, 0x000b000e, 0x000c000e, 0x000c000f, 0x0009000b,
+        0x0009000b, 0x0008000b, 0x0009000c, 0x0009000d, 0x0009000d, 0x000a000d,
+        0x000a000e, 0x000a000d, 0x000b000e, 0x000c000e, 0x000c000f, 0x000d000f,
+        0x000a000c, 0x0009000b, 0x0009000c, 0x0009000d, 0x0009000d, 0x000a000d,
+        0x000a000e, 0x000b000e, 0x000b000e, 0x000b000e, 0x000c000f, 0x000c000f,
+        0x000d000f, 0x000a000c, 0x000a000c, 0x000a000c, 0x000a000d, 0x000a000d,
+        0x000a000e, 0x000b000e, 0x000b000f, 0x000b000f, 0x000c000f, 0x000c000f,
+        0x000d000f, 0x000d000f, 0x000a000c, 0x000a000c, 0x000a000c, 0x000a000d,
+        0x000a000d, 0x000a000d, 0x000b000e, 0x000b000e, 0x000c000f, 0x000c000f,
+        0x000c0010, 0x000d000f, 0x000d0010, 0x000b000c, 0x000b000c, 0x000b000d,
+        0x000b000d, 0x000b000e, 0x000b000e, 0x000b000e, 0x000c000e, 0x000c000f,
+        0x000c000f, 0x000d0010, 0x000d0010, 0x000e0010, 0x000b000d, 0x000b000d,
+        0x000b000d, 0x000b000e, 0x000b000e, 0x000c000e, 0x000c000f, 0x000c000f,
+        0x000c000f, 0x000d0010, 0x000d0010, 0x000d0010, 0x000e0011, 0x000c000d,
+        0x000c000d, 0x000b000e, 0x000c000e, 0x000c000e, 0x000c000f, 0x000c000f,
+        0x000c000f, 0x000d000f, 0x000d0010, 0x000d0010, 0x000d0011, 0x000e0011,
+        0x000c000e, 0x000c000e, 0x000c000e, 0x000c000e, 0x000c000f, 0x000c000f,
+        0x000c000f, 0x000d000f, 0x000d0010, 0x000e0010, 0x000e0010, 0x000e0010,
+        0x000e0011
+    };
+
+/* book 11, sign bits included, escape sequences not */
+unsigned short huffbits11[289] = {
+         4,  6,  7,  8,  9,  9, 10, 11, 11, 11, 12, 12,
+        13, 12, 13, 13, 11,  6,  6,  7,  8,  9,  9, 10,
+        10, 11, 11, 11, 12, 12, 12, 12, 13, 10,  7,  7,
+         7,  8,  9,  9, 10, 10, 10, 11, 11, 11, 12, 12,
+        12, 12, 10,  8,  8,  8,  8,  9,  9, 10, 10, 10,
+        11, 11, 11, 12, 12, 12, 12, 10,  9,  9,  9,  9,
+         9, 10, 10, 10, 10, 11, 11, 11, 12, 12, 12, 12,
+        10,  9,  9,  9,  9,  9, 10, 10, 10, 11, 11, 11,
+        11, 12, 12, 12, 12, 10, 10, 10, 10, 10, 10, 10,
+        10, 10, 11, 11, 11, 12, 12, 12, 12, 12, 10, 10,
+        10, 10, 10, 10, 10, 10, 11, 11, 11, 12, 12, 12,
+        12, 12, 12, 10, 11, 11, 10, 10, 11, 11, 11, 11,
+        11, 12, 12, 12, 12, 12, 12, 13, 10, 11, 11, 11,
+        11, 11, 11, 11, 11, 12, 12, 12, 12, 12, 12, 13,
+        13, 10, 12, 11, 11, 11, 11, 11, 11, 12, 12, 12,
+        12, 12, 13, 12, 13, 13, 10, 12, 12, 11, 11, 12,
+        11, 12, 12, 12, 12, 12, 13, 13, 13, 13, 13, 10,
+        12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 13,
+        13, 13, 13, 13, 11, 12, 12, 11, 11, 12, 12, 12,
+        12, 12, 12, 13, 13, 13, 13, 13, 13, 11, 12, 12,
+        12, 12, 12, 12, 12, 12, 12, 12, 13, 13, 13, 13,
+        13, 13, 11, 13, 12, 12, 12, 12, 12, 12, 12, 13,
+        13, 13, 13, 13, 13, 14, 14, 11, 10, 10, 10, 10,
+        10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 11,
+         7
+    };
@@ -32,11 +32,11 @@ int LtpEncode(faacEncHandle hEncoder,
                 CoderInfo *coderInfo,
                 LtpInfo *ltpInfo,
                 TnsInfo *tnsInfo,
-                double *p_spectrum,
-                double *p_time_signal);
-void LtpReconstruct(CoderInfo *coderInfo, LtpInfo *ltpInfo, double *p_spectrum);
-void  LtpUpdate(LtpInfo *ltpInfo, double *time_signal,
-                     double *overlap_signal, int block_size_long);
+                faac_real *p_spectrum,
+                faac_real *p_time_signal);
+void LtpReconstruct(CoderInfo *coderInfo, LtpInfo *ltpInfo, faac_real *p_spectrum);
+void  LtpUpdate(LtpInfo *ltpInfo, faac_real *time_signal,
+                     faac_real *overlap_signal, int block_size_long);
 
 #endif /* not defined LTP_H */
 
@@ -26,7 +26,7 @@
 
 void MSEncode(CoderInfo *coderInfo,
 	      ChannelInfo *channelInfo,
-	      double *spectrum[MAX_CHANNELS],
+	      faac_real *spectrum[MAX_CHANNELS],
 	      int maxchan,
 	      int allowms)
 {
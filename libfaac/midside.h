@@ -29,7 +29,7 @@ extern "C" {
 #include "coder.h"
 
 
-void MSEncode(CoderInfo *coderInfo, ChannelInfo *channelInfo, double *spectrum[MAX_CHANNELS],
+void MSEncode(CoderInfo *coderInfo, ChannelInfo *channelInfo, faac_real *spectrum[MAX_CHANNELS],
               unsigned int numberOfChannels, unsigned int msenable);
 void MSReconstruct(CoderInfo *coderInfo, ChannelInfo *channelInfo, int numberOfChannels);
 
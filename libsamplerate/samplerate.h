@@ -175,6 +175,15 @@ enum
 	SRC_SINC_FASTEST			= 2,
 	SRC_ZERO_ORDER_HOLD			= 3,
 	SRC_LINEAR					= 4,
+
+	/*
+	** Same filters as above, but for constant rational ratios (like 44.1kHz
+	** <-> 48kHz) the interpolated coefficients are precomputed into a
+	** polyphase table. Varying ratios fall back to the normal filters.
+	*/
+	SRC_SINC_BEST_QUALITY_POLYPHASE		= 5,
+	SRC_SINC_MEDIUM_QUALITY_POLYPHASE	= 6,
+	SRC_SINC_FASTEST_POLYPHASE			= 7,
 } ;
 
 /*
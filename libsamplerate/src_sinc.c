@@ -30,6 +30,18 @@
 #include "float_cast.h"
 #include "common.h"
 
+/*
+** The mono and stereo filters have SSE versions which interpolate four
+** coefficients at a time and accumulate in single precision. The filters
+** are at most 145dB SNR so float accumulation costs nothing audible.
+*/
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#define	SINC_USE_SSE	1
+#include <emmintrin.h>
+#else
+#define	SINC_USE_SSE	0
+#endif
+
 #define	SINC_MAGIC_MARKER	MAKE_MAGIC (' ', 's', 'i', 'n', 'c', ' ')
 
 /*========================================================================================
@@ -69,6 +81,16 @@ typedef struct
 	/* Sure hope noone does more than 128 channels at once. */
 	double left_calc [128], right_calc [128] ;
 
+	/*
+	** Polyphase table for constant rational ratios. When enabled, the table
+	** lives in the same allocation as the filter, directly after the buffer.
+	*/
+	int		polyphase ;
+	double	poly_ratio ;
+	int		poly_phases, poly_step ;
+	int		poly_left, poly_width, poly_stride ;
+	float	*poly_table ;
+
 	/* C99 struct flexible array. */
 	float	buffer [] ;
 } SINC_FILTER ;
@@ -78,6 +100,8 @@ static int sinc_hex_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
 static int sinc_quad_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
 static int sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
 static int sinc_mono_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
+static int sinc_stereo_poly_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
+static int sinc_mono_poly_process (SRC_PRIVATE *psrc, SRC_DATA *data) ;
 
 static int prepare_data (SINC_FILTER *filter, SRC_DATA *data, int half_filter_chan_len) WARN_UNUSED ;
 
@@ -125,6 +149,15 @@ sinc_get_name (int src_enum)
 		case SRC_SINC_FASTEST :
 			return "Fastest Sinc Interpolator" ;
 
+		case SRC_SINC_BEST_QUALITY_POLYPHASE :
+			return "Best Sinc Interpolator (Polyphase)" ;
+
+		case SRC_SINC_MEDIUM_QUALITY_POLYPHASE :
+			return "Medium Sinc Interpolator (Polyphase)" ;
+
+		case SRC_SINC_FASTEST_POLYPHASE :
+			return "Fastest Sinc Interpolator (Polyphase)" ;
+
 		default: break ;
 		} ;
 
@@ -144,6 +177,11 @@ sinc_get_description (int src_enum)
 		case SRC_SINC_BEST_QUALITY :
 			return "Band limited sinc interpolation, best quality, 145dB SNR, 96% BW." ;
 
+		case SRC_SINC_FASTEST_POLYPHASE :
+		case SRC_SINC_MEDIUM_QUALITY_POLYPHASE :
+		case SRC_SINC_BEST_QUALITY_POLYPHASE :
+			return "Band limited sinc interpolation using precomputed polyphase tables for constant rational ratios." ;
+
 		default :
 			break ;
 		} ;
@@ -171,15 +209,35 @@ sinc_set_converter (SRC_PRIVATE *psrc, int src_enum)
 	temp_filter.sinc_magic_marker = SINC_MAGIC_MARKER ;
 	temp_filter.channels = psrc->channels ;
 
+	switch (src_enum)
+	{	case SRC_SINC_BEST_QUALITY_POLYPHASE :
+				src_enum = SRC_SINC_BEST_QUALITY ;
+				temp_filter.polyphase = 1 ;
+				break ;
+
+		case SRC_SINC_MEDIUM_QUALITY_POLYPHASE :
+				src_enum = SRC_SINC_MEDIUM_QUALITY ;
+				temp_filter.polyphase = 1 ;
+				break ;
+
+		case SRC_SINC_FASTEST_POLYPHASE :
+				src_enum = SRC_SINC_FASTEST ;
+				temp_filter.polyphase = 1 ;
+				break ;
+
+		default :
+				break ;
+		} ;
+
 	if (psrc->channels > ARRAY_LEN (temp_filter.left_calc))
 		return SRC_ERR_BAD_CHANNEL_COUNT ;
 	else if (psrc->channels == 1)
-	{	psrc->const_process = sinc_mono_vari_process ;
+	{	psrc->const_process = temp_filter.polyphase ? sinc_mono_poly_process : sinc_mono_vari_process ;
 		psrc->vari_process = sinc_mono_vari_process ;
 		}
 	else
 	if (psrc->channels == 2)
-	{	psrc->const_process = sinc_stereo_vari_process ;
+	{	psrc->const_process = temp_filter.polyphase ? sinc_stereo_poly_process : sinc_stereo_vari_process ;
 		psrc->vari_process = sinc_stereo_vari_process ;
 		}
 	else
@@ -273,6 +331,112 @@ sinc_reset (SRC_PRIVATE *psrc)
 **	Beware all ye who dare pass this point. There be dragons here.
 */
 
+/*
+** Number of taps in each half of the filter. These match the iteration
+** counts of the do/while loops in the scalar versions exactly.
+*/
+static inline int
+sinc_left_taps (increment_t filter_index, increment_t increment)
+{	return filter_index / increment + 1 ;
+} /* sinc_left_taps */
+
+static inline int
+sinc_right_taps (increment_t filter_index, increment_t increment)
+{	return filter_index > 0 ? (filter_index - 1) / increment + 1 : 1 ;
+} /* sinc_right_taps */
+
+#if SINC_USE_SSE
+
+/*
+** Interpolate the coefficients for four consecutive taps, starting at
+** filter_index and stepping down by increment.
+*/
+static inline __m128
+sinc_coeffs_sse (const coeff_t *coeffs, increment_t filter_index, increment_t increment)
+{	__m128i		index ;
+	__m128		fraction, c0, c1 ;
+	int			indx [4] ;
+
+	index = _mm_set_epi32 (filter_index - 3 * increment, filter_index - 2 * increment, filter_index - increment, filter_index) ;
+	_mm_storeu_si128 ((__m128i *) indx, _mm_srai_epi32 (index, SHIFT_BITS)) ;
+
+	fraction = _mm_cvtepi32_ps (_mm_and_si128 (index, _mm_set1_epi32 ((1 << SHIFT_BITS) - 1))) ;
+	fraction = _mm_mul_ps (fraction, _mm_set1_ps ((float) INV_FP_ONE)) ;
+
+	c0 = _mm_set_ps (coeffs [indx [3]], coeffs [indx [2]], coeffs [indx [1]], coeffs [indx [0]]) ;
+	c1 = _mm_set_ps (coeffs [indx [3] + 1], coeffs [indx [2] + 1], coeffs [indx [1] + 1], coeffs [indx [0] + 1]) ;
+
+	return _mm_add_ps (c0, _mm_mul_ps (fraction, _mm_sub_ps (c1, c0))) ;
+} /* sinc_coeffs_sse */
+
+static inline float
+sinc_coeff (const coeff_t *coeffs, increment_t filter_index)
+{	float	fraction ;
+	int		indx ;
+
+	fraction = (float) fp_to_double (filter_index) ;
+	indx = fp_to_int (filter_index) ;
+
+	return coeffs [indx] + fraction * (coeffs [indx + 1] - coeffs [indx]) ;
+} /* sinc_coeff */
+
+static inline float
+sinc_hsum_sse (__m128 val)
+{	val = _mm_add_ps (val, _mm_movehl_ps (val, val)) ;
+	val = _mm_add_ss (val, _mm_shuffle_ps (val, val, _MM_SHUFFLE (1, 1, 1, 1))) ;
+	return _mm_cvtss_f32 (val) ;
+} /* sinc_hsum_sse */
+
+static inline double
+calc_output_single (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index)
+{	increment_t	filter_index, max_filter_index ;
+	int			data_index, coeff_count, taps, k ;
+	const float	*buffer = filter->buffer ;
+	__m128		acc, coeffs, data ;
+	float		sum ;
+
+	/* Convert input parameters into fixed point. */
+	max_filter_index = int_to_fp (filter->coeff_half_len) ;
+
+	acc = _mm_setzero_ps () ;
+	sum = 0.0f ;
+
+	/* First apply the left half of the filter. */
+	filter_index = start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	data_index = filter->b_current - coeff_count ;
+	taps = sinc_left_taps (filter_index, increment) ;
+
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	coeffs = sinc_coeffs_sse (filter->coeffs, filter_index - k * increment, increment) ;
+		data = _mm_loadu_ps (buffer + data_index + k) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (coeffs, data)) ;
+		} ;
+	for ( ; k < taps ; k++)
+		sum += sinc_coeff (filter->coeffs, filter_index - k * increment) * buffer [data_index + k] ;
+
+	/* Now apply the right half of the filter, walking backwards through the data. */
+	filter_index = increment - start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	data_index = filter->b_current + 1 + coeff_count ;
+	taps = sinc_right_taps (filter_index, increment) ;
+
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	coeffs = sinc_coeffs_sse (filter->coeffs, filter_index - k * increment, increment) ;
+		coeffs = _mm_shuffle_ps (coeffs, coeffs, _MM_SHUFFLE (0, 1, 2, 3)) ;
+		data = _mm_loadu_ps (buffer + data_index - k - 3) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (coeffs, data)) ;
+		} ;
+	for ( ; k < taps ; k++)
+		sum += sinc_coeff (filter->coeffs, filter_index - k * increment) * buffer [data_index - k] ;
+
+	return sum + sinc_hsum_sse (acc) ;
+} /* calc_output_single */
+
+#else
+
 static inline double
 calc_output_single (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index)
 {	double		fraction, left, right, icoeff ;
@@ -325,6 +489,8 @@ calc_output_single (SINC_FILTER *filter, increment_t increment, increment_t star
 	return (left + right) ;
 } /* calc_output_single */
 
+#endif
+
 static int
 sinc_mono_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 {	SINC_FILTER *filter ;
@@ -419,6 +585,71 @@ sinc_mono_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 	return SRC_ERR_NO_ERROR ;
 } /* sinc_mono_vari_process */
 
+#if SINC_USE_SSE
+
+static inline void
+calc_output_stereo (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index, double scale, float * output)
+{	increment_t	filter_index, max_filter_index ;
+	int			data_index, coeff_count, taps, k ;
+	const float	*buffer = filter->buffer ;
+	__m128		acc, coeffs, data0, data1 ;
+	float		icoeff, sum [2] ;
+
+	/* Convert input parameters into fixed point. */
+	max_filter_index = int_to_fp (filter->coeff_half_len) ;
+
+	/* Accumulates interleaved as L R L R, each coefficient is duplicated across a pair. */
+	acc = _mm_setzero_ps () ;
+	sum [0] = sum [1] = 0.0f ;
+
+	/* First apply the left half of the filter. */
+	filter_index = start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	data_index = filter->b_current - filter->channels * coeff_count ;
+	taps = sinc_left_taps (filter_index, increment) ;
+
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	coeffs = sinc_coeffs_sse (filter->coeffs, filter_index - k * increment, increment) ;
+		data0 = _mm_loadu_ps (buffer + data_index + 2 * k) ;
+		data1 = _mm_loadu_ps (buffer + data_index + 2 * k + 4) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (_mm_unpacklo_ps (coeffs, coeffs), data0)) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (_mm_unpackhi_ps (coeffs, coeffs), data1)) ;
+		} ;
+	for ( ; k < taps ; k++)
+	{	icoeff = sinc_coeff (filter->coeffs, filter_index - k * increment) ;
+		sum [0] += icoeff * buffer [data_index + 2 * k] ;
+		sum [1] += icoeff * buffer [data_index + 2 * k + 1] ;
+		} ;
+
+	/* Now apply the right half of the filter, walking backwards through the data. */
+	filter_index = increment - start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	data_index = filter->b_current + filter->channels * (1 + coeff_count) ;
+	taps = sinc_right_taps (filter_index, increment) ;
+
+	for (k = 0 ; k + 4 <= taps ; k += 4)
+	{	coeffs = sinc_coeffs_sse (filter->coeffs, filter_index - k * increment, increment) ;
+		data0 = _mm_loadu_ps (buffer + data_index - 2 * k - 2) ;
+		data1 = _mm_loadu_ps (buffer + data_index - 2 * k - 6) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (_mm_shuffle_ps (coeffs, coeffs, _MM_SHUFFLE (0, 0, 1, 1)), data0)) ;
+		acc = _mm_add_ps (acc, _mm_mul_ps (_mm_shuffle_ps (coeffs, coeffs, _MM_SHUFFLE (2, 2, 3, 3)), data1)) ;
+		} ;
+	for ( ; k < taps ; k++)
+	{	icoeff = sinc_coeff (filter->coeffs, filter_index - k * increment) ;
+		sum [0] += icoeff * buffer [data_index - 2 * k] ;
+		sum [1] += icoeff * buffer [data_index - 2 * k + 1] ;
+		} ;
+
+	acc = _mm_add_ps (acc, _mm_movehl_ps (acc, acc)) ;
+
+	output [0] = (float) (scale * (sum [0] + _mm_cvtss_f32 (acc))) ;
+	output [1] = (float) (scale * (sum [1] + _mm_cvtss_f32 (_mm_shuffle_ps (acc, acc, _MM_SHUFFLE (1, 1, 1, 1))))) ;
+} /* calc_output_stereo */
+
+#else
+
 static inline void
 calc_output_stereo (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index, double scale, float * output)
 {	double		fraction, left [2], right [2], icoeff ;
@@ -474,6 +705,8 @@ calc_output_stereo (SINC_FILTER *filter, increment_t increment, increment_t star
 	output [1] = scale * (left [1] + right [1]) ;
 } /* calc_output_stereo */
 
+#endif
+
 static int
 sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 {	SINC_FILTER *filter ;
@@ -567,6 +800,318 @@ sinc_stereo_vari_process (SRC_PRIVATE *psrc, SRC_DATA *data)
 	return SRC_ERR_NO_ERROR ;
 } /* sinc_stereo_vari_process */
 
+/*----------------------------------------------------------------------------------------
+**	Polyphase tables.
+**
+**	For a constant ratio of L/M with a small L, every output sample falls on one of
+**	L fractional input positions, so the interpolated and scaled coefficients for
+**	each position can be computed once up front. Each output sample is then just a
+**	dot product over a contiguous window of input frames. The common 44.1kHz <->
+**	48kHz conversions are 160/147 and 147/160.
+*/
+
+#define	POLY_MAX_PHASES			1024
+#define	POLY_MAX_TABLE_BYTES	(4 * 1024 * 1024)
+
+static int
+poly_find_ratio (double src_ratio, int *phases, int *step)
+{	double	exact ;
+	int		l, m ;
+
+	for (l = 1 ; l <= POLY_MAX_PHASES ; l++)
+	{	exact = l / src_ratio ;
+		m = lrint (exact) ;
+
+		if (m > 0 && fabs (exact - m) < 1e-9 * l)
+		{	*phases = l ;
+			*step = m ;
+			return 1 ;
+			} ;
+		} ;
+
+	return 0 ;
+} /* poly_find_ratio */
+
+/*
+**	Walks both halves of the filter exactly like calc_output_single () and hands each
+**	tap's frame offset (relative to b_current) and interpolated coefficient to the
+**	caller. With row == NULL it only tracks the extent of the offsets.
+*/
+static void
+poly_calc_phase (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index, double scale,
+				float *row, int row_left, int *lo, int *hi)
+{	double		fraction, icoeff ;
+	increment_t	filter_index, max_filter_index ;
+	int			offset, coeff_count, taps, indx, k ;
+
+	max_filter_index = int_to_fp (filter->coeff_half_len) ;
+
+	filter_index = start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	offset = - coeff_count ;
+	taps = sinc_left_taps (filter_index, increment) ;
+
+	*lo = MIN (*lo, offset) ;
+	*hi = MAX (*hi, offset + taps - 1) ;
+
+	for (k = 0 ; row != NULL && k < taps ; k++)
+	{	fraction = fp_to_double (filter_index) ;
+		indx = fp_to_int (filter_index) ;
+		icoeff = filter->coeffs [indx] + fraction * (filter->coeffs [indx + 1] - filter->coeffs [indx]) ;
+
+		row [row_left + offset + k] += (float) (scale * icoeff) ;
+		filter_index -= increment ;
+		} ;
+
+	filter_index = increment - start_filter_index ;
+	coeff_count = (max_filter_index - filter_index) / increment ;
+	filter_index = filter_index + coeff_count * increment ;
+	offset = 1 + coeff_count ;
+	taps = sinc_right_taps (filter_index, increment) ;
+
+	*lo = MIN (*lo, offset - taps + 1) ;
+	*hi = MAX (*hi, offset) ;
+
+	for (k = 0 ; row != NULL && k < taps ; k++)
+	{	fraction = fp_to_double (filter_index) ;
+		indx = fp_to_int (filter_index) ;
+		icoeff = filter->coeffs [indx] + fraction * (filter->coeffs [indx + 1] - filter->coeffs [indx]) ;
+
+		row [row_left + offset - k] += (float) (scale * icoeff) ;
+		filter_index -= increment ;
+		} ;
+} /* poly_calc_phase */
+
+/*
+**	(Re)builds the table for src_ratio. The table is placed in the same allocation
+**	as the filter so src_delete () frees it, which means the filter may move; the
+**	return value is always the valid filter pointer. On failure poly_table is NULL
+**	and the caller falls back to the variable ratio path.
+*/
+static SINC_FILTER *
+poly_build_table (SRC_PRIVATE *psrc, SINC_FILTER *filter, double src_ratio)
+{	SINC_FILTER	*new_filter ;
+	double		float_increment, count ;
+	increment_t	increment ;
+	size_t		base_size, table_size ;
+	int			phases, step, half_filter_len, lo, hi, p ;
+
+	filter->poly_table = NULL ;
+	filter->poly_ratio = src_ratio ;
+
+	if (! poly_find_ratio (src_ratio, &phases, &step))
+		return filter ;
+
+	float_increment = filter->index_inc * 1.0 ;
+	if (src_ratio < 1.0)
+		float_increment = filter->index_inc * src_ratio ;
+
+	increment = double_to_fp (float_increment) ;
+
+	/* Find the widest window any phase touches. */
+	lo = hi = 0 ;
+	for (p = 0 ; p < phases ; p++)
+		poly_calc_phase (filter, increment, double_to_fp (((double) p / phases) * float_increment), 0.0, NULL, 0, &lo, &hi) ;
+
+	/* The window must fit inside what prepare_data () keeps around b_current. */
+	count = (filter->coeff_half_len + 2.0) / filter->index_inc ;
+	if (src_ratio < 1.0)
+		count /= src_ratio ;
+	half_filter_len = lrint (count) + 1 ;
+
+	if (-lo > half_filter_len || hi > half_filter_len)
+		return filter ;
+
+	filter->poly_phases = phases ;
+	filter->poly_step = step ;
+	filter->poly_left = -lo ;
+	filter->poly_width = hi - lo + 1 ;
+	filter->poly_stride = (filter->poly_width + 3) & ~3 ;
+
+	table_size = (size_t) phases * filter->poly_stride * sizeof (float) ;
+	if (table_size > POLY_MAX_TABLE_BYTES)
+		return filter ;
+
+	base_size = sizeof (SINC_FILTER) + sizeof (filter->buffer [0]) * (filter->b_len + filter->channels) ;
+
+	if ((new_filter = realloc (filter, base_size + table_size + 16)) == NULL)
+		return filter ;
+
+	filter = new_filter ;
+	psrc->private_data = filter ;
+
+	filter->poly_table = (float *) (((size_t) filter + base_size + 15) & ~((size_t) 15)) ;
+	memset (filter->poly_table, 0, table_size) ;
+
+	for (p = 0 ; p < phases ; p++)
+		poly_calc_phase (filter, increment, double_to_fp (((double) p / phases) * float_increment),
+						float_increment / filter->index_inc, filter->poly_table + p * filter->poly_stride, filter->poly_left, &lo, &hi) ;
+
+	return filter ;
+} /* poly_build_table */
+
+static inline void
+poly_calc_output (const SINC_FILTER *filter, const float *row, const float *data, float *output)
+{	int		width = filter->poly_width ;
+	int		k ;
+
+#if SINC_USE_SSE
+	__m128	acc, coeffs ;
+
+	acc = _mm_setzero_ps () ;
+
+	if (filter->channels == 1)
+	{	float sum = 0.0f ;
+
+		for (k = 0 ; k + 4 <= width ; k += 4)
+			acc = _mm_add_ps (acc, _mm_mul_ps (_mm_load_ps (row + k), _mm_loadu_ps (data + k))) ;
+		for ( ; k < width ; k++)
+			sum += row [k] * data [k] ;
+
+		output [0] = sum + sinc_hsum_sse (acc) ;
+		}
+	else
+	{	float sum [2] = { 0.0f, 0.0f } ;
+
+		for (k = 0 ; k + 4 <= width ; k += 4)
+		{	coeffs = _mm_load_ps (row + k) ;
+			acc = _mm_add_ps (acc, _mm_mul_ps (_mm_unpacklo_ps (coeffs, coeffs), _mm_loadu_ps (data + 2 * k))) ;
+			acc = _mm_add_ps (acc, _mm_mul_ps (_mm_unpackhi_ps (coeffs, coeffs), _mm_loadu_ps (data + 2 * k + 4))) ;
+			} ;
+		for ( ; k < width ; k++)
+		{	sum [0] += row [k] * data [2 * k] ;
+			sum [1] += row [k] * data [2 * k + 1] ;
+			} ;
+
+		acc = _mm_add_ps (acc, _mm_movehl_ps (acc, acc)) ;
+		output [0] = sum [0] + _mm_cvtss_f32 (acc) ;
+		output [1] = sum [1] + _mm_cvtss_f32 (_mm_shuffle_ps (acc, acc, _MM_SHUFFLE (1, 1, 1, 1))) ;
+		} ;
+#else
+	if (filter->channels == 1)
+	{	double sum = 0.0 ;
+
+		for (k = 0 ; k < width ; k++)
+			sum += row [k] * data [k] ;
+
+		output [0] = (float) sum ;
+		}
+	else
+	{	double sum [2] = { 0.0, 0.0 } ;
+
+		for (k = 0 ; k < width ; k++)
+		{	sum [0] += row [k] * data [2 * k] ;
+			sum [1] += row [k] * data [2 * k + 1] ;
+			} ;
+
+		output [0] = (float) sum [0] ;
+		output [1] = (float) sum [1] ;
+		} ;
+#endif
+} /* poly_calc_output */
+
+static int
+sinc_poly_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{	SINC_FILTER *filter ;
+	double		input_index, src_ratio, count, terminate, rem ;
+	int			half_filter_chan_len, samples_in_hand, phase ;
+
+	if (psrc->private_data == NULL)
+		return SRC_ERR_NO_PRIVATE ;
+
+	filter = (SINC_FILTER*) psrc->private_data ;
+
+	src_ratio = data->src_ratio ;
+
+	if (filter->poly_ratio != src_ratio)
+		filter = poly_build_table (psrc, filter, src_ratio) ;
+
+	/* Not a ratio we can tabulate. */
+	if (filter->poly_table == NULL)
+		return filter->channels == 1 ? sinc_mono_vari_process (psrc, data) : sinc_stereo_vari_process (psrc, data) ;
+
+	filter->in_count = data->input_frames * filter->channels ;
+	filter->out_count = data->output_frames * filter->channels ;
+	filter->in_used = filter->out_gen = 0 ;
+
+	/* Check the sample rate ratio wrt the buffer len. */
+	count = (filter->coeff_half_len + 2.0) / filter->index_inc ;
+	if (src_ratio < 1.0)
+		count /= src_ratio ;
+
+	/* Maximum coefficientson either side of center point. */
+	half_filter_chan_len = filter->channels * (lrint (count) + 1) ;
+
+	/*
+	** Snap the position onto the nearest phase. This is exact if the previous
+	** call was also a polyphase call, and at most 1/(2L) of a frame otherwise.
+	*/
+	input_index = psrc->last_position ;
+
+	rem = fmod_one (input_index) ;
+	filter->b_current = (filter->b_current + filter->channels * lrint (input_index - rem)) % filter->b_len ;
+
+	phase = lrint (rem * filter->poly_phases) ;
+	if (phase >= filter->poly_phases)
+	{	phase -= filter->poly_phases ;
+		filter->b_current = (filter->b_current + filter->channels) % filter->b_len ;
+		} ;
+
+	terminate = 1.0 / src_ratio + 1e-20 ;
+
+	/* Main processing loop. */
+	while (filter->out_gen < filter->out_count)
+	{
+		/* Need to reload buffer? */
+		samples_in_hand = (filter->b_end - filter->b_current + filter->b_len) % filter->b_len ;
+
+		if (samples_in_hand <= half_filter_chan_len)
+		{	if ((psrc->error = prepare_data (filter, data, half_filter_chan_len)) != 0)
+				return psrc->error ;
+
+			samples_in_hand = (filter->b_end - filter->b_current + filter->b_len) % filter->b_len ;
+			if (samples_in_hand <= half_filter_chan_len)
+				break ;
+			} ;
+
+		/* This is the termination condition. */
+		if (filter->b_real_end >= 0)
+		{	if (filter->b_current + (double) phase / filter->poly_phases + terminate >= filter->b_real_end)
+				break ;
+			} ;
+
+		poly_calc_output (filter, filter->poly_table + phase * filter->poly_stride,
+						filter->buffer + filter->b_current - filter->channels * filter->poly_left,
+						data->data_out + filter->out_gen) ;
+		filter->out_gen += filter->channels ;
+
+		/* Figure out the next index. */
+		phase += filter->poly_step ;
+
+		filter->b_current = (filter->b_current + filter->channels * (phase / filter->poly_phases)) % filter->b_len ;
+		phase %= filter->poly_phases ;
+		} ;
+
+	psrc->last_position = (double) phase / filter->poly_phases ;
+	psrc->last_ratio = src_ratio ;
+
+	data->input_frames_used = filter->in_used / filter->channels ;
+	data->output_frames_gen = filter->out_gen / filter->channels ;
+
+	return SRC_ERR_NO_ERROR ;
+} /* sinc_poly_process */
+
+static int
+sinc_mono_poly_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{	return sinc_poly_process (psrc, data) ;
+} /* sinc_mono_poly_process */
+
+static int
+sinc_stereo_poly_process (SRC_PRIVATE *psrc, SRC_DATA *data)
+{	return sinc_poly_process (psrc, data) ;
+} /* sinc_stereo_poly_process */
+
 static inline void
 calc_output_quad (SINC_FILTER *filter, increment_t increment, increment_t start_filter_index, double scale, float * output)
 {	double		fraction, left [4], right [4], icoeff ;